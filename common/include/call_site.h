@@ -131,5 +131,30 @@ typedef struct __attribute__((__packed__)) arch_live_value {
   int64_t operand_offset_or_constant;
 } arch_live_value;
 
+/*
+ * A call site's rewriting plan for a destination architecture.  Generated by
+ * pairing the call site's live value location records with those of the call
+ * site with the same ID in the destination architecture's binary, so the
+ * runtime doesn't have to match up (and check) location records while
+ * rewriting.
+ */
+typedef struct __attribute__((__packed__)) plan_site {
+  uint64_t id; /* call site ID */
+  uint16_t arch; /* destination architecture (ELF machine) */
+  uint16_t num_moves; /* number of live value moves */
+  uint64_t move_offset; /* beginning of moves in plan move section */
+  uint32_t padding; /* Make 8-byte aligned */
+} plan_site;
+
+/*
+ * A live value move, i.e., a source & destination location record.  Records
+ * are identified by offsets from the source & destination call sites'
+ * beginning of live value location records.
+ */
+typedef struct __attribute__((__packed__)) plan_move {
+  uint16_t src;
+  uint16_t dest;
+} plan_move;
+
 #endif /* _CALL_SITE_H */
 
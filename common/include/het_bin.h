@@ -30,5 +30,13 @@
 /* Architecture-specific constant locations & values. */
 #define SECTION_ARCH "arch_const"
 
+/*
+ * Section name postfixes for rewriting plans -- call sites paired with other
+ * architectures' binaries, sorted by destination architecture & ID, and the
+ * live value moves they reference, respectively.
+ */
+#define SECTION_PLAN "plan"
+#define SECTION_PLAN_MOVE "plan_move"
+
 #endif /* _HET_BIN_H */
 
@@ -180,7 +180,8 @@ def setup_argument_parsing():
     build_opts.add_argument("--libmigration-type",
                         help="Choose configuration for libmigration " + \
                              "(see INSTALL for more details)",
-                        choices=['env_select', 'native', 'debug', 'signal_trigger'],
+                        choices=['env_select', 'native', 'debug', 'signal_trigger',
+                                 'emulate'],
                         dest="libmigration_type")
     build_opts.add_argument("--enable-libmigration-timing",
                         help="Turn on timing in migration library",
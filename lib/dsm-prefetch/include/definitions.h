@@ -45,6 +45,14 @@ typedef struct {
 #define _MAPREFETCH
 #endif
 
+/*
+ * Drain requests on per-node prefetching threads rather than on the thread
+ * calling popcorn_prefetch_execute().
+ */
+#if defined(_MAPREFETCH) && !defined(_ASYNC_PREFETCH)
+#define _ASYNC_PREFETCH
+#endif
+
 /* Convert a struct timespec to raw nanoseconds */
 #define NS( ts ) ((ts.tv_sec * 1000000000UL) + ts.tv_nsec)
 
@@ -57,5 +65,23 @@ typedef struct {
  */
 #define NODE_CACHE_SIZE 64
 
+/*
+ * Maximum height of the skip list used to store spans.  With a promotion
+ * probability of 1/4, lists stay logarithmic up to ~4^LIST_MAX_LEVEL spans.
+ */
+#define LIST_MAX_LEVEL 12
+
+/*
+ * Number of requests buffered per thread before they're flushed into the
+ * shared per-node lists.  Define _NOSTAGING to insert directly instead.
+ */
+#define STAGING_SIZE 256
+
+/*
+ * Number of spans that can be queued for each node's prefetching thread
+ * before application threads block in popcorn_prefetch_execute().
+ */
+#define PREFETCH_QUEUE_SIZE 256
+
 #endif
 
@@ -19,12 +19,16 @@ typedef struct node_t node_t;
 /* An opaque cache entry type. */
 typedef struct node_cache_t node_cache_t;
 
-/* A sorted linked list. */
+/*
+ * A sorted list of non-overlapping memory spans, implemented as a skip list so
+ * that lookups, merges & splits take logarithmic time in the number of spans.
+ */
 typedef struct {
   node_cache_t *cache;
-  node_t *head, *tail;
+  node_t *head[LIST_MAX_LEVEL];
   size_t size;
-  int nid;
+  int nid, level;
+  uint32_t seed;
   pthread_mutex_t lock;
 } list_t;
 
@@ -53,6 +57,17 @@ size_t list_size(const list_t *l);
  */
 void list_insert(list_t *l, const memory_span_t *mem);
 
+/*
+ * Insert multiple memory regions into the list, merging with other spans as
+ * needed.  Spans must be sorted by low address, which allows each insertion to
+ * resume searching from where the previous one ended.
+ *
+ * @param l a list
+ * @param mem an array of contiguous memory regions, sorted by low address
+ * @param num the number of memory regions in the array
+ */
+void list_insert_sorted(list_t *l, const memory_span_t *mem, size_t num);
+
 /*
  * Return true if the list has a memory region that overlaps a span, or false
  * otherwise.
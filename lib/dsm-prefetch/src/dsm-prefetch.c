@@ -11,6 +11,7 @@
 #include <migrate.h>
 #include <semaphore.h>
 #include <stdbool.h>
+#include <pthread.h>
 #include <time.h>
 #include <unistd.h>
 #include <sys/mman.h>
@@ -31,36 +32,89 @@ typedef struct {
   char padding[PAGESZ - (3 * sizeof(list_t))];
 } __attribute__((aligned (PAGESZ))) node_requests_t;
 
-/* Parameters for threads performing asynchronous manual prefetching. */
+/* A span to be prefetched (or released) with a single system call. */
+typedef struct {
+  access_type_t type;
+  memory_span_t span;
+} prefetch_cmd_t;
+
+/*
+ * Parameters for threads performing asynchronous prefetching.  Application
+ * threads push coalesced spans into a bounded queue which is drained by the
+ * node's prefetching thread.
+ */
 typedef struct {
   int nid;
+  bool running;
   volatile bool exit;
-  sem_t work;
-  char padding[PAGESZ - sizeof(size_t) - sizeof(sem_t)];
+  sem_t work, space;
+  pthread_mutex_t lock;
+  size_t head, tail;
+  prefetch_cmd_t queue[PREFETCH_QUEUE_SIZE];
 } __attribute__((aligned (PAGESZ))) thread_arg_t;
 
 /* Statically-allocated lists. */
 static node_requests_t requests[MAX_POPCORN_NODES];
 
+#ifndef _NOSTAGING
+/* A prefetch request buffered by a thread before insertion into the lists. */
+typedef struct {
+  int nid;
+  access_type_t type;
+  memory_span_t span;
+} staged_request_t;
+
+/*
+ * Per-thread staging buffer.  Threads append requests without touching the
+ * shared lists; buffers are flushed in bulk when full, when requests are
+ * executed or counted, and at thread exit.  Buffers are registered globally
+ * so that the executing thread can drain every other thread's requests.
+ */
+typedef struct staging_t {
+  pthread_mutex_t lock;
+  size_t num, requested;
+  staged_request_t req[STAGING_SIZE];
+  struct staging_t *prev, *next;
+} staging_t;
+
+/* Registry of all threads' staging buffers. */
+static pthread_mutex_t staging_lock = PTHREAD_MUTEX_INITIALIZER;
+static staging_t *staging_head = NULL;
+
+/* Calling thread's staging buffer & key used to flush it at thread exit. */
+static pthread_key_t staging_key;
+static __thread staging_t *staging = NULL;
+static void staging_destroy(void *arg);
+#endif
+
 /* Statistics about prefetching */
 typedef struct {
   size_t num; // Number of prefetch requests
+  size_t requests; // Number of requests made by the application
+  size_t syscalls; // Number of system calls (or manual spans) issued
   size_t pages; // Number of pages prefetched
   size_t time; // Time to prefetch, in nanoseconds
+  size_t hidden; // Time prefetching on prefetching threads, in nanoseconds
+  size_t stalled; // Time waiting on full prefetch queues, in nanoseconds
 } stats_t;
 
-static stats_t total_stats = { .num = 0, .pages = 0, .time = 0 };
+static stats_t total_stats = { .num = 0, .requests = 0, .syscalls = 0,
+                               .pages = 0, .time = 0, .hidden = 0,
+                               .stalled = 0 };
 
 static void accumulate_global_stats(stats_t *stats) {
   __atomic_fetch_add(&total_stats.num, stats->num, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&total_stats.syscalls, stats->syscalls, __ATOMIC_RELAXED);
 #ifdef _STATISTICS
   __atomic_fetch_add(&total_stats.pages, stats->pages, __ATOMIC_RELAXED);
   __atomic_fetch_add(&total_stats.time, stats->time, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&total_stats.hidden, stats->hidden, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&total_stats.stalled, stats->stalled, __ATOMIC_RELAXED);
 #endif
 }
 
-#ifdef _MAPREFETCH
-/* Threads for asynchronous manual prefetching */
+#ifdef _ASYNC_PREFETCH
+/* Threads for asynchronous prefetching */
 static pthread_t prefetch_threads[MAX_POPCORN_NODES];
 static thread_arg_t prefetch_params[MAX_POPCORN_NODES];
 static void *prefetch_thread_main(void *arg);
@@ -97,7 +151,12 @@ static void __attribute__((constructor)) prefetch_initialize()
     list_init(&requests[i].release, i);
   }
 
-#ifdef _MAPREFETCH
+#ifndef _NOSTAGING
+  if(pthread_key_create(&staging_key, staging_destroy))
+    warn("Could not create staging buffer key\n");
+#endif
+
+#ifdef _ASYNC_PREFETCH
   int failed;
   for(i = 0; i < MAX_POPCORN_NODES; i++)
   {
@@ -109,43 +168,67 @@ static void __attribute__((constructor)) prefetch_initialize()
 
     prefetch_params[i].nid = i;
     prefetch_params[i].exit = false;
+    prefetch_params[i].head = prefetch_params[i].tail = 0;
     failed = sem_init(&prefetch_params[i].work, 0, 0);
+    failed |= sem_init(&prefetch_params[i].space, 0, PREFETCH_QUEUE_SIZE);
+    failed |= pthread_mutex_init(&prefetch_params[i].lock, NULL);
     failed |= pthread_create(&prefetch_threads[i], NULL, prefetch_thread_main,
                              &prefetch_params[i]);
-    if(failed) warn("Could not initialize prefetching thread %d\n", i);
+    if(failed) warn("Could not initialize prefetching thread %lu\n", i);
+    else prefetch_params[i].running = true;
   }
 #endif
 }
 
-#ifdef _MAPREFETCH
-/* Join all prefetching threads. */
+#ifdef _STATISTICS
+static void print_stats() {
+  const char *fn = NULL;
+  FILE *out = stderr;
+  size_t saved = 0;
+
+  if(total_stats.requests > total_stats.syscalls)
+    saved = total_stats.requests - total_stats.syscalls;
+
+  if((fn = getenv(ENV_STAT_LOG_FN))) out = fopen(fn, "w");
+
+  if(out)
+    fprintf(out, "Executed %lu prefetch requests\n"
+                 "Received %lu prefetch requests from the application\n"
+                 "Issued %lu system calls (saved %lu)\n"
+                 "Prefetched %lu pages\n"
+                 "Prefetching took %lu nanoseconds\n"
+                 "Hid %lu nanoseconds of prefetching from the application\n"
+                 "Stalled %lu nanoseconds on full prefetch queues\n",
+            total_stats.num, total_stats.requests, total_stats.syscalls,
+            saved, total_stats.pages, total_stats.time, total_stats.hidden,
+            total_stats.stalled);
+
+  if(fn && out) fclose(out);
+}
+#endif
+
+#if defined _ASYNC_PREFETCH || defined _STATISTICS
+/* Join all prefetching threads & print statistics (if configured). */
 static void __attribute__((destructor)) prefetch_end()
 {
+#ifdef _ASYNC_PREFETCH
   size_t i;
   for(i = 0; i < MAX_POPCORN_NODES; i++)
   {
-    if(!node_available(i)) continue;
+    if(!prefetch_params[i].running) continue;
 
     prefetch_params[i].exit = true;
     sem_post(&prefetch_params[i].work);
     pthread_join(prefetch_threads[i], NULL);
     sem_destroy(&prefetch_params[i].work);
+    sem_destroy(&prefetch_params[i].space);
+    pthread_mutex_destroy(&prefetch_params[i].lock);
+    prefetch_params[i].running = false;
   }
-}
-#elif defined _STATISTICS
-static void __attribute__((destructor)) print_stats() {
-  const char *fn = NULL;
-  FILE *out = stderr;
-
-  if((fn = getenv(ENV_STAT_LOG_FN))) out = fopen(fn, "w");
-
-  if(out)
-    fprintf(out, "Executed %lu prefetch requests\n"
-                 "Prefetched %lu pages\n"
-                 "Prefetching took %lu nanoseconds\n",
-            total_stats.num, total_stats.pages, total_stats.time);
-
-  if(fn && out) fclose(out);
+#endif
+#ifdef _STATISTICS
+  print_stats();
+#endif
 }
 #endif
 
@@ -153,6 +236,159 @@ static void __attribute__((destructor)) print_stats() {
 // Prefetch request batching
 ///////////////////////////////////////////////////////////////////////////////
 
+/* Get the list holding requests for a node & access type. */
+static inline list_t *request_list(int nid, access_type_t type)
+{
+  switch(type)
+  {
+  case READ: return &requests[nid].read;
+  case WRITE: return &requests[nid].write;
+  case RELEASE: return &requests[nid].release;
+  default: assert(false && "Unknown access type"); break;
+  }
+  return NULL;
+}
+
+#ifndef _NOSTAGING
+/* Sort staged requests by node, access type & address. */
+static int staged_request_cmp(const void *a, const void *b)
+{
+  const staged_request_t *ra = (const staged_request_t *)a,
+                         *rb = (const staged_request_t *)b;
+  if(ra->nid != rb->nid) return ra->nid < rb->nid ? -1 : 1;
+  if(ra->type != rb->type) return ra->type < rb->type ? -1 : 1;
+  if(ra->span.low != rb->span.low) return ra->span.low < rb->span.low ? -1 : 1;
+  return 0;
+}
+
+/*
+ * Insert a staging buffer's requests into the shared lists.  Requests are
+ * sorted so that each list is locked once per flush and receives its spans in
+ * address order.
+ *
+ * Note: the caller must hold the buffer's lock.
+ */
+static void staging_flush(staging_t *s)
+{
+  memory_span_t spans[STAGING_SIZE];
+  size_t i, j;
+
+  if(!s->num) return;
+
+  __atomic_fetch_add(&total_stats.requests, s->requested, __ATOMIC_RELAXED);
+  s->requested = 0;
+
+  qsort(s->req, s->num, sizeof(staged_request_t), staged_request_cmp);
+  for(i = 0; i < s->num; i = j)
+  {
+    for(j = i; j < s->num && s->req[j].nid == s->req[i].nid &&
+               s->req[j].type == s->req[i].type; j++)
+      spans[j - i] = s->req[j].span;
+    list_insert_sorted(request_list(s->req[i].nid, s->req[i].type),
+                       spans, j - i);
+  }
+  s->num = 0;
+}
+
+/* Flush all threads' staging buffers into the shared lists. */
+static void staging_flush_all()
+{
+  staging_t *s;
+
+  pthread_mutex_lock(&staging_lock);
+  for(s = staging_head; s; s = s->next)
+  {
+    pthread_mutex_lock(&s->lock);
+    staging_flush(s);
+    pthread_mutex_unlock(&s->lock);
+  }
+  pthread_mutex_unlock(&staging_lock);
+}
+
+/* Get the calling thread's staging buffer, allocating it on first use. */
+static staging_t *staging_get()
+{
+  staging_t *s;
+
+  if(staging) return staging;
+
+  s = popcorn_malloc(sizeof(staging_t), current_nid());
+  if(!s)
+  {
+    warn("Could not allocate staging buffer\n");
+    return NULL;
+  }
+  pthread_mutex_init(&s->lock, NULL);
+  s->num = s->requested = 0;
+
+  pthread_mutex_lock(&staging_lock);
+  s->prev = NULL;
+  s->next = staging_head;
+  if(staging_head) staging_head->prev = s;
+  staging_head = s;
+  pthread_mutex_unlock(&staging_lock);
+
+  pthread_setspecific(staging_key, s);
+  staging = s;
+  return s;
+}
+
+/* Flush & unregister a thread's staging buffer at thread exit. */
+static void staging_destroy(void *arg)
+{
+  staging_t *s = (staging_t *)arg;
+
+  pthread_mutex_lock(&staging_lock);
+  if(s->prev) s->prev->next = s->next;
+  else staging_head = s->next;
+  if(s->next) s->next->prev = s->prev;
+  pthread_mutex_lock(&s->lock);
+  staging_flush(s);
+  pthread_mutex_unlock(&s->lock);
+  pthread_mutex_unlock(&staging_lock);
+
+  pthread_mutex_destroy(&s->lock);
+  free(s);
+  staging = NULL;
+}
+
+/*
+ * Buffer a request in the calling thread's staging buffer.  Loops typically
+ * request consecutive chunks, so a request adjacent to or overlapping the
+ * previous one is merged in place rather than occupying a new entry.
+ *
+ * @return true if the request was buffered, false if it must be inserted
+ *         directly into the shared list
+ */
+static bool staging_add(int nid, access_type_t type, const memory_span_t *span)
+{
+  staging_t *s = staging_get();
+  staged_request_t *last;
+
+  if(!s) return false;
+
+  pthread_mutex_lock(&s->lock);
+  s->requested++;
+  last = s->num ? &s->req[s->num - 1] : NULL;
+  if(last && last->nid == nid && last->type == type &&
+     last->span.low <= span->high && span->low <= last->span.high)
+  {
+    last->span.low = MIN(last->span.low, span->low);
+    last->span.high = MAX(last->span.high, span->high);
+  }
+  else
+  {
+    if(s->num == STAGING_SIZE) staging_flush(s);
+    s->req[s->num].nid = nid;
+    s->req[s->num].type = type;
+    s->req[s->num].span = *span;
+    s->num++;
+  }
+  pthread_mutex_unlock(&s->lock);
+  return true;
+}
+#endif
+
 void popcorn_prefetch(access_type_t type, const void *low, const void *high)
 {
   popcorn_prefetch_node(current_nid(), type, low, high);
@@ -185,16 +421,20 @@ void popcorn_prefetch_node(int nid,
     return;
   }
 
-  debug("Node %d: queueing span 0x%lx -> 0x%lx for %s\n",
-        nid, span.low, span.high, access_type_str(type));
-
   switch(type)
   {
-  case READ: list_insert(&requests[nid].read, &span); break;
-  case WRITE: list_insert(&requests[nid].write, &span); break;
-  case RELEASE: list_insert(&requests[nid].release, &span); break;
-  default: assert(false && "Unknown access type"); break;
+  case READ: case WRITE: case RELEASE: break;
+  default: assert(false && "Unknown access type"); return;
   }
+
+  debug("Node %d: queueing span 0x%lx -> 0x%lx for %s\n",
+        nid, span.low, span.high, access_type_str(type));
+
+#ifndef _NOSTAGING
+  if(staging_add(nid, type, &span)) return;
+#endif
+  __atomic_fetch_add(&total_stats.requests, 1, __ATOMIC_RELAXED);
+  list_insert(request_list(nid, type), &span);
 }
 
 size_t popcorn_prefetch_num_requests(int nid, access_type_t type)
@@ -206,6 +446,10 @@ size_t popcorn_prefetch_num_requests(int nid, access_type_t type)
     return 0;
   }
 
+#ifndef _NOSTAGING
+  staging_flush_all();
+#endif
+
   switch(type)
   {
   case READ: return list_size(&requests[nid].read);
@@ -276,132 +520,211 @@ static void prefetch_span(access_type_t type, const memory_span_t *span)
 }
 
 /*
- * Core prefetching logic, used both in manual & OS-based prefetching.  By
- * default, only records the number of spans prefetched.  If _STATISTICS is
- * defined, records the number of pages and time to prefetch as well.
+ * Drain a node's request lists into an array of spans, one per system call.
+ * Regions requested for writing are removed from the read & release lists,
+ * and regions requested for reading from the release list.  The remaining
+ * spans are merged into a single address-ordered sequence across access types
+ * so the kernel walks memory in order.  Adjacent spans are merged only if
+ * they have the same access type.
+ *
+ * @param nid a node ID
+ * @param cmds set to an array of commands, which must be freed by the caller
+ * @param stats statistics, records the number of spans in the lists
+ * @return the number of commands in the array
  */
-static void popcorn_prefetch_execute_internal(int nid, stats_t *stats)
+static size_t drain_requests(int nid, prefetch_cmd_t **cmds, stats_t *stats)
 {
-  const node_t *n, *end;
+  list_t *write = &requests[nid].write, *read = &requests[nid].read,
+         *release = &requests[nid].release;
+  const node_t *w, *r, *rel;
   const memory_span_t *span;
-#ifdef _STATISTICS
-  struct timespec start_time, end_time;
-#endif
+  prefetch_cmd_t *buf, *last = NULL;
+  access_type_t type;
+  size_t num = 0;
 
   assert(0 <= nid && nid < MAX_POPCORN_NODES && "Invalid node ID");
-  assert(stats && "Invalid stats parameter");
+  assert(cmds && stats && "Invalid arguments to drain_requests()");
 
-  stats->num = 0;
-  stats->pages = 0;
-  stats->time = 0;
-
-  // We can't prefetch to another node, so warn & clear out lists to prevent
-  // them from growing forever due to failed prefetch executions.
-  if(current_nid() != nid) {
-    warn("Cannot prefetch to node on which we're not running (%d vs. %d)\n",
-         current_nid(), nid);
-    list_clear(&requests[nid].write);
-    list_clear(&requests[nid].read);
-    list_clear(&requests[nid].release);
-    return;
-  }
+  *cmds = NULL;
 
   // Acquire locks to prevent other threads from trying to add new requests
   // while we're processing the lists.
-  list_atomic_start(&requests[nid].release);
-  list_atomic_start(&requests[nid].read);
-  list_atomic_start(&requests[nid].write);
-
-  // Send write requests
-  n = list_begin(&requests[nid].write);
-  end = list_end(&requests[nid].write);
-  while(n != end)
+  list_atomic_start(release);
+  list_atomic_start(read);
+  list_atomic_start(write);
+
+  // Rather than prefetching the same region for both reading and writing,
+  // delete regions requested for writing from the read list.  If we're
+  // prefetching a region, it doesn't make sense to release ownership either.
+  for(w = list_begin(write); w != list_end(write); w = list_next(w))
   {
-    span = list_get_span(n);
+    span = list_get_span(w);
+    list_remove(read, span);
+    list_remove(release, span);
+  }
+  for(r = list_begin(read); r != list_end(read); r = list_next(r))
+    list_remove(release, list_get_span(r));
 
-    // Rather than prefetching the same region for both reading and writing,
-    // delete regions requested for writing from the read list
-    list_remove(&requests[nid].read, span);
+  stats->num = list_size(write) + list_size(read) + list_size(release);
+  if(!stats->num) goto unlock;
 
-    // If we're prefetching a region, it doesn't make sense to release
-    // ownership.  Remove any prefetched regions from the release list.
-    list_remove(&requests[nid].release, span);
+  buf = popcorn_malloc(sizeof(prefetch_cmd_t) * stats->num, nid);
+  if(!buf)
+  {
+    warn("Could not allocate %lu prefetch commands\n", stats->num);
+    stats->num = 0;
+    goto clear;
+  }
 
-    debug("Node %d: executing prefetch of 0x%lx -> 0x%lx for writing\n",
-          nid, span->low, span->high);
+  w = list_begin(write);
+  r = list_begin(read);
+  rel = list_begin(release);
+  while(w != list_end(write) || r != list_end(read) ||
+        rel != list_end(release))
+  {
+    // Select the lowest span of the three lists; spans never overlap
+    span = NULL;
+    type = WRITE;
+    if(w != list_end(write)) span = list_get_span(w);
+    if(r != list_end(read) && (!span || list_get_span(r)->low < span->low))
+    {
+      span = list_get_span(r);
+      type = READ;
+    }
+    if(rel != list_end(release) &&
+       (!span || list_get_span(rel)->low < span->low))
+    {
+      span = list_get_span(rel);
+      type = RELEASE;
+    }
 
-#ifdef _STATISTICS
-    clock_gettime(CLOCK_MONOTONIC, &start_time);
-#endif
-    prefetch_span(WRITE, span);
-#ifdef _STATISTICS
-    clock_gettime(CLOCK_MONOTONIC, &end_time);
-    stats->pages += SPAN_NUM_PAGES(*span);
-    stats->time += NS(end_time) - NS(start_time);
-#endif
-    stats->num++;
+    switch(type)
+    {
+    case READ: r = list_next(r); break;
+    case WRITE: w = list_next(w); break;
+    case RELEASE: rel = list_next(rel); break;
+    default: assert(false && "Unknown access type"); break;
+    }
 
-    n = list_next(n);
+    if(last && last->type == type && last->span.high == span->low)
+      last->span.high = span->high;
+    else
+    {
+      last = &buf[num++];
+      last->type = type;
+      last->span = *span;
+    }
   }
-  list_clear(&requests[nid].write);
-  list_atomic_end(&requests[nid].write);
+  *cmds = buf;
+
+clear:
+  list_clear(write);
+  list_clear(read);
+  list_clear(release);
+unlock:
+  list_atomic_end(write);
+  list_atomic_end(read);
+  list_atomic_end(release);
+
+  return num;
+}
 
-  // Send read requests
-  n = list_begin(&requests[nid].read);
-  end = list_end(&requests[nid].read);
-  while(n != end)
-  {
-    span = list_get_span(n);
+/*
+ * Core prefetching logic, used both in manual & OS-based prefetching.  By
+ * default, only records the number of spans prefetched.  If _STATISTICS is
+ * defined, records the number of pages and time to prefetch as well.
+ */
+static void
+issue_commands(const prefetch_cmd_t *cmds, size_t num, stats_t *stats)
+{
+  size_t i;
+#ifdef _STATISTICS
+  struct timespec start_time, end_time;
+#endif
 
-    // If we're prefetching a region, it doesn't make sense to release
-    // ownership.  Remove any prefetched regions from the release list.
-    list_remove(&requests[nid].release, span);
+  assert(stats && "Invalid stats parameter");
 
-    debug("Node %d: executing prefetch of 0x%lx -> 0x%lx for reading\n",
-          nid, span->low, span->high);
+  for(i = 0; i < num; i++)
+  {
+    debug("Node %d: executing %s of 0x%lx -> 0x%lx\n",
+          current_nid(), access_type_str(cmds[i].type),
+          cmds[i].span.low, cmds[i].span.high);
 
 #ifdef _STATISTICS
     clock_gettime(CLOCK_MONOTONIC, &start_time);
 #endif
-    prefetch_span(READ, span);
+    prefetch_span(cmds[i].type, &cmds[i].span);
 #ifdef _STATISTICS
     clock_gettime(CLOCK_MONOTONIC, &end_time);
-    stats->pages += SPAN_NUM_PAGES(*span);
+    stats->pages += SPAN_NUM_PAGES(cmds[i].span);
     stats->time += NS(end_time) - NS(start_time);
 #endif
-    stats->num++;
-
-    n = list_next(n);
+    stats->syscalls++;
   }
-  list_clear(&requests[nid].read);
-  list_atomic_end(&requests[nid].read);
+}
 
-  // Send release requests
-  n = list_begin(&requests[nid].release);
-  end = list_end(&requests[nid].release);
-  while(n != end)
-  {
-    span = list_get_span(n);
+/* Drain & prefetch a node's requests on the calling thread. */
+static void popcorn_prefetch_execute_internal(int nid, stats_t *stats)
+{
+  prefetch_cmd_t *cmds;
+  size_t num;
+
+  assert(0 <= nid && nid < MAX_POPCORN_NODES && "Invalid node ID");
+  assert(stats && "Invalid stats parameter");
+
+  // We can't prefetch to another node, so warn & clear out lists to prevent
+  // them from growing forever due to failed prefetch executions.
+  if(current_nid() != nid) {
+    warn("Cannot prefetch to node on which we're not running (%d vs. %d)\n",
+         current_nid(), nid);
+    list_clear(&requests[nid].write);
+    list_clear(&requests[nid].read);
+    list_clear(&requests[nid].release);
+    return;
+  }
 
-    debug("Node %d: executing release of 0x%lx -> 0x%lx\n",
-          nid, span->low, span->high);
+  num = drain_requests(nid, &cmds, stats);
+  issue_commands(cmds, num, stats);
+  free(cmds);
+}
 
+#ifdef _ASYNC_PREFETCH
+/*
+ * Drain a node's requests & hand them to the node's prefetching thread.  Only
+ * blocks if the thread has fallen more than PREFETCH_QUEUE_SIZE spans behind.
+ */
+static void popcorn_prefetch_queue(thread_arg_t *param, stats_t *stats)
+{
+  prefetch_cmd_t *cmds;
+  size_t i, num;
 #ifdef _STATISTICS
-    clock_gettime(CLOCK_MONOTONIC, &start_time);
+  struct timespec start_time, end_time;
 #endif
-    prefetch_span(RELEASE, span);
+
+  num = drain_requests(param->nid, &cmds, stats);
+  for(i = 0; i < num; i++)
+  {
 #ifdef _STATISTICS
-    clock_gettime(CLOCK_MONOTONIC, &end_time);
-    stats->pages += SPAN_NUM_PAGES(*span);
-    stats->time += NS(end_time) - NS(start_time);
+    if(sem_trywait(&param->space))
+    {
+      clock_gettime(CLOCK_MONOTONIC, &start_time);
+      sem_wait(&param->space);
+      clock_gettime(CLOCK_MONOTONIC, &end_time);
+      stats->stalled += NS(end_time) - NS(start_time);
+    }
+#else
+    sem_wait(&param->space);
 #endif
-    stats->num++;
 
-    n = list_next(n);
+    pthread_mutex_lock(&param->lock);
+    param->queue[param->tail % PREFETCH_QUEUE_SIZE] = cmds[i];
+    __atomic_store_n(&param->tail, param->tail + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&param->lock);
+    sem_post(&param->work);
   }
-  list_clear(&requests[nid].release);
-  list_atomic_end(&requests[nid].release);
+  free(cmds);
 }
+#endif
 
 size_t popcorn_prefetch_execute()
 {
@@ -410,7 +733,8 @@ size_t popcorn_prefetch_execute()
 
 size_t popcorn_prefetch_execute_node(int nid)
 {
-  stats_t stats;
+  stats_t stats = { .num = 0, .requests = 0, .syscalls = 0, .pages = 0,
+                    .time = 0, .hidden = 0, .stalled = 0 };
 
   // Ensure prefetch request is for a valid node.
   if(nid < 0 || nid >= MAX_POPCORN_NODES)
@@ -419,15 +743,17 @@ size_t popcorn_prefetch_execute_node(int nid)
     return 0;
   }
 
-#ifdef _MAPREFETCH
-  stats.num = list_size(&requests[nid].write) +
-              list_size(&requests[nid].read) +
-              list_size(&requests[nid].release);
-  sem_post(&prefetch_params[nid].work);
-#else
+#ifndef _NOSTAGING
+  staging_flush_all();
+#endif
+
+#ifdef _ASYNC_PREFETCH
+  if(prefetch_params[nid].running)
+    popcorn_prefetch_queue(&prefetch_params[nid], &stats);
+  else
+#endif
   popcorn_prefetch_execute_internal(nid, &stats);
   accumulate_global_stats(&stats);
-#endif
 
   return stats.num;
 }
@@ -436,37 +762,47 @@ size_t popcorn_prefetch_execute_node(int nid)
 static void * __attribute__((unused))
 prefetch_thread_main(void *arg)
 {
-  stats_t stats = { .num = 0, .pages = 0, .time = 0 }, cur;
+  stats_t stats = { .num = 0, .requests = 0, .syscalls = 0, .pages = 0,
+                    .time = 0, .hidden = 0, .stalled = 0 };
   thread_arg_t *param = (thread_arg_t *)arg;
+  prefetch_cmd_t cmd;
+  bool on_node;
 
   debug("PID %d: servicing prefetch requests for node %d\n",
         gettid(), param->nid);
 
   migrate(param->nid, NULL, NULL);
-  if(current_nid() != param->nid) warn("PID %d: still on origin\n", gettid());
+  on_node = current_nid() == param->nid;
+  if(!on_node) warn("PID %d: still on origin, dropping requests\n", gettid());
 
-  sem_wait(&param->work);
-  while(!param->exit)
+  while(true)
   {
-    debug("PID %d: prefetching for node %d\n", gettid(), param->nid);
-    popcorn_prefetch_execute_internal(param->nid, &cur);
-    stats.num += cur.num;
-#ifdef _STATISTICS
-    stats.pages += cur.pages;
-    stats.time += cur.time;
-#endif
     sem_wait(&param->work);
+
+    // Drain any queued requests before exiting
+    if(param->head == __atomic_load_n(&param->tail, __ATOMIC_ACQUIRE))
+    {
+      if(param->exit) break;
+      else continue;
+    }
+
+    cmd = param->queue[param->head++ % PREFETCH_QUEUE_SIZE];
+    sem_post(&param->space);
+    if(on_node) issue_commands(&cmd, 1, &stats);
   }
 
   migrate(0, NULL, NULL);
 
+  // All time spent prefetching on this thread was hidden from the application
+  stats.hidden = stats.time;
+  accumulate_global_stats(&stats);
+
 #ifndef _STATISTICS
-  debug("PID %d: executed %lu requests\n", gettid(), stats.num);
+  debug("PID %d: executed %lu requests\n", gettid(), stats.syscalls);
 #else
   debug("PID %d: executed %lu requests, touched %lu pages, took %lu ns\n",
-        gettid(), stats.num, stats.pages, stats.time);
+        gettid(), stats.syscalls, stats.pages, stats.time);
 #endif
 
   return NULL;
 }
-
@@ -9,6 +9,7 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <string.h>
 #include <assert.h>
 
 #include "definitions.h"
@@ -19,18 +20,21 @@
 // Node API
 ///////////////////////////////////////////////////////////////////////////////
 
-/* A linked list node. */
+/* A skip list node. */
 typedef struct node_t {
-  struct node_t *prev, *next;
   memory_span_t mem;
+  int level;
+  struct node_t *next[LIST_MAX_LEVEL];
 } node_t;
 
-/* Per-node linked list node cache */
+/* Per-node skip list node cache */
 typedef struct node_cache_t {
   node_t node[NODE_CACHE_SIZE];
   bool node_used[NODE_CACHE_SIZE];
+  size_t num_used;
   char padding[PAGESZ - ((sizeof(node_t) * NODE_CACHE_SIZE +
-                          sizeof(bool) * NODE_CACHE_SIZE) % PAGESZ)];
+                          sizeof(bool) * NODE_CACHE_SIZE +
+                          sizeof(size_t)) % PAGESZ)];
 } __attribute__((aligned(PAGESZ))) node_cache_t;
 
 #ifndef _NOCACHE
@@ -46,7 +50,7 @@ static node_cache_t cache[NUM_CACHE];
 
 #endif
 
-/* Allocate & initialize a new linked list node */
+/* Allocate & initialize a new skip list node */
 static node_t *node_create(node_cache_t *cache,
                            const memory_span_t *mem,
                            int nid)
@@ -60,13 +64,15 @@ static node_t *node_create(node_cache_t *cache,
   // Try to allocate from the node cache before dropping to malloc
   assert(cache && "Invalid cache pointer");
 
+  // Skip scanning a full cache, which is the common case for large lists
   size_t i;
-  for(i = 0; i < NODE_CACHE_SIZE; i++) {
+  for(i = 0; cache->num_used < NODE_CACHE_SIZE && i < NODE_CACHE_SIZE; i++) {
     if(!cache->node_used[i]) {
       cache->node_used[i] = true;
+      cache->num_used++;
       cache->node[i].mem = *mem;
 #ifdef _CHECKS
-      cache->node[i].prev = cache->node[i].next = NULL;
+      memset(cache->node[i].next, 0, sizeof(cache->node[i].next));
 #endif
       return &cache->node[i];
     }
@@ -76,17 +82,17 @@ static node_t *node_create(node_cache_t *cache,
   assert(n && "Invalid node pointer");
   n->mem = *mem;
 #ifdef _CHECKS
-  n->prev = n->next = NULL;
+  memset(n->next, 0, sizeof(n->next));
 #endif
   return n;
 }
 
-/* Free a linked list node */
+/* Free a skip list node */
 static void node_free(node_cache_t *cache, node_t *n)
 {
   assert(n && "Invalid node pointer");
 #ifdef _CHECKS
-  n->prev = n->next = NULL;
+  memset(n->next, 0, sizeof(n->next));
   n->mem.low = n->mem.high = 0;
 #endif
 #ifndef _NOCACHE
@@ -105,6 +111,7 @@ static void node_free(node_cache_t *cache, node_t *n)
     assert(cache->node_used[entry] == true && "Invalid cache metadata");
 
     cache->node_used[entry] = false;
+    cache->num_used--;
     return;
   }
 #endif
@@ -177,108 +184,204 @@ list_check_contained(const memory_span_t *a, const memory_span_t *b)
 
 /*
  * Seek to the location in the list where the memory span would be inserted.
- * Return the successor node, i.e., the node directly after where the span
- * would be inserted.  For example, in the following list:
+ * Fill in the predecessors at every level of the skip list, i.e., at each
+ * level the last node whose span starts strictly before the span's low address
+ * and the address of its forward pointer.  The successor node (the node
+ * directly after where the span would be inserted) is *update[0].  For
+ * example, in the following list:
  *
  *           ----------     ----------
- *   ... <-> | 0x1000 | <-> | 0x3000 | <-> ...
+ *   ... --> | 0x1000 | --> | 0x3000 | --> ...
  *           ----------     ----------
  *
- * calling list_seek() for a memory span starting at 0x2000 would return a
- * pointer to the node containing 0x3000.  Note that if the start address
- * already exists in a node in the list, list_seek() returns that node.  For
- * example, calling list_seek() for another memory span starting at 0x3000
- * would again return a pointer to the node containing 0x3000.
+ * seeking for a memory span starting at 0x2000 would return a pointer to the
+ * node containing 0x1000 and set *update[0] to the node containing 0x3000.
+ * Note that if the start address already exists in a node in the list, that
+ * node is the successor.
+ *
+ * The search starts from the predecessors passed in pred (NULL entries start
+ * from the head), which lets sorted batches of spans resume each search where
+ * the previous one ended rather than from the top of the list.
+ *
+ * Note: pred must only contain nodes starting at or before mem's low address.
  *
  * @param l a list
  * @param mem a memory span
- * @return a node, or NULL if the span should be added as the tail
+ * @param pred predecessor nodes at each level, used as a starting point and
+ *             filled in
+ * @param update predecessor forward pointers at each level, filled in
+ * @return the predecessor node, or NULL if the span should be the new head
  */
-static inline node_t *list_seek(list_t *l, const memory_span_t *mem)
+static inline node_t *
+list_seek_from(list_t *l,
+               const memory_span_t *mem,
+               node_t *pred[LIST_MAX_LEVEL],
+               node_t **update[LIST_MAX_LEVEL])
 {
-  assert(l && mem && "Invalid arguments to list_seek()");
-  if(l->head)
+  node_t *cur = NULL, **fwd;
+  int i;
+
+  assert(l && mem && pred && update && "Invalid arguments to list_seek()");
+
+  for(i = l->level - 1; i >= 0; i--)
   {
-    node_t *cur = l->head;
-    while(cur && cur->mem.low < mem->low) cur = cur->next;
-    return cur;
+    // Start from the later of this level's previous predecessor & the
+    // predecessor found on the level above.
+    if(pred[i] && (!cur || pred[i]->mem.low > cur->mem.low)) cur = pred[i];
+    fwd = cur ? &cur->next[i] : &l->head[i];
+    while(*fwd && (*fwd)->mem.low < mem->low)
+    {
+      cur = *fwd;
+      fwd = &cur->next[i];
+    }
+    pred[i] = cur;
+    update[i] = fwd;
   }
-  else return NULL;
+  for(i = l->level; i < LIST_MAX_LEVEL; i++)
+  {
+    pred[i] = NULL;
+    update[i] = &l->head[i];
+  }
+  return cur;
+}
+
+/* Seek from the head of the list; see list_seek_from(). */
+static inline node_t *
+list_seek(list_t *l, const memory_span_t *mem, node_t **update[LIST_MAX_LEVEL])
+{
+  node_t *pred[LIST_MAX_LEVEL] = { NULL };
+  return list_seek_from(l, mem, pred, update);
 }
 
 /*
- * Merge two nodes.  Merges b into a and returns the merged node.
+ * Choose a height for a new node.  Each level is promoted with probability
+ * 1/4, using a cheap per-list xorshift generator (protected by the list lock).
  *
- * Note: a *must* be directly before b in sorted ordering in the list.
+ * @param l a list
+ * @return a level in the range [1, LIST_MAX_LEVEL]
+ */
+static inline int list_random_level(list_t *l)
+{
+  uint32_t x = l->seed;
+  int level = 1;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  l->seed = x;
+
+  while(level < LIST_MAX_LEVEL && !(x & 0x3))
+  {
+    level++;
+    x >>= 2;
+  }
+  return level;
+}
+
+/*
+ * Link a node into the list at the location described by update, and point
+ * the update links at the new node's forward pointers.
  *
- * @param a a linked list node
- * @param b a linked list node
- * @return the new merged node
+ * @param l a list
+ * @param n a node with its span & level set
+ * @param update predecessor forward pointers returned by list_seek_from()
  */
-static node_t *list_merge(list_t *l, node_t *a, node_t *b)
+static void list_link(list_t *l, node_t *n, node_t **update[LIST_MAX_LEVEL])
 {
-  assert(l && a && b &&
-         a->mem.low <= b->mem.low &&
-         a->next == b && b->prev == a &&
-         "Invalid arguments to node merge");
-
-  debug("Merging 0x%lx - 0x%lx and 0x%lx - 0x%lx to 0x%lx - 0x%lx\n",
-        a->mem.low, a->mem.high, b->mem.low, b->mem.high,
-        MIN(a->mem.low, b->mem.low), MAX(a->mem.high, b->mem.high));
-
-  a->mem.high = MAX(a->mem.high, b->mem.high);
-  a->next = b->next;
-  if(a->next) a->next->prev = a;
-  else l->tail = a; // b was the tail
-  node_free(l->cache, b);
-  l->size--;
-  return a;
+  int i;
+
+  assert(l && n && update && "Invalid arguments to list_link()");
+
+  if(n->level > l->level) l->level = n->level;
+  for(i = 0; i < n->level; i++)
+  {
+    n->next[i] = *update[i];
+    *update[i] = n;
+    update[i] = &n->next[i];
+  }
+  l->size++;
 }
 
 /*
- * Delete a node from the list & return its successor.
+ * Unlink a node from the list & free it.  The node must be the direct
+ * successor of every update link at the levels it occupies, which holds for
+ * the first node after the update links returned by list_seek_from().
  *
  * @param l a list
  * @param n a node
- * @return the node's successor in the list, or NULL if the node was the tail
+ * @param update predecessor forward pointers
  */
-static node_t *list_delete(list_t *l, node_t *n)
+static void list_delete(list_t *l, node_t *n, node_t **update[LIST_MAX_LEVEL])
 {
-  node_t *prev, *next = NULL;
+  int i;
 
-  assert(l && n && "Invalid arguments to list_delete()");
+  assert(l && n && update && "Invalid arguments to list_delete()");
 
   debug("Deleting 0x%lx - 0x%lx\n", n->mem.low, n->mem.high);
 
-  if(l->size == 1)
+  for(i = 0; i < n->level; i++)
+  {
+    assert(*update[i] == n && "Invalid predecessor link");
+    *update[i] = n->next[i];
+  }
+  while(l->level > 1 && !l->head[l->level - 1]) l->level--;
+  l->size--;
+  node_free(l->cache, n);
+}
+
+
+/*
+ * Insert a memory region, merging with other spans as needed.
+ *
+ * Note: the caller must hold the list's lock.
+ *
+ * @param l a list
+ * @param mem a contiguous memory region to be inserted into the list
+ * @param pred predecessor nodes at each level, see list_seek_from(); updated
+ *             to be valid for any span starting at or after mem's low address
+ */
+static void list_insert_locked(list_t *l,
+                               const memory_span_t *mem,
+                               node_t *pred[LIST_MAX_LEVEL])
+{
+  node_t **update[LIST_MAX_LEVEL], *prev, *next, *n;
+  int i;
+
+  // Merge with predecessor span if adjacent/overlapping, otherwise link in a
+  // new node.  Either way, point the update links at n's forward pointers so
+  // successors can be unlinked while merging.
+  prev = list_seek_from(l, mem, pred, update);
+  if(prev && list_check_merge(&prev->mem, mem))
   {
-    l->head = l->tail = NULL;
-    l->size = 0;
+    debug("Merging 0x%lx - 0x%lx and 0x%lx - 0x%lx to 0x%lx - 0x%lx\n",
+          prev->mem.low, prev->mem.high, mem->low, mem->high,
+          prev->mem.low, MAX(prev->mem.high, mem->high));
+
+    n = prev;
+    n->mem.high = MAX(n->mem.high, mem->high);
+    for(i = 0; i < n->level; i++) update[i] = &n->next[i];
   }
   else
   {
-    if(n == l->head)
-    {
-      l->head = n->next;
-      l->head->prev = NULL;
-      next = l->head;
-    }
-    else if(n == l->tail)
-    {
-      l->tail = n->prev;
-      l->tail->next = NULL;
-    }
-    else
-    {
-      prev = n->prev;
-      next = n->next;
-      prev->next = next;
-      next->prev = prev;
-    }
-    l->size--;
+    n = node_create(l->cache, mem, l->nid);
+    assert(n && "Invalid pointer returned by node_create()");
+    n->level = list_random_level(l);
+    list_link(l, n, update);
+    for(i = 0; i < n->level; i++) pred[i] = n;
+  }
+
+  // Merge with successor spans; can merge an arbitrary number of times.
+  next = n->next[0];
+  while(next && list_check_merge(&n->mem, &next->mem))
+  {
+    debug("Merging 0x%lx - 0x%lx and 0x%lx - 0x%lx to 0x%lx - 0x%lx\n",
+          n->mem.low, n->mem.high, next->mem.low, next->mem.high,
+          n->mem.low, MAX(n->mem.high, next->mem.high));
+
+    n->mem.high = MAX(n->mem.high, next->mem.high);
+    list_delete(l, next, update);
+    next = n->next[0];
   }
-  node_free(l->cache, n);
-  return next;
 }
 
 /* User-facing APIs */
@@ -294,9 +397,12 @@ void list_init(list_t *l, int nid)
 #else
   l->cache = NULL;
 #endif
-  l->head = l->tail = NULL;
+  memset(l->head, 0, sizeof(l->head));
   l->size = 0;
   l->nid = nid;
+  l->level = 1;
+  l->seed = 0x9e3779b9 ^ (uint32_t)(uintptr_t)l;
+  if(!l->seed) l->seed = 1;
   pthread_mutexattr_init(&attr);
   pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
   pthread_mutex_init(&l->lock, &attr);
@@ -311,66 +417,29 @@ size_t list_size(const list_t *l)
 
 void list_insert(list_t *l, const memory_span_t *mem)
 {
-  node_t *cur, *prev, *next, *n;
+  node_t *pred[LIST_MAX_LEVEL] = { NULL };
 
   assert(l && mem && "Invalid arguments to list_insert()");
   assert(mem->low < mem->high && "Invalid memory span");
 
   pthread_mutex_lock(&l->lock);
+  list_insert_locked(l, mem, pred);
+  pthread_mutex_unlock(&l->lock);
+}
 
-  n = node_create(l->cache, mem, l->nid);
+void list_insert_sorted(list_t *l, const memory_span_t *mem, size_t num)
+{
+  node_t *pred[LIST_MAX_LEVEL] = { NULL };
+  size_t i;
 
-  assert(n && "Invalid pointer returned by node_create()");
+  assert(l && (mem || !num) && "Invalid arguments to list_insert_sorted()");
 
-  if(!l->head)
+  pthread_mutex_lock(&l->lock);
+  for(i = 0; i < num; i++)
   {
-    // First node in the list
-    l->head = l->tail = n;
-    l->size = 1;
-    n->prev = n->next = NULL;
-  }
-  else
-  {
-    // Insert the node into the list
-    cur = list_seek(l, mem);
-    if(cur == l->head) // First element in the list
-    {
-      cur->prev = n;
-      n->next = cur;
-      n->prev = NULL;
-      l->head = n;
-    }
-    else if(!cur) // Last element in the list
-    {
-      cur = l->tail;
-      cur->next = n;
-      n->prev = cur;
-      n->next = NULL;
-      l->tail = n;
-    }
-    else // In the middle of the list
-    {
-      next = cur;
-      cur = cur->prev;
-      cur->next = n;
-      n->prev = cur;
-      next->prev = n;
-      n->next = next;
-    }
-    l->size++;
-
-    // Merge with predecessor span; can merge at most once.
-    prev = n->prev;
-    if(prev && list_check_merge(&prev->mem, &n->mem))
-      n = list_merge(l, prev, n);
-
-    // Merge with successor spans; can merge an arbitrary number of times.
-    next = n->next;
-    while(next && list_check_merge(&n->mem, &next->mem))
-    {
-      n = list_merge(l, n, next);
-      next = n->next;
-    }
+    assert(mem[i].low < mem[i].high && "Invalid memory span");
+    assert((!i || mem[i - 1].low <= mem[i].low) && "Spans are not sorted");
+    list_insert_locked(l, &mem[i], pred);
   }
   pthread_mutex_unlock(&l->lock);
 }
@@ -378,19 +447,16 @@ void list_insert(list_t *l, const memory_span_t *mem)
 bool list_overlaps(list_t *l, const memory_span_t *mem)
 {
   bool overlaps = false;
-  node_t *next;
+  node_t **update[LIST_MAX_LEVEL], *prev, *next;
 
   assert(l && mem && "Invalid arguments to list_overlaps()");
   assert(mem->low < mem->high && "Invalid memory span");
 
   pthread_mutex_lock(&l->lock);
-  if(l->head)
-  {
-    next = list_seek(l, mem);
-    if(!next) overlaps = list_check_overlap(&l->tail->mem, mem);
-    else overlaps = list_check_overlap(&next->prev->mem, mem) ||
-                    list_check_overlap(mem, &next->mem);
-  }
+  prev = list_seek(l, mem, update);
+  next = *update[0];
+  overlaps = (prev && list_check_overlap(&prev->mem, mem)) ||
+             (next && list_check_overlap(mem, &next->mem));
   pthread_mutex_unlock(&l->lock);
 
   return overlaps;
@@ -398,68 +464,74 @@ bool list_overlaps(list_t *l, const memory_span_t *mem)
 
 void list_remove(list_t *l, const memory_span_t *mem)
 {
-  node_t *cur, *prev;
-  memory_span_t cur_span, new_span;
+  node_t **update[LIST_MAX_LEVEL], *prev, *cur, *n;
+  memory_span_t new_span;
+  int i;
 
   assert(l && mem && "Invalid arguments to list_remove()");
   assert(mem->low < mem->high && "Invalid memory span");
 
   pthread_mutex_lock(&l->lock);
-  if(l->head)
+
+  // Remove overlapping region from predecessor; can split at most once.
+  // Note that by definition the predecessor will not be a subset of mem
+  // since it's lower bound *must* be before mem's lower bound.
+  prev = list_seek(l, mem, update);
+  if(prev && list_check_overlap(&prev->mem, mem))
   {
-    cur = list_seek(l, mem);
-
-    // Remove overlapping region from predecessor; can split at most once.
-    // Note that by definition the predecessor will not be a subset of mem
-    // since it's lower bound *must* be before mem's lower bound.
-    if(cur) prev = cur->prev;
-    else prev = l->tail;
-    if(prev && list_check_overlap(&prev->mem, mem))
+    if(prev->mem.high <= mem->high)
     {
-      if(prev->mem.high <= mem->high)
-      {
-        debug("Resizing 0x%lx - 0x%lx to 0x%lx - 0x%lx\n",
-              prev->mem.low, prev->mem.high, prev->mem.low, mem->low);
-
-        prev->mem.high = mem->low;
-      }
-      else
-      {
-        // The memory region being removed is a strict subset of prev -- split
-        // prev into two new nodes with mem removed.
-        debug("Replacing 0x%lx - 0x%lx with 0x%lx - 0x%lx & 0x%lx - 0x%lx\n",
-              prev->mem.low, prev->mem.high, prev->mem.low, mem->low,
-              mem->high, prev->mem.high);
-
-        cur_span = prev->mem;
-        list_delete(l, prev);
-
-        new_span.low = cur_span.low;
-        new_span.high = mem->low;
-        list_insert(l, &new_span);
-
-        new_span.low = mem->high;
-        new_span.high = cur_span.high;
-        list_insert(l, &new_span);
-      }
+      debug("Resizing 0x%lx - 0x%lx to 0x%lx - 0x%lx\n",
+            prev->mem.low, prev->mem.high, prev->mem.low, mem->low);
+
+      prev->mem.high = mem->low;
     }
+    else
+    {
+      // The memory region being removed is a strict subset of prev -- split
+      // prev into two nodes with mem removed.  The upper half can't merge
+      // with prev's successor, as prev didn't.
+      debug("Replacing 0x%lx - 0x%lx with 0x%lx - 0x%lx & 0x%lx - 0x%lx\n",
+            prev->mem.low, prev->mem.high, prev->mem.low, mem->low,
+            mem->high, prev->mem.high);
+
+      new_span.low = mem->high;
+      new_span.high = prev->mem.high;
+      prev->mem.high = mem->low;
+
+      for(i = 0; i < prev->level; i++) update[i] = &prev->next[i];
+      n = node_create(l->cache, &new_span, l->nid);
+      assert(n && "Invalid pointer returned by node_create()");
+      n->level = list_random_level(l);
+      list_link(l, n, update);
+
+      pthread_mutex_unlock(&l->lock);
+      return;
+    }
+  }
 
-    // Remove overlapping regions from successors; can split an arbitrary
-    // number of times.  Note that by definition mem will not be a strict
-    // subset of the successor since its lower bound *must* be less than or
-    // equal to the successor's lower bound.
-    while(cur && list_check_overlap(mem, &cur->mem))
+  // Remove overlapping regions from successors; can delete an arbitrary
+  // number of times.  Note that by definition mem will not be a strict
+  // subset of the successor since its lower bound *must* be less than or
+  // equal to the successor's lower bound.
+  cur = *update[0];
+  while(cur && list_check_overlap(mem, &cur->mem))
+  {
+    if(list_check_contained(mem, &cur->mem))
+    {
+      list_delete(l, cur, update);
+      cur = *update[0];
+    }
+    else
     {
-      if(list_check_contained(mem, &cur->mem)) cur = list_delete(l, cur);
-      else
-      {
-        debug("Resizing 0x%lx - 0x%lx to 0x%lx - 0x%lx\n",
-              cur->mem.low, cur->mem.high, mem->high, cur->mem.high);
-
-        cur->mem.low = mem->high;
-      }
+      debug("Resizing 0x%lx - 0x%lx to 0x%lx - 0x%lx\n",
+            cur->mem.low, cur->mem.high, mem->high, cur->mem.high);
+
+      cur->mem.low = mem->high;
+      break;
     }
   }
+
   pthread_mutex_unlock(&l->lock);
 }
 
@@ -468,15 +540,15 @@ void list_clear(list_t *l)
   node_t *cur, *next;
 
   pthread_mutex_lock(&l->lock);
-  cur = l->head;
+  cur = l->head[0];
   while(cur)
   {
-    next = cur->next;
+    next = cur->next[0];
     node_free(l->cache, cur);
     cur = next;
   }
-  l->head = NULL;
-  l->tail = NULL;
+  memset(l->head, 0, sizeof(l->head));
+  l->level = 1;
   l->size = 0;
   pthread_mutex_unlock(&l->lock);
 }
@@ -493,11 +565,11 @@ void list_atomic_end(list_t *l) {
 
 const node_t *list_begin(list_t *l) {
   assert(l && "Invalid arguments to list_begin()");
-  return l->head;
+  return l->head[0];
 }
 
 const node_t *list_next(const node_t *n) {
-  if(n) return n->next;
+  if(n) return n->next[0];
   else return NULL;
 }
 
@@ -516,12 +588,11 @@ void list_print(list_t *l)
 
   pthread_mutex_lock(&l->lock);
   printf("List for node %d (%p) contains %lu span(s)\n", l->nid, l, l->size);
-  cur = l->head;
+  cur = l->head[0];
   while(cur)
   {
     printf("  0x%lu - 0x%lu\n", cur->mem.low, cur->mem.high);
-    cur = cur->next;
+    cur = cur->next[0];
   }
   pthread_mutex_unlock(&l->lock);
 }
-
@@ -30,6 +30,21 @@ static char __attribute__((aligned(PAGESZ))) data[20][PAGESZ];
     } \
   })
 
+#define CHECK_NUM_EXECUTED( nid, num ) \
+  ({ \
+    size_t num_executed = popcorn_prefetch_execute_node(nid); \
+    if(num_executed == num) { \
+      printf("Passed: executed %d request(s) (%s:%d)\n", \
+             num, __FILE__, __LINE__); \
+    } \
+    else { \
+      printf("\nERROR: invalid number of executed requests -- " \
+             "expected %d but got %lu (%s:%d)\n", \
+             num, num_executed, __FILE__, __LINE__); \
+      exit(1); \
+    } \
+  })
+
 int main()
 {
   printf("My TID: %d\n", gettid());
@@ -73,6 +88,19 @@ int main()
   CHECK_NUM_REQUESTS(1, READ, 0);
   CHECK_NUM_REQUESTS(1, WRITE, 0);
 
+  // Writes take precedence over overlapping reads & releases, and reads over
+  // overlapping releases
+  popcorn_prefetch_node(0, READ, data[0], data[4]);
+  popcorn_prefetch_node(0, WRITE, data[1], data[2]);
+  popcorn_prefetch_node(0, RELEASE, data[3], data[6]);
+  CHECK_NUM_REQUESTS(0, READ, 1);
+  CHECK_NUM_REQUESTS(0, WRITE, 1);
+  CHECK_NUM_REQUESTS(0, RELEASE, 1);
+  CHECK_NUM_EXECUTED(0, 4);
+  CHECK_NUM_REQUESTS(0, READ, 0);
+  CHECK_NUM_REQUESTS(0, WRITE, 0);
+  CHECK_NUM_REQUESTS(0, RELEASE, 0);
+
   printf("\nSUCCESS - All tests passed!\n");
 
   return 0;
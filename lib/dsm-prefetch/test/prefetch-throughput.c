@@ -0,0 +1,109 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "dsm-prefetch.h"
+#include "platform.h"
+
+/*
+ * Measure prefetch request insertion throughput as the number of threads
+ * increases.  Each thread issues single-page read requests interleaved with
+ * the other threads' requests and separated by a gap so that spans never
+ * merge, i.e., the node's read list grows to threads * requests spans.
+ */
+
+#define DEFAULT_MAX_THREADS 8
+#define DEFAULT_REQUESTS 20000
+
+#define NS( ts ) ((ts.tv_sec * 1000000000UL) + ts.tv_nsec)
+
+static pthread_barrier_t barrier;
+static char *region;
+static size_t num_threads, num_requests;
+
+static void *insert_requests(void *arg)
+{
+  size_t i, tid = (size_t)arg, page;
+
+  pthread_barrier_wait(&barrier);
+  for(i = 0; i < num_requests; i++)
+  {
+    page = (i * num_threads + tid) * 2;
+    popcorn_prefetch(READ, region + page * PAGESZ,
+                     region + (page + 1) * PAGESZ);
+  }
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  size_t max_threads = DEFAULT_MAX_THREADS, i, got, region_size;
+  pthread_t *threads;
+  struct timespec start, end;
+  double secs;
+
+  if(argc > 1) max_threads = atol(argv[1]);
+  if(argc > 2) num_requests = atol(argv[2]);
+  else num_requests = DEFAULT_REQUESTS;
+  if(!max_threads || !num_requests)
+  {
+    printf("Usage: %s [ max threads ] [ requests per thread ]\n", argv[0]);
+    return 1;
+  }
+
+  // Reserve (but don't populate) enough address space for every request
+  region_size = max_threads * num_requests * 2 * PAGESZ;
+  region = mmap(NULL, region_size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if(region == MAP_FAILED)
+  {
+    printf("Could not reserve %lu bytes\n", region_size);
+    return 1;
+  }
+
+  threads = malloc(sizeof(pthread_t) * max_threads);
+  if(!threads)
+  {
+    printf("Could not allocate thread handles\n");
+    return 1;
+  }
+
+  printf("%8s %10s %14s %12s\n",
+         "Threads", "Requests", "Time (ns)", "Mreq/s");
+  for(num_threads = 1; num_threads <= max_threads; num_threads *= 2)
+  {
+    pthread_barrier_init(&barrier, NULL, num_threads + 1);
+    for(i = 0; i < num_threads; i++)
+      pthread_create(&threads[i], NULL, insert_requests, (void *)i);
+
+    // Time includes flushing each thread's staged requests at thread exit
+    pthread_barrier_wait(&barrier);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(i = 0; i < num_threads; i++) pthread_join(threads[i], NULL);
+    got = popcorn_prefetch_num_requests(current_nid(), READ);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    pthread_barrier_destroy(&barrier);
+
+    if(got != num_threads * num_requests)
+    {
+      printf("\nERROR: invalid number of requests -- "
+             "expected %lu but got %lu\n", num_threads * num_requests, got);
+      return 1;
+    }
+
+    secs = (double)(NS(end) - NS(start)) / 1e9;
+    printf("%8lu %10lu %14lu %12.3f\n", num_threads, got,
+           NS(end) - NS(start), (double)got / secs / 1e6);
+
+    popcorn_prefetch_execute();
+  }
+
+  free(threads);
+  munmap(region, region_size);
+
+  return 0;
+}
@@ -1,7 +1,9 @@
 #include <iostream>
 #include <iomanip>
 #include <fstream>
+#include <sstream>
 #include <list>
+#include <vector>
 #include <stdlib.h>
 #include <stdint.h>
 #include <unistd.h>
@@ -12,11 +14,19 @@ using namespace std;
 
 string map_fn = "htm-abort.map";
 string counter_fn = "htm-abort.ctr";
+string series_fn = "";
+bool per_thread = false;
+
+/* Counters for a single thread */
+struct thread_counters {
+  long tid;
+  vector<uint64_t> counters;
+};
 
 void parse_args(int argc, char **argv) {
   int c;
 
-  while((c = getopt(argc, argv, "m:c:h")) != -1) {
+  while((c = getopt(argc, argv, "m:c:s:th")) != -1) {
     switch(c) {
     case 'h':
       cout << argv[0] << " -- parse & display counter data\n\n"
@@ -24,11 +34,16 @@ void parse_args(int argc, char **argv) {
            << "  -m name : map filename printed by compiler "
            << "(default: '" << map_fn << "')\n"
            << "  -c name : counter filename generated by application "
-           << "(default: '" << counter_fn << "')\n";
+           << "(default: '" << counter_fn << "')\n"
+           << "  -t      : print per-thread counters\n"
+           << "  -s name : print per-interval abort rates from time series "
+           << "file generated by application (ABORT_PROF_INTERVAL)\n";
       exit(0);
       break;
     case 'm': map_fn = optarg; break;
     case 'c': counter_fn = optarg; break;
+    case 't': per_thread = true; break;
+    case 's': series_fn = optarg; break;
     default:
       cerr << "WARNING: Unknown argument '" << c << "'\n";
       break;
@@ -59,9 +74,22 @@ size_t parse_map_file(list<string> &basic_blocks) {
   return longest;
 }
 
-void parse_counter_file(list<uint64_t> &counters) {
-  ifstream fp(counter_fn.c_str());
+void read_counters(istream &is, vector<uint64_t> &counters) {
   uint64_t counter;
+  counters.clear();
+  while(is >> counter) counters.push_back(counter);
+}
+
+/*
+ * Parse the counter file.  Files contain a sample period, the merged counters
+ * and each thread's counters on separate lines.  Older files contain only a
+ * single line of counters.
+ */
+void parse_counter_file(vector<uint64_t> &counters,
+                        list<thread_counters> &threads,
+                        uint32_t &period) {
+  ifstream fp(counter_fn.c_str());
+  string line, type;
 
   if(!fp.is_open() || !fp.good()) {
     cerr << "WARNING: Could not open counter file '" << counter_fn << "'!\n";
@@ -69,32 +97,134 @@ void parse_counter_file(list<uint64_t> &counters) {
   }
 
   counters.clear();
-  fp >> counter;
-  while(!fp.eof()) {
-    counters.push_back(counter);
-    counter = UINT64_MAX;
-    fp >> counter;
+  threads.clear();
+  period = 1;
+  while(getline(fp, line)) {
+    stringstream ss(line);
+    if(!(ss >> type)) continue;
+    if(type == "period") ss >> period;
+    else if(type == "merged") read_counters(ss, counters);
+    else if(type == "thread") {
+      threads.push_back(thread_counters());
+      ss >> threads.back().tid;
+      read_counters(ss, threads.back().counters);
+    }
+    else {
+      stringstream old(line);
+      read_counters(old, counters);
+    }
+  }
+
+  fp.close();
+}
+
+bool read_varint(istream &is, uint64_t &val) {
+  int c, shift;
+
+  val = 0;
+  for(shift = 0; shift < 64; shift += 7) {
+    if((c = is.get()) == EOF) return false;
+    val |= (uint64_t)(c & 0x7f) << shift;
+    if(!(c & 0x80)) return true;
+  }
+  return false;
+}
+
+/*
+ * Stream the time series file & print the abort rate for each interval along
+ * with the basic block that aborted most frequently in that interval.
+ */
+void print_series(const vector<string> &basic_blocks) {
+  ifstream fp(series_fn.c_str(), ios::in | ios::binary);
+  char magic[4];
+  uint64_t version, num_ctrs, period, interval, num_snaps, ts, prev_ts,
+           changed, idx, delta, total, hottest, hottest_ctr, i, j;
+  double secs;
+
+  if(!fp.is_open() || !fp.good()) {
+    cerr << "WARNING: Could not open time series file '" << series_fn
+         << "'!\n";
+    exit(3);
+  }
+
+  if(!fp.read(magic, 4) || string(magic, 4) != "HTMS" ||
+     !read_varint(fp, version) || version != 1 ||
+     !read_varint(fp, num_ctrs) || !read_varint(fp, period) ||
+     !read_varint(fp, interval) || !read_varint(fp, num_snaps)) {
+    cerr << "WARNING: Invalid time series file '" << series_fn << "'!\n";
+    exit(3);
   }
-  if(counter != UINT64_MAX) counters.push_back(counter);
+
+  cout << "\nAbort rates (" << interval / 1000000 << " ms intervals):\n";
+  cout << left << setw(14) << "Time (ms):" << setw(14) << "Aborts:"
+       << setw(16) << "Aborts/s:" << "Hottest block:" << endl;
+  for(i = 0, prev_ts = UINT64_MAX; i < num_snaps; i++) {
+    if(!read_varint(fp, ts) || !read_varint(fp, changed)) break;
+    for(j = 0, idx = 0, total = 0, hottest = 0, hottest_ctr = 0;
+        j < changed; j++) {
+      if(!read_varint(fp, delta)) break;
+      idx += delta;
+      if(!read_varint(fp, delta)) break;
+      delta *= period;
+      total += delta;
+      if(delta > hottest) {
+        hottest = delta;
+        hottest_ctr = idx;
+      }
+    }
+    if(j < changed) break;
+
+    secs = (double)(prev_ts == UINT64_MAX || ts < prev_ts ? interval
+                                                          : ts - prev_ts) / 1e9;
+    prev_ts = ts;
+    cout << left << setw(14) << ts / 1000000 << setw(14) << total
+         << setw(16) << (uint64_t)(secs > 0 ? total / secs : 0);
+    if(hottest) {
+      if(hottest_ctr < basic_blocks.size())
+        cout << basic_blocks[hottest_ctr];
+      else cout << "counter " << hottest_ctr;
+      cout << " (" << hottest << ")";
+    }
+    cout << "\n";
+  }
+  if(i < num_snaps)
+    cerr << "WARNING: time series file '" << series_fn << "' is truncated!\n";
 
   fp.close();
 }
 
 int main(int argc, char **argv) {
   list<string> basic_blocks;
-  list<uint64_t> counters;
-  size_t longest;
+  vector<uint64_t> counters;
+  list<thread_counters> threads;
+  list<thread_counters>::const_iterator thit;
+  uint32_t period;
+  size_t longest, i;
 
   parse_args(argc, argv);
   longest = parse_map_file(basic_blocks);
-  parse_counter_file(counters);
+  parse_counter_file(counters, threads, period);
+
+  if(period > 1)
+    cout << "Sampled 1 in " << period << " aborts, counters are estimates\n";
+  if(!threads.empty()) cout << threads.size() << " thread(s) aborted\n";
 
   list<string>::const_iterator bbit = basic_blocks.begin();
-  list<uint64_t>::const_iterator ctrit = counters.begin();
-  cout << left << setw(longest + 3) << "Basic block:" << "Counter:" << endl;
-  for(; bbit != basic_blocks.end(); bbit++, ctrit++)
-    cout << left << setw(longest + 3) << *bbit << *ctrit << "\n";
+  cout << left << setw(longest + 3) << "Basic block:" << setw(14) << "Counter:";
+  if(per_thread)
+    for(thit = threads.begin(); thit != threads.end(); thit++)
+      cout << setw(14) << ("TID " + to_string(thit->tid) + ":");
+  cout << endl;
+  for(i = 0; bbit != basic_blocks.end() && i < counters.size(); bbit++, i++) {
+    cout << left << setw(longest + 3) << *bbit << setw(14) << counters[i];
+    if(per_thread)
+      for(thit = threads.begin(); thit != threads.end(); thit++)
+        cout << setw(14) << (i < thit->counters.size() ? thit->counters[i] : 0);
+    cout << "\n";
+  }
+
+  if(series_fn != "")
+    print_series(vector<string>(basic_blocks.begin(), basic_blocks.end()));
 
   return 0;
 }
-
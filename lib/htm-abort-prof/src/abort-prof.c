@@ -1,36 +1,333 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
 
 /* Users can override output data file by setting this environment variable. */
 #define ENV_ABORT_PROF_FILE "ABORT_PROF_FN"
 
+/*
+ * Time-series capture.  If ABORT_PROF_INTERVAL is set to a number of
+ * milliseconds, a thread snapshots the counters every interval & records the
+ * per-interval deltas in a ring of the most recent ABORT_PROF_RING snapshots,
+ * which is written to ABORT_PROF_SERIES_FN at exit.
+ */
+#define ENV_ABORT_PROF_INTERVAL "ABORT_PROF_INTERVAL"
+#define ENV_ABORT_PROF_RING "ABORT_PROF_RING"
+#define ENV_ABORT_PROF_SERIES_FILE "ABORT_PROF_SERIES_FN"
+#define DEFAULT_RING 4096
+
+/* Maximum number of counters the LLVM pass will insert */
+#define MAX_ABORT_COUNTERS 1024
+
 /* The LLVM pass *must* insert definitions for these */
-uint64_t __attribute__((weak)) __abort_counters[] = { 0 };
 volatile uint32_t __attribute__((weak)) __num_abort_counters = UINT32_MAX;
+volatile uint32_t __attribute__((weak)) __abort_sample_period = 1;
+
+/*
+ * Per-thread counters.  Each thread bumps counters in its own cache-line
+ * aligned shard, so aborting threads never bounce counter cache lines between
+ * cores; shards are merged when dumping the counters.  Shards are never freed,
+ * as threads may exit before the application.
+ */
+typedef struct shard {
+  uint64_t counters[MAX_ABORT_COUNTERS];
+  pid_t tid;
+  uint32_t countdown; /* Aborts until the next sample */
+  struct shard *next;
+} __attribute__((aligned(64))) shard_t;
+
+static shard_t *shards = NULL;
+static __thread shard_t *my_shard = NULL;
+
+static shard_t *create_shard() {
+  shard_t *shard;
+
+  if(posix_memalign((void **)&shard, 64, sizeof(shard_t))) return NULL;
+  memset(shard, 0, sizeof(shard_t));
+  shard->tid = syscall(SYS_gettid);
+  shard->countdown = __abort_sample_period;
+  shard->next = __atomic_load_n(&shards, __ATOMIC_RELAXED);
+  while(!__atomic_compare_exchange_n(&shards, &shard->next, shard, true,
+                                     __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+  my_shard = shard;
+  return shard;
+}
+
+/* Called by abort handlers instrumented by the LLVM pass */
+void __abort_count(uint32_t ctr) {
+  shard_t *shard = my_shard;
+
+  if(!shard && !(shard = create_shard())) return;
+  if(ctr >= MAX_ABORT_COUNTERS) return;
+  if(--shard->countdown) return;
+  shard->countdown = __abort_sample_period;
+
+  /* Plain increment, but visible to the snapshot thread without tearing */
+  __atomic_store_n(&shard->counters[ctr],
+                   __atomic_load_n(&shard->counters[ctr], __ATOMIC_RELAXED) + 1,
+                   __ATOMIC_RELAXED);
+}
+
+/*
+ * Time-series ring.  Each snapshot is encoded as LEB128 varints:
+ *
+ *   <ns since start> <# of changed counters>
+ *   { <counter index delta from previous changed counter> <count delta> }*
+ *
+ * The series file contains the magic "HTMS" followed by varints:
+ *
+ *   <version> <# of counters> <sample period> <interval (ns)> <# of snapshots>
+ *   <snapshot>*
+ *
+ * Counts are raw, i.e., must be scaled by the sample period.
+ */
+#define SERIES_MAGIC "HTMS"
+#define SERIES_VERSION 1
+
+typedef struct {
+  uint8_t *data;
+  size_t len;
+} snapshot_t;
+
+static struct {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  bool running, stop;
+  uint64_t interval, start;
+  uint64_t *prev;
+  snapshot_t *ring;
+  size_t ring_size, num, next;
+} series = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .cond = PTHREAD_COND_INITIALIZER,
+};
+
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static size_t put_varint(uint8_t *buf, uint64_t val) {
+  size_t len = 0;
+  while(val >= 0x80) {
+    buf[len++] = (uint8_t)(val | 0x80);
+    val >>= 7;
+  }
+  buf[len++] = (uint8_t)val;
+  return len;
+}
+
+static void take_snapshot(uint32_t num) {
+  uint64_t cur, delta, changed = 0;
+  uint32_t i, last = 0;
+  size_t len = 0, hdr_len;
+  uint8_t *buf, *data, hdr[20];
+  shard_t *shard, *head = __atomic_load_n(&shards, __ATOMIC_ACQUIRE);
+  snapshot_t *snap;
+
+  /* Worst case every counter changed: 5 bytes index + 10 bytes count each */
+  buf = malloc(num * 15 + 1);
+  if(!buf) return;
+  for(i = 0; i < num; i++) {
+    for(cur = 0, shard = head; shard; shard = shard->next)
+      cur += __atomic_load_n(&shard->counters[i], __ATOMIC_RELAXED);
+    if((delta = cur - series.prev[i])) {
+      len += put_varint(buf + len, i - last);
+      len += put_varint(buf + len, delta);
+      last = i;
+      changed++;
+    }
+    series.prev[i] = cur;
+  }
+
+  /* Prepend the timestamp & number of changed counters */
+  hdr_len = put_varint(hdr, now_ns() - series.start);
+  hdr_len += put_varint(hdr + hdr_len, changed);
+  if(!(data = malloc(hdr_len + len))) {
+    free(buf);
+    return;
+  }
+  memcpy(data, hdr, hdr_len);
+  memcpy(data + hdr_len, buf, len);
+  free(buf);
+
+  snap = &series.ring[series.next];
+  free(snap->data);
+  snap->data = data;
+  snap->len = hdr_len + len;
+
+  series.next = (series.next + 1) % series.ring_size;
+  if(series.num < series.ring_size) series.num++;
+}
+
+static void *snapshot_thread(void *arg) {
+  struct timespec deadline;
+  uint64_t next = series.start;
+
+  pthread_mutex_lock(&series.lock);
+  while(!series.stop) {
+    next += series.interval;
+    deadline.tv_sec = next / 1000000000ULL;
+    deadline.tv_nsec = next % 1000000000ULL;
+    while(!series.stop &&
+          !pthread_cond_timedwait(&series.cond, &series.lock, &deadline));
+    take_snapshot(__num_abort_counters);
+  }
+  pthread_mutex_unlock(&series.lock);
+  return NULL;
+}
+
+static void __attribute__((constructor)) __start_abort_snapshots() {
+  const char *env;
+  unsigned long ms;
+  pthread_condattr_t attr;
+
+  if(__num_abort_counters == UINT32_MAX ||
+     __num_abort_counters > MAX_ABORT_COUNTERS) return;
+  if(!(env = getenv(ENV_ABORT_PROF_INTERVAL)) ||
+     !(ms = strtoul(env, NULL, 10))) return;
 
+  series.ring_size = DEFAULT_RING;
+  if((env = getenv(ENV_ABORT_PROF_RING)) && strtoul(env, NULL, 10))
+    series.ring_size = strtoul(env, NULL, 10);
+  series.interval = ms * 1000000ULL;
+  series.prev = calloc(MAX_ABORT_COUNTERS, sizeof(uint64_t));
+  series.ring = calloc(series.ring_size, sizeof(snapshot_t));
+  if(!series.prev || !series.ring) {
+    fprintf(stderr, "WARNING: couldn't allocate HTM abort snapshot ring!\n");
+    return;
+  }
+
+  /* Deadlines are computed from CLOCK_MONOTONIC timestamps */
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&series.cond, &attr);
+  pthread_condattr_destroy(&attr);
+
+  series.start = now_ns();
+  if(pthread_create(&series.thread, NULL, snapshot_thread, NULL)) {
+    fprintf(stderr, "WARNING: couldn't start HTM abort snapshot thread!\n");
+    return;
+  }
+  series.running = true;
+}
+
+static void stop_snapshots() {
+  size_t i, idx;
+  uint8_t buf[60];
+  size_t len;
+  const char *fn = "htm-abort.series", *env;
+  FILE *fp;
+
+  pthread_mutex_lock(&series.lock);
+  series.stop = true;
+  pthread_cond_signal(&series.cond);
+  pthread_mutex_unlock(&series.lock);
+  pthread_join(series.thread, NULL);
+
+  if((env = getenv(ENV_ABORT_PROF_SERIES_FILE))) fn = env;
+  if(!(fp = fopen(fn, "wb"))) {
+    fprintf(stderr, "WARNING: couldn't open '%s' to write "
+                    "HTM abort time series!\n", fn);
+    return;
+  }
+
+  printf(" [ Printing %lu snapshots to '%s' ]\n", series.num, fn);
+
+  memcpy(buf, SERIES_MAGIC, 4);
+  len = 4;
+  len += put_varint(buf + len, SERIES_VERSION);
+  len += put_varint(buf + len, __num_abort_counters);
+  len += put_varint(buf + len, __abort_sample_period);
+  len += put_varint(buf + len, series.interval);
+  len += put_varint(buf + len, series.num);
+  if(fwrite(buf, 1, len, fp) != len) goto error;
+
+  /* Oldest snapshot first */
+  idx = (series.next + series.ring_size - series.num) % series.ring_size;
+  for(i = 0; i < series.num; i++, idx = (idx + 1) % series.ring_size) {
+    if(fwrite(series.ring[idx].data, 1, series.ring[idx].len, fp) !=
+       series.ring[idx].len) goto error;
+    free(series.ring[idx].data);
+  }
+
+  fclose(fp);
+  return;
+
+error:
+  fprintf(stderr, "WARNING: couldn't write HTM abort time series!\n");
+  fclose(fp);
+}
+
+static int write_counters(FILE *fp, const uint64_t *counters, uint32_t num,
+                          uint64_t scale) {
+  uint32_t i;
+  for(i = 0; i < num; i++)
+    if(fprintf(fp, " %lu", counters[i] * scale) < 0) return 0;
+  return fprintf(fp, "\n") >= 0;
+}
+
+/*
+ * Dump counters, one line per record:
+ *
+ *   period <sample period>
+ *   merged <counter 0> <counter 1> ...
+ *   thread <tid> <counter 0> <counter 1> ...
+ *
+ * When sampling, counts are scaled by the sample period to estimate the
+ * actual number of aborts.
+ */
 void __attribute__((destructor)) __dump_abort_loc_ctrs() {
   if(__num_abort_counters == UINT32_MAX) return;
+  if(series.running) stop_snapshots();
 
+  uint32_t i, num = __num_abort_counters, period = __abort_sample_period;
+  uint64_t *merged;
+  shard_t *shard, *head = __atomic_load_n(&shards, __ATOMIC_ACQUIRE);
   const char *fn = "htm-abort.ctr", *env;
   if((env = getenv(ENV_ABORT_PROF_FILE))) fn = env;
+  if(num > MAX_ABORT_COUNTERS) num = MAX_ABORT_COUNTERS;
+  if(!period) period = 1;
+
+  merged = calloc(num ? num : 1, sizeof(uint64_t));
+  if(!merged) {
+    fprintf(stderr, "WARNING: couldn't allocate merged HTM abort counters!\n");
+    return;
+  }
+  for(shard = head; shard; shard = shard->next)
+    for(i = 0; i < num; i++) merged[i] += shard->counters[i];
+
   FILE *fp = fopen(fn, "w");
   if(!fp) {
     fprintf(stderr, "WARNING: couldn't open '%s' to write"
                     "HTM abort counter data!\n", fn);
+    free(merged);
     return;
   }
 
-  printf(" [ Printing %u counters to '%s' ]\n", __num_abort_counters, fn);
+  printf(" [ Printing %u counters to '%s' ]\n", num, fn);
 
-  uint32_t i;
-  for(i = 0; i < __num_abort_counters; i++) {
-    if(!fprintf(fp, "%lu ", __abort_counters[i])) {
-      fprintf(stderr, "WARNING: couldn't write HTM abort counter data!\n");
-      return;
-    }
+  if(fprintf(fp, "period %u\nmerged", period) < 0 ||
+     !write_counters(fp, merged, num, period)) goto error;
+  for(shard = head; shard; shard = shard->next) {
+    if(fprintf(fp, "thread %d", shard->tid) < 0 ||
+       !write_counters(fp, shard->counters, num, period)) goto error;
   }
 
   fclose(fp);
-}
+  free(merged);
+  return;
 
+error:
+  fprintf(stderr, "WARNING: couldn't write HTM abort counter data!\n");
+  fclose(fp);
+  free(merged);
+}
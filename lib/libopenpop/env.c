@@ -1371,11 +1371,22 @@ handle_omp_display_env (unsigned long stacksize, int wait_policy)
                popcorn_global.hybrid_barrier ? "TRUE" : "FALSE");
       fprintf (stderr, "  POPCORN_HYBRID_REDUCE = %s\n",
                popcorn_global.hybrid_reduce ? "TRUE" : "FALSE");
+      fprintf (stderr, "  POPCORN_REDUCTION_ARITY = %lu\n",
+               popcorn_reduction_arity);
       fprintf (stderr, "  POPCORN_PROBE_PERCENT = %.2f\n",
                popcorn_probe_percent);
       fprintf (stderr, "  POPCORN_MAX_PROBES = %lu\n", popcorn_max_probes);
       fprintf (stderr, "  POPCORN_LOG_STATISTICS = %d\n",
                popcorn_log_statistics);
+      fprintf (stderr, "  POPCORN_HETPROBE_CONTINUOUS = %s\n",
+               popcorn_hetprobe_continuous ? "TRUE" : "FALSE");
+      fprintf (stderr, "  POPCORN_RESPLIT_THRESHOLD = %.2f\n",
+               popcorn_resplit_threshold);
+      fprintf (stderr, "  POPCORN_FAULT_COUNTERS = '%s'\n",
+               popcorn_fault_counters_name ());
+      if (getenv ("POPCORN_WORKSHARE_CACHE"))
+        fprintf (stderr, "  POPCORN_WORKSHARE_CACHE = '%s'\n",
+                 getenv ("POPCORN_WORKSHARE_CACHE"));
       if (popcorn_prime_region)
         {
           fprintf(stderr, "  POPCORN_PRIME_REGION = %s\n",
@@ -1527,6 +1538,9 @@ initialize_env (void)
 	gomp_throttled_spin_count_var = gomp_spin_count_var;
       parse_boolean("POPCORN_HYBRID_BARRIER", &popcorn_global.hybrid_barrier);
       parse_boolean("POPCORN_HYBRID_REDUCE", &popcorn_global.hybrid_reduce);
+      if (!parse_unsigned_long("POPCORN_REDUCTION_ARITY",
+                               &popcorn_reduction_arity, false))
+        popcorn_reduction_arity = REDUCTION_TREE_ARITY;
       popcorn_global.het_workshare =
         parse_het_workshare_var("POPCORN_HET_WORKSHARE");
       if (!parse_float("POPCORN_PROBE_PERCENT", &popcorn_probe_percent))
@@ -1544,7 +1558,25 @@ initialize_env (void)
         popcorn_max_probes = UINT64_MAX;
       popcorn_log_statistics = false;
       parse_boolean("POPCORN_LOG_STATISTICS", &popcorn_log_statistics);
+      popcorn_hetprobe_continuous = false;
+      parse_boolean("POPCORN_HETPROBE_CONTINUOUS",
+                    &popcorn_hetprobe_continuous);
+      if (!parse_float("POPCORN_RESPLIT_THRESHOLD",
+                       &popcorn_resplit_threshold))
+        popcorn_resplit_threshold = 0.1;
+      else
+        {
+          if (popcorn_resplit_threshold <= 0.0
+              || popcorn_resplit_threshold >= 1.0)
+            {
+              gomp_error("Invalid value for POPCORN_RESPLIT_THRESHOLD");
+              popcorn_resplit_threshold = 0.1;
+            }
+        }
+      if (!popcorn_init_fault_counters(getenv("POPCORN_FAULT_COUNTERS")))
+        gomp_error("Invalid value for POPCORN_FAULT_COUNTERS");
       popcorn_init_workshare_cache(128);
+      popcorn_load_workshare_cache(getenv("POPCORN_WORKSHARE_CACHE"));
       popcorn_prime_region = getenv("POPCORN_PRIME_REGION");
       if (!parse_int("POPCORN_PREFERRED_NODE", &popcorn_preferred_node, true))
         popcorn_preferred_node = 0;
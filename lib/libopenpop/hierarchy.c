@@ -5,7 +5,12 @@
  */
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
 #include <math.h>
 #include <assert.h>
 #include <float.h>
@@ -193,6 +198,8 @@ void hierarchy_clear_node_team_state(int nid)
 
 /* Note: the main thread should already have initialized this node's
    synchronization data structures! */
+static void init_fault_counters(int nid);
+
 void hierarchy_init_thread(int nid)
 {
   size_t i, start = popcorn_node[nid].ns.ts.team_id;
@@ -227,6 +234,7 @@ void hierarchy_init_thread(int nid)
       nthr->data = data;
     }
     popcorn_node[nid].ns.fn = NULL;
+    init_fault_counters(nid);
     hierarchy_leader_cleanup(&popcorn_node[nid].sync);
   }
   gomp_team_barrier_wait(&popcorn_node[nid].bar);
@@ -295,37 +303,23 @@ void hierarchy_hybrid_barrier_final(int nid)
 // Reductions
 ///////////////////////////////////////////////////////////////////////////////
 
+size_t popcorn_reduction_arity = REDUCTION_TREE_ARITY;
+
+/* Per-node combining tree slots, indexed by a thread's position in the tree.
+   Kept out of node_info_t as they don't fit in its page. */
+static aligned_void_ptr ALIGN_PAGE
+reduction_tree[MAX_POPCORN_NODES][REDUCTION_TREE_MAX];
+
 static inline bool
-hierarchy_reduce_leader(int nid,
+hierarchy_reduce_global(int nid,
                         void *reduce_data,
                         void (*reduce_func)(void *lhs, void *rhs))
 {
   bool global_leader;
-  size_t i, reduced = 1, nthreads = popcorn_node[nid].opt.num, max_entry;
+  size_t i, reduced;
   void *thr_data;
 
-  /* First, reduce from all threads locally.  The basic strategy is to loop
-     through all reduction entries, waiting for a thread to populate it with
-     data.  Keep looping until all local threads have been combined. */
-  max_entry = nthreads < REDUCTION_ENTRIES ? nthreads : REDUCTION_ENTRIES;
-  while(reduced < nthreads)
-  {
-    // TODO only execute this a set number of times then donate leadership?
-    for(i = 0; i < max_entry; i++)
-    {
-      thr_data = __atomic_load_n(&popcorn_node[nid].reductions[i].p,
-                                 MEMMODEL_ACQUIRE);
-      if(!thr_data) continue;
-
-      reduce_func(reduce_data, thr_data);
-      __atomic_store_n(&popcorn_node[nid].reductions[i].p, NULL,
-                       MEMMODEL_RELEASE);
-      reduced++;
-      thr_data = NULL;
-    }
-  }
-
-  /* Now, select a global leader & do the same thing on the global data. */
+  /* Select a global leader & reduce each node's data. */
   global_leader = select_leader_optimistic(&popcorn_global.opt, NULL);
   if(global_leader)
   {
@@ -354,21 +348,51 @@ hierarchy_reduce_leader(int nid,
   return global_leader;
 }
 
-static inline void
-hierarchy_reduce_local(int nid, size_t ticket, void *reduce_data)
+static inline bool
+hierarchy_reduce_leader(int nid,
+                        void *reduce_data,
+                        void (*reduce_func)(void *lhs, void *rhs))
+{
+  size_t i, reduced = 1, nthreads = popcorn_node[nid].opt.num, max_entry;
+  void *thr_data;
+
+  /* First, reduce from all threads locally.  The basic strategy is to loop
+     through all reduction entries, waiting for a thread to populate it with
+     data.  Keep looping until all local threads have been combined. */
+  max_entry = nthreads < REDUCTION_ENTRIES ? nthreads : REDUCTION_ENTRIES;
+  while(reduced < nthreads)
+  {
+    // TODO only execute this a set number of times then donate leadership?
+    for(i = 0; i < max_entry; i++)
+    {
+      thr_data = __atomic_load_n(&popcorn_node[nid].reductions[i].p,
+                                 MEMMODEL_ACQUIRE);
+      if(!thr_data) continue;
+
+      reduce_func(reduce_data, thr_data);
+      __atomic_store_n(&popcorn_node[nid].reductions[i].p, NULL,
+                       MEMMODEL_RELEASE);
+      reduced++;
+      thr_data = NULL;
+    }
+  }
+
+  return hierarchy_reduce_global(nid, reduce_data, reduce_func);
+}
+
+/* Make reduction data available in a slot, waiting for the slot's previous
+   data to be consumed. */
+static inline void publish_reduce_data(aligned_void_ptr *slot,
+                                       void *reduce_data)
 {
   bool set = false;
   void *expected;
   unsigned long long i;
 
-  /* All we need to do is make our reduction data available to the per-node
-     leader (it's the leader's job to clean up).  However, we could be sharing
-     a reduction entry on manycore machines so spin until it's open. */
-  ticket %= REDUCTION_ENTRIES;
   while(true)
   {
     expected = NULL;
-    set = __atomic_compare_exchange_n(&popcorn_node[nid].reductions[ticket].p,
+    set = __atomic_compare_exchange_n(&slot->p,
                                       &expected,
                                       reduce_data,
                                       false,
@@ -379,13 +403,63 @@ hierarchy_reduce_local(int nid, size_t ticket, void *reduce_data)
     /* Spin for a bit (adapted from "config/linux/wait.h") */
     for(i = 0; i < gomp_spin_count_var; i++)
     {
-      if(__atomic_load_n(&popcorn_node[nid].reductions[ticket].p,
-                         MEMMODEL_RELAXED) == NULL) break;
+      if(__atomic_load_n(&slot->p, MEMMODEL_RELAXED) == NULL) break;
       else __asm volatile("" : : : "memory");
     }
   }
 }
 
+static inline void
+hierarchy_reduce_local(int nid, size_t ticket, void *reduce_data)
+{
+  /* All we need to do is make our reduction data available to the per-node
+     leader (it's the leader's job to clean up).  However, we could be sharing
+     a reduction entry on manycore machines so spin until it's open. */
+  publish_reduce_data(&popcorn_node[nid].reductions[ticket % REDUCTION_ENTRIES],
+                      reduce_data);
+}
+
+/*
+ * Combining-tree reduction.  Threads are placed in a k-ary tree in arrival
+ * order, i.e., the leader (first to arrive) is the root and thread at position
+ * p has children at positions k*p+1 ... k*p+k.  Each thread combines its
+ * children's data into its own and hands the result to its parent, so the
+ * leader only combines k partial results rather than every thread's data.
+ */
+static inline bool
+hierarchy_reduce_tree(int nid,
+                      size_t pos,
+                      void *reduce_data,
+                      void (*reduce_func)(void *lhs, void *rhs))
+{
+  size_t child, last, nthreads = popcorn_node[nid].opt.num,
+         arity = popcorn_reduction_arity;
+  aligned_void_ptr *slots = reduction_tree[nid];
+  void *thr_data;
+
+  last = arity * pos + arity;
+  if(last >= nthreads) last = nthreads - 1;
+  for(child = arity * pos + 1; child <= last; child++)
+  {
+    while(!(thr_data = __atomic_load_n(&slots[child].p, MEMMODEL_ACQUIRE)))
+      __asm volatile("" : : : "memory");
+    reduce_func(reduce_data, thr_data);
+    __atomic_store_n(&slots[child].p, NULL, MEMMODEL_RELEASE);
+  }
+
+  if(pos) publish_reduce_data(&slots[pos], reduce_data);
+  else return hierarchy_reduce_global(nid, reduce_data, reduce_func);
+  return false;
+}
+
+/* Whether a node has enough threads to use the combining-tree reduction */
+static inline bool use_reduce_tree(int nid)
+{
+  size_t nthreads = popcorn_node[nid].opt.num;
+  return popcorn_reduction_arity > 1 && nthreads > REDUCTION_ENTRIES &&
+         nthreads <= REDUCTION_TREE_MAX;
+}
+
 bool hierarchy_reduce(int nid,
                       void *reduce_data,
                       void (*reduce_func)(void *lhs, void *rhs))
@@ -394,7 +468,16 @@ bool hierarchy_reduce(int nid,
   size_t ticket;
 
   leader = select_leader_optimistic(&popcorn_node[nid].opt, &ticket);
-  if(leader)
+  if(use_reduce_tree(nid))
+  {
+    /* Tickets count down from the number of threads, so the leader's position
+       in the tree is zero */
+    leader = hierarchy_reduce_tree(nid, popcorn_node[nid].opt.num - 1 - ticket,
+                                   reduce_data, reduce_func);
+    if(ticket == popcorn_node[nid].opt.num - 1)
+      hierarchy_leader_cleanup(&popcorn_node[nid].opt);
+  }
+  else if(leader)
   {
     leader = hierarchy_reduce_leader(nid, reduce_data, reduce_func);
     hierarchy_leader_cleanup(&popcorn_node[nid].opt);
@@ -431,8 +514,35 @@ typedef struct workshare_csr
   float uspf;
   float scaled_thread_range;
   float core_speed_rating[MAX_POPCORN_NODES];
+
+  /* Continuous mode: whether the current invocation uses cached splits rather
+     than probing, the iteration type of the current invocation, exponentially
+     weighted per-thread throughput (iterations/us) for each node, the most
+     recently measured imbalance & the number of times splits were
+     re-calculated */
+  bool use_splits;
+  bool ull;
+  float throughput[MAX_POPCORN_NODES];
+  float imbalance;
+  size_t resplits;
+
+  /* Hash of the thread placement with which the region was first probed, used
+     to match results saved by previous runs */
+  uint64_t placement;
 } workshare_csr_t;
 
+/* FNV-1a hash of a per-node thread placement */
+static uint64_t hash_places(const unsigned long *places)
+{
+  const unsigned char *p = (const unsigned char *)places;
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  size_t i;
+
+  for(i = 0; i < sizeof(unsigned long) * MAX_POPCORN_NODES; i++)
+    hash = (hash ^ p[i]) * 0x100000001b3ULL;
+  return hash;
+}
+
 typedef workshare_csr_t *hash_entry_type;
 static inline void *htab_alloc(size_t size) { return malloc(size); }
 static inline void htab_free(void *ptr) { free(ptr); }
@@ -456,6 +566,12 @@ static inline hash_entry_type new_hash_value(const void *ident)
   new_val->uspf = 0.0;
   new_val->scaled_thread_range = 0.0;
   memset(&new_val->core_speed_rating, 0, sizeof(float) * MAX_POPCORN_NODES);
+  new_val->use_splits = false;
+  new_val->ull = false;
+  memset(&new_val->throughput, 0, sizeof(float) * MAX_POPCORN_NODES);
+  new_val->imbalance = 0.0;
+  new_val->resplits = 0;
+  new_val->placement = hash_places(popcorn_global.threads_per_node);
   return new_val;
 }
 
@@ -465,6 +581,8 @@ void popcorn_init_workshare_cache(size_t size)
 size_t popcorn_max_probes;
 const char *popcorn_prime_region;
 int popcorn_preferred_node;
+bool popcorn_hetprobe_continuous;
+float popcorn_resplit_threshold;
 
 #ifndef _CACHE_HETPROBE
 /* If not using a cache, use a single global core speed rating struct which
@@ -478,6 +596,250 @@ static hash_entry_type get_entry(const void *ident)
   return htab_find(popcorn_global.workshare_cache, &tmp);
 }
 
+/************************ Persistent workshare cache *************************/
+
+/* Probing results can be saved across runs by setting POPCORN_WORKSHARE_CACHE
+   to a file name.  The file starts with a header identifying the binary &
+   node configuration for which the results were gathered, followed by one
+   record per region:
+
+     uint16_t ident length, ident string (not NUL-terminated),
+     uint64_t thread placement hash, uint32_t number of nodes N,
+     float uspf, float scaled thread range,
+     float core speed rating[N], float throughput[N]
+
+   The entire file is discarded if the binary or node configuration changed.
+   Records are matched to regions by ident string, as ident pointers differ
+   between runs, and are discarded if the region executes with a different
+   thread placement.  Regions are saved once they've been probed
+   POPCORN_MAX_PROBES times, and records not matched by a region in the current
+   run are written back unchanged. */
+
+#define WSCACHE_MAGIC 0x57534348U /* "WSCH" */
+#define WSCACHE_VERSION 1
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t exe_size;
+  uint64_t exe_mtime;
+  uint64_t config;
+  uint32_t num;
+} wscache_header_t;
+
+typedef struct wscache_record {
+  char *ident;
+  uint64_t placement;
+  uint32_t nodes;
+  float uspf;
+  float scaled_thread_range;
+  float core_speed_rating[MAX_POPCORN_NODES];
+  float throughput[MAX_POPCORN_NODES];
+  bool used; /* Matched by a region in this run, superseded by its entry */
+  struct wscache_record *next;
+} wscache_record_t;
+
+static const char *wscache_fn;
+static wscache_record_t *wscache_saved;
+
+static bool wscache_init_header(wscache_header_t *hdr)
+{
+  struct stat st;
+
+  memset(hdr, 0, sizeof(wscache_header_t));
+  if(stat("/proc/self/exe", &st)) return false;
+  hdr->magic = WSCACHE_MAGIC;
+  hdr->version = WSCACHE_VERSION;
+  hdr->exe_size = st.st_size;
+  hdr->exe_mtime = st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec;
+  hdr->config = hash_places(popcorn_global.node_places);
+  return true;
+}
+
+static void wscache_free_record(wscache_record_t *rec)
+{
+  free(rec->ident);
+  free(rec);
+}
+
+static wscache_record_t *wscache_read_record(FILE *fp)
+{
+  uint16_t len;
+  wscache_record_t *rec = calloc(1, sizeof(wscache_record_t));
+
+  if(!rec) return NULL;
+  if(fread(&len, sizeof(len), 1, fp) != 1 ||
+     !(rec->ident = malloc(len + 1)) ||
+     fread(rec->ident, 1, len, fp) != len ||
+     fread(&rec->placement, sizeof(rec->placement), 1, fp) != 1 ||
+     fread(&rec->nodes, sizeof(rec->nodes), 1, fp) != 1 ||
+     rec->nodes > MAX_POPCORN_NODES ||
+     fread(&rec->uspf, sizeof(float), 1, fp) != 1 ||
+     fread(&rec->scaled_thread_range, sizeof(float), 1, fp) != 1 ||
+     fread(rec->core_speed_rating, sizeof(float), rec->nodes, fp)
+       != rec->nodes ||
+     fread(rec->throughput, sizeof(float), rec->nodes, fp) != rec->nodes)
+  {
+    wscache_free_record(rec);
+    return NULL;
+  }
+  rec->ident[len] = '\0';
+  return rec;
+}
+
+static bool wscache_write_record(FILE *fp,
+                                 const char *ident,
+                                 uint64_t placement,
+                                 float uspf,
+                                 float scaled_thread_range,
+                                 const float *core_speed_rating,
+                                 const float *throughput)
+{
+  size_t len = strlen(ident);
+  uint16_t len16 = len;
+  uint32_t nodes;
+
+  if(len > UINT16_MAX) return false;
+  for(nodes = MAX_POPCORN_NODES; nodes > 0; nodes--)
+    if(core_speed_rating[nodes - 1] != 0.0 || throughput[nodes - 1] != 0.0)
+      break;
+
+  return fwrite(&len16, sizeof(len16), 1, fp) == 1 &&
+         fwrite(ident, 1, len, fp) == len &&
+         fwrite(&placement, sizeof(placement), 1, fp) == 1 &&
+         fwrite(&nodes, sizeof(nodes), 1, fp) == 1 &&
+         fwrite(&uspf, sizeof(float), 1, fp) == 1 &&
+         fwrite(&scaled_thread_range, sizeof(float), 1, fp) == 1 &&
+         fwrite(core_speed_rating, sizeof(float), nodes, fp) == nodes &&
+         fwrite(throughput, sizeof(float), nodes, fp) == nodes;
+}
+
+void popcorn_load_workshare_cache(const char *fn)
+{
+  FILE *fp;
+  wscache_header_t hdr, cur;
+  wscache_record_t *rec;
+  uint32_t i;
+
+  wscache_fn = fn;
+  if(!fn || !(fp = fopen(fn, "rb"))) return;
+
+  if(!wscache_init_header(&cur) ||
+     fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+     hdr.magic != cur.magic || hdr.version != cur.version ||
+     hdr.exe_size != cur.exe_size || hdr.exe_mtime != cur.exe_mtime ||
+     hdr.config != cur.config)
+  {
+    popcorn_log("Discarding stale workshare cache '%s'\n", fn);
+    fclose(fp);
+    return;
+  }
+
+  for(i = 0; i < hdr.num; i++)
+  {
+    if(!(rec = wscache_read_record(fp)))
+    {
+      popcorn_log("Truncated workshare cache '%s' (%u of %u records)\n",
+                  fn, i, hdr.num);
+      break;
+    }
+    rec->next = wscache_saved;
+    wscache_saved = rec;
+  }
+  fclose(fp);
+}
+
+/* Seed a newly-created entry from a previous run's results, if available.
+   Returns true if the region doesn't need to be probed. */
+static bool seed_from_saved(hash_entry_type ent)
+{
+  wscache_record_t *rec;
+
+  for(rec = wscache_saved; rec; rec = rec->next)
+    if(!rec->used && !strcmp(rec->ident, (const char *)ent->ident)) break;
+  if(!rec) return false;
+
+  /* Either way, this run's entry supersedes the saved record */
+  rec->used = true;
+  if(rec->placement != ent->placement) return false;
+
+  ent->trips = popcorn_max_probes;
+  ent->uspf = rec->uspf;
+  ent->scaled_thread_range = rec->scaled_thread_range;
+  memcpy(ent->core_speed_rating, rec->core_speed_rating,
+         sizeof(float) * rec->nodes);
+  memcpy(ent->throughput, rec->throughput, sizeof(float) * rec->nodes);
+  return true;
+}
+
+static void __attribute__((destructor))
+popcorn_save_workshare_cache(void)
+{
+  FILE *fp;
+  size_t i, fnlen;
+  char *tmpfn;
+  long num_pos;
+  wscache_header_t hdr;
+  wscache_record_t *rec, *next;
+  hash_entry_type ent;
+  htab_t htab = popcorn_global.workshare_cache;
+  bool ok;
+
+  if(!wscache_fn || !htab || !wscache_init_header(&hdr)) goto out;
+
+  /* Write to a temporary file & rename so concurrent runs never observe a
+     partially-written cache */
+  fnlen = strlen(wscache_fn);
+  if(!(tmpfn = malloc(fnlen + 5))) goto out;
+  memcpy(tmpfn, wscache_fn, fnlen);
+  memcpy(tmpfn + fnlen, ".tmp", 5);
+  if(!(fp = fopen(tmpfn, "wb")))
+  {
+    free(tmpfn);
+    goto out;
+  }
+
+  ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1;
+  for(i = 0; ok && i < htab->size; i++)
+  {
+    ent = htab->entries[i];
+    if(ent == HTAB_EMPTY_ENTRY || ent == HTAB_DELETED_ENTRY ||
+       ent->trips < popcorn_max_probes) continue;
+    ok = wscache_write_record(fp, (const char *)ent->ident, ent->placement,
+                              ent->uspf, ent->scaled_thread_range,
+                              ent->core_speed_rating, ent->throughput);
+    hdr.num++;
+  }
+  for(rec = wscache_saved; ok && rec; rec = rec->next)
+  {
+    if(rec->used) continue;
+    ok = wscache_write_record(fp, rec->ident, rec->placement, rec->uspf,
+                              rec->scaled_thread_range,
+                              rec->core_speed_rating, rec->throughput);
+    hdr.num++;
+  }
+
+  /* Patch in the number of records */
+  num_pos = offsetof(wscache_header_t, num);
+  ok = ok && !fseek(fp, num_pos, SEEK_SET) &&
+       fwrite(&hdr.num, sizeof(hdr.num), 1, fp) == 1;
+  ok = !fclose(fp) && ok;
+  if(!ok || rename(tmpfn, wscache_fn))
+  {
+    popcorn_log("Could not save workshare cache '%s'\n", wscache_fn);
+    remove(tmpfn);
+  }
+  free(tmpfn);
+
+out:
+  for(rec = wscache_saved; rec; rec = next)
+  {
+    next = rec->next;
+    wscache_free_record(rec);
+  }
+  wscache_saved = NULL;
+}
+
 static hash_entry_type get_or_create_entry(const void *ident, bool *new)
 {
   hash_entry_type ret;
@@ -495,43 +857,157 @@ static hash_entry_type get_or_create_entry(const void *ident, bool *new)
   {
     ret = new_hash_value(ident);
     *htab_find_slot(&popcorn_global.workshare_cache, &tmp, INSERT) = ret;
-    *new = true;
+    *new = !seed_from_saved(ret);
   }
   return ret;
 }
 
 /*********************** Work splitting helper APIs **************************/
 
-void popcorn_get_page_faults(unsigned long long *sent,
-                             unsigned long long *recv)
+/*
+ * Page fault counter providers.  Counts are read at the start & end of every
+ * probing period, so providers set up everything they need when a node first
+ * joins (outside of the probing window) and only read counters afterwards --
+ * reading must not allocate memory, as that would cause the page faults we're
+ * trying to count.  Selected by the POPCORN_FAULT_COUNTERS environment
+ * variable:
+ *
+ *   procfs: sent/received page counts from '/proc/popcorn_stat', read with a
+ *           single pread() of a per-node file descriptor into a per-node
+ *           buffer (default)
+ *   rusage: minor/major page faults from getrusage(), for testing on stock
+ *           Linux
+ *   none: always zero
+ */
+
+#define FAULT_BUFSZ 768
+
+typedef struct fault_provider {
+  const char *name;
+  void (*init_node)(int nid);
+  void (*read)(int nid, unsigned long long *sent, unsigned long long *recv);
+} fault_provider_t;
+
+/* Per-node state, page-aligned so nodes don't share pages */
+typedef struct fault_counter {
+  bool initialized;
+  int fd;
+  char buf[FAULT_BUFSZ];
+} ALIGN_PAGE fault_counter_t;
+
+static fault_counter_t fault_counters[MAX_POPCORN_NODES];
+
+static void procfs_init_node(int nid)
 {
-  struct gomp_thread *thr = gomp_thread();
-  unsigned long long i, read;
-  char *buf, *cur, *end;
-  FILE *fp;
-  static const size_t bufsz = 768;
+  fault_counters[nid].fd = open("/proc/popcorn_stat", O_RDONLY);
+}
 
-  assert(sent && recv && "Invalid arguments to get_page_faults()");
+static void procfs_read(int nid,
+                        unsigned long long *sent,
+                        unsigned long long *recv)
+{
+  fault_counter_t *ctr = &fault_counters[nid];
+  ssize_t len;
+  size_t i;
+  char *cur, *end;
+
+  *sent = *recv = 0;
+  if(ctr->fd < 0) return;
+  len = pread(ctr->fd, ctr->buf, FAULT_BUFSZ - 1, 0);
+  if(len <= 0) return;
+  ctr->buf[len] = '\0';
+
+  /* Counts are on the 10th line after the first separator */
+  if(!(cur = strchr(ctr->buf, '-'))) return;
+  for(i = 0; i < 10 && (cur = strchr(cur, '\n')); i++, cur++);
+  if(!cur) return;
+  while(*cur == ' ') cur++;
+  *sent = strtoull(cur, &end, 10);
+  cur = end;
+  while(*cur == ' ') cur++;
+  *recv = strtoull(cur, NULL, 10);
+}
+
+static void rusage_init_node(int nid) { }
 
-  if((fp = fopen("/proc/popcorn_stat", "r")))
+static void rusage_read(int nid,
+                        unsigned long long *sent,
+                        unsigned long long *recv)
+{
+  struct rusage usage;
+  if(getrusage(RUSAGE_SELF, &usage))
   {
-    cur = buf = (char *)popcorn_malloc(sizeof(char) * bufsz, thr->popcorn_nid);
-    read = fread(buf, bufsz, 1, fp);
-    while(*cur != '-') cur++;
-    for(i = 0; i < 10; cur++)
-      if(*cur == '\n') i++;
-    while(*cur == ' ') cur++;
-    *sent = strtoul(cur, &end, 10);
-    cur = end;
-    while(*cur == ' ') cur++;
-    *recv = strtoul(cur, NULL, 10);
-    popcorn_free(buf);
+    *sent = *recv = 0;
+    return;
   }
-  else
+  *sent = usage.ru_minflt;
+  *recv = usage.ru_majflt;
+}
+
+static void none_init_node(int nid) { }
+
+static void none_read(int nid,
+                      unsigned long long *sent,
+                      unsigned long long *recv)
+{
+  *sent = *recv = 0;
+}
+
+static const fault_provider_t fault_providers[] = {
+  { "procfs", procfs_init_node, procfs_read },
+  { "rusage", rusage_init_node, rusage_read },
+  { "none", none_init_node, none_read },
+};
+
+static const fault_provider_t *fault_provider = &fault_providers[0];
+
+/* Set up the node's counters.  Must be called on the node. */
+static void init_fault_counters(int nid)
+{
+  if(fault_counters[nid].initialized) return;
+  fault_provider->init_node(nid);
+  fault_counters[nid].initialized = true;
+}
+
+bool popcorn_init_fault_counters(const char *name)
+{
+  size_t i;
+  bool found = !name;
+
+  for(i = 0; name && i < sizeof(fault_providers) / sizeof(fault_providers[0]);
+      i++)
+  {
+    if(!strcmp(name, fault_providers[i].name))
+    {
+      fault_provider = &fault_providers[i];
+      found = true;
+      break;
+    }
+  }
+  for(i = 0; i < MAX_POPCORN_NODES; i++)
   {
-    *sent = 0;
-    *recv = 0;
+    fault_counters[i].initialized = false;
+    fault_counters[i].fd = -1;
   }
+
+  /* Called at startup by the main thread, which executes on node 0 */
+  init_fault_counters(0);
+  return found;
+}
+
+const char *popcorn_fault_counters_name() { return fault_provider->name; }
+
+void popcorn_get_page_faults(unsigned long long *sent,
+                             unsigned long long *recv)
+{
+  int nid = gomp_thread()->popcorn_nid;
+
+  assert(sent && recv && "Invalid arguments to get_page_faults()");
+
+  // Note: only happens if the node never went through hierarchy_init_thread()
+  if(__builtin_expect(!fault_counters[nid].initialized, 0))
+    init_fault_counters(nid);
+  fault_provider->read(nid, sent, recv);
 }
 
 static void init_statistics(int nid)
@@ -807,12 +1283,26 @@ static void log_hetprobe_results(const char *ident, workshare_csr_t *csr)
                     popcorn_global.page_faults[i]);
   }
 
-  snprintf(cur, REMAINING_BUF(buf, cur),
-           "\nProbe: %ld / %llu probe iters/thread, "
-           "%ld / %llu remaining, %.3f us/fault\n",
-           csr->chunk_size, csr->chunk_size_ull,
-           csr->remaining, csr->remaining_ull,
-           csr->uspf);
+  cur += snprintf(cur, REMAINING_BUF(buf, cur),
+                  "\nProbe: %ld / %llu probe iters/thread, "
+                  "%ld / %llu remaining, %.3f us/fault\n",
+                  csr->chunk_size, csr->chunk_size_ull,
+                  csr->remaining, csr->remaining_ull,
+                  csr->uspf);
+
+  if(popcorn_hetprobe_continuous && csr->use_splits)
+  {
+    cur += snprintf(cur, REMAINING_BUF(buf, cur), "Throughput:");
+    for(i = 0; i < max; i++)
+    {
+      if(i && !(i % 8)) cur += snprintf(cur, REMAINING_BUF(buf, cur), "\n");
+      cur += snprintf(cur, REMAINING_BUF(buf, cur), "\t%.3f",
+                      csr->throughput[i]);
+    }
+    snprintf(cur, REMAINING_BUF(buf, cur),
+             "\nImbalance: %.3f (threshold %.3f), %lu re-split(s)\n",
+             csr->imbalance, popcorn_resplit_threshold, csr->resplits);
+  }
   popcorn_log(buf);
 }
 
@@ -1025,10 +1515,13 @@ void hierarchy_init_workshare_hetprobe(int nid,
 #ifdef _CACHE_HETPROBE
       ent = get_or_create_entry(ident, &new_ent);
       ent->chunk_size = chunk;
+      ent->use_splits = false;
+      ent->ull = false;
       if(!new_ent) /* Hey we've seen you before! */
       {
         if(ent->trips >= popcorn_max_probes)
         {
+          ent->use_splits = true;
           calculate_splits(ent, global);
           global->sched = GFS_HIERARCHY_DYNAMIC;
         }
@@ -1045,6 +1538,8 @@ void hierarchy_init_workshare_hetprobe(int nid,
       assert(ent && "Missing cache entry");
       init_workshare_from_splits(nid, ent, ws);
       if(popcorn_log_statistics) init_statistics(nid);
+      else if(popcorn_hetprobe_continuous)
+        popcorn_node[nid].workshare_time = 0;
     }
     else init_statistics(nid);
 #else
@@ -1098,10 +1593,13 @@ void hierarchy_init_workshare_hetprobe_ull(int nid,
 #ifdef _CACHE_HETPROBE
       ent = get_or_create_entry(ident, &new_ent);
       ent->chunk_size_ull = chunk;
+      ent->use_splits = false;
+      ent->ull = true;
       if(!new_ent) /* Hey we've seen you before! */
       {
         if(ent->trips >= popcorn_max_probes)
         {
+          ent->use_splits = true;
           calculate_splits_ull(ent, global);
           global->sched = GFS_HIERARCHY_DYNAMIC;
         }
@@ -1117,6 +1615,8 @@ void hierarchy_init_workshare_hetprobe_ull(int nid,
       assert(ent && "Missing cache entry");
       init_workshare_from_splits_ull(nid, ent, ws);
       if(popcorn_log_statistics) init_statistics(nid);
+      else if(popcorn_hetprobe_continuous)
+        popcorn_node[nid].workshare_time = 0;
     }
     else init_statistics(nid);
 #else
@@ -1324,6 +1824,72 @@ static void calc_het_probe_workshare(int nid, bool ull, workshare_csr_t *csr)
   gomp_team_barrier_wait_nospin(&popcorn_global.bar);
 }
 
+/* Continuous hetprobe mode: after the probing period, keep refining the core
+   speed ratings from how long each node took to execute its split.  Each
+   node's per-thread throughput is folded into an exponentially-weighted moving
+   average; if the nodes finished further apart than popcorn_resplit_threshold
+   (as a fraction of the slowest node's time), the ratings are re-derived from
+   the averages so the next invocation of the region is re-split.
+
+   Note: must be called by the global leader once all nodes have written their
+   time to popcorn_global.workshare_time & before the global work share is
+   released. */
+static void update_throughput_model(workshare_csr_t *csr)
+{
+  size_t i;
+  unsigned long long cur_elapsed, min = UINT64_MAX, max = 0;
+  float iters, rate, min_rate = FLT_MAX;
+  bool complete = true;
+
+  for(i = 0; i < MAX_POPCORN_NODES; i++)
+  {
+    if(!popcorn_global.threads_per_node[i] ||
+       csr->core_speed_rating[i] == NO_ITER) continue;
+
+    if(csr->ull)
+      iters = (float)(popcorn_global.split_ull[i+1] -
+                      popcorn_global.split_ull[i]) /
+              (float)popcorn_global.ws.incr_ull;
+    else
+      iters = (float)(popcorn_global.split[i+1] - popcorn_global.split[i]) /
+              (float)popcorn_global.ws.incr;
+    cur_elapsed = popcorn_global.workshare_time[i];
+    if(iters <= 0.0 || !cur_elapsed)
+    {
+      complete = false;
+      continue;
+    }
+
+    rate = iters / ((float)cur_elapsed * popcorn_global.threads_per_node[i]);
+    csr->throughput[i] = time_weighted_average(rate, csr->throughput[i],
+                                               csr->throughput[i] == 0.0);
+    if(cur_elapsed < min) min = cur_elapsed;
+    if(cur_elapsed > max) max = cur_elapsed;
+  }
+
+  if(!max) return;
+  csr->imbalance = (float)(max - min) / (float)max;
+  if(!complete || csr->imbalance <= popcorn_resplit_threshold) return;
+
+  /* Re-derive ratings relative to the slowest node, as in the probing
+     period */
+  for(i = 0; i < MAX_POPCORN_NODES; i++)
+    if(popcorn_global.threads_per_node[i] && csr->throughput[i] > 0.0 &&
+       csr->throughput[i] < min_rate)
+      min_rate = csr->throughput[i];
+
+  csr->scaled_thread_range = 0.0;
+  for(i = 0; i < MAX_POPCORN_NODES; i++)
+  {
+    if(!popcorn_global.threads_per_node[i] || csr->throughput[i] == 0.0)
+      continue;
+    csr->core_speed_rating[i] = csr->throughput[i] / min_rate;
+    csr->scaled_thread_range += csr->core_speed_rating[i] *
+                                popcorn_global.threads_per_node[i];
+  }
+  csr->resplits++;
+}
+
 bool hierarchy_next_hetprobe(int nid,
                              const void *ident,
                              long *start,
@@ -1440,15 +2006,20 @@ void hierarchy_loop_end(int nid, const void *ident, bool global)
 #ifdef _CACHE_HETPROBE
   struct timespec region_end;
   unsigned long long sent, recv;
-  hash_entry_type ent;
+  hash_entry_type ent = NULL;
+  bool continuous = false;
 
-  if(popcorn_log_statistics)
+  if(popcorn_log_statistics || popcorn_hetprobe_continuous)
   {
     /* If it was originally the hetprobe scheduler we have an entry & region
-       statistics will have been calculated.  If we don't have one, then we
-       need to calculate the region statistics here. */
+       statistics will have been calculated during the probing period.  If we
+       don't have one, or we're continuously refining splits from a
+       non-probing invocation, we need to calculate the region statistics
+       here. */
     ent = get_entry(ident);
-    if(!ent)
+    continuous = popcorn_hetprobe_continuous && global &&
+                 ent && ent->use_splits;
+    if((popcorn_log_statistics && !ent) || continuous)
     {
       clock_gettime(CLOCK_MONOTONIC, &region_end);
       __atomic_add_fetch(&popcorn_node[nid].workshare_time,
@@ -1472,6 +2043,10 @@ void hierarchy_loop_end(int nid, const void *ident, bool global)
       popcorn_get_page_faults(&sent, &recv);
       popcorn_global.page_faults[nid] = sent - popcorn_node[nid].page_faults;
     }
+    else if(continuous)
+      popcorn_global.workshare_time[nid] =
+        MAX(popcorn_node[nid].workshare_time /
+            popcorn_global.threads_per_node[nid], 1);
 #endif
     gomp_fini_work_share(&popcorn_node[nid].ws);
     gomp_ptrlock_destroy(&popcorn_node[nid].ws_lock);
@@ -1483,6 +2058,9 @@ void hierarchy_loop_end(int nid, const void *ident, bool global)
                                          false, NULL);
       if(leader)
       {
+#ifdef _CACHE_HETPROBE
+        if(continuous) update_throughput_model(ent);
+#endif
         gomp_fini_work_share(&popcorn_global.ws);
         gomp_ptrlock_destroy(&popcorn_global.ws_lock);
         gomp_ptrlock_init(&popcorn_global.ws_lock, NULL);
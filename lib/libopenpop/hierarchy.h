@@ -30,6 +30,12 @@ typedef union {
   char padding[64];
 } ALIGN_CACHE aligned_void_ptr;
 
+/* Nodes with more than REDUCTION_ENTRIES threads (up to REDUCTION_TREE_MAX)
+   reduce locally using a combining tree with POPCORN_REDUCTION_ARITY children
+   per thread, by default REDUCTION_TREE_ARITY */
+#define REDUCTION_TREE_ARITY 8UL
+#define REDUCTION_TREE_MAX 256UL
+
 /* Leader selection information */
 typedef struct {
   /* Number of participants in the leader selection process */
@@ -271,7 +277,9 @@ void hierarchy_hybrid_barrier_final(int nid);
 
 /*
  * Execute a tree reduction; use an optimistic leader selection process, reduce
- * locally then globally.
+ * locally then globally.  Locally, nodes with few threads have the leader
+ * combine every thread's data, whereas nodes with many threads combine data
+ * up a k-ary tree so that the leader only combines its children's data.
  *
  * @param nid the node in which to execute reductions
  * @param reduce_data the leader's payload
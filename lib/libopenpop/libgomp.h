@@ -1203,10 +1203,14 @@ extern float popcorn_probe_percent;
 /* hierarchy.c */
 extern bool popcorn_log_statistics;
 extern size_t popcorn_max_probes;
+extern size_t popcorn_reduction_arity;
 extern const char *popcorn_prime_region;
 extern int popcorn_preferred_node;
+extern bool popcorn_hetprobe_continuous;
+extern float popcorn_resplit_threshold;
 
 extern void popcorn_init_workshare_cache(size_t);
+extern void popcorn_load_workshare_cache(const char *);
 
 extern bool popcorn_distributed ();
 extern bool popcorn_finished ();
@@ -1220,6 +1224,8 @@ extern void popcorn_set_hybrid_barrier (bool);
 extern void popcorn_set_hybrid_reduce (bool);
 extern void popcorn_set_het_workshare (bool);
 
+extern bool popcorn_init_fault_counters (const char *);
+extern const char *popcorn_fault_counters_name ();
 extern void popcorn_get_page_faults (unsigned long long *,
                                      unsigned long long *);
 
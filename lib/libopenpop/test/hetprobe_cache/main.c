@@ -0,0 +1,103 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <time.h>
+#include <omp.h>
+
+/*
+ * Time-to-steady-state of the vector_reduce kernel under the HetProbe
+ * scheduler.  Run with OMP_SCHEDULE=hetprobe and POPCORN_MAX_PROBES set, once
+ * to populate POPCORN_WORKSHARE_CACHE and again to measure a run that starts
+ * from the cached probing results, e.g.:
+ *
+ *   export OMP_SCHEDULE=hetprobe POPCORN_MAX_PROBES=5
+ *   export POPCORN_WORKSHARE_CACHE=/tmp/hetprobe.cache
+ *   rm -f $POPCORN_WORKSHARE_CACHE
+ *   ./hetprobe_cache   # cold: probes the first POPCORN_MAX_PROBES iterations
+ *   ./hetprobe_cache   # warm: uses the cached splits from the first iteration
+ */
+
+#define TO_NS( ts ) ((ts.tv_sec * 1000000000) + ts.tv_nsec)
+
+static bool verbose = false;
+static size_t nthreads = 8;
+static size_t vecsize = 1048576;
+static size_t niters = 100;
+
+void vector_init(int *vec, size_t size) {
+  size_t i;
+  #pragma omp parallel for
+  for(i = 0; i < size; i++)
+    vec[i] = i % 256;
+}
+
+int vector_reduce(int *vec, size_t size) {
+  size_t i;
+  int reduced = 0;
+  #pragma omp parallel for reduction(+:reduced) schedule(runtime)
+  for(i = 0; i < size; i++) {
+    reduced += vec[i];
+    vec[i] = (vec[i] * 31 + 7) % 256;
+  }
+  return reduced;
+}
+
+int main(int argc, char **argv) {
+  size_t i, steady, *times;
+  int c, *vec;
+  struct timespec start, end;
+  double avg = 0.0, warmup = 0.0;
+
+  while((c = getopt(argc, argv, "t:s:i:vh")) != -1) {
+    switch(c) {
+    case 't': nthreads = strtoul(optarg, NULL, 10); break;
+    case 's': vecsize = strtoul(optarg, NULL, 10); break;
+    case 'i': niters = strtoul(optarg, NULL, 10); break;
+    case 'v': verbose = true; break;
+    case 'h':
+    default:
+      printf("Usage: hetprobe_cache -t THREADS -s VECSIZE -i ITERS\n");
+      exit(0);
+    }
+  }
+
+  if(niters < 2) {
+    fprintf(stderr, "Need at least 2 iterations\n");
+    exit(1);
+  }
+
+  omp_set_num_threads(nthreads);
+  vec = (int *)malloc(sizeof(int) * vecsize);
+  times = (size_t *)malloc(sizeof(size_t) * niters);
+  if(!vec || !times) {
+    fprintf(stderr, "Could not allocate vector\n");
+    exit(1);
+  }
+  vector_init(vec, vecsize);
+
+  for(i = 0; i < niters; i++) {
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    vector_reduce(vec, vecsize);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    times[i] = TO_NS(end) - TO_NS(start);
+    if(verbose) printf("Iteration %lu: %lu ns\n", i, times[i]);
+  }
+
+  /* Steady state is the average of the second half of the run; the run
+     reaches it after the last iteration in the first half more than 10%
+     slower than that average. */
+  for(i = niters / 2; i < niters; i++) avg += times[i];
+  avg /= niters - niters / 2;
+  for(steady = 0, i = 0; i < niters / 2; i++)
+    if(times[i] > avg * 1.1) steady = i + 1;
+  for(i = 0; i < steady; i++) warmup += times[i];
+
+  printf("Steady state: %.0f ns/iteration\n", avg);
+  printf("Reached steady state after %lu iteration(s), %.0f ns\n",
+         steady, warmup);
+
+  free(times);
+  free(vec);
+  return 0;
+}
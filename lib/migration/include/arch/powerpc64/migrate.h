@@ -22,9 +22,9 @@
 
 #if _NATIVE == 1 /* Safe for native execution/debugging */
 
-#define REWRITE_STACK(regs_src, regs_dst, dst_arch) \
-    !st_userspace_rewrite((void *)regs_src.powerpc.pc, ARCH_POWERPC64, \
-                          &regs_src, ARCH_POWERPC64, &regs_dst)
+#define REWRITE_STACK(regs_src, regs_dst, dst_arch, handles) \
+    !st_userspace_rewrite_prepared((void *)regs_src.powerpc.pc, handles, \
+                                   &regs_src, regs_dst, REWRITE_MODE)
 
 #define MIGRATE(err) \
     { \
@@ -36,14 +36,14 @@
 
 #else /* Heterogeneous migration */
 
-#define REWRITE_STACK(regs_src, regs_dst, dst_arch) \
+#define REWRITE_STACK(regs_src, regs_dst, dst_arch, handles) \
     ({ \
       int ret = 1; \
       if(dst_arch != ARCH_POWERPC64) \
-        ret = !st_userspace_rewrite((void *)regs_src.powerpc.pc, \
-                                    ARCH_POWERPC64, &regs_src, \
-                                    dst_arch, &regs_dst); \
-      else memcpy(&regs_dst, &regs_src, sizeof(struct regset_powerpc64)); \
+        ret = !st_userspace_rewrite_prepared((void *)regs_src.powerpc.pc, \
+                                             handles, &regs_src, regs_dst, \
+                                             REWRITE_MODE); \
+      else memcpy(regs_dst, &regs_src, sizeof(struct regset_powerpc64)); \
       ret; \
     })
 
@@ -64,7 +64,7 @@
                       : /* Outputs */ \
                       "=r"(err) \
                       : /* Inputs */ \
-                      "r"(nid), "r"(&regs_dst), "r"(sp), "r"(bp), \
+                      "r"(nid), "r"(regs_dst), "r"(sp), "r"(bp), \
                       "i"(SYS_sched_migrate) \
                       : /* Clobbered */ \
                       FIXUP_CLOBBERS, "r3", "r4", "r0"); \
@@ -83,7 +83,7 @@
                       : /* Outputs */ \
                       "=m"(data.post_syscall), "=r"(err) \
                       : /* Inputs */ \
-                      "r"(nid), "r"(&regs_dst), "r"(sp), "r"(bp), \
+                      "r"(nid), "r"(regs_dst), "r"(sp), "r"(bp), \
                       "i"(SYS_sched_migrate) \
                       : /* Clobbered */ \
                       FIXUP_CLOBBERS, "r3", "r4", "r0"); \
@@ -22,9 +22,9 @@
 
 #if _NATIVE == 1 /* Safe for native execution/debugging */
 
-#define REWRITE_STACK(regs_src, regs_dst, dst_arch) \
-    !st_userspace_rewrite((void *)regs_src.x86.rsp, ARCH_X86_64, &regs_src, \
-                          ARCH_X86_64, &regs_dst)
+#define REWRITE_STACK(regs_src, regs_dst, dst_arch, handles) \
+    !st_userspace_rewrite_prepared((void *)regs_src.x86.rsp, handles, \
+                                   &regs_src, regs_dst, REWRITE_MODE)
 
 #define MIGRATE(err) \
     { \
@@ -36,19 +36,43 @@
 
 #else /* Heterogeneous migration */
 
-#define REWRITE_STACK(regs_src, regs_dst, dst_arch) \
+#define REWRITE_STACK(regs_src, regs_dst, dst_arch, handles) \
     ({ \
       int ret = 1; \
       if(dst_arch != ARCH_X86_64) \
-        ret = !st_userspace_rewrite((void *)regs_src.x86.rsp, ARCH_X86_64, \
-                                    &regs_src, dst_arch, &regs_dst); \
-      else memcpy(&regs_dst, &regs_src, sizeof(struct regset_x86_64)); \
+        ret = !st_userspace_rewrite_prepared((void *)regs_src.x86.rsp, \
+                                             handles, &regs_src, regs_dst, \
+                                             REWRITE_MODE); \
+      else memcpy(regs_dst, &regs_src, sizeof(struct regset_x86_64)); \
       ret; \
     })
 
+#if _EMULATE_MIGRATION == 1
+
+/*
+ * Call the userspace stand-in rather than entering the kernel, stepping over
+ * the red zone.  The stand-in doesn't return if it migrates.
+ */
+#define MIGRATE_SYSCALL \
+    "leaq -128(%%rsp), %%rsp;" \
+    "call __migrate_emulate_x86_64;" \
+    "leaq 128(%%rsp), %%rsp;"
+
+/*
+ * Registers clobbered during __migrate_fixup_x86_64, plus those clobbered by
+ * the stand-in's call into C when migration fails
+ */
+#define FIXUP_CLOBBERS "rax", "rdx", "rcx", "r8", "r9", "r10", "r11", "memory"
+
+#else
+
+#define MIGRATE_SYSCALL "syscall;"
+
 /* Registers clobbered during __migrate_fixup_x86_64 */
 #define FIXUP_CLOBBERS "rax", "rdx", "rcx"
 
+#endif
+
 #define MIGRATE(err) \
     ({ \
       if(dst_arch != ARCH_X86_64) \
@@ -59,12 +83,12 @@
                       "movq %3, %%rsp;" \
                       "movq %4, %%rbp;" \
                       "movl %5, %%eax;" \
-                      "syscall;" \
+                      MIGRATE_SYSCALL \
                       "movl %%eax, %0;" \
                       : /* Outputs */ \
                       "=g"(err) \
                       : /* Inputs */ \
-                      "g"(nid), "g"(&regs_dst), "r"(sp), "r"(bp), \
+                      "g"(nid), "g"(regs_dst), "r"(sp), "r"(bp), \
                       "i"(SYS_sched_migrate) \
                       : /* Clobbered */ \
                       FIXUP_CLOBBERS, "edi", "rsi", "eax"); \
@@ -77,12 +101,12 @@
                       "movq %4, %%rsp;" \
                       "movq %5, %%rbp;" \
                       "movl %6, %%eax;" \
-                      "syscall;" \
+                      MIGRATE_SYSCALL \
                       "1: movl %%eax, %1;" \
                       : /* Outputs */ \
                       "=m"(data.post_syscall), "=g"(err) \
                       : /* Inputs */ \
-                      "g"(nid), "g"(&regs_dst), "r"(sp), "r"(bp), \
+                      "g"(nid), "g"(regs_dst), "r"(sp), "r"(bp), \
                       "i"(SYS_sched_migrate) \
                       : /* Clobbered */ \
                       FIXUP_CLOBBERS, "edi", "rsi", "eax"); \
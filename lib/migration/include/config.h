@@ -38,6 +38,42 @@
 #define _TIME_REWRITE 0
 #endif
 
+/*
+ * Rewrite the stack on-demand, i.e., only transform the outermost frame at
+ * migration time and transform the remaining frames as the thread returns
+ * into them.
+ */
+#ifndef _ONDEMAND_REWRITE
+#define _ONDEMAND_REWRITE 0
+#endif
+
+#if _ONDEMAND_REWRITE == 1
+# define REWRITE_MODE ST_REWRITE_ONDEMAND
+#else
+# define REWRITE_MODE ST_REWRITE_EAGER
+#endif
+
+/*
+ * Emulate Popcorn's nodes & migration system call in userspace so migrations
+ * can be measured end-to-end on stock Linux.  Only supported on x86-64, other
+ * architectures' libraries are built normally.  Composes with _NATIVE to
+ * rewrite the stack for every migration rather than copying the register set.
+ */
+#ifndef _EMULATE_MIGRATION
+#define _EMULATE_MIGRATION 0
+#endif
+
+#if _EMULATE_MIGRATION == 1 && !defined __x86_64__
+# undef _EMULATE_MIGRATION
+# define _EMULATE_MIGRATION 0
+#endif
+
+#if _EMULATE_MIGRATION == 1
+# include "emulate.h"
+#else
+# define PHASE_TIMESTAMP( phase )
+#endif
+
 /* Use environment variables to specify at which function to migrate. */
 #ifndef _ENV_SELECT_MIGRATE
 #define _ENV_SELECT_MIGRATE 0
@@ -0,0 +1,69 @@
+/*
+ * Userspace stand-in for Popcorn's migration system call & node queries, for
+ * measuring migrations on stock Linux.  Every emulated node has the local
+ * architecture, so migrations between them are homogeneous -- rather than the
+ * kernel moving the thread to another node, the thread switches its emulated
+ * node ID & restores the destination register set itself.
+ *
+ * The library is statically linked after musl-libc, which already defines
+ * popcorn_getnid() & friends via Popcorn's system calls, so the library's
+ * queries are redirected here at compile time.  Applications calling musl's
+ * versions directly still see the real (i.e., absent) nodes.
+ *
+ * Note: only supported on x86-64.
+ */
+
+#ifndef _EMULATE_H
+#define _EMULATE_H
+
+#include <time.h>
+#include "platform.h"
+
+/* Redirect the library's node queries to the emulated nodes. */
+#define popcorn_getnid emulate_getnid
+#define popcorn_getthreadinfo emulate_getthreadinfo
+#define popcorn_getnodeinfo emulate_getnodeinfo
+
+int emulate_getnid();
+int emulate_getthreadinfo(struct popcorn_thread_status *status);
+int emulate_getnodeinfo(int *origin,
+                        struct popcorn_node_status status[MAX_POPCORN_NODES]);
+
+/*
+ * Switch the calling thread to an emulated node, called in place of the
+ * migration system call.  Returns zero if switched or a negative error code
+ * like the system call otherwise.
+ */
+int __migrate_emulate_enter(int nid);
+
+/*
+ * Phases of a migration.  Each is timestamped when it ends, except for
+ * PHASE_START which is taken when entering the migration library.
+ */
+enum migrate_phase {
+  PHASE_START = 0,
+  PHASE_CAPTURE,
+  PHASE_PREPARE,
+  PHASE_REWRITE,
+  PHASE_SETUP,
+  PHASE_SYSCALL,
+  PHASE_RESUME,
+  PHASE_CALLBACK,
+  NUM_PHASES
+};
+
+/* Per-thread timestamps of the most recent migration, in nanoseconds. */
+extern __thread unsigned long long __migrate_phase_ts[NUM_PHASES];
+
+/*
+ * Emulated migrations run on any x86-64 machine, so use the (vDSO-backed)
+ * monotonic clock rather than converting TSC values with a per-CPU constant.
+ */
+#define PHASE_TIMESTAMP( phase ) \
+    ({ \
+      struct timespec stamp; \
+      clock_gettime(CLOCK_MONOTONIC, &stamp); \
+      __migrate_phase_ts[phase] = (stamp.tv_sec * 1000000000) + stamp.tv_nsec; \
+    })
+
+#endif /* _EMULATE_H */
@@ -28,6 +28,51 @@ enum arch current_arch(void);
  */
 int current_nid(void);
 
+/**
+ * Prepare the calling thread to migrate to a node by resolving stack
+ * transformation metadata & the destination's thread pointer ahead of time.
+ * Migrations prepare lazily if needed, but threads which migrate frequently
+ * can call this beforehand to keep the preparation off of the migration path.
+ * Preparations are cached per-thread for each source & destination
+ * architecture pair.
+ *
+ * @param nid the node ID
+ * @return zero if the thread was prepared, or non-zero otherwise
+ */
+int migrate_prepare(int nid);
+
+/**
+ * Per-phase latencies of a migration, in nanoseconds.
+ */
+struct migrate_phases {
+  unsigned long long capture;  /* Capture the source register set */
+  unsigned long long prepare;  /* Prepare the thread for the destination */
+  unsigned long long rewrite;  /* Rewrite the stack/copy the register set */
+  unsigned long long setup;    /* Set up the destination thread pointer */
+  unsigned long long syscall;  /* Enter the migration system call */
+  unsigned long long resume;   /* Restore the destination register set */
+  unsigned long long callback; /* Run the post-migration callback */
+  unsigned long long total;    /* End-to-end migration latency */
+};
+
+/**
+ * Get the per-phase latencies of the calling thread's most recent migration.
+ * Phases are only recorded when the library emulates migrations on stock
+ * Linux (type=emulate).
+ *
+ * @param phases struct to be populated with the latencies
+ * @return zero if the latencies were recorded, or non-zero otherwise
+ */
+int migrate_last_phases(struct migrate_phases *phases);
+
+/**
+ * Per-thread migration request word.  Compiler-inserted migration points only
+ * call check_migrate() when it's non-zero, so that points are a load & branch
+ * when no migration can be pending.  Builds which check for migrations on
+ * every call (e.g., by querying the OS) leave it set.
+ */
+extern __thread volatile int __migrate_request;
+
 /**
  * Check if thread should migrate, and if so, invoke migration.  The optional
  * callback function will be invoked before execution resumes on destination
@@ -87,3 +87,55 @@ __migrate_fixup_x86_64:
 
 .endif
 
+
+.extern __migrate_emulate_enter
+
+.section .text.__migrate_emulate_x86_64, "ax"
+.globl __migrate_emulate_x86_64
+.type __migrate_emulate_x86_64,@function
+__migrate_emulate_x86_64:
+.ifdef __x86_64__
+  /*
+   * Userspace stand-in for the migration system call when emulating
+   * migrations on stock Linux, called with the same arguments:
+   *
+   *  arg 1 (edi): destination node ID
+   *  arg 2 (rsi): destination register set
+   *
+   * Switch to the emulated node & restore the destination register set like
+   * the kernel would on the destination, resuming at its PC (i.e.,
+   * __migrate_fixup_x86_64).  If the node can't be switched to, return the
+   * error like the system call.
+   */
+  push %rsi /* Save regset pointer & align stack pointer */
+  call __migrate_emulate_enter
+  pop %rsi
+  test %eax, %eax
+  jnz .Lemulate_error
+
+  /*
+   * See <compiler repo>/lib/stack_transformation/include/arch/x86_64/regs.h
+   * for the register set layout.
+   */
+  mov 16(%rsi), %rdx
+  mov 24(%rsi), %rcx
+  mov 32(%rsi), %rbx
+  mov 48(%rsi), %rdi
+  mov 56(%rsi), %rbp
+  mov 72(%rsi), %r8
+  mov 80(%rsi), %r9
+  mov 88(%rsi), %r10
+  mov 96(%rsi), %r11
+  mov 104(%rsi), %r12
+  mov 112(%rsi), %r13
+  mov 120(%rsi), %r14
+  mov 128(%rsi), %r15
+  mov 64(%rsi), %rsp
+  mov 0(%rsi), %rax /* Load destination PC */
+  mov 40(%rsi), %rsi
+  jmp *%rax
+
+.Lemulate_error:
+  ret
+
+.endif
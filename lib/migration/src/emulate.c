@@ -0,0 +1,97 @@
+/*
+ * Userspace stand-in for Popcorn's nodes & migration system call.  See
+ * include/emulate.h for more details.
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include "config.h"
+#include "arch.h"
+#include "migrate.h"
+
+#if _EMULATE_MIGRATION == 1
+
+/* Environment variable specifying the number of emulated nodes */
+static const char *env_nodes = "POPCORN_EMULATE_NODES";
+
+#define DEFAULT_NODES 2
+
+/* Node on which the thread is emulated to be running */
+static __thread int emulated_nid = 0;
+
+__thread unsigned long long __migrate_phase_ts[NUM_PHASES];
+
+int emulate_getnid()
+{
+  return emulated_nid;
+}
+
+int emulate_getthreadinfo(struct popcorn_thread_status *status)
+{
+  if(!status) return 1;
+  status->current_nid = emulated_nid;
+  status->proposed_nid = -1;
+  status->peer_nid = -1;
+  status->peer_pid = -1;
+  return 0;
+}
+
+int emulate_getnodeinfo(int *origin,
+                        struct popcorn_node_status status[MAX_POPCORN_NODES])
+{
+  int i, num_nodes = DEFAULT_NODES;
+  const char *nodes = getenv(env_nodes);
+
+  if(!origin || !status) return 1;
+  if(nodes) num_nodes = atoi(nodes);
+  if(num_nodes < 1 || num_nodes > MAX_POPCORN_NODES) num_nodes = DEFAULT_NODES;
+
+  *origin = 0;
+  for(i = 0; i < MAX_POPCORN_NODES; i++)
+  {
+    status[i].status = i < num_nodes;
+    status[i].arch = i < num_nodes ? ARCH_X86_64 : ARCH_UNKNOWN;
+    status[i].distance = i != *origin;
+  }
+  return 0;
+}
+
+int __migrate_emulate_enter(int nid)
+{
+  PHASE_TIMESTAMP(PHASE_SYSCALL);
+  if(!node_available(nid))
+  {
+    errno = EINVAL;
+    return -EINVAL;
+  }
+  emulated_nid = nid;
+  return 0;
+}
+
+int migrate_last_phases(struct migrate_phases *phases)
+{
+  const unsigned long long *ts = __migrate_phase_ts;
+
+  // The last migration didn't complete if it didn't reach the callback
+  if(!phases || !ts[PHASE_START] || ts[PHASE_CALLBACK] < ts[PHASE_START])
+    return 1;
+
+  phases->capture = ts[PHASE_CAPTURE] - ts[PHASE_START];
+  phases->prepare = ts[PHASE_PREPARE] - ts[PHASE_CAPTURE];
+  phases->rewrite = ts[PHASE_REWRITE] - ts[PHASE_PREPARE];
+  phases->setup = ts[PHASE_SETUP] - ts[PHASE_REWRITE];
+  phases->syscall = ts[PHASE_SYSCALL] - ts[PHASE_SETUP];
+  phases->resume = ts[PHASE_RESUME] - ts[PHASE_SYSCALL];
+  phases->callback = ts[PHASE_CALLBACK] - ts[PHASE_RESUME];
+  phases->total = ts[PHASE_CALLBACK] - ts[PHASE_START];
+  return 0;
+}
+
+#else /* _EMULATE_MIGRATION */
+
+int migrate_last_phases(struct migrate_phases __attribute__((unused)) *phases)
+{
+  return 1;
+}
+
+#endif /* _EMULATE_MIGRATION */
@@ -1,35 +1,81 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "config.h"
 
 /* Default node ID if no mapping is available. */
 static int default_node = 0;
 void set_default_node(int node) { default_node = node; }
 
-/* A Popcorn thread ID -> node mapping for a given application region. */
-typedef struct mapping {
-  size_t region; // The application region number
-  size_t num; // The number of node mappings for this region
-  int *node; // node mappings, use PTID as index
-} mapping_t;
+/*
+ * Compiled thread schedule.  Schedules are stored in a flat image which is
+ * either mmap'd directly from a binary schedule file or built from a text
+ * schedule at startup.  All fields are 32-bit little-endian integers:
+ *
+ *   Header:
+ *     magic "PSCH", format version, number of regions, number of nodes
+ *
+ *   Region table, indexed by region number (num regions + 1 entries):
+ *     offset into node table, number of node mappings
+ *
+ *   Node table (num nodes entries):
+ *     node for each PTID of each region, region by region
+ *
+ * Regions are indexed densely from 0, so looking up a region's mapping is a
+ * single array access.  Regions with no mapping have zero node mappings.  The
+ * extra entry at the end of the region table holds region -1.
+ *
+ * util/scripts/compile-schedule.py compiles text schedules into this format.
+ */
+#define SCHED_MAGIC "PSCH"
+#define SCHED_MAGIC_LEN 4
+#define SCHED_VERSION 1
+
+/* Upper bound on the number of regions, as the region table is dense */
+#define SCHED_MAX_REGIONS (1 << 20)
+
+/* Region number for the default mapping */
+#define SCHED_DEFAULT_REGION ((size_t)-1)
+
+typedef struct sched_header {
+  char magic[SCHED_MAGIC_LEN];
+  uint32_t version;
+  uint32_t num_regions; // Number of regions, excluding region -1
+  uint32_t num_nodes; // Number of entries in the node table
+} sched_header_t;
 
-static size_t num_mappings = 0; // Number of mappings parsed from file
-static mapping_t *mappings = NULL; // The guts
+typedef struct sched_region {
+  uint32_t offset; // Offset of the region's first mapping in the node table
+  uint32_t num; // The number of node mappings for this region
+} sched_region_t;
+
+static void *sched = NULL; // The guts
+static size_t sched_size = 0; // Size of the image
+static int sched_mapped = 0; // Whether the image was mmap'd from a file
+static size_t num_regions = 0;
+static const sched_region_t *regions = NULL;
+static const int32_t *nodes = NULL;
 
 /* Free any dynamically-allocated data. */
 static void __attribute__((destructor)) cleanup()
 {
-  size_t i;
-
-  if(mappings)
+  if(sched)
   {
-    for(i = 0; i < num_mappings; i++)
-      if(mappings[i].node) free(mappings[i].node);
-    free(mappings);
+    if(sched_mapped) munmap(sched, sched_size);
+    else free(sched);
   }
 
-  num_mappings = 0;
-  mappings = NULL;
+  sched = NULL;
+  sched_size = 0;
+  sched_mapped = 0;
+  num_regions = 0;
+  regions = NULL;
+  nodes = NULL;
 }
 
 /*
@@ -40,19 +86,67 @@ static void __attribute__((destructor)) cleanup()
 #define DEF_THREAD_SCHEDULE "thread-schedule.txt"
 #define ENV_POPCORN_THREAD_SCHEDULE "POPCORN_THREAD_SCHEDULE"
 
-/* Comparison function for sorting by region numbers. */
-int region_compare(const void *a, const void *b)
+/*
+ * Point the lookup tables at a schedule image, checking that every region's
+ * mappings are within the image.  Returns 1 if the image is valid or 0
+ * otherwise.
+ */
+static int set_schedule(void *image, size_t size)
+{
+  const sched_header_t *hdr = (const sched_header_t *)image;
+  size_t i, needed;
+
+  if(size < sizeof(sched_header_t) ||
+     memcmp(hdr->magic, SCHED_MAGIC, SCHED_MAGIC_LEN) ||
+     hdr->version != SCHED_VERSION ||
+     hdr->num_regions > SCHED_MAX_REGIONS) return 0;
+  needed = sizeof(sched_header_t) +
+           sizeof(sched_region_t) * ((size_t)hdr->num_regions + 1) +
+           sizeof(int32_t) * (size_t)hdr->num_nodes;
+  if(size < needed) return 0;
+
+  regions = (const sched_region_t *)(hdr + 1);
+  nodes = (const int32_t *)(regions + hdr->num_regions + 1);
+  for(i = 0; i <= hdr->num_regions; i++)
+  {
+    if(regions[i].offset > hdr->num_nodes ||
+       regions[i].num > hdr->num_nodes - regions[i].offset)
+    {
+      regions = NULL;
+      nodes = NULL;
+      return 0;
+    }
+  }
+  num_regions = hdr->num_regions;
+  return 1;
+}
+
+/* Map a compiled thread schedule.  Returns 1 if successful or 0 otherwise. */
+static int map_schedule(int fd, size_t size)
 {
-  mapping_t *map_a = (mapping_t *)a;
-  mapping_t *map_b = (mapping_t *)b;
-  if(map_a->region < map_b->region) return -1;
-  else if(map_a->region > map_b->region) return 1;
-  else return 0;
+  void *image = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(image == MAP_FAILED) return 0;
+  if(!set_schedule(image, size))
+  {
+    munmap(image, size);
+    return 0;
+  }
+  sched = image;
+  sched_size = size;
+  sched_mapped = 1;
+  return 1;
 }
 
+/* A region parsed from a text schedule. */
+typedef struct text_region {
+  size_t region; // The application region number
+  size_t num; // The number of node mappings for this region
+  size_t offset; // Offset of the region's first mapping in the node list
+} text_region_t;
+
 /*
- * Parse the mapping file, if one is available. Files contain a Popcorn
- * thread ID (PTID) -> node mapping in the following format:
+ * Parse a text schedule & build a compiled schedule image from it.  Files
+ * contain a Popcorn thread ID (PTID) -> node mapping in the following format:
  *
  *  <region #> <# entries> <PTID 0 node> ... <PTID N node>
  *
@@ -66,105 +160,172 @@ int region_compare(const void *a, const void *b)
  *                   (denoted by its index in the mapping list) should execute
  *
  * The file may contain multiple lines, one per region.  Regions are
- * implementation-dependent and may be defined by the user or compiler.
+ * implementation-dependent and may be defined by the user or compiler.  If a
+ * region is listed multiple times, the last line wins.
  */
-static void __attribute__((constructor)) read_mapping_schedule()
+static void read_text_schedule(FILE *fp)
 {
-  int c, read;
-  size_t i, j;
-  const char *fn;
-  FILE *fp;
-
-  if(!(fn = getenv(ENV_POPCORN_THREAD_SCHEDULE))) fn = DEF_THREAD_SCHEDULE;
-  if(!(fp = fopen(fn, "r")))
-  {
-#if _DEBUG == 1
-    perror("Could not open thread schedule file");
-#endif
-    return;
-  }
-
-  // Start by figuring out how many mappings are in the file
-  num_mappings = 1;
-  while((c = getc(fp)) != EOF)
-    if(c == '\n') num_mappings++;
-  fseek(fp, 0, SEEK_SET);
+  int read, node;
+  size_t i, j, num_text = 0, num_nodes = 0, max_regions = 0, max_nodes = 0;
+  size_t dense = 0, size;
+  text_region_t *text = NULL, *tmp;
+  int32_t *text_nodes = NULL, *tmp_nodes, *image_nodes;
+  sched_header_t *hdr;
+  sched_region_t *image_regions;
+  void *image;
 
-  // Allocate storage & parse file
-  mappings = (mapping_t *)calloc(num_mappings, sizeof(mapping_t));
-  for(i = 0; i < num_mappings; i++)
+  while(1)
   {
-    // The first few fields are fixed and will tell us the variable parts
-    read = fscanf(fp, "%lu %lu", &mappings[i].region, &mappings[i].num);
-
-    // Check if we accidentally have an extra newline character
-    if(read == EOF)
+    if(num_text == max_regions)
     {
-      num_mappings--;
-      break;
+      max_regions = max_regions ? max_regions * 2 : 64;
+      if(!(tmp = realloc(text, sizeof(text_region_t) * max_regions)))
+        goto error;
+      text = tmp;
     }
-    // Otherwise, ensure the format wasn't screwed up
+
+    // The first few fields are fixed and will tell us the variable parts
+    read = fscanf(fp, "%lu %lu", &text[num_text].region, &text[num_text].num);
+    if(read == EOF) break;
     else if(read != 2)
     {
 #if _DEBUG == 1
       fprintf(stderr, "Parsing error: invalid thread mapping "
-                      "format, line %lu\n", i);
+                      "format, line %lu\n", num_text);
 #endif
-      cleanup();
-      return;
+      goto error;
+    }
+    else if(text[num_text].region != SCHED_DEFAULT_REGION &&
+            text[num_text].region >= SCHED_MAX_REGIONS)
+    {
+#if _DEBUG == 1
+      fprintf(stderr, "Parsing error: region number too large (max %u), "
+                      "line %lu\n", SCHED_MAX_REGIONS - 1, num_text);
+#endif
+      goto error;
     }
 
-    // Allocate storage & parse node mapping list
-    mappings[i].node = calloc(mappings[i].num, sizeof(int));
-    for(j = 0; j < mappings[i].num; j++)
+    // Parse node mapping list
+    text[num_text].offset = num_nodes;
+    for(j = 0; j < text[num_text].num; j++)
     {
-      read = fscanf(fp, "%d", &mappings[i].node[j]);
+      read = fscanf(fp, "%d", &node);
       if(read != 1)
       {
 #if _DEBUG == 1
         fprintf(stderr, "Parsing error: not enough node "
-                        "mappings, line %lu\n", i);
+                        "mappings, line %lu\n", num_text);
 #endif
-        cleanup();
-        return;
+        goto error;
+      }
+
+      if(num_nodes == max_nodes)
+      {
+        max_nodes = max_nodes ? max_nodes * 2 : 256;
+        if(!(tmp_nodes = realloc(text_nodes, sizeof(int32_t) * max_nodes)))
+          goto error;
+        text_nodes = tmp_nodes;
       }
+      text_nodes[num_nodes++] = node;
     }
+
+    if(text[num_text].region != SCHED_DEFAULT_REGION &&
+       text[num_text].region >= dense)
+      dense = text[num_text].region + 1;
+    num_text++;
+  }
+
+  // Build the image, filling in the dense region table
+  size = sizeof(sched_header_t) + sizeof(sched_region_t) * (dense + 1) +
+         sizeof(int32_t) * num_nodes;
+  if(!(image = calloc(1, size))) goto error;
+  hdr = (sched_header_t *)image;
+  memcpy(hdr->magic, SCHED_MAGIC, SCHED_MAGIC_LEN);
+  hdr->version = SCHED_VERSION;
+  hdr->num_regions = dense;
+  hdr->num_nodes = num_nodes;
+  image_regions = (sched_region_t *)(hdr + 1);
+  image_nodes = (int32_t *)(image_regions + dense + 1);
+  for(i = 0; i < num_text; i++)
+  {
+    j = text[i].region == SCHED_DEFAULT_REGION ? dense : text[i].region;
+    image_regions[j].offset = text[i].offset;
+    image_regions[j].num = text[i].num;
+  }
+  if(num_nodes) memcpy(image_nodes, text_nodes, sizeof(int32_t) * num_nodes);
+
+  set_schedule(image, size);
+  sched = image;
+  sched_size = size;
+
+error:
+  free(text);
+  free(text_nodes);
+}
+
+/*
+ * Load the thread schedule, if one is available.  The file may either be a
+ * compiled schedule, which is mmap'd, or a text schedule (see
+ * read_text_schedule() for the format).
+ */
+static void __attribute__((constructor)) read_mapping_schedule()
+{
+  const char *fn;
+  char magic[SCHED_MAGIC_LEN];
+  struct stat st;
+  FILE *fp;
+
+  if(!(fn = getenv(ENV_POPCORN_THREAD_SCHEDULE))) fn = DEF_THREAD_SCHEDULE;
+  if(!(fp = fopen(fn, "r")))
+  {
+#if _DEBUG == 1
+    perror("Could not open thread schedule file");
+#endif
+    return;
   }
 
-  // Sort so we can do a binary search based on region ID
-  qsort(mappings, num_mappings, sizeof(mapping_t), region_compare);
+  if(fread(magic, 1, SCHED_MAGIC_LEN, fp) == SCHED_MAGIC_LEN &&
+     !memcmp(magic, SCHED_MAGIC, SCHED_MAGIC_LEN))
+  {
+    if(fstat(fileno(fp), &st) || !map_schedule(fileno(fp), st.st_size))
+    {
+#if _DEBUG == 1
+      fprintf(stderr, "Invalid compiled thread schedule '%s'\n", fn);
+#endif
+    }
+  }
+  else
+  {
+    fseek(fp, 0, SEEK_SET);
+    read_text_schedule(fp);
+  }
+  fclose(fp);
 
 #if _DEBUG == 1
+  size_t i, j;
+
   printf("-> Thread schedule <-\n");
-  for(i = 0; i < num_mappings; i++)
+  for(i = 0; regions && i <= num_regions; i++)
   {
-    printf("Region %lu: %lu mappings", mappings[i].region, mappings[i].num);
-    for(j = 0; j < mappings[i].num; j++) printf(" %d", mappings[i].node[j]);
+    if(!regions[i].num) continue;
+    if(i == num_regions) printf("Region -1: %u mappings", regions[i].num);
+    else printf("Region %lu: %u mappings", i, regions[i].num);
+    for(j = 0; j < regions[i].num; j++)
+      printf(" %d", nodes[regions[i].offset + j]);
     printf("\n");
   }
 #endif
-
-  fclose(fp);
-}
-
-/* Comparison function for finding region. */
-int region_find(const void *k, const void *m)
-{
-  size_t key = *(size_t *)k;
-  mapping_t *map = (mapping_t *)m;
-  if(key < map->region) return -1;
-  else if(key > map->region) return 1;
-  else return 0;
 }
 
 int get_node_mapping(size_t region, int ptid)
 {
-  if(ptid < 0) return default_node;
-  mapping_t *map = bsearch(&region, mappings, num_mappings,
-                           sizeof(mapping_t), region_find);
-  if(!map) return default_node;
+  const sched_region_t *map;
+
+  if(ptid < 0 || !regions) return default_node;
+  if(region < num_regions) map = &regions[region];
+  else if(region == SCHED_DEFAULT_REGION) map = &regions[num_regions];
+  else return default_node;
 
-  if((size_t)ptid < map->num) return map->node[ptid];
+  if((uint32_t)ptid < map->num) return nodes[map->offset + ptid];
   return default_node;
 }
-
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <assert.h>
@@ -43,49 +44,64 @@ static void *end_powerpc64 = NULL;
 static void *start_x86_64 = NULL;
 static void *end_x86_64 = NULL;
 
-/* TLS keys indicating if the thread has previously migrated */
-static pthread_key_t num_migrated_aarch64 = 0;
-static pthread_key_t num_migrated_powerpc64 = 0;
-static pthread_key_t num_migrated_x86_64 = 0;
+/* This architecture's range & the node to which it migrates */
+#ifdef __aarch64__
+# define env_start env_start_aarch64
+# define env_end env_end_aarch64
+# define migrate_start start_aarch64
+# define migrate_end end_aarch64
+# define MIGRATE_TARGET 0
+#elif defined(__powerpc64__)
+# define env_start env_start_powerpc64
+# define env_end env_end_powerpc64
+# define migrate_start start_powerpc64
+# define migrate_end end_powerpc64
+# define MIGRATE_TARGET 1
+#else
+# define env_start env_start_x86_64
+# define env_end env_end_x86_64
+# define migrate_start start_x86_64
+# define migrate_end end_x86_64
+# define MIGRATE_TARGET 2
+#endif
+
+/*
+ * Per-thread trigger state, replacing per-call pthread_getspecific() lookups.
+ * Threads check the address range until they migrate from it, after which (or
+ * if no range was specified) the trigger is disarmed & calls only test this
+ * word.  Disarming also clears the thread's migration request word so that
+ * compiler-inserted migration points stop calling into the library.  Threads
+ * other than the main thread start out uninitialized and arm themselves on
+ * their first call.
+ */
+enum trigger_state {
+  TRIGGER_UNINIT = 0,
+  TRIGGER_ARMED,
+  TRIGGER_DISARMED
+};
+
+static __thread int trigger = TRIGGER_UNINIT;
+
+static int __attribute__((noinline)) init_trigger(void)
+{
+  trigger = (migrate_start && migrate_end) ? TRIGGER_ARMED : TRIGGER_DISARMED;
+  if(trigger == TRIGGER_DISARMED) __migrate_request = 0;
+  return trigger;
+}
 
 /* Read environment variables to setup migration points. */
 static void __attribute__((constructor))
 __init_migrate_testing(void)
 {
-  const char *start;
-  const char *end;
+  const char *start = getenv(env_start);
+  const char *end = getenv(env_end);
 
-#ifdef __aarch64__
-  start = getenv(env_start_aarch64);
-  end = getenv(env_end_aarch64);
   if(start && end)
   {
-    start_aarch64 = (void *)strtoll(start, NULL, 16);
-    end_aarch64 = (void *)strtoll(end, NULL, 16);
-    if(start_aarch64 && end_aarch64)
-      pthread_key_create(&num_migrated_aarch64, NULL);
+    migrate_start = (void *)strtoll(start, NULL, 16);
+    migrate_end = (void *)strtoll(end, NULL, 16);
   }
-#elif defined(__powerpc64__)
-  start = getenv(env_start_powerpc64);
-  end = getenv(env_end_powerpc64);
-  if(start && end)
-  {
-    start_powerpc64 = (void *)strtoll(start, NULL, 16);
-    end_powerpc64 = (void *)strtoll(end, NULL, 16);
-    if(start_powerpc64 && end_powerpc64)
-      pthread_key_create(&num_migrated_powerpc64, NULL);
-  }
-#else
-  start = getenv(env_start_x86_64);
-  end = getenv(env_end_x86_64);
-  if(start && end)
-  {
-    start_x86_64 = (void *)strtoll(start, NULL, 16);
-    end_x86_64 = (void *)strtoll(end, NULL, 16);
-    if(start_x86_64 && end_x86_64)
-      pthread_key_create(&num_migrated_x86_64, NULL);
-  }
-#endif
+  init_trigger();
 }
 
 /*
@@ -94,30 +110,15 @@ __init_migrate_testing(void)
  */
 static inline int do_migrate(void *addr)
 {
-  int retval = -1;
-#ifdef __aarch64__
-  if(start_aarch64 && !pthread_getspecific(num_migrated_aarch64)) {
-    if(start_aarch64 <= addr && addr < end_aarch64) {
-      pthread_setspecific(num_migrated_aarch64, (void *)1);
-      retval = 0;
-    }
-  }
-#elif defined(__powerpc64__)
-  if(start_powerpc64 && !pthread_getspecific(num_migrated_powerpc64)) {
-    if(start_powerpc64 <= addr && addr < end_powerpc64) {
-      pthread_setspecific(num_migrated_powerpc64, (void *)1);
-      retval = 1;
-    }
-  }
-#else
-  if(start_x86_64 && !pthread_getspecific(num_migrated_x86_64)) {
-    if(start_x86_64 <= addr && addr < end_x86_64) {
-      pthread_setspecific(num_migrated_x86_64, (void *)1);
-      retval = 2;
-    }
+  int state = trigger;
+  if(__builtin_expect(state == TRIGGER_DISARMED, 1)) return -1;
+  if(state == TRIGGER_UNINIT && init_trigger() != TRIGGER_ARMED) return -1;
+  if(migrate_start <= addr && addr < migrate_end) {
+    trigger = TRIGGER_DISARMED;
+    __migrate_request = 0;
+    return MIGRATE_TARGET;
   }
-#endif
-  return retval;
+  return -1;
 }
 
 #else /* _ENV_SELECT_MIGRATE */
@@ -203,6 +204,85 @@ static inline void *get_thread_pointer(void *raw_tls, enum arch dest)
   }
 }
 
+#ifdef __aarch64__
+# define LOCAL_ARCH ARCH_AARCH64
+#elif defined(__powerpc64__)
+# define LOCAL_ARCH ARCH_POWERPC64
+#else
+# define LOCAL_ARCH ARCH_X86_64
+#endif
+
+/* Register set for any architecture. */
+union regset {
+  struct regset_aarch64 aarch;
+  struct regset_powerpc64 powerpc;
+  struct regset_x86_64 x86;
+};
+
+/*
+ * Per-thread migration state, prepared before the first migration between a
+ * pair of architectures & re-used by subsequent migrations between them so
+ * that frequent migrators only pay for the rewrite itself.
+ */
+struct migrate_prep {
+  int prepared; // Non-zero if the state below is valid
+  st_userspace_handles handles; // Pinned rewriting metadata
+  void *thread_pointer; // Destination architecture's thread pointer
+  union regset regs_dst; // Destination register set
+};
+
+static pthread_once_t prep_once = PTHREAD_ONCE_INIT;
+static pthread_key_t prep_key; // Frees the thread's state when it exits
+
+/*
+ * The thread's preparations, indexed by source & destination architecture.
+ * The thread keeps its TLS across migrations, so the source must be part of
+ * the key: a preparation made on one architecture is not valid on another.
+ */
+static __thread struct migrate_prep (*prep)[NUM_ARCHES] = NULL;
+
+static void init_prep_key(void) { pthread_key_create(&prep_key, free); }
+
+/*
+ * Get the calling thread's preparation for migrating to a node, preparing it
+ * if this is the first migration from the current to the node's architecture.
+ *
+ * @param nid the node ID
+ * @return the thread's preparation, or NULL if it could not be prepared
+ */
+static struct migrate_prep *get_prep(int nid)
+{
+  enum arch dst_arch, rewrite_arch;
+  struct migrate_prep *cur;
+
+  if(!node_available(nid)) return NULL;
+  dst_arch = ni[nid].arch;
+  if(dst_arch < 0 || dst_arch >= NUM_ARCHES) return NULL;
+  if(prep && prep[LOCAL_ARCH][dst_arch].prepared)
+    return &prep[LOCAL_ARCH][dst_arch];
+#if _NATIVE == 1
+  rewrite_arch = LOCAL_ARCH;
+#else
+  rewrite_arch = dst_arch;
+#endif
+
+  if(!prep)
+  {
+    pthread_once(&prep_once, init_prep_key);
+    if(!(prep = calloc(NUM_ARCHES, sizeof(*prep)))) return NULL;
+    pthread_setspecific(prep_key, prep);
+  }
+
+  cur = &prep[LOCAL_ARCH][dst_arch];
+  if(st_userspace_prepare(LOCAL_ARCH, rewrite_arch, &cur->handles))
+    return NULL;
+  cur->thread_pointer = get_thread_pointer(GET_TLS_POINTER, dst_arch);
+  cur->prepared = 1;
+  return cur;
+}
+
+int migrate_prepare(int nid) { return get_prep(nid) == NULL; }
+
 /* Generate a call site to get rewriting metadata for outermost frame. */
 static void* __attribute__((noinline))
 get_call_site() { return __builtin_return_address(0); };
@@ -231,28 +311,46 @@ __migrate_shim_internal(int nid, void (*callback)(void *), void *callback_data)
   {
     unsigned long sp = 0, bp = 0;
     const enum arch dst_arch = ni[nid].arch;
-    union {
-       struct regset_aarch64 aarch;
-       struct regset_powerpc64 powerpc;
-       struct regset_x86_64 x86;
-    } regs_src, regs_dst;
+    union regset regs_src, *regs_dst;
+    struct migrate_prep *cur;
+    void *thread_pointer;
 #if _TIME_REWRITE == 1
-    unsigned long long start, end;
+    unsigned long long start, captured, prepared, end;
+    TIMESTAMP(start);
 #endif
+    PHASE_TIMESTAMP(PHASE_START);
     GET_LOCAL_REGSET(regs_src);
+    PHASE_TIMESTAMP(PHASE_CAPTURE);
 
 #if _TIME_REWRITE == 1
-    TIMESTAMP(start);
+    TIMESTAMP(captured);
+#endif
+    if(!(cur = get_prep(nid)))
+    {
+      fprintf(stderr, "Could not prepare migration!\n");
+      return;
+    }
+    regs_dst = &cur->regs_dst;
+    thread_pointer = cur->thread_pointer;
+    PHASE_TIMESTAMP(PHASE_PREPARE);
+
+#if _TIME_REWRITE == 1
+    TIMESTAMP(prepared);
 #endif
-    if(REWRITE_STACK(regs_src, regs_dst, dst_arch))
+    if(REWRITE_STACK(regs_src, regs_dst, dst_arch, &cur->handles))
     {
+      PHASE_TIMESTAMP(PHASE_REWRITE);
 #if _TIME_REWRITE == 1
       TIMESTAMP(end);
-      printf("Stack transformation time: %lluns\n", TIMESTAMP_DIFF(start, end));
+      printf("Stack transformation time: %lluns (capture: %lluns, "
+             "prepare: %lluns, rewrite: %lluns)\n",
+             TIMESTAMP_DIFF(start, end), TIMESTAMP_DIFF(start, captured),
+             TIMESTAMP_DIFF(captured, prepared),
+             TIMESTAMP_DIFF(prepared, end));
 #endif
       data.callback = callback;
       data.callback_data = callback_data;
-      data.regset = &regs_dst;
+      data.regset = regs_dst;
       pthread_set_migrate_args(&data);
 #if _SIG_MIGRATION == 1
       clear_migrate_flag();
@@ -260,27 +358,27 @@ __migrate_shim_internal(int nid, void (*callback)(void *), void *callback_data)
 
       switch(dst_arch) {
       case ARCH_AARCH64:
-        regs_dst.aarch.pc = __migrate_fixup_aarch64;
-        sp = (unsigned long)regs_dst.aarch.sp;
-        bp = (unsigned long)regs_dst.aarch.x[29];
+        regs_dst->aarch.pc = __migrate_fixup_aarch64;
+        sp = (unsigned long)regs_dst->aarch.sp;
+        bp = (unsigned long)regs_dst->aarch.x[29];
 #if _LOG == 1
-        dump_regs_aarch64(&regs_dst.aarch, LOG_FILE);
+        dump_regs_aarch64(&regs_dst->aarch, LOG_FILE);
 #endif
         break;
       case ARCH_POWERPC64:
-        regs_dst.powerpc.pc = __migrate_fixup_powerpc64;
-        sp = (unsigned long)regs_dst.powerpc.r[1];
-        bp = (unsigned long)regs_dst.powerpc.r[31];
+        regs_dst->powerpc.pc = __migrate_fixup_powerpc64;
+        sp = (unsigned long)regs_dst->powerpc.r[1];
+        bp = (unsigned long)regs_dst->powerpc.r[31];
 #if _LOG == 1
-        dump_regs_powerpc64(&regs_dst.powerpc, LOG_FILE);
+        dump_regs_powerpc64(&regs_dst->powerpc, LOG_FILE);
 #endif
         break;
       case ARCH_X86_64:
-        regs_dst.x86.rip = __migrate_fixup_x86_64;
-        sp = (unsigned long)regs_dst.x86.rsp;
-        bp = (unsigned long)regs_dst.x86.rbp;
+        regs_dst->x86.rip = __migrate_fixup_x86_64;
+        sp = (unsigned long)regs_dst->x86.rsp;
+        bp = (unsigned long)regs_dst->x86.rbp;
 #if _LOG == 1
-        dump_regs_x86_64(&regs_dst.x86, LOG_FILE);
+        dump_regs_x86_64(&regs_dst->x86, LOG_FILE);
 #endif
         break;
       default: assert(0 && "Unsupported architecture!");
@@ -292,7 +390,19 @@ __migrate_shim_internal(int nid, void (*callback)(void *), void *callback_data)
 
       // Translate between architecture-specific thread descriptors
       // Note: TLS is now invalid until after migration!
-      __set_thread_area(get_thread_pointer(GET_TLS_POINTER, dst_arch));
+      __set_thread_area(thread_pointer);
+      PHASE_TIMESTAMP(PHASE_SETUP);
+
+#if _EMULATE_MIGRATION == 1 && _NATIVE == 1
+      // Native execution never enters the migration system call, so switch
+      // the emulated node here
+      if(__migrate_emulate_enter(nid))
+      {
+        perror("Could not migrate to node");
+        pthread_set_migrate_args(NULL);
+        return;
+      }
+#endif
 
       // This code has different behavior depending on the type of migration:
       //
@@ -322,6 +432,7 @@ __migrate_shim_internal(int nid, void (*callback)(void *), void *callback_data)
   }
 
   // Post-migration
+  PHASE_TIMESTAMP(PHASE_RESUME);
 #if _DEBUG == 1
   // Hold until we can attach post-migration
   while(__hold);
@@ -330,6 +441,7 @@ __migrate_shim_internal(int nid, void (*callback)(void *), void *callback_data)
   if(cur_nid != origin_nid) remote_debug_init(cur_nid);
 #endif
   if(data_ptr->callback) data_ptr->callback(data_ptr->callback_data);
+  PHASE_TIMESTAMP(PHASE_CALLBACK);
 
   pthread_set_migrate_args(NULL);
 }
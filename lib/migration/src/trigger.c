@@ -1,17 +1,35 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <unistd.h>
 #include <string.h>
 #include <signal.h>
 #include <assert.h>
 #include "config.h"
+#include "migrate.h"
+
+/*
+ * Migration request word tested by compiler-inserted migration points.  When
+ * migrations are triggered by signals, threads only need to call into the
+ * migration library once signalled.  Otherwise threads need to check at every
+ * migration point, although selecting migration points via environment
+ * variables clears the word for threads which can no longer migrate.
+ */
+#if _SIG_MIGRATION == 1 && _ENV_SELECT_MIGRATE == 0
+__thread volatile int __migrate_request = 0;
+#else
+__thread volatile int __migrate_request = 1;
+#endif
 
 #if _SIG_MIGRATION == 1
 
-/* Flag set by signal handler indicating a thread should migrate. */
-// TODO this should be thread-specific
-volatile int __migrate_flag = -1;
+/*
+ * Flag set by signal handler indicating a thread should migrate.  Migration
+ * signals are delivered to the thread that should migrate, so the flag is
+ * thread-local (the compiler instrumentation reads it as a TLS variable).
+ */
+__thread volatile int __migrate_flag = -1;
 
 #if _TIME_RESPONSE_DELAY == 1
 
@@ -20,28 +38,88 @@ volatile int __migrate_flag = -1;
 /*
  * Statistics about number of times a migration was signalled and the time
  * between when the migration was signalled and when the thread reached the
- * migration library.
+ * migration library.  Response times are recorded in a log-bucketed histogram
+ * updated with atomic increments, so any number of threads can record an
+ * unbounded number of timings without locks.  Each power-of-two range of
+ * nanoseconds is split into 2^HISTO_SUB_BITS linear sub-buckets, bounding
+ * the error of reported percentiles to 1/2^HISTO_SUB_BITS (12.5%).
  */
-// Note: we don't expect to be signalled *that* much during a single
-// application's execution, so only maintain 1024 timings.
-static volatile unsigned long num_triggers = 0;
-static unsigned long long response_timings[1024] = { 0L }; // In nanoseconds
+#define HISTO_SUB_BITS 3
+#define HISTO_SUB_BUCKETS (1UL << HISTO_SUB_BITS)
+#define HISTO_BUCKETS ((64 - HISTO_SUB_BITS + 1) * HISTO_SUB_BUCKETS)
+
+static unsigned long num_triggers = 0;
+static unsigned long long total_time = 0, max_time = 0; // In nanoseconds
+static unsigned long histogram[HISTO_BUCKETS] = { 0 };
 
 /*
  * Starting (architecture-specific) timestamp set when a thread executes the
  * migration request signal handler.
  */
-// TODO needs to be thread-specific
-static unsigned long long start = UINT64_MAX;
+static __thread unsigned long long start = UINT64_MAX;
+
+/* Map a response time to its histogram bucket. */
+static inline unsigned long histo_bucket(unsigned long long ns)
+{
+  unsigned long exp;
+  if(ns < HISTO_SUB_BUCKETS) return ns;
+  exp = 63 - __builtin_clzll(ns);
+  return (exp - HISTO_SUB_BITS + 1) * HISTO_SUB_BUCKETS +
+         ((ns >> (exp - HISTO_SUB_BITS)) & (HISTO_SUB_BUCKETS - 1));
+}
+
+/* Return the largest response time that maps to a histogram bucket. */
+static inline unsigned long long histo_bucket_max(unsigned long bucket)
+{
+  unsigned long exp, sub;
+  if(bucket < HISTO_SUB_BUCKETS) return bucket;
+  exp = bucket / HISTO_SUB_BUCKETS + HISTO_SUB_BITS - 1;
+  sub = bucket % HISTO_SUB_BUCKETS;
+  return ((HISTO_SUB_BUCKETS + sub + 1) << (exp - HISTO_SUB_BITS)) - 1;
+}
+
+static void record_response_time(unsigned long long ns)
+{
+  unsigned long long cur = __atomic_load_n(&max_time, __ATOMIC_RELAXED);
+
+  __atomic_fetch_add(&histogram[histo_bucket(ns)], 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&total_time, ns, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&num_triggers, 1, __ATOMIC_RELAXED);
+  while(ns > cur && !__atomic_compare_exchange_n(&max_time, &cur, ns, true,
+                                                 __ATOMIC_RELAXED,
+                                                 __ATOMIC_RELAXED));
+}
+
+/*
+ * Return the response time at a percentile, i.e., the upper bound of the
+ * bucket containing the percentile (capped by the maximum response time).
+ */
+static unsigned long long histo_percentile(double pct)
+{
+  unsigned long i, seen = 0, target;
+  unsigned long long val;
+
+  target = (unsigned long)(pct * num_triggers + 0.5);
+  if(!target) target = 1;
+  for(i = 0; i < HISTO_BUCKETS; i++)
+  {
+    seen += histogram[i];
+    if(seen >= target) break;
+  }
+  val = histo_bucket_max(i);
+  return val < max_time ? val : max_time;
+}
 
 /* Output response time statistics. */
 // Note: destructor should only be called by one thread and is therefore
 // thread-safe.
 static void __attribute__((destructor)) __print_response_timing()
 {
-  unsigned long i;
-  printf("Number of migration triggers: %lu\nResponse times:\n", num_triggers);
-  for(i = 0; i < num_triggers; i++) printf("  %llu ns\n", response_timings[i]);
+  printf("Number of migration triggers: %lu\n", num_triggers);
+  if(!num_triggers) return;
+  printf("Response times: mean %llu ns, p50 %llu ns, p99 %llu ns, "
+         "max %llu ns\n", total_time / num_triggers, histo_percentile(0.5),
+         histo_percentile(0.99), max_time);
 }
 
 #endif /* _TIME_RESPONSE_DELAY */
@@ -53,19 +131,18 @@ static void __attribute__((destructor)) __print_response_timing()
 void clear_migrate_flag()
 {
 #if _TIME_RESPONSE_DELAY == 1
-  unsigned long end, idx;
+  unsigned long long end;
   if(start != UINT64_MAX)
   {
     TIMESTAMP(end);
-    idx = __sync_fetch_and_add(&num_triggers, 1);
-    if(idx >= 1024) fprintf(stderr, "WARNING: too many response timings!\n");
-    else response_timings[idx] = TIMESTAMP_DIFF(start, end);
+    record_response_time(TIMESTAMP_DIFF(start, end));
     start = UINT64_MAX;
   }
   else fprintf(stderr, "WARNING: no starting time stamp");
 #endif
 
   __migrate_flag = -1;
+  __migrate_request = 0;
 }
 
 /*
@@ -86,6 +163,7 @@ static void __migrate_sighandler(int sig, siginfo_t *info, void *args)
   // TODO this needs to be set according to the what the OS tells us (maybe in
   // the args argument?)
   __migrate_flag = 1;
+  __migrate_request = 1;
 
   // Tell the OS we're requesting this thread migrate.
   // TODO in the real version, the OS should *know* that the thread is to be
@@ -0,0 +1,108 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <time.h>
+#include "migrate.h"
+
+/*
+ * Per-call overhead of check_migrate() on a call-heavy kernel (recursive
+ * Fibonacci) that never migrates.  Each call to fib() is timed with and
+ * without a check_migrate() call at function entry & exit, mimicking the
+ * migration points inserted by the compiler.  Points are timed both as plain
+ * calls & as the inline check of the migration request word now emitted by the
+ * compiler, which is what -more-mig-points multiplies.  Build against the
+ * migration library built with "type=env_select" and run once with migration
+ * disabled & once with the trigger armed at an address range that is never
+ * hit, e.g.:
+ *
+ *   ./check_migrate
+ *   X86_64_MIGRATE_START=1 X86_64_MIGRATE_END=2 ./check_migrate
+ */
+
+#define TO_NS( ts ) ((ts.tv_sec * 1000000000) + ts.tv_nsec)
+
+static unsigned long n = 30;
+static size_t niters = 5;
+
+static unsigned long __attribute__((noinline)) fib(unsigned long n) {
+  if(n < 2) return n;
+  return fib(n - 1) + fib(n - 2);
+}
+
+static unsigned long __attribute__((noinline)) fib_check(unsigned long n) {
+  unsigned long ret;
+  check_migrate(NULL, NULL);
+  if(n < 2) ret = n;
+  else ret = fib_check(n - 1) + fib_check(n - 2);
+  check_migrate(NULL, NULL);
+  return ret;
+}
+
+static unsigned long __attribute__((noinline)) fib_inline(unsigned long n) {
+  unsigned long ret;
+  if(__builtin_expect(__migrate_request, 0)) check_migrate(NULL, NULL);
+  if(n < 2) ret = n;
+  else ret = fib_inline(n - 1) + fib_inline(n - 2);
+  if(__builtin_expect(__migrate_request, 0)) check_migrate(NULL, NULL);
+  return ret;
+}
+
+static double time_kernel(unsigned long (*kernel)(unsigned long),
+                          unsigned long *result) {
+  size_t i;
+  struct timespec start, end;
+  double best = 0.0, cur;
+
+  for(i = 0; i < niters; i++) {
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    *result = kernel(n);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    cur = (double)(TO_NS(end) - TO_NS(start));
+    if(!i || cur < best) best = cur;
+  }
+  return best;
+}
+
+static void print_help(const char *bin) {
+  printf("%s: measure check_migrate() overhead\n\n", bin);
+  printf("Usage: %s [ OPTIONS ]\n", bin);
+  printf("Options:\n");
+  printf("  -h     : print help & exit\n");
+  printf("  -n num : Fibonacci number to calculate (default: %lu)\n", n);
+  printf("  -i num : number of timed runs, fastest is reported "
+         "(default: %lu)\n", niters);
+}
+
+int main(int argc, char **argv) {
+  int c;
+  unsigned long result, result_check, result_inline, calls;
+  double base, check, check_inline;
+
+  while((c = getopt(argc, argv, "hn:i:")) != -1) {
+    switch(c) {
+    case 'n': n = strtoul(optarg, NULL, 10); break;
+    case 'i': niters = strtoul(optarg, NULL, 10); break;
+    case 'h':
+    default: print_help(argv[0]); return 0;
+    }
+  }
+  if(!niters) niters = 1;
+
+  base = time_kernel(fib, &result);
+  check = time_kernel(fib_check, &result_check);
+  check_inline = time_kernel(fib_inline, &result_inline);
+  if(result != result_check || result != result_inline) {
+    fprintf(stderr, "ERROR: results differ (%lu vs. %lu vs. %lu)\n",
+            result, result_check, result_inline);
+    return 1;
+  }
+
+  /* fib(n) makes 2 * fib(n + 1) - 1 calls, each with 2 migration points */
+  calls = 2 * (2 * fib(n + 1) - 1);
+  printf("fib(%lu): %.3f ms, %.3f ms with %lu check_migrate() calls, "
+         "%.2f ns/call\n", n, base / 1e6, check / 1e6, calls,
+         (check - base) / calls);
+  printf("fib(%lu): %.3f ms with inline request checks, %.2f ns/point\n",
+         n, check_inline / 1e6, (check_inline - base) / calls);
+  return 0;
+}
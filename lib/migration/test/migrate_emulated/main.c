@@ -0,0 +1,124 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <time.h>
+#include "migrate.h"
+
+/*
+ * End-to-end migration throughput & per-phase latency on stock Linux.  The
+ * thread descends a synthetic call chain & migrates at the bottom, bouncing
+ * between the origin and another node, so every migration captures, prepares
+ * & resumes a thread with a call chain of the given depth.  Build against the
+ * migration library built with "type=emulate" (x86-64 only), e.g.:
+ *
+ *   ./migrate_emulated -d 16 -n 100000
+ *   POPCORN_EMULATE_NODES=4 ./migrate_emulated -t 3
+ *
+ * Emulated nodes share the local architecture, so by default migrations copy
+ * the register set.  Build the library with "type=emulate,native" to instead
+ * rewrite the entire call chain on every migration.
+ */
+
+#define TO_NS( ts ) ((ts.tv_sec * 1000000000) + ts.tv_nsec)
+
+static size_t depth = 8;
+static size_t nmigrations = 10000;
+static int target = 1;
+
+static unsigned long __attribute__((noinline))
+chain(size_t level, int nid) {
+  unsigned long ret;
+  if(level) ret = chain(level - 1, nid) + level;
+  else {
+    migrate(nid, NULL, NULL);
+    ret = current_nid();
+  }
+  return ret;
+}
+
+static void print_help(const char *bin) {
+  printf("%s: measure end-to-end migrations on emulated nodes\n\n", bin);
+  printf("Usage: %s [ OPTIONS ]\n", bin);
+  printf("Options:\n");
+  printf("  -h     : print help & exit\n");
+  printf("  -d num : depth of the call chain at which to migrate "
+         "(default: %lu)\n", depth);
+  printf("  -n num : number of timed migrations (default: %lu)\n",
+         nmigrations);
+  printf("  -t nid : node to migrate to & back from (default: %d)\n", target);
+}
+
+int main(int argc, char **argv) {
+  int c, nid, origin;
+  size_t i, recorded = 0;
+  unsigned long expected = 0;
+  struct timespec start, end;
+  struct migrate_phases phases, sum = { 0 };
+  double elapsed;
+
+  while((c = getopt(argc, argv, "hd:n:t:")) != -1) {
+    switch(c) {
+    case 'd': depth = strtoul(optarg, NULL, 10); break;
+    case 'n': nmigrations = strtoul(optarg, NULL, 10); break;
+    case 't': target = atoi(optarg); break;
+    case 'h':
+    default: print_help(argv[0]); return 0;
+    }
+  }
+
+  nid = origin = current_nid();
+  if(target == origin || !node_available(target)) {
+    fprintf(stderr, "ERROR: node %d is not available to migrate to\n", target);
+    return 1;
+  }
+  for(i = 1; i <= depth; i++) expected += i;
+
+  /* Warm up so the timed migrations don't include the first preparation */
+  chain(depth, target);
+  chain(depth, origin);
+  if(current_nid() != origin) {
+    fprintf(stderr, "ERROR: could not migrate (is the library built with "
+                    "type=emulate?)\n");
+    return 1;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(i = 0; i < nmigrations; i++) {
+    nid = (i % 2) ? origin : target;
+    if(chain(depth, nid) != expected + nid) {
+      fprintf(stderr, "ERROR: migration %lu did not reach node %d\n", i, nid);
+      return 1;
+    }
+    if(!migrate_last_phases(&phases)) {
+      sum.capture += phases.capture;
+      sum.prepare += phases.prepare;
+      sum.rewrite += phases.rewrite;
+      sum.setup += phases.setup;
+      sum.syscall += phases.syscall;
+      sum.resume += phases.resume;
+      sum.callback += phases.callback;
+      sum.total += phases.total;
+      recorded++;
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  if(nid != origin) chain(depth, origin);
+
+  elapsed = (double)(TO_NS(end) - TO_NS(start));
+  printf("%lu migrations at depth %lu: %.3f ms, %.0f migrations/s\n",
+         nmigrations, depth, elapsed / 1e6, nmigrations / (elapsed / 1e9));
+  if(!recorded) {
+    printf("No per-phase latencies recorded\n");
+    return 0;
+  }
+  printf("Per-phase latency (ns, average of %lu):\n", recorded);
+  printf("  capture  : %.1f\n", (double)sum.capture / recorded);
+  printf("  prepare  : %.1f\n", (double)sum.prepare / recorded);
+  printf("  rewrite  : %.1f\n", (double)sum.rewrite / recorded);
+  printf("  setup    : %.1f\n", (double)sum.setup / recorded);
+  printf("  syscall  : %.1f\n", (double)sum.syscall / recorded);
+  printf("  resume   : %.1f\n", (double)sum.resume / recorded);
+  printf("  callback : %.1f\n", (double)sum.callback / recorded);
+  printf("  total    : %.1f\n", (double)sum.total / recorded);
+  return 0;
+}
@@ -0,0 +1,60 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <time.h>
+#include "migrate.h"
+
+/*
+ * Overhead of migrate_schedule() when the thread schedule keeps the thread on
+ * its current node, i.e., the cost of the schedule lookup & node check.
+ * Generate a schedule which maps every region to the origin node, optionally
+ * compile it, and run the benchmark with it, e.g.:
+ *
+ *   for i in $(seq 0 999); do echo "$i 1 0"; done > thread-schedule.txt
+ *   POPCORN_THREAD_SCHEDULE=thread-schedule.txt ./schedule -r 1000
+ *   compile-schedule.py -input thread-schedule.txt -output thread-schedule.bin
+ *   POPCORN_THREAD_SCHEDULE=thread-schedule.bin ./schedule -r 1000
+ */
+
+#define TO_NS( ts ) ((ts.tv_sec * 1000000000) + ts.tv_nsec)
+
+static size_t nregions = 1000;
+static size_t niters = 10000000;
+
+static void print_help(const char *bin) {
+  printf("%s: measure migrate_schedule() overhead\n\n", bin);
+  printf("Usage: %s [ OPTIONS ]\n", bin);
+  printf("Options:\n");
+  printf("  -h     : print help & exit\n");
+  printf("  -r num : number of regions to cycle through (default: %lu)\n",
+         nregions);
+  printf("  -i num : number of migrate_schedule() calls (default: %lu)\n",
+         niters);
+}
+
+int main(int argc, char **argv) {
+  size_t i;
+  int c;
+  struct timespec start, end;
+  double elapsed;
+
+  while((c = getopt(argc, argv, "hr:i:")) != -1) {
+    switch(c) {
+    case 'r': nregions = strtoul(optarg, NULL, 10); break;
+    case 'i': niters = strtoul(optarg, NULL, 10); break;
+    case 'h':
+    default: print_help(argv[0]); return 0;
+    }
+  }
+  if(!nregions) nregions = 1;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(i = 0; i < niters; i++)
+    migrate_schedule(i % nregions, 0, NULL, NULL);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  elapsed = (double)(TO_NS(end) - TO_NS(start));
+  printf("%lu calls over %lu regions: %.3f ms, %.2f ns/call\n",
+         niters, nregions, elapsed / 1e6, niters ? elapsed / niters : 0.0);
+  return 0;
+}
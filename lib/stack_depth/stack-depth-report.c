@@ -0,0 +1,281 @@
+/*
+ * Streaming reader for binary stack depth data.  Prints the same summary as
+ * util/scripts/stack-depth-info.py (average depth, maximum depth & the most
+ * called functions) while only keeping the address dictionary and the top-N
+ * functions in memory.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "stack_depth_format.h"
+
+#define DEFAULT_TOP 20
+
+typedef struct {
+  uint64_t idx, calls;
+} caller_t;
+
+typedef struct {
+  uint64_t func, calls, depth, incl;
+  caller_t *callers;
+  uint64_t num_callers;
+} func_t;
+
+static const char *data_file = NULL;
+static size_t top = DEFAULT_TOP;
+static bool verbose = false;
+
+static void print_help(const char *bin)
+{
+  printf("%s: summarize binary stack depth data\n\n", bin);
+  printf("Usage: %s -d file [ OPTIONS ]\n", bin);
+  printf("Options:\n");
+  printf("  -h      : print help & exit\n");
+  printf("  -d file : stack depth file dumped by library\n");
+  printf("  -n num  : number of most-called functions to print (default: %d, "
+         "0 for all)\n", DEFAULT_TOP);
+  printf("  -v      : verbose output, prints caller information\n");
+}
+
+static bool read_varint(FILE *fp, uint64_t *val)
+{
+  int c, i, shift = 0;
+
+  *val = 0;
+  for(i = 0; i < STACK_DATA_MAX_VARINT; i++, shift += 7)
+  {
+    if((c = getc(fp)) == EOF) return false;
+    *val |= (uint64_t)(c & 0x7f) << shift;
+    if(!(c & 0x80)) return true;
+  }
+  return false;
+}
+
+/*
+ * Min-heap of the most-called functions seen so far, keyed by number of calls.
+ */
+static func_t *heap;
+static size_t heap_size;
+
+static void heap_swap(size_t a, size_t b)
+{
+  func_t tmp = heap[a];
+  heap[a] = heap[b];
+  heap[b] = tmp;
+}
+
+static void heap_sift_down(size_t i)
+{
+  size_t min, l, r;
+
+  while(true)
+  {
+    min = i;
+    l = 2 * i + 1;
+    r = 2 * i + 2;
+    if(l < heap_size && heap[l].calls < heap[min].calls) min = l;
+    if(r < heap_size && heap[r].calls < heap[min].calls) min = r;
+    if(min == i) break;
+    heap_swap(i, min);
+    i = min;
+  }
+}
+
+static void heap_sift_up(size_t i)
+{
+  while(i && heap[i].calls < heap[(i - 1) / 2].calls)
+  {
+    heap_swap(i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+}
+
+/* Add a function to the heap.  Returns false if the function was dropped
+   because it was called less than every function already in the heap. */
+static bool heap_push(const func_t *func)
+{
+  if(heap_size < top)
+  {
+    heap[heap_size] = *func;
+    heap_sift_up(heap_size++);
+    return true;
+  }
+  else if(func->calls > heap[0].calls)
+  {
+    free(heap[0].callers);
+    heap[0] = *func;
+    heap_sift_down(0);
+    return true;
+  }
+  return false;
+}
+
+static int cmp_calls(const void *a, const void *b)
+{
+  const func_t *fa = (const func_t *)a, *fb = (const func_t *)b;
+  if(fa->calls > fb->calls) return -1;
+  else if(fa->calls < fb->calls) return 1;
+  else return 0;
+}
+
+static int cmp_caller_calls(const void *a, const void *b)
+{
+  const caller_t *ca = (const caller_t *)a, *cb = (const caller_t *)b;
+  if(ca->calls > cb->calls) return -1;
+  else if(ca->calls < cb->calls) return 1;
+  else return 0;
+}
+
+int main(int argc, char **argv)
+{
+  FILE *fp;
+  char magic[STACK_DATA_MAGIC_LEN];
+  uint64_t version, num_addrs, num_funcs, *addrs, i, j, delta, prev;
+  uint64_t total_calls = 0, total_depth = 0, max_depth = 0, max_func = 0,
+           max_caller = 0, max_caller_idx, this_max, count;
+  size_t cap;
+  func_t func;
+  int c;
+
+  while((c = getopt(argc, argv, "hd:n:v")) != -1)
+  {
+    switch(c)
+    {
+    case 'd': data_file = optarg; break;
+    case 'n': top = strtoul(optarg, NULL, 10); break;
+    case 'v': verbose = true; break;
+    case 'h':
+    default: print_help(argv[0]); return 0;
+    }
+  }
+
+  if(!data_file)
+  {
+    printf("Please supply a data file!\n");
+    print_help(argv[0]);
+    return 1;
+  }
+
+  if(!(fp = fopen(data_file, "rb")))
+  {
+    fprintf(stderr, "ERROR: could not open '%s'\n", data_file);
+    return 1;
+  }
+
+  if(fread(magic, 1, STACK_DATA_MAGIC_LEN, fp) != STACK_DATA_MAGIC_LEN ||
+     memcmp(magic, STACK_DATA_MAGIC, STACK_DATA_MAGIC_LEN))
+  {
+    fprintf(stderr, "ERROR: '%s' is not binary stack depth data (text data "
+                    "can be parsed by stack-depth-info.py)\n", data_file);
+    return 1;
+  }
+  if(!read_varint(fp, &version) || version != STACK_DATA_VERSION)
+  {
+    fprintf(stderr, "ERROR: unsupported format version %lu\n", version);
+    return 1;
+  }
+  if(!read_varint(fp, &num_addrs) || !read_varint(fp, &num_funcs)) goto trunc;
+
+  if(!(addrs = malloc(sizeof(uint64_t) * (num_addrs ? num_addrs : 1))))
+  {
+    fprintf(stderr, "ERROR: could not allocate address dictionary\n");
+    return 1;
+  }
+  for(i = 0, prev = 0; i < num_addrs; i++)
+  {
+    if(!read_varint(fp, &delta)) goto trunc;
+    prev = addrs[i] = prev + delta;
+  }
+
+  cap = top ? top : num_funcs;
+  if(!(heap = malloc(sizeof(func_t) * (cap ? cap : 1))))
+  {
+    fprintf(stderr, "ERROR: could not allocate function table\n");
+    return 1;
+  }
+  if(!top) top = num_funcs;
+
+  for(i = 0; i < num_funcs; i++)
+  {
+    memset(&func, 0, sizeof(func));
+    if(!read_varint(fp, &func.func) || !read_varint(fp, &func.calls) ||
+       !read_varint(fp, &func.depth) || !read_varint(fp, &max_caller_idx) ||
+       !read_varint(fp, &this_max) || !read_varint(fp, &func.incl) ||
+       !read_varint(fp, &func.num_callers) ||
+       func.func >= num_addrs || max_caller_idx >= num_addrs) goto trunc;
+
+    total_calls += func.calls;
+    total_depth += func.depth;
+    if(this_max > max_depth)
+    {
+      max_depth = this_max;
+      max_func = addrs[func.func];
+      max_caller = addrs[max_caller_idx];
+    }
+
+    // Only keep callers for functions that will be printed
+    if(verbose && (heap_size < top || func.calls > heap[0].calls))
+    {
+      func.callers = malloc(sizeof(caller_t) * (func.num_callers ?
+                                                func.num_callers : 1));
+      if(!func.callers)
+      {
+        fprintf(stderr, "ERROR: could not allocate callers\n");
+        return 1;
+      }
+    }
+    for(j = 0, prev = 0; j < func.num_callers; j++)
+    {
+      if(!read_varint(fp, &delta) || (prev += delta) >= num_addrs ||
+         !read_varint(fp, &count)) goto trunc;
+      if(func.callers)
+      {
+        func.callers[j].idx = prev;
+        func.callers[j].calls = count;
+      }
+    }
+    if(!heap_push(&func)) free(func.callers);
+  }
+  fclose(fp);
+
+  qsort(heap, heap_size, sizeof(func_t), cmp_calls);
+
+  printf("Data from %s\n", data_file);
+  printf("Average depth: %.3f\n",
+         total_calls ? (double)total_depth / (double)total_calls : 0.0);
+  printf("Max depth: %lu, 0x%lx called by 0x%lx\n\n",
+         max_depth, max_func, max_caller);
+  printf("%-14s %12s %12s %16s\n",
+         "Function:", "Num Calls", "Avg. Depth", "Incl. Time (ms)");
+  for(i = 0; i < heap_size; i++)
+    printf("0x%-12lx %12lu %12.3f %16.3f\n", addrs[heap[i].func],
+           heap[i].calls, (double)heap[i].depth / (double)heap[i].calls,
+           (double)heap[i].incl / 1e6);
+
+  if(verbose)
+  {
+    for(i = 0; i < heap_size; i++)
+    {
+      printf("\n0x%lx called by:\n", addrs[heap[i].func]);
+      qsort(heap[i].callers, heap[i].num_callers, sizeof(caller_t),
+            cmp_caller_calls);
+      for(j = 0; j < heap[i].num_callers; j++)
+        printf("  0x%lx: %lu time(s)\n", addrs[heap[i].callers[j].idx],
+               heap[i].callers[j].calls);
+    }
+  }
+
+  for(i = 0; i < heap_size; i++) free(heap[i].callers);
+  free(heap);
+  free(addrs);
+  return 0;
+
+trunc:
+  fprintf(stderr, "ERROR: '%s' is truncated or corrupt\n", data_file);
+  return 1;
+}
@@ -1,26 +1,193 @@
 #include <fstream>
 #include <iostream>
 #include <mutex>
+#include <vector>
+#include <algorithm>
 
 #include <cstdlib>
+#include <cstring>
+#include <ctime>
 #include <execinfo.h>
+#ifdef __x86_64__
+#include <x86intrin.h>
+#endif
 
 #include "stack_depth.h"
+#include "stack_depth_format.h"
 
 #define STACK_DATA_FN_ENV "STACK_DATA_FILENAME"
+#define STACK_DATA_FORMAT_ENV "STACK_DATA_FORMAT"
 #define STACK_DATA_MAX_DEPTH 512
 
 using namespace std;
 
-/* Call data */
-static unordered_map<void*, FuncInfo>* funcCalls;
-static mutex funcCallsLock;
-static thread_local size_t stackDepth = 0;
+/*
+ * Per-thread call data.  Each thread records calls into its own tables, which
+ * are merged into a single profile at exit.  The shadow stack caches the call
+ * records for the active frames so exits don't need to search the table.
+ */
+struct ThreadData
+{
+  FuncTable funcs;
+  EdgeTable edges;
+  size_t stackDepth;
+  ThreadFuncInfo *stack[STACK_DATA_MAX_DEPTH];
+  ThreadData *next;
+};
+
+/* All threads' call data, only locked when a thread makes its first call */
+static ThreadData *threads = nullptr;
+static mutex threadsLock;
+static thread_local ThreadData *threadData = nullptr;
+
+static inline uint64_t nowNs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Timestamps for inclusive time.  Every call is timed, so on x86-64 read the
+ * timestamp counter rather than calling clock_gettime() & convert ticks to
+ * nanoseconds at exit, calibrated over the application's execution.
+ */
+#ifdef __x86_64__
+static inline uint64_t now() { return __rdtsc(); }
+#else
+static inline uint64_t now() { return nowNs(); }
+#endif
+
+static uint64_t startTicks, startNs;
 
 void __attribute__((constructor))
 __stack_depth_ctor(void)
 {
-  funcCalls = new unordered_map<void*, FuncInfo>();
+  startNs = nowNs();
+  startTicks = now();
+}
+
+static ThreadData *initThreadData()
+{
+  ThreadData *td = new ThreadData();
+  threadsLock.lock();
+  td->next = threads;
+  threads = td;
+  threadsLock.unlock();
+  threadData = td;
+  return td;
+}
+
+/* Merge a thread's call data into the global profile */
+static void mergeThreadData(const ThreadData *td,
+                            double nsPerTick,
+                            unordered_map<void*, FuncInfo> &funcCalls)
+{
+  const ThreadFuncInfo *tfi;
+  size_t i;
+
+  for(i = 0; i < td->funcs.getCapacity(); i++)
+  {
+    if(!(tfi = td->funcs.at(i))) continue;
+    FuncInfo &info = funcCalls[tfi->func];
+    info.numCalls += tfi->numCalls;
+    info.avgStackDepth += tfi->sumStackDepth;
+    if(tfi->maxDepth > info.maxDepth.second)
+    {
+      info.maxDepth.first = tfi->maxDepthCaller;
+      info.maxDepth.second = tfi->maxDepth;
+    }
+    info.inclusiveTime += tfi->inclusiveTime * nsPerTick;
+    if(tfi->lastCallerCalls)
+      info.caller[tfi->lastCaller] += tfi->lastCallerCalls;
+  }
+
+  for(i = 0; i < td->edges.getCapacity(); i++)
+  {
+    const CallEdge &edge = td->edges.at(i);
+    if(edge.func) funcCalls[edge.func].caller[edge.caller] += edge.count;
+  }
+}
+
+/* Write one line per function, parsed by stack-depth-info.py */
+static void writeText(ofstream &stackData,
+                      const unordered_map<void*, FuncInfo> &funcCalls)
+{
+  unordered_map<void*, FuncInfo>::const_iterator it;
+
+  for(it = funcCalls.begin(); it != funcCalls.end(); it++)
+    stackData << "(" << it->first << ", " << it->second.toStr() << ")" << endl;
+}
+
+static void putVarint(string &buf, uint64_t val)
+{
+  while(val >= 0x80)
+  {
+    buf.push_back((char)(val | 0x80));
+    val >>= 7;
+  }
+  buf.push_back((char)val);
+}
+
+/* Write the binary format described in stack_depth_format.h */
+static void writeBinary(ofstream &stackData,
+                        const unordered_map<void*, FuncInfo> &funcCalls)
+{
+  string buf;
+  vector<uintptr_t> addrs;
+  vector<pair<uint64_t, uint64_t> > callers;
+  unordered_map<void*, FuncInfo>::const_iterator it;
+  unordered_map<void*, uint64_t>::const_iterator ci;
+  uintptr_t prev;
+  size_t i;
+
+  // Build the address dictionary from every function & call site
+  for(it = funcCalls.begin(); it != funcCalls.end(); it++)
+  {
+    addrs.push_back((uintptr_t)it->first);
+    addrs.push_back((uintptr_t)it->second.maxDepth.first);
+    for(ci = it->second.caller.begin(); ci != it->second.caller.end(); ci++)
+      addrs.push_back((uintptr_t)ci->first);
+  }
+  sort(addrs.begin(), addrs.end());
+  addrs.erase(unique(addrs.begin(), addrs.end()), addrs.end());
+  auto index = [&addrs](const void *addr) -> uint64_t {
+    return lower_bound(addrs.begin(), addrs.end(), (uintptr_t)addr) -
+           addrs.begin();
+  };
+
+  buf.append(STACK_DATA_MAGIC, STACK_DATA_MAGIC_LEN);
+  putVarint(buf, STACK_DATA_VERSION);
+  putVarint(buf, addrs.size());
+  putVarint(buf, funcCalls.size());
+  for(i = 0, prev = 0; i < addrs.size(); prev = addrs[i], i++)
+    putVarint(buf, addrs[i] - prev);
+  stackData.write(buf.data(), buf.size());
+
+  for(it = funcCalls.begin(); it != funcCalls.end(); it++)
+  {
+    const FuncInfo &info = it->second;
+
+    buf.clear();
+    putVarint(buf, index(it->first));
+    putVarint(buf, info.numCalls);
+    putVarint(buf, info.avgStackDepth);
+    putVarint(buf, index(info.maxDepth.first));
+    putVarint(buf, info.maxDepth.second);
+    putVarint(buf, info.inclusiveTime);
+
+    callers.clear();
+    for(ci = info.caller.begin(); ci != info.caller.end(); ci++)
+      callers.push_back(make_pair(index(ci->first), ci->second));
+    sort(callers.begin(), callers.end());
+    putVarint(buf, callers.size());
+    for(i = 0, prev = 0; i < callers.size(); prev = callers[i].first, i++)
+    {
+      putVarint(buf, callers[i].first - prev);
+      putVarint(buf, callers[i].second);
+    }
+    stackData.write(buf.data(), buf.size());
+  }
 }
 
 void __attribute__((destructor))
@@ -28,61 +195,75 @@ __stack_depth_dtor(void)
 {
   string fileName("stack_data.dat");
   ofstream stackData;
-  unordered_map<void*, FuncInfo>::const_iterator it;
+  unordered_map<void*, FuncInfo> funcCalls;
+  const ThreadData *td;
+  const char *format = getenv(STACK_DATA_FORMAT_ENV);
+  bool text = format && !strcmp(format, "text");
+  uint64_t ticks = now() - startTicks, ns = nowNs() - startNs;
+  double nsPerTick = ticks ? (double)ns / (double)ticks : 1.0;
+
+  threadsLock.lock();
+  for(td = threads; td; td = td->next)
+    mergeThreadData(td, nsPerTick, funcCalls);
+  threadsLock.unlock();
 
   if(getenv(STACK_DATA_FN_ENV)) fileName = getenv(STACK_DATA_FN_ENV);
-  stackData.open(fileName.c_str());
+  stackData.open(fileName.c_str(), text ? ios::out : ios::out | ios::binary);
   if(stackData.is_open()) {
-    for(it = funcCalls->begin(); it != funcCalls->end(); it++)
-      stackData << "(" << it->first << ", " << it->second.toStr() << ")" << endl;
+    if(text) writeText(stackData, funcCalls);
+    else writeBinary(stackData, funcCalls);
     stackData.close();
   }
   else cerr << "[Stack-Depth] ERROR: could not open file " << fileName << endl;
-
-  delete funcCalls;
 }
 
 extern "C" {
 
 void __cyg_profile_func_enter(void* func, void* caller)
 {
-  unordered_map<void*, FuncInfo>::iterator ci;
-  unordered_map<void*, uint64_t>::iterator ri;
-  FuncInfo funcInfo;
-
-  stackDepth++;
-  funcCallsLock.lock();
-  ci = funcCalls->find(func);
-  if(ci != funcCalls->end())
-  {
-    ci->second.numCalls++;
-    ci->second.avgStackDepth += stackDepth;
-    if(stackDepth > ci->second.maxDepth.second)
-    {
-      ci->second.maxDepth.first = caller;
-      ci->second.maxDepth.second = stackDepth;
-    }
+  ThreadData *td = threadData;
+  ThreadFuncInfo *fi;
+  size_t depth;
 
-    ri = ci->second.caller.find(caller);
-    if(ri != ci->second.caller.end()) ri->second++;
-    else ci->second.caller.insert(unordered_map<void*, uint64_t>::value_type(caller, 1));
+  if(!td) td = initThreadData();
+  fi = td->funcs.findOrInsert(func);
+  depth = ++td->stackDepth;
+  if(depth <= STACK_DATA_MAX_DEPTH) td->stack[depth - 1] = fi;
+
+  fi->numCalls++;
+  fi->sumStackDepth += depth;
+  if(depth > fi->maxDepth)
+  {
+    fi->maxDepthCaller = caller;
+    fi->maxDepth = depth;
   }
+
+  if(fi->lastCaller == caller) fi->lastCallerCalls++;
   else
   {
-    funcInfo.numCalls = 1;
-    funcInfo.avgStackDepth = stackDepth;
-    funcInfo.maxDepth.first = caller;
-    funcInfo.maxDepth.second = stackDepth;
-    funcInfo.caller.insert(unordered_map<void*, uint64_t>::value_type(caller, 1));
-    funcCalls->insert(unordered_map<void*, FuncInfo>::value_type(func, funcInfo));
+    if(fi->lastCallerCalls)
+      td->edges.add(func, fi->lastCaller, fi->lastCallerCalls);
+    fi->lastCaller = caller;
+    fi->lastCallerCalls = 1;
   }
-  funcCallsLock.unlock();
+
+  if(!fi->active++) fi->start = now();
 }
 
-void __cyg_profile_func_exit(void* dest, void* caller)
+void __cyg_profile_func_exit(void* func, void* caller)
 {
-  stackDepth--;
-}
+  ThreadData *td = threadData;
+  ThreadFuncInfo *fi;
+  size_t depth;
+
+  if(!td || !td->stackDepth) return;
+  depth = td->stackDepth--;
+  if(depth <= STACK_DATA_MAX_DEPTH && td->stack[depth - 1]->func == func)
+    fi = td->stack[depth - 1];
+  else fi = td->funcs.find(func);
 
+  if(fi && fi->active && !--fi->active)
+    fi->inclusiveTime += now() - fi->start;
 }
 
+}
@@ -8,9 +8,10 @@
 #include <unordered_map>
 #include <sstream>
 #include <cstdint>
+#include <cstdlib>
 
 /*
- * Function call information.
+ * Function call information, merged from all threads at exit.
  */
 class FuncInfo
 {
@@ -19,8 +20,10 @@ public:
   uint64_t avgStackDepth;
   std::pair<void*, uint64_t> maxDepth;
   std::unordered_map<void*, uint64_t> caller;
+  uint64_t inclusiveTime;
 
-  FuncInfo() : numCalls(0), avgStackDepth(0), maxDepth(0, 0) {};
+  FuncInfo() : numCalls(0), avgStackDepth(0), maxDepth(0, 0),
+               inclusiveTime(0) {};
 
   std::string toStr(void) const
   {
@@ -36,9 +39,156 @@ public:
     ss << "(" << it->first << ", " << it->second << ")";
     for(it++; it != caller.end(); it++)
       ss << ", (" << it->first << ", " << it->second << ")";
-    ss << "]";
+    ss << "], " << inclusiveTime;
 
     return ss.str();
   }
 };
 
+/*
+ * Per-thread function call information.  Only ever touched by the owning
+ * thread until the tables are merged at exit, so no locking is needed.
+ */
+struct ThreadFuncInfo
+{
+  void *func;
+  uint64_t numCalls;
+  uint64_t sumStackDepth;
+  void *maxDepthCaller;
+  uint64_t maxDepth;
+
+  /* Inclusive time (in timestamp ticks) is only accumulated by the outermost
+     activation so that recursive calls aren't counted multiple times */
+  uint64_t inclusiveTime;
+  uint64_t active;
+  uint64_t start;
+
+  /* Inline callee/caller pair cache -- calls from the same caller are counted
+     here & only spilled to the thread's edge table when the caller changes */
+  void *lastCaller;
+  uint64_t lastCallerCalls;
+};
+
+/* Number of times a function was called from a call site */
+struct CallEdge
+{
+  void *func;
+  void *caller;
+  uint64_t count;
+};
+
+static inline size_t hashPtr(const void *ptr, size_t mask)
+{
+  return ((uintptr_t)ptr * 0x9e3779b97f4a7c15ULL >> 32) & mask;
+}
+
+/*
+ * Open-addressing (linear probing) table mapping function addresses to
+ * per-thread call information.  Records are allocated separately so pointers
+ * to them remain valid when the table grows.
+ */
+class FuncTable
+{
+public:
+  FuncTable() : capacity(1024), size(0)
+  { slots = (ThreadFuncInfo **)calloc(capacity, sizeof(ThreadFuncInfo *)); }
+
+  ThreadFuncInfo *find(void *func) const
+  {
+    size_t mask = capacity - 1, i;
+    for(i = hashPtr(func, mask); slots[i]; i = (i + 1) & mask)
+      if(slots[i]->func == func) return slots[i];
+    return nullptr;
+  }
+
+  ThreadFuncInfo *findOrInsert(void *func)
+  {
+    size_t mask = capacity - 1, i;
+    for(i = hashPtr(func, mask); slots[i]; i = (i + 1) & mask)
+      if(slots[i]->func == func) return slots[i];
+
+    slots[i] = (ThreadFuncInfo *)calloc(1, sizeof(ThreadFuncInfo));
+    slots[i]->func = func;
+    if(++size * 2 > capacity) return grow(func);
+    return slots[i];
+  }
+
+  size_t getCapacity() const { return capacity; }
+  ThreadFuncInfo *at(size_t i) const { return slots[i]; }
+
+private:
+  ThreadFuncInfo **slots;
+  size_t capacity, size;
+
+  /* Double the table size, returning the record for func */
+  ThreadFuncInfo *grow(void *func)
+  {
+    ThreadFuncInfo **old = slots;
+    size_t oldCap = capacity, mask, i, j;
+
+    capacity *= 2;
+    mask = capacity - 1;
+    slots = (ThreadFuncInfo **)calloc(capacity, sizeof(ThreadFuncInfo *));
+    for(i = 0; i < oldCap; i++)
+    {
+      if(!old[i]) continue;
+      for(j = hashPtr(old[i]->func, mask); slots[j]; j = (j + 1) & mask);
+      slots[j] = old[i];
+    }
+    free(old);
+    return find(func);
+  }
+};
+
+/*
+ * Open-addressing (linear probing) table of caller edges.
+ */
+class EdgeTable
+{
+public:
+  EdgeTable() : capacity(1024), size(0)
+  { slots = (CallEdge *)calloc(capacity, sizeof(CallEdge)); }
+
+  void add(void *func, void *caller, uint64_t count)
+  {
+    CallEdge *edge = findSlot(slots, capacity, func, caller);
+    if(!edge->func)
+    {
+      edge->func = func;
+      edge->caller = caller;
+      edge->count = count;
+      if(++size * 2 > capacity) grow();
+    }
+    else edge->count += count;
+  }
+
+  size_t getCapacity() const { return capacity; }
+  const CallEdge &at(size_t i) const { return slots[i]; }
+
+private:
+  CallEdge *slots;
+  size_t capacity, size;
+
+  static CallEdge *
+  findSlot(CallEdge *slots, size_t capacity, void *func, void *caller)
+  {
+    size_t mask = capacity - 1, i;
+    i = hashPtr((void *)((uintptr_t)func ^ ((uintptr_t)caller << 1)), mask);
+    for(; slots[i].func; i = (i + 1) & mask)
+      if(slots[i].func == func && slots[i].caller == caller) break;
+    return &slots[i];
+  }
+
+  void grow()
+  {
+    CallEdge *old = slots;
+    size_t oldCap = capacity, i;
+
+    capacity *= 2;
+    slots = (CallEdge *)calloc(capacity, sizeof(CallEdge));
+    for(i = 0; i < oldCap; i++)
+      if(old[i].func)
+        *findSlot(slots, capacity, old[i].func, old[i].caller) = old[i];
+    free(old);
+  }
+};
@@ -0,0 +1,37 @@
+/*
+ * Binary stack depth data format, shared by the library (writer) and
+ * stack-depth-report (reader).
+ *
+ * The file starts with the 4-byte magic "SDPF".  Every subsequent value is an
+ * unsigned LEB128 varint:
+ *
+ *   Header:
+ *     format version, number of addresses, number of functions
+ *
+ *   Address dictionary, in ascending order:
+ *     delta from the previous address (the first is relative to 0)
+ *
+ *   Function records:
+ *     function's dictionary index, number of calls, sum of stack depths over
+ *     all calls, dictionary index of the caller at the maximum depth, maximum
+ *     depth, inclusive time (ns), number of callers, and for each caller in
+ *     ascending dictionary index order:
+ *       delta from the previous caller's index, number of calls
+ *
+ * Functions & call sites are referenced by dictionary index, so each address
+ * is stored once and caller edges usually take a couple of bytes each.  The
+ * dictionary precedes the records so readers can stream the records in a
+ * single pass.
+ */
+
+#ifndef _STACK_DEPTH_FORMAT_H
+#define _STACK_DEPTH_FORMAT_H
+
+#define STACK_DATA_MAGIC "SDPF"
+#define STACK_DATA_MAGIC_LEN 4
+#define STACK_DATA_VERSION 1
+
+/* Maximum number of bytes in an encoded 64-bit varint */
+#define STACK_DATA_MAX_VARINT 10
+
+#endif /* _STACK_DEPTH_FORMAT_H */
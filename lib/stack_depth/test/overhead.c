@@ -0,0 +1,84 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+/*
+ * Call-heavy kernel for measuring profiling overhead.  Each thread computes
+ * Fibonacci numbers recursively, i.e., nearly all time is spent in function
+ * prologues & epilogues.  Build once with and once without
+ * -finstrument-functions & compare (see "make bench").
+ */
+
+#define DEFAULT_MAX_THREADS 64
+#define DEFAULT_N 25
+
+#define NS( ts ) ((ts.tv_sec * 1000000000UL) + ts.tv_nsec)
+
+static pthread_barrier_t barrier;
+static unsigned n;
+
+static uint64_t __attribute__((noinline)) add(uint64_t a, uint64_t b)
+{
+  return a + b;
+}
+
+static uint64_t __attribute__((noinline)) fib(unsigned i)
+{
+  if(i < 2) return i;
+  return add(fib(i - 1), fib(i - 2));
+}
+
+static void *thread_main(void *arg)
+{
+  pthread_barrier_wait(&barrier);
+  *(uint64_t *)arg = fib(n);
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  size_t max_threads = DEFAULT_MAX_THREADS, num_threads, i;
+  pthread_t *threads;
+  uint64_t *results;
+  struct timespec start, end;
+
+  if(argc > 1) max_threads = atol(argv[1]);
+  if(argc > 2) n = atoi(argv[2]);
+  else n = DEFAULT_N;
+  if(!max_threads || !n)
+  {
+    printf("Usage: %s [ max threads ] [ Fibonacci number ]\n", argv[0]);
+    return 1;
+  }
+
+  threads = malloc(sizeof(pthread_t) * max_threads);
+  results = malloc(sizeof(uint64_t) * max_threads);
+  if(!threads || !results)
+  {
+    printf("Could not allocate thread handles\n");
+    return 1;
+  }
+
+  printf("%8s %14s\n", "Threads", "Time (ns)");
+  for(num_threads = 1; num_threads <= max_threads; num_threads *= 2)
+  {
+    pthread_barrier_init(&barrier, NULL, num_threads + 1);
+    for(i = 0; i < num_threads; i++)
+      pthread_create(&threads[i], NULL, thread_main, &results[i]);
+
+    /* Start timing before the barrier releases the workers */
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_barrier_wait(&barrier);
+    for(i = 0; i < num_threads; i++) pthread_join(threads[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    pthread_barrier_destroy(&barrier);
+
+    printf("%8lu %14lu\n", num_threads, NS(end) - NS(start));
+  }
+
+  free(results);
+  free(threads);
+  return 0;
+}
@@ -0,0 +1,62 @@
+/*
+ * APIs for acquiring a thread's rewriting contexts & their data pools.  Each
+ * thread only ever uses a single source & destination context at a time, so
+ * contexts (and their pools) are kept per-thread & reused across rewrites.
+ */
+
+#ifndef _ARENA_H
+#define _ARENA_H
+
+#include "definitions.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Context arena
+///////////////////////////////////////////////////////////////////////////////
+
+/* A thread's rewriting contexts. */
+typedef enum context_type {
+  SRC_CONTEXT = 0,
+  DEST_CONTEXT,
+  NUM_CONTEXTS
+} context_type;
+
+/*
+ * Acquire the calling thread's context of type TYPE for rewriting using
+ * HANDLE.  The context's data pools can hold at least as many frames as the
+ * largest stack observed so far.
+ *
+ * @param handle a stack transformation handle
+ * @param type which of the thread's contexts to acquire
+ * @return a context with initialized data pools
+ */
+rewrite_context acquire_context(st_handle handle, context_type type);
+
+/*
+ * Release a context acquired with acquire_context().  Its data pools are kept
+ * for the thread's next rewrite.
+ *
+ * @param ctx a rewriting context
+ */
+void release_context(rewrite_context ctx);
+
+/*
+ * Grow a context's data pools so that they can hold at least FRAMES frames.
+ * Frames already set up are copied into the new pools.
+ *
+ * @param ctx a rewriting context
+ * @param frames the number of frames the pools must be able to hold
+ */
+void grow_data_pools(rewrite_context ctx, size_t frames);
+
+/*
+ * Ensure a context's data pools can hold activation ACT.
+ *
+ * @param ctx a rewriting context
+ * @param act an activation to be set up
+ */
+static inline void reserve_frame(rewrite_context ctx, int act)
+{
+  if((size_t)act >= ctx->pool_frames) grow_data_pools(ctx, act + 1);
+}
+
+#endif /* _ARENA_H */
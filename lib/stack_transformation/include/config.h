@@ -48,6 +48,15 @@
 #define PTHREAD_TLS 1
 #define _TLS_IMPL COMPILER_TLS
 
+/*
+ * Read stack transformation metadata by mapping the binary & walking its
+ * section header table directly rather than through libelf.  Handles point
+ * directly into the mapping rather than at copies of the metadata.  Falls back
+ * to libelf if the binary cannot be mapped/parsed, or if ENV_DISABLE_MMAP is
+ * set in the environment.  Set to 0 to always use libelf.
+ */
+#define _MMAP_METADATA 1
+
 /* Select either global or per-thread malloc implementation */
 #define PER_NODE_MALLOC 1
 #ifdef PER_NODE_MALLOC
@@ -59,7 +68,45 @@
 /*
  * Maximum number of frames that can be rewritten.
  */
-#define MAX_FRAMES 512
+#ifndef MAX_FRAMES
+# define MAX_FRAMES 512
+#endif
+
+/*
+ * Number of frames data pools are initially sized for when not using compiler
+ * TLS.  Pools are re-used across rewrites & grown as needed (up to MAX_FRAMES).
+ */
+#define INIT_POOL_FRAMES 32
+
+/*
+ * Number of pointer-to-stack fixups which can be tracked before the fixup
+ * storage must be grown dynamically.
+ */
+#define FIXUP_POOL_SIZE 1024
+
+/*
+ * Split copying live values across a pool of helper threads when eagerly
+ * rewriting deep stacks.  Laying out frames, callee-saved register bookkeeping
+ * & pointer-to-stack fixups remain serialized.  Stacks with fewer than
+ * PARALLEL_MIN_FRAMES frames are always rewritten serially.  The helper threads
+ * are spawned on the first parallel rewrite; the number of threads sharing a
+ * rewrite (including the rewriting thread) defaults to PARALLEL_WORKERS and can
+ * be changed with ENV_REWRITE_WORKERS (1 disables parallel rewriting).
+ * Fine-grained timers are not thread-safe & are inaccurate in this mode.
+ */
+//#define _PARALLEL_REWRITE 1
+#define PARALLEL_WORKERS 4
+#define PARALLEL_MIN_FRAMES 256
+#define PARALLEL_CHUNK_FRAMES 32
+
+/*
+ * Compile each call site's live values into a plan of copy operations the
+ * first time the call site is rewritten to a given destination binary.  Plans
+ * are cached in the source handle, so later rewrites through the same call
+ * sites copy values without re-interpreting their location records.  Values
+ * which may point to the stack are still rewritten generically.
+ */
+//#define _REWRITE_PLANS 1
 
 /*
  * Default character buffer size.
@@ -76,6 +123,8 @@
 #define SECTION_ST_ADDR SECTION_PREFIX "." SECTION_ADDR
 #define SECTION_ST_LIVE SECTION_PREFIX "." SECTION_LIVE
 #define SECTION_ST_ARCH_LIVE SECTION_PREFIX "." SECTION_ARCH
+#define SECTION_ST_PLAN SECTION_PREFIX "." SECTION_PLAN
+#define SECTION_ST_PLAN_MOVE SECTION_PREFIX "." SECTION_PLAN_MOVE
 
 ///////////////////////////////////////////////////////////////////////////////
 // Userspace rewriting configuration
@@ -88,6 +137,18 @@
 #define ENV_POWERPC64_BIN "ST_POWERPC64_BIN"
 #define ENV_X86_64_BIN "ST_X86_64_BIN"
 
+/*
+ * Environment variable which disables reading metadata from a mapping of the
+ * binary (see _MMAP_METADATA).
+ */
+#define ENV_DISABLE_MMAP "ST_DISABLE_MMAP"
+
+/*
+ * Environment variable specifying the number of threads sharing a parallel
+ * rewrite (see _PARALLEL_REWRITE).
+ */
+#define ENV_REWRITE_WORKERS "ST_REWRITE_WORKERS"
+
 /*
  * Stack limits -- Linux defaults to 8MB.
  */
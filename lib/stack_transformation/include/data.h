@@ -54,6 +54,19 @@ void put_val_data(rewrite_context ctx,
                   int act,
                   uint64_t data);
 
+/*
+ * Get the location of a callee-saved register for an activation, i.e., the
+ * stack save slot in the closest activation down the call chain which saved
+ * the register, or the register in the base activation if it is still live.
+ *
+ * @param ctx the rewriting context
+ * @param regnum the callee-saved register
+ * @param act the activation in which the register is set
+ * @return the register's save location, or NULL if there's nothing to
+ *         propagate
+ */
+void* get_callee_saved_loc(rewrite_context ctx, uint16_t regnum, int act);
+
 /*
  * Return whether or not a pointer points to some location on the stack.  If
  * so, return the pointer's value.  If not, return NULL.
@@ -85,6 +98,16 @@ void* points_to_data(const rewrite_context src,
                      const live_value* dest_val,
                      void* src_ptr);
 
+/*
+ * Return the address of a stack allocation in the current activation of a
+ * rewriting context.
+ *
+ * @param ctx the rewriting context
+ * @param val a stack allocation's metadata
+ * @return the address of the stack allocation
+ */
+void* get_alloca_addr(const rewrite_context ctx, const live_value* val);
+
 /*
  * Set the return address in the current stack frame of a rewriting context.
  *
@@ -20,7 +20,6 @@
 #include "config.h"
 #include "retvals.h"
 #include "bitmap.h"
-#include "list.h"
 #include "timer.h"
 #include "regs.h"
 #include "properties.h"
@@ -137,8 +136,23 @@ typedef struct fixup {
   const live_value* dest_loc; // pointer to reify on destination stack
 } fixup;
 
-/* List of fixup records. */
-define_list_type(fixup);
+/*
+ * Set of fixup records, sorted by pointed-to source address so that the
+ * fixups for a stack object can be found with a binary search.  Fixups
+ * recorded while rewriting a frame are staged after the sorted records and
+ * merged in once the frame has been rewritten.  Resolved fixups are marked by
+ * clearing their destination location and are dropped when merging.
+ */
+typedef struct fixup_set {
+  fixup* fixups; /* sorted records followed by staged records */
+  fixup* scratch; /* buffer for merging, same capacity as fixups */
+  size_t num_sorted; /* number of sorted records */
+  size_t num; /* total number of records, including staged records */
+  size_t max; /* capacity of fixups & scratch */
+  fixup* pool; /* context's fixup pool */
+  size_t pool_size; /* capacity of the pool */
+  fixup* storage; /* backing storage, either the pool or dynamically grown */
+} fixup_set;
 
 ///////////////////////////////////////////////////////////////////////////////
 // Rewriting metadata
@@ -153,6 +167,23 @@ typedef struct activation
   bitmap callee_saved; /* callee-saved registers stored in prologue */
 } activation;
 
+/*
+ * Search index over a metadata section sorted by a 64-bit key.  Keys are
+ * stored in Eytzinger (breadth-first) order, so the first levels of every
+ * search share a handful of cache lines and the cache lines for the levels
+ * further down can be prefetched several iterations ahead.  Built when
+ * initializing the handle.
+ *
+ * Note: the tree is 1-indexed (slot 0 of keys & pos is unused), but the
+ * positions stored in pos are 0-based indices into the section.
+ */
+typedef struct search_index
+{
+  uint64_t count; /* number of keys */
+  uint64_t* keys; /* section's keys in Eytzinger order */
+  uint32_t* pos; /* position in the section of the corresponding key */
+} search_index;
+
 /*
  * Stack transformation handle, holds information required to do transform.
  * Instantiated once for each binary.
@@ -164,7 +195,9 @@ struct _st_handle
   /////////////////////////////////////////////////////////////////////////////
 
   int fd; /* OS file descriptor */
-  Elf* elf; /* libELF descriptor */
+  Elf* elf; /* libELF descriptor, or NULL if metadata is read from map */
+  const void* map; /* read-only mapping of the binary, or NULL if using libELF */
+  size_t map_size; /* size of the mapping */
 
   /////////////////////////////////////////////////////////////////////////////
   // Binary & architecture information
@@ -194,6 +227,11 @@ struct _st_handle
   const call_site* sites_id; /* sorted by ID */
   const call_site* sites_addr; /* sorted by return address */
 
+  /* Search indexes for call site & per-function unwinding records */
+  search_index unwind_addr_index;
+  search_index sites_id_index;
+  search_index sites_addr_index;
+
   /* Call site live value records */
   uint64_t live_vals_count;
   const live_value* live_vals;
@@ -201,6 +239,21 @@ struct _st_handle
   /* Architecture-specific call site live value records */
   uint64_t arch_live_vals_count;
   const arch_live_value* arch_live_vals;
+
+  /* Call sites paired with other binaries' call sites by gen-stackinfo */
+  uint64_t plan_sites_count;
+  const plan_site* plan_sites; /* sorted by destination architecture & ID */
+  uint64_t plan_moves_count;
+  const plan_move* plan_moves;
+
+#ifdef _REWRITE_PLANS
+  /* Rewriting plans compiled for this binary's call sites (see plan.h) */
+  uint64_t plans_mask;
+  struct rewrite_plan** plans;
+  uint64_t generation; /* unique across handles, keys other handles' plans */
+  struct rewrite_plan* retired_plans; /* removed from plans, freed with it */
+  struct _st_handle* next_plan_cache; /* next handle with a plan cache */
+#endif
 };
 
 typedef struct _st_handle* st_handle;
@@ -223,12 +276,17 @@ struct rewrite_context
   /* Meta-data for stack activations. */
   int num_acts; /* number of activations */
   int act; /* current activation */
-  activation acts[MAX_FRAMES]; /* all activations currently processed */
-  list_t(fixup) stack_pointers; /* pointers to the stack, to be resolved */
+  int base_act; /* innermost activation still to be resumed */
+  activation* acts; /* all activations currently processed (MAX_FRAMES) */
+  fixup_set stack_pointers; /* pointers to the stack, to be resolved */
 
   /* Pools for constant-time allocation of per-frame/runtime-dependent data */
   void* regset_pool; /* Register sets */
   void* callee_saved_pool; /* Callee-saved registers (bitmaps) */
+  size_t regset_pool_size; /* Size of register set pool, in bytes */
+  size_t callee_saved_pool_size; /* Size of callee-saved pool, in bytes */
+  size_t pool_frames; /* Number of frames the pools can currently hold */
+  fixup* fixup_pool; /* Pointer-to-stack fixups (2 * FIXUP_POOL_SIZE) */
 };
 
 typedef struct rewrite_context* rewrite_context;
@@ -0,0 +1,83 @@
+/*
+ * APIs for tracking pointer-to-stack fixups, i.e., pointers on the source
+ * stack which must be reified once the pointed-to data has been placed on the
+ * destination stack.
+ */
+
+#ifndef _FIXUP_H
+#define _FIXUP_H
+
+#include "definitions.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Fixup tracking
+///////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Initialize an empty fixup set.
+ *
+ * @param set a fixup set
+ * @param pool storage for 2 * POOL_SIZE fixups, or NULL to allocate on demand
+ * @param pool_size number of fixups which can be tracked using POOL
+ */
+void fixups_init(fixup_set* set, fixup* pool, size_t pool_size);
+
+/*
+ * Release any dynamically-allocated storage for a fixup set.
+ *
+ * @param set a fixup set
+ */
+void fixups_free(fixup_set* set);
+
+/*
+ * Stage a new fixup, to be merged into the sorted records with
+ * fixups_merge().
+ *
+ * @param set a fixup set
+ * @param src_addr the pointed-to address on the source stack
+ * @param act the activation in which the pointer is live
+ * @param dest_loc the pointer's location on the destination stack
+ */
+void fixups_add(fixup_set* set,
+                void* src_addr,
+                int act,
+                const live_value* dest_loc);
+
+/*
+ * Sort staged fixups by pointed-to address.
+ *
+ * @param set a fixup set
+ */
+void fixups_sort_staged(fixup_set* set);
+
+/*
+ * Find fixups whose pointed-to address falls within [LOW, HIGH).  Searches
+ * either the sorted or (previously sorted) staged fixups.
+ *
+ * @param set a fixup set
+ * @param staged search the staged fixups if true, or sorted fixups otherwise
+ * @param low lowest pointed-to address
+ * @param high one past the highest pointed-to address
+ * @param begin set to the index of the first matching fixup
+ * @param end set to one past the index of the last matching fixup
+ */
+void fixups_range(const fixup_set* set,
+                  bool staged,
+                  void* low,
+                  void* high,
+                  size_t* begin,
+                  size_t* end);
+
+/*
+ * Merge (previously sorted) staged fixups into the sorted fixups, dropping
+ * resolved fixups.
+ *
+ * @param set a fixup set
+ */
+void fixups_merge(fixup_set* set);
+
+/* Mark a fixup as resolved & check whether it has been resolved. */
+#define fixup_resolve( fix ) ((fix)->dest_loc = NULL)
+#define fixup_resolved( fix ) ((fix)->dest_loc == NULL)
+
+#endif /* _FIXUP_H */
@@ -0,0 +1,115 @@
+/*
+ * Precompiled rewriting plans.  A plan is a call site's live values compiled
+ * into a compact list of copy operations for a particular destination binary.
+ * Plans are built the first time a call site is rewritten & are cached in the
+ * source handle, so repeatedly rewriting the same call chain copies values
+ * without re-interpreting their location records.
+ */
+
+#ifndef _PLAN_H
+#define _PLAN_H
+
+#include "definitions.h"
+
+#ifdef _REWRITE_PLANS
+
+///////////////////////////////////////////////////////////////////////////////
+// Plan definitions
+///////////////////////////////////////////////////////////////////////////////
+
+/* Where a value lives, resolved against an activation's register set. */
+typedef enum plan_loc_type {
+  PLAN_LOC_REG = 0, /* in a register */
+  PLAN_LOC_STACK, /* in memory at an offset from a register */
+  PLAN_LOC_CONST /* constant stored in the metadata */
+} plan_loc_type;
+
+typedef struct plan_loc {
+  uint8_t type; /* a plan_loc_type */
+  uint32_t reg; /* offset of the register within the register set */
+  int32_t offset; /* offset from the register's value (PLAN_LOC_STACK) */
+  const void* constant; /* address of the constant (PLAN_LOC_CONST) */
+} plan_loc;
+
+/* Plan operations. */
+typedef enum plan_op_type {
+  PLAN_COPY = 0, /* copy a value */
+  PLAN_COPY_CALLEE_SAVED, /* copy into a callee-saved register & its save slot */
+  PLAN_POINTED_TO, /* resolve fixups for pointers to a stack allocation */
+  PLAN_REWRITE_VAL /* value which may point to the stack, rewritten generically */
+} plan_op_type;
+
+typedef struct plan_op {
+  uint8_t type; /* a plan_op_type */
+  uint16_t regnum; /* destination register (PLAN_COPY_CALLEE_SAVED) */
+  uint32_t size; /* number of bytes to copy/size of stack allocation */
+  union {
+    struct {
+      plan_loc src, dest;
+    } loc;
+    struct {
+      const live_value* src, *dest;
+    } val;
+  };
+} plan_op;
+
+typedef struct rewrite_plan {
+  uint64_t dest_generation; /* generation of the destination handle */
+  struct rewrite_plan* next_retired; /* next plan removed from the cache */
+  uint64_t id; /* call site ID */
+  size_t num_ops; /* number of operations */
+  plan_op ops[]; /* operations, in the order values are rewritten */
+} rewrite_plan;
+
+///////////////////////////////////////////////////////////////////////////////
+// Plan access
+///////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Initialize a handle's plan cache, sized for the handle's call sites.
+ *
+ * @param handle a stack transformation handle
+ * @return true if the cache was initialized, false otherwise
+ */
+bool init_plan_cache(st_handle handle);
+
+/*
+ * Free a handle's plan cache & all plans in it, and remove plans compiled for
+ * the handle as a destination from all other handles' caches.
+ *
+ * @param handle a stack transformation handle
+ */
+void free_plan_cache(st_handle handle);
+
+/*
+ * Get the plan for rewriting the current frame of SRC into the current frame
+ * of DEST, compiling & caching it on first use.  Safe to call concurrently
+ * from multiple threads.
+ *
+ * @param src the source rewriting context
+ * @param dest the destination rewriting context
+ * @return the plan, or NULL if no plan could be cached
+ */
+const rewrite_plan* get_rewrite_plan(rewrite_context src,
+                                     rewrite_context dest);
+
+/*
+ * Get the address of a plan location in register set REGS.
+ *
+ * @param loc a plan location
+ * @param regs an activation's register set
+ * @return the address of the value
+ */
+static inline void* plan_loc_addr(const plan_loc* loc, void* regs)
+{
+  switch(loc->type)
+  {
+  case PLAN_LOC_REG: return regs + loc->reg;
+  case PLAN_LOC_STACK: return *(void**)(regs + loc->reg) + loc->offset;
+  default: return (void*)loc->constant;
+  }
+}
+
+#endif /* _REWRITE_PLANS */
+
+#endif /* _PLAN_H */
@@ -24,6 +24,19 @@ extern "C" {
 /* Handle containing per-binary rewriting information */
 typedef struct _st_handle* st_handle;
 
+/* Stack transformation strategies */
+typedef enum st_rewrite_mode {
+  ST_REWRITE_EAGER = 0, /* Rewrite all frames at migration time */
+  ST_REWRITE_ONDEMAND /* Rewrite frames as the thread returns into them */
+} st_rewrite_mode;
+
+/* Source & destination handles for user-space rewriting, see
+   st_userspace_prepare() */
+typedef struct st_userspace_handles {
+  st_handle src;
+  st_handle dest;
+} st_userspace_handles;
+
 /* Thread stack bounds */
 typedef struct stack_bounds {
   void* high;
@@ -65,13 +78,51 @@ void st_destroy(st_handle handle);
  * @param src_regs the current register set
  * @param dest_arch the destination ISA
  * @param dest_regs the transformed destination register set
+ * @param mode whether to rewrite all frames now or on-demand
  * @return 0 if the stack was successfully re-written, 1 otherwise
  */
 int st_userspace_rewrite(void* sp,
                          enum arch src_arch,
                          void* src_regs,
                          enum arch dest_arch,
-                         void* dest_regs);
+                         void* dest_regs,
+                         st_rewrite_mode mode);
+
+/*
+ * Resolve the handles for rewriting the stack from user-space between a pair
+ * of architectures, so that callers which repeatedly rewrite between the same
+ * architectures can skip the lookup.  The handles remain valid until the
+ * program exits.
+ *
+ * Note: specific to Popcorn Compiler/the migration wrapper.
+ *
+ * @param src_arch the source ISA
+ * @param dest_arch the destination ISA
+ * @param handles the handles to be filled
+ * @return 0 if rewriting metadata is available for both ISAs, 1 otherwise
+ */
+int st_userspace_prepare(enum arch src_arch,
+                         enum arch dest_arch,
+                         st_userspace_handles* handles);
+
+/*
+ * Rewrite the stack from user-space using handles resolved by
+ * st_userspace_prepare().
+ *
+ * Note: specific to Popcorn Compiler/the migration wrapper.
+ *
+ * @param sp the current stack pointer
+ * @param handles the source & destination handles
+ * @param src_regs the current register set
+ * @param dest_regs the transformed destination register set
+ * @param mode whether to rewrite all frames now or on-demand
+ * @return 0 if the stack was successfully re-written, 1 otherwise
+ */
+int st_userspace_rewrite_prepared(void* sp,
+                                  const st_userspace_handles* handles,
+                                  void* src_regs,
+                                  void* dest_regs,
+                                  st_rewrite_mode mode);
 
 /*
  * Rewrite the stack in its entirety from its current form (source) to the
@@ -99,7 +150,12 @@ int st_rewrite_stack(st_handle src,
 
 /*
  * Rewrite only the top frame of the stack.  Previous frames will be
- * re-written on-demand as the thread unwinds the call stack.
+ * re-written on-demand as the thread unwinds the call stack -- the runtime
+ * lays out the destination stack and replaces each frame's return address
+ * with a trampoline which transforms the caller's frame before returning into
+ * it.  The handles must remain valid until the thread has returned through all
+ * transformed frames.  Architectures without trampoline support fall back to
+ * rewriting the entire stack.
  *
  * @param src a stack transformation handle which has transformation metadata
  *            for the source binary
@@ -114,7 +170,6 @@ int st_rewrite_stack(st_handle src,
  *                     (will fill downwards with activation records)
  * @return 0 if succesful, or 1 otherwise
  */
-// TODO not yet implemented
 int st_rewrite_ondemand(st_handle src,
                         void* regset_src,
                         void* sp_base_src,
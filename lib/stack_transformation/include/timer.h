@@ -34,8 +34,11 @@ typedef struct timer* timer;
   X(st_init) \
   X(st_destroy) \
   X(st_rewrite_stack) \
+  X(st_rewrite_ondemand) \
+  X(rewrite_ondemand_frame) \
   X(init_src_context) \
   X(init_dest_context) \
+  X(grow_data_pools) \
   X(unwind_and_size) \
   X(rewrite_stack) \
   X(free_context)
@@ -43,10 +46,12 @@ typedef struct timer* timer;
 /* Fine-grained timers for timing of individual operations */
 #define FINE_TIMERS \
   X(rewrite_frame) \
+  X(compile_plan) \
   X(pop_frame) \
   X(put_val) \
   X(get_site_by_addr) \
   X(get_site_by_id) \
+  X(get_site_moves) \
   X(get_unwind_offset_by_addr)
 
 /* All timers available to the runtime. */
@@ -66,6 +66,64 @@ int64_t get_num_entries(Elf* e, const char* sec);
  */
 const void* get_section_data(Elf* e, const char* sec);
 
+/*
+ * Return the header for section SEC in an ELF64 binary mapped into memory.
+ * Assumes the ELF header has been validated.
+ *
+ * @param map the start of the mapped binary
+ * @param size the size of the mapping
+ * @param sec the name of the section
+ * @return the section header for SEC, or NULL if not found or malformed
+ */
+const Elf64_Shdr*
+get_mapped_section(const void* map, size_t size, const char* sec);
+
+/*
+ * Returns the number of entries encoded in section SEC in a mapped binary.
+ *
+ * @param map the start of the mapped binary
+ * @param size the size of the mapping
+ * @param sec name of the ELF section
+ * @return the number of entries, or -1 if an error occurred
+ */
+int64_t get_mapped_num_entries(const void* map, size_t size, const char* sec);
+
+/*
+ * Return the section data encoded in section SEC in a mapped binary.  The
+ * data is not copied, i.e., it points into the mapping.
+ *
+ * @param map the start of the mapped binary
+ * @param size the size of the mapping
+ * @param sec name of the ELF section
+ * @return a pointer to data in the section, or NULL if an error occurred
+ */
+const void*
+get_mapped_section_data(const void* map, size_t size, const char* sec);
+
+/*
+ * Build a search index over COUNT sorted records of size SIZE, keyed by the
+ * 64-bit value at OFFSET within each record.
+ *
+ * @param index the search index to initialize
+ * @param records the (sorted) records
+ * @param count the number of records
+ * @param size the size of each record
+ * @param offset offset of the key within each record
+ * @return true if the index was built, false otherwise
+ */
+bool init_search_index(search_index* index,
+                       const void* records,
+                       uint64_t count,
+                       size_t size,
+                       size_t offset);
+
+/*
+ * Free a search index's memory.
+ *
+ * @param index a search index
+ */
+void free_search_index(search_index* index);
+
 /*
  * Return the call site information for the specified return address.
  *
@@ -86,6 +144,21 @@ bool get_site_by_addr(st_handle handle, void* ret_addr, call_site* site);
  */
 bool get_site_by_id(st_handle handle, uint64_t csid, call_site* site);
 
+/*
+ * Return the live value moves paired at build time for the specified call site
+ * ID when rewriting to a binary for architecture ARCH.
+ *
+ * @param handle a stack transformation handle
+ * @param arch the destination architecture
+ * @param csid a call site id
+ * @param num_moves set to the number of moves
+ * @return the call site's moves, or NULL if the binary has no plan for the site
+ */
+const plan_move* get_site_moves(st_handle handle,
+                                uint16_t arch,
+                                uint64_t csid,
+                                uint16_t* num_moves);
+
 /*
  * Return the address of the function containing the specified program
  * location.  This is used to bootstrap in the outer frame, where we have an
@@ -0,0 +1,44 @@
+/*
+ * APIs for splitting work across a pool of helper threads.  Used to copy live
+ * values for independent frames in parallel when rewriting deep stacks.
+ */
+
+#ifndef _WORKERS_H
+#define _WORKERS_H
+
+#include "definitions.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Worker pool
+///////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Work function, called for contiguous sub-ranges [BEGIN, END) of the
+ * iteration space.  Sub-ranges are processed concurrently.
+ */
+typedef void (*work_fn)(void* arg, size_t begin, size_t end);
+
+/*
+ * Return the number of threads which share work, including the calling
+ * thread.  Spawns the pool's helper threads on first use.
+ *
+ * @return the number of threads sharing work, or 1 if work is not shared
+ */
+size_t num_workers(void);
+
+/*
+ * Run FN over [BEGIN, END) in chunks of CHUNK iterations, using both the
+ * pool's helper threads & the calling thread.  Returns once all iterations
+ * have completed.  If the pool is busy with another thread's work, runs all
+ * iterations on the calling thread.
+ *
+ * @param fn the work function
+ * @param arg argument passed to the work function
+ * @param begin first iteration
+ * @param end one past the last iteration
+ * @param chunk number of iterations handed out at a time
+ */
+void parallel_for(work_fn fn, void* arg, size_t begin, size_t end,
+                  size_t chunk);
+
+#endif /* _WORKERS_H */
@@ -0,0 +1,245 @@
+/*
+ * Implementation of per-thread rewriting context storage.
+ */
+
+#include "arena.h"
+#include "arch_regs.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// File-local API & definitions
+///////////////////////////////////////////////////////////////////////////////
+
+#if _TLS_IMPL == COMPILER_TLS
+
+#define REGSET_POOL (MAX_REGSET_SIZE * MAX_FRAMES)
+#define CALLEE_POOL (MAX_CALLEE_SIZE * MAX_FRAMES)
+
+/*
+ * Declare all rewriting space at compile time to avoid malloc whenever
+ * possible.  We only need to declare a pair of each as each thread will only
+ * ever use 2 at a time.
+ */
+static __thread struct rewrite_context contexts[NUM_CONTEXTS];
+static __thread activation activations[NUM_CONTEXTS][MAX_FRAMES];
+static __thread char regsets[NUM_CONTEXTS][REGSET_POOL];
+static __thread char callee_saved[NUM_CONTEXTS][CALLEE_POOL];
+
+/*
+ * Fixups are only ever recorded in the destination context.  The pool holds
+ * both the fixup records & the buffer used to merge them.
+ */
+static __thread fixup dest_fixups[2 * FIXUP_POOL_SIZE];
+
+#else
+
+/*
+ * A thread's contexts, allocated on the thread's first rewrite & freed when
+ * the thread exits.  Data pools start out sized for the largest stack
+ * observed so far & are grown on demand.
+ */
+typedef struct context_arena {
+  struct rewrite_context contexts[NUM_CONTEXTS];
+  activation activations[NUM_CONTEXTS][MAX_FRAMES];
+} context_arena;
+
+static pthread_key_t arena_key;
+static pthread_once_t arena_key_once = PTHREAD_ONCE_INIT;
+
+/* Most frames observed in a single rewrite by any thread. */
+static size_t max_frames = INIT_POOL_FRAMES;
+
+/*
+ * Create the TLS key for context arenas.
+ */
+static void create_arena_key(void);
+
+/*
+ * Free a thread's context arena.
+ */
+static void free_arena(void* arena);
+
+/*
+ * Get the calling thread's context arena.
+ */
+static context_arena* get_arena(void);
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// Context arena
+///////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Acquire the calling thread's context of type TYPE.
+ */
+rewrite_context acquire_context(st_handle handle, context_type type)
+{
+  rewrite_context ctx;
+
+#if _TLS_IMPL == COMPILER_TLS
+  ctx = &contexts[type];
+  ctx->handle = handle;
+  ctx->acts = activations[type];
+  ctx->regset_pool = regsets[type];
+  ctx->callee_saved_pool = callee_saved[type];
+  ctx->regset_pool_size = REGSET_POOL;
+  ctx->callee_saved_pool_size = CALLEE_POOL;
+  ctx->pool_frames = MAX_FRAMES;
+  ctx->fixup_pool = (type == DEST_CONTEXT ? dest_fixups : NULL);
+#else
+  size_t frames, regset_size, callee_size;
+  context_arena* arena = get_arena();
+
+  ctx = &arena->contexts[type];
+  ctx->handle = handle;
+  ctx->acts = arena->activations[type];
+
+  /*
+   * Pools are sized in bytes, as a context may be used for different
+   * architectures (and hence register set sizes) across rewrites.
+   */
+  regset_size = REGOPS(ctx)->regset_size;
+  callee_size = bitmap_size(REGOPS(ctx)->num_regs);
+  frames = __atomic_load_n(&max_frames, __ATOMIC_RELAXED);
+  if(ctx->regset_pool_size < frames * regset_size ||
+     ctx->callee_saved_pool_size < frames * callee_size)
+  {
+    ctx->pool_frames = 0;
+    grow_data_pools(ctx, frames);
+  }
+  else
+  {
+    ctx->pool_frames = ctx->regset_pool_size / regset_size;
+    if(ctx->callee_saved_pool_size / callee_size < ctx->pool_frames)
+      ctx->pool_frames = ctx->callee_saved_pool_size / callee_size;
+    if(ctx->pool_frames > MAX_FRAMES) ctx->pool_frames = MAX_FRAMES;
+  }
+
+  if(type == DEST_CONTEXT && !ctx->fixup_pool)
+  {
+    ctx->fixup_pool = MALLOC(sizeof(fixup) * 2 * FIXUP_POOL_SIZE);
+    ASSERT(ctx->fixup_pool, "could not initialize fixup pool\n");
+  }
+#endif
+
+  return ctx;
+}
+
+/*
+ * Release a context, recording how many frames it used.
+ */
+void release_context(rewrite_context ctx)
+{
+#if _TLS_IMPL != COMPILER_TLS
+  size_t frames = __atomic_load_n(&max_frames, __ATOMIC_RELAXED);
+  while((size_t)ctx->num_acts > frames &&
+        !__atomic_compare_exchange_n(&max_frames, &frames, ctx->num_acts, true,
+                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+#endif
+}
+
+/*
+ * Grow a context's data pools.
+ */
+void grow_data_pools(rewrite_context ctx, size_t frames)
+{
+#if _TLS_IMPL == COMPILER_TLS
+  ST_ERR(1, "too many frames on stack (maximum is %d)\n", MAX_FRAMES);
+#else
+  size_t i, new_frames, regset_size, callee_size;
+  void* regset_pool, *callee_saved_pool;
+
+  if(frames > MAX_FRAMES)
+    ST_ERR(1, "too many frames on stack (maximum is %d)\n", MAX_FRAMES);
+
+  TIMER_START(grow_data_pools);
+
+  new_frames = ctx->pool_frames ? ctx->pool_frames : INIT_POOL_FRAMES;
+  while(new_frames < frames) new_frames *= 2;
+  if(new_frames > MAX_FRAMES) new_frames = MAX_FRAMES;
+
+  ST_INFO("Growing data pools to %lu frames\n", new_frames);
+
+  regset_size = REGOPS(ctx)->regset_size;
+  callee_size = bitmap_size(REGOPS(ctx)->num_regs);
+  regset_pool = MALLOC(regset_size * new_frames);
+  callee_saved_pool = MALLOC(callee_size * new_frames);
+  ASSERT(regset_pool && callee_saved_pool, "could not grow data pools\n");
+
+  /* Move frames which have already been set up into the new pools */
+  if(ctx->pool_frames)
+  {
+    memcpy(regset_pool, ctx->regset_pool, regset_size * ctx->pool_frames);
+    memcpy(callee_saved_pool, ctx->callee_saved_pool,
+           callee_size * ctx->pool_frames);
+    for(i = 0; i < ctx->pool_frames; i++)
+    {
+      ctx->acts[i].regs = regset_pool + (i * regset_size);
+      ctx->acts[i].callee_saved.bits = callee_saved_pool + (i * callee_size);
+    }
+  }
+
+  free(ctx->regset_pool);
+  free(ctx->callee_saved_pool);
+  ctx->regset_pool = regset_pool;
+  ctx->callee_saved_pool = callee_saved_pool;
+  ctx->regset_pool_size = regset_size * new_frames;
+  ctx->callee_saved_pool_size = callee_size * new_frames;
+  ctx->pool_frames = new_frames;
+
+  TIMER_STOP(grow_data_pools);
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// File-local API (implementation)
+///////////////////////////////////////////////////////////////////////////////
+
+#if _TLS_IMPL != COMPILER_TLS
+
+/*
+ * Create the TLS key for context arenas.
+ */
+static void create_arena_key(void)
+{
+  if(pthread_key_create(&arena_key, free_arena))
+    ST_ERR(1, "could not create context arena TLS key\n");
+}
+
+/*
+ * Free a thread's context arena.
+ */
+static void free_arena(void* arena)
+{
+  int i;
+  rewrite_context ctx;
+
+  for(i = 0; i < NUM_CONTEXTS; i++)
+  {
+    ctx = &((context_arena*)arena)->contexts[i];
+    free(ctx->regset_pool);
+    free(ctx->callee_saved_pool);
+    free(ctx->fixup_pool);
+  }
+  free(arena);
+}
+
+/*
+ * Get the calling thread's context arena, allocating it if necessary.
+ */
+static context_arena* get_arena(void)
+{
+  context_arena* arena;
+
+  pthread_once(&arena_key_once, create_arena_key);
+  if(!(arena = pthread_getspecific(arena_key)))
+  {
+    arena = (context_arena*)MALLOC(sizeof(context_arena));
+    ASSERT(arena, "could not allocate context arena\n");
+    memset(arena, 0, sizeof(context_arena));
+    pthread_setspecific(arena_key, arena);
+  }
+  return arena;
+}
+
+#endif
@@ -39,14 +39,6 @@ static void* get_dest_loc(rewrite_context ctx,
                           const live_value* val,
                           int act);
 
-/*
- * Get pointer to the stack save slot or the register in the outer-most
- * activation in which a callee-saved register is saved.
- */
-static void* callee_saved_loc(rewrite_context ctx,
-                              uint16_t regnum,
-                              int act);
-
 /*
  * Given a destination (and possible callee-saved location) apply an insruction
  * to generate an architecture-specific value.
@@ -105,7 +97,7 @@ void put_val(rewrite_context src,
   // This is cheap & supports both eager & on-demand rewriting.
   if(dest_val->type == SM_REGISTER &&
      PROPS(dest)->is_callee_saved(dest_val->regnum))
-    callee_addr = callee_saved_loc(dest, dest_val->regnum, dest->act);
+    callee_addr = get_callee_saved_loc(dest, dest_val->regnum, dest->act);
 
   ASSERT(dest_addr, "invalid destination location\n");
   memcpy(dest_addr, src_addr, VAL_SIZE(dest_val));
@@ -129,7 +121,7 @@ void put_val_arch(rewrite_context ctx, const arch_live_value* val)
   ST_INFO("Putting arch-specific destination value (size=%u): ", val->size);
   dest_addr = get_val_loc(ctx, val->type, val->regnum, val->offset, ctx->act);
   if(val->type == SM_REGISTER && PROPS(ctx)->is_callee_saved(val->regnum))
-    callee_addr = callee_saved_loc(ctx, val->regnum, ctx->act);
+    callee_addr = get_callee_saved_loc(ctx, val->regnum, ctx->act);
 
   ASSERT(dest_addr, "invalid destination location\n");
 
@@ -161,7 +153,7 @@ void put_val_data(rewrite_context ctx,
   ST_INFO("Setting data in frame %d: ", act);
   dest_addr = get_dest_loc(ctx, val, act);
   if(val->type == SM_REGISTER && PROPS(ctx)->is_callee_saved(val->regnum))
-    callee_addr = callee_saved_loc(ctx, val->regnum, act);
+    callee_addr = get_callee_saved_loc(ctx, val->regnum, act);
 
   ASSERT(dest_addr, "invalid destination location\n");
   memcpy(dest_addr, &data, sizeof(uint64_t));
@@ -260,6 +252,16 @@ void* points_to_data(const rewrite_context src,
   return dest_addr;
 }
 
+/*
+ * Return the address of a stack allocation in the current activation.
+ */
+void* get_alloca_addr(const rewrite_context ctx, const live_value* val)
+{
+  ASSERT(val->type == SM_DIRECT, "invalid value type (must be an alloca)\n");
+  return get_val_loc(ctx, val->type, val->regnum, val->offset_or_constant,
+                     ctx->act);
+}
+
 /*
  * Set return address of current frame in CTX to RETADDR.
  */
@@ -384,17 +386,23 @@ static void* get_dest_loc(rewrite_context ctx,
                      act);
 }
 
-static void* callee_saved_loc(rewrite_context ctx,
-                              uint16_t regnum,
-                              int act)
+/*
+ * Return where a callee-saved register is saved for activation ACT.
+ */
+void* get_callee_saved_loc(rewrite_context ctx,
+                           uint16_t regnum,
+                           int act)
 {
   void* saved_addr;
 
-  /* Nothing to propagate from outermost frame */
-  if(act <= 0) return NULL;
+  /*
+   * Nothing to propagate from outermost frame.  When rewriting on-demand,
+   * frames below the base activation have already returned.
+   */
+  if(act <= ctx->base_act) return NULL;
 
   /* Walk call chain to check if register has been saved. */
-  for(act--; act >= 0; act--)
+  for(act--; act >= ctx->base_act; act--)
   {
     if(bitmap_is_set(ctx->acts[act].callee_saved, regnum))
     {
@@ -408,7 +416,7 @@ static void* callee_saved_loc(rewrite_context ctx,
 
   /* Register is still live in outermost frame. */
   ST_INFO("Callee-saved register %u live in outer-most frame\n", regnum);
-  return REGOPS(ctx)->reg(ctx->acts[0].regs, regnum);
+  return REGOPS(ctx)->reg(ctx->acts[ctx->base_act].regs, regnum);
 }
 
 static void apply_arch_operation(rewrite_context ctx,
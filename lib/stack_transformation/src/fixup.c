@@ -0,0 +1,183 @@
+/*
+ * Implementation of pointer-to-stack fixup tracking.
+ */
+
+#include "fixup.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// File-local API & definitions
+///////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Compare fixups by pointed-to address.
+ */
+static int fixup_cmp(const void* a, const void* b);
+
+/*
+ * Return the index of the first fixup in [BEGIN, END) whose pointed-to
+ * address is greater than or equal to ADDR.
+ */
+static size_t lower_bound(const fixup* fixups,
+                          size_t begin,
+                          size_t end,
+                          void* addr);
+
+/*
+ * Double the fixup set's capacity.
+ */
+static void fixups_grow(fixup_set* set);
+
+///////////////////////////////////////////////////////////////////////////////
+// Fixup tracking
+///////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Initialize an empty fixup set.
+ */
+void fixups_init(fixup_set* set, fixup* pool, size_t pool_size)
+{
+  ASSERT(set, "invalid arguments to fixups_init()\n");
+  set->pool = set->storage = set->fixups = pool;
+  set->scratch = pool ? pool + pool_size : NULL;
+  set->max = set->pool_size = pool ? pool_size : 0;
+  set->num_sorted = set->num = 0;
+}
+
+/*
+ * Release any dynamically-allocated storage.
+ */
+void fixups_free(fixup_set* set)
+{
+  ASSERT(set, "invalid arguments to fixups_free()\n");
+  if(set->storage != set->pool) free(set->storage);
+  fixups_init(set, set->pool, set->pool_size);
+}
+
+/*
+ * Stage a new fixup.
+ */
+void fixups_add(fixup_set* set,
+                void* src_addr,
+                int act,
+                const live_value* dest_loc)
+{
+  ASSERT(set && dest_loc, "invalid arguments to fixups_add()\n");
+  if(set->num == set->max) fixups_grow(set);
+  set->fixups[set->num].src_addr = src_addr;
+  set->fixups[set->num].act = act;
+  set->fixups[set->num].dest_loc = dest_loc;
+  set->num++;
+}
+
+/*
+ * Sort staged fixups by pointed-to address.
+ */
+void fixups_sort_staged(fixup_set* set)
+{
+  ASSERT(set, "invalid arguments to fixups_sort_staged()\n");
+  if(set->num - set->num_sorted > 1)
+    qsort(&set->fixups[set->num_sorted], set->num - set->num_sorted,
+          sizeof(fixup), fixup_cmp);
+}
+
+/*
+ * Find fixups whose pointed-to address falls within [LOW, HIGH).
+ */
+void fixups_range(const fixup_set* set,
+                  bool staged,
+                  void* low,
+                  void* high,
+                  size_t* begin,
+                  size_t* end)
+{
+  size_t first, last;
+
+  ASSERT(set && begin && end, "invalid arguments to fixups_range()\n");
+
+  first = staged ? set->num_sorted : 0;
+  last = staged ? set->num : set->num_sorted;
+  *begin = lower_bound(set->fixups, first, last, low);
+  *end = lower_bound(set->fixups, *begin, last, high);
+}
+
+/*
+ * Merge staged fixups into the sorted fixups, dropping resolved fixups.
+ */
+void fixups_merge(fixup_set* set)
+{
+  size_t i = 0, j, k = 0;
+  fixup* tmp;
+
+  ASSERT(set, "invalid arguments to fixups_merge()\n");
+
+  j = set->num_sorted;
+  while(i < set->num_sorted || j < set->num)
+  {
+    if(i < set->num_sorted && fixup_resolved(&set->fixups[i])) i++;
+    else if(j < set->num && fixup_resolved(&set->fixups[j])) j++;
+    else if(j == set->num || (i < set->num_sorted &&
+            set->fixups[i].src_addr <= set->fixups[j].src_addr))
+      set->scratch[k++] = set->fixups[i++];
+    else set->scratch[k++] = set->fixups[j++];
+  }
+
+  tmp = set->fixups;
+  set->fixups = set->scratch;
+  set->scratch = tmp;
+  set->num_sorted = set->num = k;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// File-local API (implementation)
+///////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Compare fixups by pointed-to address.
+ */
+static int fixup_cmp(const void* a, const void* b)
+{
+  const fixup* fa = (const fixup*)a, *fb = (const fixup*)b;
+  if(fa->src_addr < fb->src_addr) return -1;
+  else if(fa->src_addr > fb->src_addr) return 1;
+  else return 0;
+}
+
+/*
+ * Return the index of the first fixup with an address not less than ADDR.
+ */
+static size_t lower_bound(const fixup* fixups,
+                          size_t begin,
+                          size_t end,
+                          void* addr)
+{
+  size_t mid;
+
+  while(begin < end)
+  {
+    mid = begin + (end - begin) / 2;
+    if(fixups[mid].src_addr < addr) begin = mid + 1;
+    else end = mid;
+  }
+  return begin;
+}
+
+/*
+ * Double the fixup set's capacity.  Both the records & the merge buffer are
+ * carved out of a single allocation.
+ */
+static void fixups_grow(fixup_set* set)
+{
+  size_t new_max = set->max ? set->max * 2 : FIXUP_POOL_SIZE;
+  fixup* storage;
+
+  ST_INFO("Growing fixup storage to %lu records\n", new_max);
+
+  storage = (fixup*)MALLOC(sizeof(fixup) * new_max * 2);
+  ASSERT(storage, "could not allocate fixup storage\n");
+  if(set->num) memcpy(storage, set->fixups, sizeof(fixup) * set->num);
+  if(set->storage != set->pool) free(set->storage);
+
+  set->storage = set->fixups = storage;
+  set->scratch = storage + new_max;
+  set->max = new_max;
+}
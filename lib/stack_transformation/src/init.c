@@ -7,10 +7,14 @@
  */
 
 #include <pthread.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "stack_transform.h"
+#include "plan.h"
 #include "unwind.h"
 #include "util.h"
 
@@ -52,6 +56,39 @@ __st_dtor(void)
 #endif
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// File-local API & definitions
+///////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Open the binary's metadata by mapping the file into memory.  Returns true
+ * if the binary is a native-endian ELF64 file which was successfully mapped.
+ */
+static bool open_mapped_metadata(st_handle handle);
+
+/*
+ * Open the binary's metadata through libelf.  Returns true if successful.
+ */
+static bool open_elf_metadata(st_handle handle);
+
+/*
+ * Release the mapping or libelf descriptor used to read metadata.
+ */
+static void close_metadata(st_handle handle);
+
+/*
+ * Read architecture information & stack transformation metadata from an
+ * opened binary.  Returns true if all required metadata was found.
+ */
+static bool read_metadata(st_handle handle);
+
+/*
+ * Get the number of entries in & the data contained in section SEC, using
+ * whichever method was used to open the metadata.
+ */
+static inline int64_t num_entries(st_handle handle, const char* sec);
+static inline const void* section_data(st_handle handle, const char* sec);
+
 ///////////////////////////////////////////////////////////////////////////////
 // Initialization & teardown
 ///////////////////////////////////////////////////////////////////////////////
@@ -63,8 +100,6 @@ __st_dtor(void)
  */
 st_handle st_init(const char* fn)
 {
-  const char* id;
-  Elf64_Ehdr* ehdr;
   st_handle handle;
 
   if(!fn) goto return_null;
@@ -74,70 +109,250 @@ st_handle st_init(const char* fn)
 
   if(!(handle = (st_handle)MALLOC(sizeof(struct _st_handle)))) goto return_null;
   handle->fn = fn;
-
-  /* Initialize libelf data */
+  handle->elf = NULL;
+  handle->map = NULL;
+  handle->map_size = 0;
   if((handle->fd = open(fn, O_RDONLY, 0)) < 0) goto free_handle;
-  if(!(handle->elf = elf_begin(handle->fd, ELF_C_READ, NULL))) goto close_file;
+
+  /*
+   * Read metadata in place from a mapping of the binary if possible, falling
+   * back to libelf otherwise.
+   */
+  if(!open_mapped_metadata(handle) || !read_metadata(handle))
+  {
+    if(handle->map)
+    {
+      ST_INFO("Could not read mapped metadata, falling back to libelf\n");
+      close_metadata(handle);
+    }
+    if(!open_elf_metadata(handle)) goto close_file;
+    if(!read_metadata(handle)) goto close_metadata;
+  }
+
+  /* Build search indexes for per-function & call site lookups. */
+  if(!init_search_index(&handle->unwind_addr_index, handle->unwind_addrs,
+                        handle->unwind_addr_count, sizeof(unwind_addr),
+                        offsetof(unwind_addr, addr)))
+    goto close_metadata;
+  if(!init_search_index(&handle->sites_id_index, handle->sites_id,
+                        handle->sites_count, sizeof(call_site),
+                        offsetof(call_site, id)))
+    goto free_unwind_index;
+  if(!init_search_index(&handle->sites_addr_index, handle->sites_addr,
+                        handle->sites_count, sizeof(call_site),
+                        offsetof(call_site, addr)))
+    goto free_id_index;
+
+  /* Get architecture-specific register operations & stack properties. */
+  if(!(handle->regops = get_regops(handle->arch))) goto free_addr_index;
+  if(!(handle->props = get_properties(handle->arch))) goto free_addr_index;
+
+#ifdef _REWRITE_PLANS
+  if(!init_plan_cache(handle)) goto free_addr_index;
+#endif
+
+  TIMER_STOP(st_init);
+
+  return handle;
+
+free_addr_index:
+  free_search_index(&handle->sites_addr_index);
+free_id_index:
+  free_search_index(&handle->sites_id_index);
+free_unwind_index:
+  free_search_index(&handle->unwind_addr_index);
+close_metadata:
+  close_metadata(handle);
+close_file:
+  close(handle->fd);
+free_handle:
+  free(handle);
+return_null:
+  return NULL;
+}
+
+/*
+ * Destroy a previously opened handle.  No bugs are checked when cleaning up
+ * ELF resources, so internally things may fail silently.
+ */
+void st_destroy(st_handle handle)
+{
+  if(!handle) return;
+
+  TIMER_START(st_destroy);
+  ST_INFO("Cleaning up handle for '%s'\n", handle->fn);
+
+#ifdef _REWRITE_PLANS
+  free_plan_cache(handle);
+#endif
+  free_search_index(&handle->sites_addr_index);
+  free_search_index(&handle->sites_id_index);
+  free_search_index(&handle->unwind_addr_index);
+  close_metadata(handle);
+  close(handle->fd);
+  free(handle);
+
+  TIMER_STOP(st_destroy);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// File-local API (implementation)
+///////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Map the binary into memory & validate its ELF header.
+ */
+static bool open_mapped_metadata(st_handle handle)
+{
+#if _MMAP_METADATA
+  struct stat st;
+  const Elf64_Ehdr* ehdr;
+  void* map;
+
+  if(getenv(ENV_DISABLE_MMAP)) return false;
+  if(fstat(handle->fd, &st) || (size_t)st.st_size < sizeof(Elf64_Ehdr))
+    return false;
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, handle->fd, 0);
+  if(map == MAP_FAILED) return false;
+  handle->map = map;
+  handle->map_size = st.st_size;
+
+  /*
+   * Metadata records are accessed in place, so we can only use the mapping
+   * for ELF64 binaries with the same byte order as the host.
+   */
+  ehdr = (const Elf64_Ehdr*)map;
+  if(memcmp(ehdr->e_ident, ELFMAG, SELFMAG) ||
+     ehdr->e_ident[EI_CLASS] != ELFCLASS64 ||
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+     ehdr->e_ident[EI_DATA] != ELFDATA2LSB ||
+#else
+     ehdr->e_ident[EI_DATA] != ELFDATA2MSB ||
+#endif
+     ehdr->e_shentsize != sizeof(Elf64_Shdr) ||
+     ehdr->e_shoff < sizeof(Elf64_Ehdr) ||
+     ehdr->e_shoff + sizeof(Elf64_Shdr) > handle->map_size)
+  {
+    ST_INFO("Unsupported ELF header for mapped metadata\n");
+    return false;
+  }
+
+  return true;
+#else
+  return false;
+#endif
+}
+
+/*
+ * Open the binary through libelf.
+ */
+static bool open_elf_metadata(st_handle handle)
+{
+  handle->elf = elf_begin(handle->fd, ELF_C_READ, NULL);
+  return handle->elf != NULL;
+}
+
+/*
+ * Release the mapping or libelf descriptor.
+ */
+static void close_metadata(st_handle handle)
+{
+  if(handle->map) munmap((void*)handle->map, handle->map_size);
+  if(handle->elf) elf_end(handle->elf);
+  handle->map = NULL;
+  handle->map_size = 0;
+  handle->elf = NULL;
+}
+
+/*
+ * Get the number of entries in section SEC.
+ */
+static inline int64_t num_entries(st_handle handle, const char* sec)
+{
+  if(handle->map)
+    return get_mapped_num_entries(handle->map, handle->map_size, sec);
+  else return get_num_entries(handle->elf, sec);
+}
+
+/*
+ * Get the data contained in section SEC.
+ */
+static inline const void* section_data(st_handle handle, const char* sec)
+{
+  if(handle->map)
+    return get_mapped_section_data(handle->map, handle->map_size, sec);
+  else return get_section_data(handle->elf, sec);
+}
+
+/*
+ * Read architecture information & stack transformation metadata.
+ */
+static bool read_metadata(st_handle handle)
+{
+  int64_t num_plans, num_moves;
+  const char* id;
+  const Elf64_Ehdr* ehdr;
 
   /* Get architecture-specific information */
-  if(!(ehdr = elf64_getehdr(handle->elf))) goto close_elf;
+  if(handle->map) ehdr = (const Elf64_Ehdr*)handle->map;
+  else if(!(ehdr = elf64_getehdr(handle->elf))) return false;
   handle->arch = ehdr->e_machine;
-  if(!(id = elf_getident(handle->elf, NULL))) goto close_elf;
+  if(handle->map) id = (const char*)ehdr->e_ident;
+  else if(!(id = elf_getident(handle->elf, NULL))) return false;
   handle->ptr_size = (id[EI_CLASS] == ELFCLASS64 ? 8 : 4);
 
   /* Read unwinding addresses */
-  handle->unwind_addr_count = get_num_entries(handle->elf,
-                                              SECTION_ST_UNWIND_ADDR);
+  handle->unwind_addr_count = num_entries(handle, SECTION_ST_UNWIND_ADDR);
   if(handle->unwind_addr_count > 0)
   {
-    handle->unwind_addrs = get_section_data(handle->elf,
-                                            SECTION_ST_UNWIND_ADDR);
-    if(!handle->unwind_addrs) goto close_elf;
+    handle->unwind_addrs = section_data(handle, SECTION_ST_UNWIND_ADDR);
+    if(!handle->unwind_addrs) return false;
     ST_INFO("Found %lu per-function unwinding metadata entries\n",
             handle->unwind_addr_count);
   }
   else
   {
     ST_WARN("no per-function unwinding metadata\n");
-    goto close_elf;
+    return false;
   }
 
   /* Read unwinding information */
-  handle->unwind_count = get_num_entries(handle->elf, SECTION_ST_UNWIND);
+  handle->unwind_count = num_entries(handle, SECTION_ST_UNWIND);
   if(handle->unwind_count > 0)
   {
-    handle->unwind_locs = get_section_data(handle->elf, SECTION_ST_UNWIND);
-    if(!handle->unwind_locs ) goto close_elf;
+    handle->unwind_locs = section_data(handle, SECTION_ST_UNWIND);
+    if(!handle->unwind_locs) return false;
     ST_INFO("Found %lu callee-saved frame unwinding entries\n",
             handle->unwind_count);
   }
   else
   {
     ST_WARN("no frame unwinding information\n");
-    goto close_elf;
+    return false;
   }
 
   /* Read call site metadata */
-  handle->sites_count = get_num_entries(handle->elf, SECTION_ST_ID);
+  handle->sites_count = num_entries(handle, SECTION_ST_ID);
   if(handle->sites_count > 0)
   {
-    handle->sites_id = get_section_data(handle->elf, SECTION_ST_ID);
-    handle->sites_addr = get_section_data(handle->elf, SECTION_ST_ADDR);
-    if(!handle->sites_id || !handle->sites_addr) goto close_elf;
+    handle->sites_id = section_data(handle, SECTION_ST_ID);
+    handle->sites_addr = section_data(handle, SECTION_ST_ADDR);
+    if(!handle->sites_id || !handle->sites_addr) return false;
     ST_INFO("Found %lu call sites\n", handle->sites_count);
   }
   else
   {
     ST_WARN("no call site information\n");
-    goto close_elf;
+    return false;
   }
 
   /* Read live value location records */
-  handle->live_vals_count = get_num_entries(handle->elf, SECTION_ST_LIVE);
+  handle->live_vals_count = num_entries(handle, SECTION_ST_LIVE);
   if(handle->live_vals_count > 0)
   {
-    handle->live_vals = get_section_data(handle->elf, SECTION_ST_LIVE);
-    if(!handle->live_vals) goto close_elf;
+    handle->live_vals = section_data(handle, SECTION_ST_LIVE);
+    if(!handle->live_vals) return false;
     ST_INFO("Found %lu live value location records\n",
             handle->live_vals_count);
   }
@@ -147,52 +362,40 @@ st_handle st_init(const char* fn)
   /* Read architecture-specific live value location records */
   // Note: unlike other sections, we may not have any architecture-specific
   // live value records
-  handle->arch_live_vals_count = get_num_entries(handle->elf,
-                                                 SECTION_ST_ARCH_LIVE);
+  handle->arch_live_vals_count = num_entries(handle, SECTION_ST_ARCH_LIVE);
   if(handle->arch_live_vals_count > 0)
   {
-    handle->arch_live_vals = get_section_data(handle->elf,
-                                              SECTION_ST_ARCH_LIVE);
-    if(!handle->arch_live_vals) goto close_elf;
+    handle->arch_live_vals = section_data(handle, SECTION_ST_ARCH_LIVE);
+    if(!handle->arch_live_vals) return false;
     ST_INFO("Found %lu architecture-specific live value location records\n",
             handle->arch_live_vals_count);
   }
   else
     ST_INFO("no architecture-specific live value location records\n");
 
-  /* Get architecture-specific register operations & stack properties. */
-  if(!(handle->regops = get_regops(handle->arch))) goto close_elf;
-  if(!(handle->props = get_properties(handle->arch))) goto close_elf;
-
-  TIMER_STOP(st_init);
-
-  return handle;
-
-close_elf:
-  elf_end(handle->elf);
-close_file:
-  close(handle->fd);
-free_handle:
-  free(handle);
-return_null:
-  return NULL;
-}
-
-/*
- * Destroy a previously opened handle.  No bugs are checked when cleaning up
- * ELF resources, so internally things may fail silently.
- */
-void st_destroy(st_handle handle)
-{
-  if(!handle) return;
-
-  TIMER_START(st_destroy);
-  ST_INFO("Cleaning up handle for '%s'\n", handle->fn);
-
-  elf_end(handle->elf);
-  close(handle->fd);
-  free(handle);
+  /* Read rewriting plans */
+  // Note: plans are optional, they're only added if gen-stackinfo was told
+  // about the binaries for other architectures
+  num_plans = num_entries(handle, SECTION_ST_PLAN);
+  num_moves = num_entries(handle, SECTION_ST_PLAN_MOVE);
+  if(num_plans > 0 && num_moves > 0)
+  {
+    handle->plan_sites_count = num_plans;
+    handle->plan_sites = section_data(handle, SECTION_ST_PLAN);
+    handle->plan_moves_count = num_moves;
+    handle->plan_moves = section_data(handle, SECTION_ST_PLAN_MOVE);
+    if(!handle->plan_sites || !handle->plan_moves) return false;
+    ST_INFO("Found %lu rewriting plans (%lu live value moves)\n",
+            handle->plan_sites_count, handle->plan_moves_count);
+  }
+  else
+  {
+    handle->plan_sites_count = handle->plan_moves_count = 0;
+    handle->plan_sites = NULL;
+    handle->plan_moves = NULL;
+    ST_INFO("no rewriting plans\n");
+  }
 
-  TIMER_STOP(st_destroy);
+  return true;
 }
 
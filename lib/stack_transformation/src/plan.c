@@ -0,0 +1,321 @@
+/*
+ * Compile call sites' live values into rewriting plans & cache them.
+ */
+
+#include <pthread.h>
+
+#include "plan.h"
+#include "util.h"
+
+#ifdef _REWRITE_PLANS
+
+///////////////////////////////////////////////////////////////////////////////
+// File-local API & definitions
+///////////////////////////////////////////////////////////////////////////////
+
+/* Minimum number of slots in a handle's plan cache, >= PLAN_MAX_PROBES. */
+#define MIN_PLAN_SLOTS 64
+
+/*
+ * Cache slots per call site.  Each call site gets a plan per destination
+ * architecture, leave headroom for open addressing.
+ */
+#define PLAN_SLOTS_PER_SITE 4
+
+/*
+ * Maximum number of slots probed when looking up a plan.  Bounds the cost of
+ * a lookup which misses, e.g., if the cache is crowded.
+ */
+#define PLAN_MAX_PROBES 16
+
+/*
+ * Source of handle generations.  Plans are keyed on their destination handle's
+ * generation rather than its address, which may be reused by a new handle
+ * after st_destroy().
+ */
+static uint64_t next_generation = 0;
+
+/*
+ * Handles with plan caches.  When a handle is destroyed, plans compiled for it
+ * as a destination are removed from the other handles' caches so their slots
+ * can be reused.
+ */
+static pthread_mutex_t plan_caches_lock = PTHREAD_MUTEX_INITIALIZER;
+static st_handle plan_caches = NULL;
+
+/*
+ * Hash a call site ID & destination handle generation into the plan cache.
+ */
+static inline uint64_t plan_hash(uint64_t id, uint64_t generation)
+{
+  return ((id ^ (generation << 16)) * 0x9e3779b97f4a7c15ULL) >> 32;
+}
+
+/*
+ * Compile a value's location in the current frame of CTX.  Returns false if
+ * the location cannot be compiled.
+ */
+static bool compile_loc(rewrite_context ctx,
+                        const live_value* val,
+                        plan_loc* loc)
+{
+  switch(val->type)
+  {
+  case SM_REGISTER:
+    loc->type = PLAN_LOC_REG;
+    loc->offset = 0;
+    break;
+  case SM_DIRECT: case SM_INDIRECT:
+    loc->type = PLAN_LOC_STACK;
+    loc->offset = val->offset_or_constant;
+    break;
+  case SM_CONSTANT:
+    loc->type = PLAN_LOC_CONST;
+    loc->reg = 0;
+    loc->constant = &val->offset_or_constant;
+    return true;
+  default: return false;
+  }
+
+  loc->reg = REGOPS(ctx)->reg(ACT(ctx).regs, val->regnum) - ACT(ctx).regs;
+  loc->constant = NULL;
+  return true;
+}
+
+/*
+ * Compile a source/destination value pair into operations, mirroring
+ * rewrite_val().  Returns the number of operations added to OPS.
+ */
+static size_t compile_val(rewrite_context src,
+                          const live_value* val_src,
+                          rewrite_context dest,
+                          const live_value* val_dest,
+                          plan_op* ops)
+{
+  size_t num = 0;
+  plan_loc src_loc, dest_loc;
+
+  if(val_dest->is_temporary) return 0;
+
+  /*
+   * Pointers need to be checked for whether they point to the stack when
+   * rewriting & mismatched values (e.g., va_list) need special handling, so
+   * rewrite them generically.
+   */
+  if(val_src->is_ptr || val_src->is_temporary ||
+     VAL_SIZE(val_src) != VAL_SIZE(val_dest) ||
+     (val_src->is_alloca && (val_src->type != SM_DIRECT ||
+                             val_dest->type != SM_DIRECT)) ||
+     !compile_loc(src, val_src, &src_loc))
+  {
+    ops[0].type = PLAN_REWRITE_VAL;
+    ops[0].regnum = 0;
+    ops[0].size = 0;
+    ops[0].val.src = val_src;
+    ops[0].val.dest = val_dest;
+    return 1;
+  }
+
+  /* Copy the value, unless the destination is constant */
+  if(compile_loc(dest, val_dest, &dest_loc) && dest_loc.type != PLAN_LOC_CONST)
+  {
+    if(val_dest->type == SM_REGISTER &&
+       PROPS(dest)->is_callee_saved(val_dest->regnum))
+      ops[num].type = PLAN_COPY_CALLEE_SAVED;
+    else ops[num].type = PLAN_COPY;
+    ops[num].regnum = val_dest->regnum;
+    ops[num].size = VAL_SIZE(val_dest);
+    ops[num].loc.src = src_loc;
+    ops[num].loc.dest = dest_loc;
+    num++;
+  }
+
+  /* Stack allocations may be pointed to by frames down the call chain */
+  if(val_src->is_alloca)
+  {
+    ops[num].type = PLAN_POINTED_TO;
+    ops[num].regnum = 0;
+    ops[num].size = val_src->alloca_size;
+    ops[num].loc.src = src_loc;
+    ops[num].loc.dest = dest_loc;
+    num++;
+  }
+
+  return num;
+}
+
+/*
+ * Compile the plan for the current frames of SRC & DEST.
+ */
+static rewrite_plan* compile_plan(rewrite_context src, rewrite_context dest)
+{
+  size_t i, j, src_offset, dest_offset, num = 0;
+  uint16_t num_moves;
+  const live_value* val_src, *val_dest;
+  const plan_move* moves;
+  rewrite_plan* plan;
+
+  /* Each destination location record needs at most two operations */
+  plan = MALLOC(sizeof(rewrite_plan) +
+                sizeof(plan_op) * 2 * ACT(dest).site.num_live);
+  if(!plan) return NULL;
+
+  TIMER_FG_START(compile_plan);
+
+  src_offset = ACT(src).site.live_offset;
+  dest_offset = ACT(dest).site.live_offset;
+
+  /* Use the records paired by gen-stackinfo, if available */
+  if((moves = get_site_moves(src->handle, dest->handle->arch,
+                             ACT(src).site.id, &num_moves)))
+  {
+    for(i = 0; i < num_moves; i++)
+    {
+      val_src = &src->handle->live_vals[moves[i].src + src_offset];
+      val_dest = &dest->handle->live_vals[moves[i].dest + dest_offset];
+      num += compile_val(src, val_src, dest, val_dest, &plan->ops[num]);
+    }
+  }
+  else
+  {
+    /* Otherwise walk the records exactly like rewrite_frame() */
+    for(i = 0, j = 0; j < ACT(dest).site.num_live; i++, j++)
+    {
+      val_src = &src->handle->live_vals[i + src_offset];
+      val_dest = &dest->handle->live_vals[j + dest_offset];
+      num += compile_val(src, val_src, dest, val_dest, &plan->ops[num]);
+
+      while((j + 1 + dest_offset) < dest->handle->live_vals_count &&
+            dest->handle->live_vals[j + 1 + dest_offset].is_duplicate)
+      {
+        j++;
+        val_dest = &dest->handle->live_vals[j + dest_offset];
+        num += compile_val(src, val_src, dest, val_dest, &plan->ops[num]);
+      }
+
+      while((i + 1 + src_offset) < src->handle->live_vals_count &&
+            src->handle->live_vals[i + 1 + src_offset].is_duplicate) i++;
+    }
+  }
+
+  plan->dest_generation = dest->handle->generation;
+  plan->id = ACT(src).site.id;
+  plan->num_ops = num;
+
+  ST_INFO("Compiled plan for call site %lu (%lu operations)\n",
+          plan->id, plan->num_ops);
+
+  TIMER_FG_STOP(compile_plan);
+  return plan;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Plan access
+///////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Initialize a handle's plan cache.
+ */
+bool init_plan_cache(st_handle handle)
+{
+  uint64_t slots = MIN_PLAN_SLOTS;
+
+  while(slots < handle->sites_count * PLAN_SLOTS_PER_SITE) slots <<= 1;
+  handle->plans = (rewrite_plan**)MALLOC(sizeof(rewrite_plan*) * slots);
+  if(!handle->plans) return false;
+  memset(handle->plans, 0, sizeof(rewrite_plan*) * slots);
+  handle->plans_mask = slots - 1;
+  handle->retired_plans = NULL;
+  handle->generation = __atomic_add_fetch(&next_generation, 1,
+                                          __ATOMIC_RELAXED);
+
+  pthread_mutex_lock(&plan_caches_lock);
+  handle->next_plan_cache = plan_caches;
+  plan_caches = handle;
+  pthread_mutex_unlock(&plan_caches_lock);
+  return true;
+}
+
+/*
+ * Free a handle's plan cache.  Plans compiled for the handle as a destination
+ * are removed from other handles' caches.  Threads may still be reading them,
+ * so they're retired & freed along with the cache they were removed from.
+ */
+void free_plan_cache(st_handle handle)
+{
+  st_handle* link, cur;
+  rewrite_plan* plan;
+  uint64_t i;
+
+  if(!handle->plans) return;
+
+  pthread_mutex_lock(&plan_caches_lock);
+  for(link = &plan_caches; *link; link = &(*link)->next_plan_cache)
+  {
+    if(*link == handle)
+    {
+      *link = handle->next_plan_cache;
+      break;
+    }
+  }
+  for(cur = plan_caches; cur; cur = cur->next_plan_cache)
+  {
+    for(i = 0; i <= cur->plans_mask; i++)
+    {
+      plan = __atomic_load_n(&cur->plans[i], __ATOMIC_ACQUIRE);
+      if(plan && plan->dest_generation == handle->generation &&
+         __atomic_compare_exchange_n(&cur->plans[i], &plan, NULL, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+      {
+        plan->next_retired = cur->retired_plans;
+        cur->retired_plans = plan;
+      }
+    }
+  }
+  pthread_mutex_unlock(&plan_caches_lock);
+
+  for(i = 0; i <= handle->plans_mask; i++) free(handle->plans[i]);
+  while((plan = handle->retired_plans))
+  {
+    handle->retired_plans = plan->next_retired;
+    free(plan);
+  }
+  free(handle->plans);
+  handle->plans = NULL;
+}
+
+/*
+ * Get the plan for the current frames, compiling it on first use.  Plans are
+ * published with a compare-and-swap on an empty slot, so threads racing to
+ * compile the same plan keep whichever was published first.
+ */
+const rewrite_plan* get_rewrite_plan(rewrite_context src,
+                                     rewrite_context dest)
+{
+  uint64_t id = ACT(src).site.id, mask = src->handle->plans_mask, i, probes;
+  rewrite_plan** slots = src->handle->plans, *cur, *plan = NULL;
+
+  i = plan_hash(id, dest->handle->generation) & mask;
+  for(probes = 0; probes < PLAN_MAX_PROBES; probes++, i = (i + 1) & mask)
+  {
+    cur = __atomic_load_n(&slots[i], __ATOMIC_ACQUIRE);
+    if(!cur)
+    {
+      if(!plan && !(plan = compile_plan(src, dest))) return NULL;
+      if(__atomic_compare_exchange_n(&slots[i], &cur, plan, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        return plan;
+    }
+    if(cur->id == id && cur->dest_generation == dest->handle->generation)
+    {
+      free(plan);
+      return cur;
+    }
+  }
+
+  ST_WARN("no free plan cache slot for call site %lu\n", id);
+  free(plan);
+  return NULL;
+}
+
+#endif /* _REWRITE_PLANS */
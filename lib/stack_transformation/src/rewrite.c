@@ -6,31 +6,74 @@
  */
 
 #include "stack_transform.h"
+#include "arena.h"
 #include "data.h"
+#include "fixup.h"
+#include "plan.h"
 #include "unwind.h"
 #include "util.h"
+#include "workers.h"
 
 ///////////////////////////////////////////////////////////////////////////////
 // File-local API & definitions
 ///////////////////////////////////////////////////////////////////////////////
 
+#include "arch_regs.h"
+
+/*
+ * Trampolines which intercept returns into frames that have not yet been
+ * transformed when rewriting on-demand.  Saves return-value registers, calls
+ * __st_ondemand_rewrite() to transform the frame being returned into and
+ * jumps to the call site with the frame's register set.  Defined in
+ * src/arch/<arch>/ondemand_<arch>.S.
+ */
+extern void __st_ondemand_trampoline_aarch64(void);
+extern void __st_ondemand_trampoline_x86_64(void);
+
+/* State of a thread's in-progress on-demand rewrite. */
+typedef enum ondemand_status {
+  ONDEMAND_NONE = 0, /* no on-demand rewrite in progress */
+  ONDEMAND_PENDING, /* frames left to transform when returned into */
+  ONDEMAND_RESOLVED /* frames transformed, trampoline installs resume_regs */
+} ondemand_status;
+
+typedef struct ondemand_state {
+  ondemand_status status;
+  rewrite_context src, dest; /* contexts kept alive between frames */
+  char resume_regs[MAX_REGSET_SIZE]; /* register set for ONDEMAND_RESOLVED */
+  size_t resume_size; /* size of resume_regs for the architecture */
+} ondemand_state;
+
 #if _TLS_IMPL == COMPILER_TLS
+static __thread ondemand_state ondemand;
+#else
+static pthread_key_t ondemand_key;
+static pthread_once_t ondemand_key_once = PTHREAD_ONCE_INIT;
+#endif
 
-#include "arch_regs.h"
+/* Which parts of a frame's transformation to perform. */
+typedef enum rewrite_phase {
+  REWRITE_ALL = 0, /* copy values & handle pointers to the stack */
+  REWRITE_COPY, /* copy values only, can run concurrently for other frames */
+  REWRITE_FIXUP /* handle pointers to the stack only */
+} rewrite_phase;
 
-#define REGSET_POOL (MAX_REGSET_SIZE * MAX_FRAMES)
-#define CALLEE_POOL (MAX_CALLEE_SIZE * MAX_FRAMES)
+/*
+ * Get the calling thread's on-demand rewriting state.
+ */
+static ondemand_state* get_ondemand_state(void);
 
 /*
- * Declare all rewriting space at compile time to avoid malloc whenever
- * possible.  We only need to declare a pair of each as each thread will only
- * ever use 2 at a time.
+ * Get the on-demand rewriting trampoline for architecture ARCH, or NULL if not
+ * supported.
  */
-static __thread struct rewrite_context src_ctx, dest_ctx;
-static __thread char src_regs[REGSET_POOL], dest_regs[REGSET_POOL];
-static __thread char src_callee[CALLEE_POOL], dest_callee[CALLEE_POOL];
+static void* get_ondemand_trampoline(uint16_t arch);
 
-#endif
+/*
+ * Transform all remaining frames of an in-progress on-demand rewrite, so that
+ * the stack can be unwound for another rewrite.
+ */
+static void finish_ondemand(ondemand_state* state);
 
 /*
  * Initialize an architecture-specific (source) context using previously
@@ -49,21 +92,11 @@ static rewrite_context init_dest_context(st_handle handle,
                                          void* regset,
                                          void* sp_base);
 
-/*
- * Initialize data pools for constant-time allocation.
- */
-static void init_data_pools(rewrite_context ctx);
-
 /*
  * Free previously-allocated context information.
  */
 static void free_context(rewrite_context ctx);
 
-/*
- * Free a context's data pools.
- */
-static void free_data_pools(rewrite_context ctx);
-
 /*
  * Unwind the source stack to find all live stack frames & determine
  * destination stack size.
@@ -76,7 +109,26 @@ static void unwind_and_size(rewrite_context src,
  * Returns true if there's a fixup needed within this stack frame.
  */
 static bool rewrite_val(rewrite_context src, const live_value* val_src,
-                        rewrite_context dest, const live_value* val_dest);
+                        rewrite_context dest, const live_value* val_dest,
+                        rewrite_phase phase);
+
+/*
+ * Resolve fixups for pointers from frames down the call chain into a stack
+ * allocation of SIZE bytes at SRC_ADDR, which is at DEST_ADDR in the
+ * destination frame.
+ */
+static void resolve_pointed_to(rewrite_context dest,
+                               void* src_addr,
+                               void* dest_addr,
+                               size_t size);
+
+/*
+ * Search the current frame's allocas for the data pointed to by SRC_PTR.
+ * Returns the corresponding destination address, or NULL if not found.
+ */
+static void* find_pointed_to(rewrite_context src,
+                             rewrite_context dest,
+                             void* src_ptr);
 
 /*
  * Fix up pointers to same-frame data.
@@ -84,10 +136,57 @@ static bool rewrite_val(rewrite_context src, const live_value* val_src,
 static inline void
 fixup_local_pointers(rewrite_context src, rewrite_context dest);
 
+/*
+ * Fix up pointers from the current frame to data in frames up the call chain.
+ * Used when rewriting on-demand, as the current frame resumes before the
+ * pointed-to frames are transformed.
+ */
+static void fixup_caller_pointers(rewrite_context src, rewrite_context dest);
+
+/*
+ * Rewrite the current frame's live values by interpreting their location
+ * records.  Returns true if there are fixups needed within this stack frame.
+ */
+static bool rewrite_vals(rewrite_context src,
+                         rewrite_context dest,
+                         rewrite_phase phase);
+
+#ifdef _REWRITE_PLANS
+/*
+ * Rewrite the current frame's live values by running a precompiled plan.
+ * Returns true if there are fixups needed within this stack frame.
+ */
+static bool run_plan(rewrite_context src,
+                     rewrite_context dest,
+                     const rewrite_plan* plan,
+                     rewrite_phase phase);
+#endif
+
 /*
  * Re-write an individual frame from the source to destination stack.
  */
-static void rewrite_frame(rewrite_context src, rewrite_context dest);
+static void rewrite_frame(rewrite_context src,
+                          rewrite_context dest,
+                          rewrite_phase phase);
+
+/*
+ * Rewrite all frames after unwinding, one frame at a time.
+ */
+static void rewrite_frames(rewrite_context src, rewrite_context dest);
+
+#ifdef _PARALLEL_REWRITE
+/*
+ * Rewrite all frames after unwinding.  Lays out all destination frames, copies
+ * frames' values in parallel & then serially resolves pointers to the stack.
+ */
+static void rewrite_frames_parallel(rewrite_context src, rewrite_context dest);
+
+/*
+ * Copy values for frames [BEGIN, END).  ARG points to the source & destination
+ * contexts.
+ */
+static void copy_frames(void* arg, size_t begin, size_t end);
+#endif
 
 ///////////////////////////////////////////////////////////////////////////////
 // Perform stack transformation
@@ -104,7 +203,7 @@ int st_rewrite_stack(st_handle handle_src,
                      void* sp_base_dest)
 {
   rewrite_context src, dest;
-  uint64_t* saved_fbp;
+  ondemand_state* state;
 
   if(!handle_src || !regset_src || !sp_base_src ||
      !handle_dest || !regset_dest || !sp_base_dest)
@@ -115,6 +214,10 @@ int st_rewrite_stack(st_handle handle_src,
 
   TIMER_START(st_rewrite_stack);
 
+  /* Transform frames left over from a previous on-demand rewrite. */
+  state = get_ondemand_state();
+  if(state->status == ONDEMAND_PENDING) finish_ondemand(state);
+
   ST_INFO("--> Initializing rewrite (%s -> %s) <--\n",
           arch_name(handle_src->arch), arch_name(handle_dest->arch));
 
@@ -134,39 +237,15 @@ int st_rewrite_stack(st_handle handle_src,
   /* Unwind source stack to determine destination stack size. */
   unwind_and_size(src, dest);
 
-  // Note: the following code is brittle -- it has to happen in this *exact*
-  // order because of the way the stack is unwound and information in the
-  // current & surrounding frames is accessed.  Modify with care!
-
   ST_INFO("--> Rewriting from source to destination stack <--\n");
 
   TIMER_START(rewrite_stack);
-
-  /* Rewrite outer-most frame. */
-  ST_INFO("--> Rewriting outermost frame <--\n");
-
-  set_return_address_funcentry(dest, (void*)NEXT_ACT(dest).site.addr);
-  pop_frame_funcentry(dest);
-
-  /* Rewrite rest of frames. */
-  for(src->act = 1; src->act < src->num_acts - 1; src->act++)
-  {
-    ST_INFO("--> Rewriting frame %d <--\n", src->act);
-
-    set_return_address(dest, (void*)NEXT_ACT(dest).site.addr);
-    rewrite_frame(src, dest);
-    saved_fbp = get_savedfbp_loc(dest);
-    ASSERT(saved_fbp, "invalid saved frame pointer location\n");
-    pop_frame(dest, true);
-    *saved_fbp = (uint64_t)REGOPS(dest)->fbp(ACT(dest).regs);
-    ST_INFO("Old FP saved to %p\n", saved_fbp);
-  }
-
-  // Note: there may be a few things to fix up in the innermost function, e.g.,
-  // the TOC pointer on PowerPC
-  ST_INFO("--> Rewriting frame %d (starting function) <--\n", src->act);
-  rewrite_frame(src, dest);
-
+#ifdef _PARALLEL_REWRITE
+  if(src->num_acts >= PARALLEL_MIN_FRAMES && num_workers() > 1)
+    rewrite_frames_parallel(src, dest);
+  else
+#endif
+  rewrite_frames(src, dest);
   TIMER_STOP(rewrite_stack);
 
   /* Copy out register state for destination & clean up. */
@@ -199,17 +278,227 @@ int st_rewrite_ondemand(st_handle handle_src,
                         void* regset_dest,
                         void* sp_base_dest)
 {
-  ST_ERR(1, "on-demand rewriting not yet supported\n");
+  rewrite_context src, dest;
+  ondemand_state* state;
+  uint64_t* saved_fbp;
+  void* trampoline;
+
+  if(!handle_src || !regset_src || !sp_base_src ||
+     !handle_dest || !regset_dest || !sp_base_dest)
+  {
+    ST_WARN("invalid arguments\n");
+    return 1;
+  }
+
+  if(!(trampoline = get_ondemand_trampoline(handle_dest->arch)))
+  {
+    ST_WARN("on-demand rewriting not supported for %s, rewriting entire "
+            "stack\n", arch_name(handle_dest->arch));
+    return st_rewrite_stack(handle_src, regset_src, sp_base_src,
+                            handle_dest, regset_dest, sp_base_dest);
+  }
+
+  TIMER_START(st_rewrite_ondemand);
+
+  /* Transform frames left over from a previous on-demand rewrite. */
+  state = get_ondemand_state();
+  if(state->status == ONDEMAND_PENDING) finish_ondemand(state);
+
+  ST_INFO("--> Initializing on-demand rewrite (%s -> %s) <--\n",
+          arch_name(handle_src->arch), arch_name(handle_dest->arch));
+
+  /* Initialize rewriting contexts. */
+  src = init_src_context(handle_src, regset_src, sp_base_src);
+  dest = init_dest_context(handle_dest, regset_dest, sp_base_dest);
+
+  if(!src || !dest)
+  {
+    if(src) free_context(src);
+    if(dest) free_context(dest);
+    return 1;
+  }
+
+  ST_INFO("--> Unwinding source stack to find live activations <--\n");
+
+  /* Unwind source stack to determine destination stack size. */
+  unwind_and_size(src, dest);
+
+  // Note: the same ordering constraints as st_rewrite_stack() apply here.
+  // We lay out all destination frames now (so that every frame has a valid
+  // CFA & frame base pointer) but defer copying live values until the thread
+  // returns into each frame through the trampoline.
+
+  ST_INFO("--> Laying out destination stack <--\n");
+
+  set_return_address_funcentry(dest, trampoline);
+  pop_frame_funcentry(dest);
+  REGOPS(dest)->set_pc(ACT(dest).regs, (void*)ACT(dest).site.addr);
+
+  while(dest->act < dest->num_acts - 1)
+  {
+    set_return_address(dest, trampoline);
+    saved_fbp = get_savedfbp_loc(dest);
+    ASSERT(saved_fbp, "invalid saved frame pointer location\n");
+    pop_frame(dest, true);
+    *saved_fbp = (uint64_t)REGOPS(dest)->fbp(ACT(dest).regs);
+    REGOPS(dest)->set_pc(ACT(dest).regs, (void*)ACT(dest).site.addr);
+  }
+
+  /* Copy out register state for destination, next frame is rewritten lazily */
+  REGOPS(dest)->regset_copyout(dest->acts[0].regs, dest->regs);
+  src->act = dest->act = 1;
+  state->src = src;
+  state->dest = dest;
+  state->status = ONDEMAND_PENDING;
+
+  ST_INFO("Finished rewriting outermost frame, %d frame(s) pending\n",
+          dest->num_acts - 1);
+
+  TIMER_STOP(st_rewrite_ondemand);
+
+#ifdef _LOG
+#ifndef _PER_LOG_OPEN
+  fflush(__log);
+#endif
+#endif
 
   // Note: don't clean up, as we'll need the contexts when the thread needs to
   // re-write the next frame
   return 0;
 }
 
+/*
+ * Called by the trampoline when returning into a frame which has not yet been
+ * transformed.  Transforms the frame and fills REGSET with the register set
+ * needed to resume it.
+ */
+void __st_ondemand_rewrite(void* regset)
+{
+  rewrite_context src, dest;
+  ondemand_state* state = get_ondemand_state();
+
+  if(state->status == ONDEMAND_RESOLVED)
+  {
+    ST_INFO("Resuming previously transformed frame\n");
+    memcpy(regset, state->resume_regs, state->resume_size);
+    state->status = ONDEMAND_NONE;
+    return;
+  }
+  ASSERT(state->status == ONDEMAND_PENDING, "no on-demand rewrite pending\n");
+
+  TIMER_START(rewrite_ondemand_frame);
+
+  src = state->src;
+  dest = state->dest;
+  ASSERT(src->act == dest->act, "mismatched activations\n");
+  ST_INFO("--> Rewriting frame %d on-demand <--\n", dest->act);
+
+  /* Frames down the call chain have returned, don't propagate into them. */
+  src->base_act = dest->base_act = dest->act;
+  rewrite_frame(src, dest, REWRITE_ALL);
+  fixup_caller_pointers(src, dest);
+  REGOPS(dest)->regset_copyout(ACT(dest).regs, regset);
+
+  if(dest->act == dest->num_acts - 1)
+  {
+    ST_INFO("Finished on-demand rewrite!\n");
+    free_context(dest);
+    free_context(src);
+    state->status = ONDEMAND_NONE;
+  }
+  else
+  {
+    src->act++;
+    dest->act++;
+  }
+
+  TIMER_STOP(rewrite_ondemand_frame);
+  if(state->status == ONDEMAND_NONE) TIMER_PRINT;
+
+#ifdef _LOG
+#ifndef _PER_LOG_OPEN
+  fflush(__log);
+#endif
+#endif
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // File-local API implementation
 ///////////////////////////////////////////////////////////////////////////////
 
+#if _TLS_IMPL != COMPILER_TLS
+static void create_ondemand_key(void)
+{
+  if(pthread_key_create(&ondemand_key, free))
+    ST_ERR(1, "could not create on-demand rewriting TLS key\n");
+}
+#endif
+
+/*
+ * Get the calling thread's on-demand rewriting state.
+ */
+static ondemand_state* get_ondemand_state(void)
+{
+#if _TLS_IMPL == COMPILER_TLS
+  return &ondemand;
+#else
+  ondemand_state* state;
+
+  pthread_once(&ondemand_key_once, create_ondemand_key);
+  if(!(state = pthread_getspecific(ondemand_key)))
+  {
+    state = (ondemand_state*)MALLOC(sizeof(ondemand_state));
+    ASSERT(state, "could not allocate on-demand rewriting state\n");
+    state->status = ONDEMAND_NONE;
+    pthread_setspecific(ondemand_key, state);
+  }
+  return state;
+#endif
+}
+
+/*
+ * Get the on-demand rewriting trampoline for architecture ARCH.
+ */
+static void* get_ondemand_trampoline(uint16_t arch)
+{
+  switch(arch)
+  {
+  case EM_AARCH64: return __st_ondemand_trampoline_aarch64;
+  case EM_X86_64: return __st_ondemand_trampoline_x86_64;
+  default: return NULL;
+  }
+}
+
+/*
+ * Transform all remaining frames of an in-progress on-demand rewrite.  The
+ * register set for the innermost remaining frame is stashed for when the
+ * thread returns through the trampoline (or when the stack is unwound again).
+ */
+static void finish_ondemand(ondemand_state* state)
+{
+  rewrite_context src = state->src, dest = state->dest;
+  int first = dest->act;
+
+  ST_INFO("--> Finishing on-demand rewrite (frames %d - %d) <--\n",
+          first, dest->num_acts - 1);
+
+  src->base_act = dest->base_act = first;
+  for(; dest->act < dest->num_acts; src->act++, dest->act++)
+  {
+    /* Restore the real return addresses hijacked for the trampoline. */
+    if(dest->act < dest->num_acts - 1)
+      set_return_address(dest, (void*)NEXT_ACT(dest).site.addr);
+    rewrite_frame(src, dest, REWRITE_ALL);
+    fixup_caller_pointers(src, dest);
+  }
+
+  REGOPS(dest)->regset_copyout(dest->acts[first].regs, state->resume_regs);
+  state->resume_size = REGOPS(dest)->regset_size;
+  free_context(dest);
+  free_context(src);
+  state->status = ONDEMAND_RESOLVED;
+}
+
 /*
  * Initialize an architecture-specific (source) context using previously
  * initialized REGSET and HANDLE.
@@ -222,23 +511,15 @@ static rewrite_context init_src_context(st_handle handle,
 
   TIMER_START(init_src_context);
 
-#if _TLS_IMPL == COMPILER_TLS
-  ctx = &src_ctx;
-  ctx->regset_pool = src_regs;
-  ctx->callee_saved_pool = src_callee;
-#else
-  ctx = (rewrite_context)MALLOC(sizeof(struct rewrite_context));
-#endif
-  ctx->handle = handle;
+  ctx = acquire_context(handle, SRC_CONTEXT);
   ctx->num_acts = 1;
   ctx->act = 0;
+  ctx->base_act = 0;
   ctx->regs = regset;
   ctx->stack_base = sp_base;
 
-#if _TLS_IMPL != COMPILER_TLS
-  init_data_pools(ctx);
-#endif
-  list_init(fixup, &ctx->stack_pointers);
+  fixups_init(&ctx->stack_pointers, ctx->fixup_pool,
+              ctx->fixup_pool ? FIXUP_POOL_SIZE : 0);
   bootstrap_first_frame(ctx, regset); // Sets up initial register set
   ctx->stack = REGOPS(ctx)->sp(ACT(ctx).regs);
   ASSERT(ctx->stack, "invalid stack pointer\n");
@@ -270,23 +551,15 @@ static rewrite_context init_dest_context(st_handle handle,
 
   TIMER_START(init_dest_context);
 
-#if _TLS_IMPL == COMPILER_TLS
-  ctx = &dest_ctx;
-  ctx->regset_pool = dest_regs;
-  ctx->callee_saved_pool = dest_callee;
-#else
-  ctx = (rewrite_context)MALLOC(sizeof(struct rewrite_context));
-#endif
-  ctx->handle = handle;
+  ctx = acquire_context(handle, DEST_CONTEXT);
   ctx->num_acts = 1;
   ctx->act = 0;
+  ctx->base_act = 0;
   ctx->regs = regset;
   ctx->stack_base = sp_base;
 
-#if _TLS_IMPL != COMPILER_TLS
-  init_data_pools(ctx);
-#endif
-  list_init(fixup, &ctx->stack_pointers);
+  fixups_init(&ctx->stack_pointers, ctx->fixup_pool,
+              ctx->fixup_pool ? FIXUP_POOL_SIZE : 0);
 
   // Note: cannot setup frame information because CFA will be invalid, need to
   // set up SP & find call site information
@@ -295,61 +568,34 @@ static rewrite_context init_dest_context(st_handle handle,
   return ctx;
 }
 
-/*
- * Initialize the context's data pools.
- */
-static void init_data_pools(rewrite_context ctx)
-{
-  size_t num_regs = REGOPS(ctx)->num_regs;
-  ctx->regset_pool = MALLOC(REGOPS(ctx)->regset_size * MAX_FRAMES);
-  ctx->callee_saved_pool = MALLOC(bitmap_size(num_regs) * MAX_FRAMES);
-  ASSERT(ctx->callee_saved_pool && ctx->regset_pool,
-         "could not initialize data pools");
-}
-
 /*
  * Free an architecture-specific context.
  */
 static void free_context(rewrite_context ctx)
 {
-  node_t(fixup)* node;
+  size_t i;
+  const fixup* fix;
 
   TIMER_START(free_context);
 
-  node = list_begin(fixup, &ctx->stack_pointers);
-  while(node)
+  for(i = 0; i < ctx->stack_pointers.num; i++)
   {
-    ST_WARN("could not find stack pointer fixup for %p (in activation %d)\n",
-            node->data.src_addr, node->data.act);
-    node = list_remove(fixup, &ctx->stack_pointers, node);
+    fix = &ctx->stack_pointers.fixups[i];
+    if(!fixup_resolved(fix))
+      ST_WARN("could not find stack pointer fixup for %p (in activation %d)\n",
+              fix->src_addr, fix->act);
   }
+  fixups_free(&ctx->stack_pointers);
 
 #ifdef _CHECKS
-  int i;
   for(i = 0; i < ctx->num_acts; i++)
     clear_activation(ctx->handle, &ctx->acts[i]);
 #endif
-#if _TLS_IMPL != COMPILER_TLS
-  free_data_pools(ctx);
-  free(ctx);
-#endif
+  release_context(ctx);
 
   TIMER_STOP(free_context);
 }
 
-/*
- * Free a rewrite context's data pools.
- */
-static void free_data_pools(rewrite_context ctx)
-{
-  free(ctx->regset_pool);
-  free(ctx->callee_saved_pool);
-#ifdef _DEBUG
-  ctx->regset_pool = NULL;
-  ctx->callee_saved_pool = NULL;
-#endif
-}
-
 /*
  * Unwind source stack to find live frames & size destination stack.
  * Simultaneously caches function & call-site information.
@@ -358,10 +604,12 @@ static void unwind_and_size(rewrite_context src,
                             rewrite_context dest)
 {
   size_t stack_size = 8; // Account for possible already-pushed return address
-  void* fn;
+  void* fn, *trampoline;
+  ondemand_state* state = get_ondemand_state();
 
   TIMER_START(unwind_and_size);
 
+  trampoline = get_ondemand_trampoline(src->handle->arch);
   do
   {
     pop_frame(src, false);
@@ -369,6 +617,19 @@ static void unwind_and_size(rewrite_context src,
     dest->num_acts++;
     dest->act++;
 
+    /*
+     * If we hit the trampoline of a previous on-demand rewrite, the frame's
+     * registers were stashed when finishing that rewrite.
+     */
+    if(trampoline && REGOPS(src)->pc(ACT(src).regs) == trampoline)
+    {
+      ASSERT(state->status == ONDEMAND_RESOLVED,
+             "returns into on-demand trampoline with no resolved frame\n");
+      ST_INFO("Restoring frame stashed by on-demand rewrite\n");
+      REGOPS(src)->regset_copyin(ACT(src).regs, state->resume_regs);
+      state->status = ONDEMAND_NONE;
+    }
+
     ST_INFO("Stack Activation Number = %d\n", ACT(src).site.id);
 
     /*
@@ -412,6 +673,7 @@ static void unwind_and_size(rewrite_context src,
   ST_INFO("Rewriting destination as if entering function @ %p\n", fn);
 
   /* Clear the callee-saved bitmaps for all destination frames. */
+  reserve_frame(dest, dest->num_acts - 1);
   memset(dest->callee_saved_pool, 0, bitmap_size(REGOPS(dest)->num_regs) *
                                      dest->num_acts);
 
@@ -422,12 +684,11 @@ static void unwind_and_size(rewrite_context src,
  * Rewrite an individual value from the source to destination call frame.
  */
 static bool rewrite_val(rewrite_context src, const live_value* val_src,
-                        rewrite_context dest, const live_value* val_dest)
+                        rewrite_context dest, const live_value* val_dest,
+                        rewrite_phase phase)
 {
   bool skip = false, needs_local_fixup = false;
-  void* stack_addr;
-  fixup fixup_data;
-  node_t(fixup)* fixup_node;
+  void* stack_addr, *src_addr;
 
   ASSERT(val_src && val_dest, "invalid values\n");
 
@@ -479,13 +740,11 @@ static bool rewrite_val(rewrite_context src, const live_value* val_src,
    */
   if((stack_addr = points_to_stack(src, val_src)))
   {
-    if(stack_addr >= PREV_ACT(src).cfa || src->act == 0)
+    if(phase == REWRITE_COPY) return false;
+    else if(stack_addr >= PREV_ACT(src).cfa || src->act == 0)
     {
       ST_INFO("Adding fixup for pointer-to-stack %p\n", stack_addr);
-      fixup_data.src_addr = stack_addr;
-      fixup_data.act = dest->act;
-      fixup_data.dest_loc = val_dest;
-      list_add(fixup, &dest->stack_pointers, fixup_data);
+      fixups_add(&dest->stack_pointers, stack_addr, dest->act, val_dest);
 
       /* Are we pointing to a value within the same frame? */
       if(stack_addr < ACT(src).cfa) needs_local_fixup = true;
@@ -495,33 +754,132 @@ static bool rewrite_val(rewrite_context src, const live_value* val_src,
     else
       ST_WARN("Pointer-to-stack points to called functions\n");
   }
-  else put_val(src, val_src, dest, val_dest);
+  else if(phase != REWRITE_FIXUP) put_val(src, val_src, dest, val_dest);
 
-  /* Check if value is pointed to by other values & fix up if so. */
+  /*
+   * Check if value is pointed to by values from frames down the call chain &
+   * fix up if so.  Pointers from this frame are staged & are resolved by
+   * fixup_local_pointers() after all values in the frame have been rewritten.
+   */
   // Note: can only be pointed to if value is in memory, i.e., allocas
-  if(val_src->is_alloca && !val_src->is_temporary)
+  if(val_src->is_alloca && !val_src->is_temporary && phase != REWRITE_COPY &&
+     dest->stack_pointers.num_sorted)
   {
-    fixup_node = list_begin(fixup, &dest->stack_pointers);
-    while(fixup_node)
+    src_addr = get_alloca_addr(src, val_src);
+    resolve_pointed_to(dest, src_addr, get_alloca_addr(dest, val_dest),
+                       val_src->alloca_size);
+  }
+
+  return needs_local_fixup;
+}
+
+/*
+ * Resolve fixups for pointers into a stack allocation.
+ */
+static void resolve_pointed_to(rewrite_context dest,
+                               void* src_addr,
+                               void* dest_addr,
+                               size_t size)
+{
+  size_t i, end;
+  fixup* fix;
+
+  fixups_range(&dest->stack_pointers, false,
+               src_addr, src_addr + size, &i, &end);
+  for(; i < end; i++)
+  {
+    fix = &dest->stack_pointers.fixups[i];
+    if(fixup_resolved(fix)) continue;
+
+    ST_INFO("Found fixup for %p (in frame %d)\n", fix->src_addr, fix->act);
+    put_val_data(dest, fix->dest_loc, fix->act,
+                 (uint64_t)(dest_addr + (fix->src_addr - src_addr)));
+    fixup_resolve(fix);
+  }
+}
+
+/*
+ * Search the current frame's allocas for the data pointed to by SRC_PTR.
+ */
+static void* find_pointed_to(rewrite_context src,
+                             rewrite_context dest,
+                             void* src_ptr)
+{
+  size_t i, j, src_offset, dest_offset;
+  uint16_t num_moves;
+  void* stack_addr;
+  const live_value* val_src, *val_dest;
+  const plan_move* moves;
+
+  src_offset = ACT(src).site.live_offset;
+  dest_offset = ACT(dest).site.live_offset;
+
+  /* Records were paired at build time, duplicates are never allocas */
+  if((moves = get_site_moves(src->handle, dest->handle->arch,
+                             ACT(src).site.id, &num_moves)))
+  {
+    for(i = 0; i < num_moves; i++)
     {
-      if((stack_addr = points_to_data(src, val_src,
-                                      dest, val_dest,
-                                      fixup_node->data.src_addr)))
-      {
-        ST_INFO("Found fixup for %p (in frame %d)\n",
-                fixup_node->data.src_addr, fixup_node->data.act);
-
-        put_val_data(dest,
-                     fixup_node->data.dest_loc,
-                     fixup_node->data.act,
-                     (uint64_t)stack_addr);
-        fixup_node = list_remove(fixup, &dest->stack_pointers, fixup_node);
-      }
-      else fixup_node = list_next(fixup, fixup_node);
+      val_src = &src->handle->live_vals[moves[i].src + src_offset];
+      val_dest = &dest->handle->live_vals[moves[i].dest + dest_offset];
+      if(!val_src->is_alloca || !val_dest->is_alloca) continue;
+      if((stack_addr = points_to_data(src, val_src, dest, val_dest, src_ptr)))
+        return stack_addr;
     }
+    return NULL;
   }
 
-  return needs_local_fixup;
+  for(i = 0, j = 0; j < ACT(dest).site.num_live; i++, j++)
+  {
+    val_src = &src->handle->live_vals[i + src_offset];
+    val_dest = &dest->handle->live_vals[j + dest_offset];
+
+    ASSERT(!val_src->is_duplicate, "invalid duplicate location record\n");
+    ASSERT(!val_dest->is_duplicate, "invalid duplicate location record\n");
+
+    /*
+     * Advance past duplicate location records, which can never be
+     * pointed-to (these are spilled values, not stack allocations).
+     */
+    while(src->handle->live_vals[i + 1 + src_offset].is_duplicate) i++;
+    while(dest->handle->live_vals[j + 1 + dest_offset].is_duplicate) j++;
+
+    /* Can only have stack pointers to allocas */
+    if(!val_src->is_alloca || !val_dest->is_alloca) continue;
+
+    if((stack_addr = points_to_data(src, val_src, dest, val_dest, src_ptr)))
+      return stack_addr;
+  }
+
+  return NULL;
+}
+
+/*
+ * Fix up staged pointers into a stack allocation in the current frame.
+ */
+static void fixup_local_alloca(rewrite_context src,
+                               const live_value* val_src,
+                               rewrite_context dest,
+                               const live_value* val_dest)
+{
+  size_t k, end;
+  void* src_addr, *dest_addr = NULL;
+  fixup* fix;
+
+  src_addr = get_alloca_addr(src, val_src);
+  fixups_range(&dest->stack_pointers, true,
+               src_addr, src_addr + val_src->alloca_size, &k, &end);
+  if(k < end) dest_addr = get_alloca_addr(dest, val_dest);
+  for(; k < end; k++)
+  {
+    fix = &dest->stack_pointers.fixups[k];
+    if(fixup_resolved(fix)) continue;
+
+    ST_INFO("Found local fixup for %p\n", fix->src_addr);
+    put_val_data(dest, fix->dest_loc, fix->act,
+                 (uint64_t)(dest_addr + (fix->src_addr - src_addr)));
+    fixup_resolve(fix);
+  }
 }
 
 /*
@@ -531,91 +889,115 @@ static inline void
 fixup_local_pointers(rewrite_context src, rewrite_context dest)
 {
   size_t i, j, src_offset, dest_offset;
-  bool found_fixup;
-  void* stack_addr;
+  uint16_t num_moves;
   const live_value* val_src, *val_dest;
-  node_t(fixup)* fixup_node;
+  const plan_move* moves;
 
   ST_INFO("Resolving local fix-ups\n");
 
-  // Search over all fix-ups
-  fixup_node = list_begin(fixup, &dest->stack_pointers);
-  while(fixup_node)
+  // Search the staged fix-ups for pointers into each of the frame's allocas
+  src_offset = ACT(src).site.live_offset;
+  dest_offset = ACT(dest).site.live_offset;
+  if((moves = get_site_moves(src->handle, dest->handle->arch,
+                             ACT(src).site.id, &num_moves)))
   {
-    // TODO If the code creates a pointer to an argument, is LLVM forced to
-    // create an alloca and copy the argument into the local stack space?
-    // Otherwise, how does LLVM understand argument/register conventions?
-    if(fixup_node->data.src_addr <= ACT(src).cfa) // Is fixup in this frame?
+    for(i = 0; i < num_moves; i++)
     {
-      // Note: we should have resolved all fixups for this frame from frames
-      // down the call chain by this point.  If not, the fixup may be
-      // pointing to garbage data (e.g. uninitialized local values)
-      if(fixup_node->data.act != src->act)
-      {
-        ST_WARN("unresolved fixup for %p (frame %d)\n",
-                fixup_node->data.src_addr, fixup_node->data.act);
-        fixup_node = list_next(fixup, fixup_node);
-        continue;
-      }
-
-      // Find the same-frame data which corresponds to the fixup
-      found_fixup = false;
-      src_offset = ACT(src).site.live_offset;
-      dest_offset = ACT(dest).site.live_offset;
-      for(i = 0, j = 0; j < ACT(dest).site.num_live; i++, j++)
-      {
-        val_src = &src->handle->live_vals[i + src_offset];
-        val_dest = &dest->handle->live_vals[j + dest_offset];
-
-        ASSERT(!val_src->is_duplicate, "invalid duplicate location record\n");
-        ASSERT(!val_dest->is_duplicate, "invalid duplicate location record\n");
-
-        /*
-         * Advance past duplicate location records, which can never be
-         * pointed-to (these are spilled values, not stack allocations).
-         */
-        while(src->handle->live_vals[i + 1 + src_offset].is_duplicate) i++;
-        while(dest->handle->live_vals[j + 1 + dest_offset].is_duplicate) j++;
-
-        /* Can only have stack pointers to allocas */
-        if(!val_src->is_alloca || !val_dest->is_alloca) continue;
-
-        if((stack_addr = points_to_data(src, val_src,
-                                        dest, val_dest,
-                                        fixup_node->data.src_addr)))
-        {
-          ST_INFO("Found local fixup for %p\n", fixup_node->data.src_addr);
-
-          put_val_data(dest,
-                       fixup_node->data.dest_loc,
-                       fixup_node->data.act,
-                       (uint64_t)stack_addr);
-          fixup_node = list_remove(fixup, &dest->stack_pointers, fixup_node);
-          found_fixup = true;
-          break;
-        }
-      }
+      val_src = &src->handle->live_vals[moves[i].src + src_offset];
+      val_dest = &dest->handle->live_vals[moves[i].dest + dest_offset];
+      if(val_src->is_alloca && val_dest->is_alloca)
+        fixup_local_alloca(src, val_src, dest, val_dest);
     }
+    return;
+  }
 
-    if(!found_fixup) fixup_node = list_next(fixup, fixup_node);
+  for(i = 0, j = 0; j < ACT(dest).site.num_live; i++, j++)
+  {
+    val_src = &src->handle->live_vals[i + src_offset];
+    val_dest = &dest->handle->live_vals[j + dest_offset];
+
+    while(src->handle->live_vals[i + 1 + src_offset].is_duplicate) i++;
+    while(dest->handle->live_vals[j + 1 + dest_offset].is_duplicate) j++;
+
+    if(val_src->is_alloca && val_dest->is_alloca)
+      fixup_local_alloca(src, val_src, dest, val_dest);
   }
 }
 
 /*
- * Transform an individual frame from the source to destination stack.
+ * Fix up pointers from the current frame to data in frames up the call chain.
  */
-static void rewrite_frame(rewrite_context src, rewrite_context dest)
+static void fixup_caller_pointers(rewrite_context src, rewrite_context dest)
+{
+  int cur_act = src->act;
+  size_t i;
+  void* stack_addr;
+  fixup* fix;
+
+  ST_INFO("Resolving fix-ups to callers' frames\n");
+
+  for(i = 0; i < dest->stack_pointers.num; i++)
+  {
+    fix = &dest->stack_pointers.fixups[i];
+    if(fixup_resolved(fix) || fix->act != cur_act) continue;
+
+    /* Find the frame containing the pointed-to data & search its allocas. */
+    for(src->act = cur_act + 1; src->act < src->num_acts; src->act++)
+      if(fix->src_addr <= ACT(src).cfa) break;
+
+    stack_addr = NULL;
+    if(src->act < src->num_acts)
+    {
+      dest->act = src->act;
+      stack_addr = find_pointed_to(src, dest, fix->src_addr);
+      src->act = dest->act = cur_act;
+    }
+    else src->act = cur_act;
+
+    if(stack_addr)
+    {
+      ST_INFO("Found fixup for %p in caller's frame\n", fix->src_addr);
+      put_val_data(dest, fix->dest_loc, fix->act, (uint64_t)stack_addr);
+    }
+    else
+      ST_WARN("could not find stack pointer fixup for %p (in activation %d)\n",
+              fix->src_addr, fix->act);
+    fixup_resolve(fix);
+  }
+}
+
+/*
+ * Rewrite the current frame's live values by interpreting location records.
+ * If gen-stackinfo paired the call site's records with the destination
+ * binary's, apply the pairs rather than matching them up here.
+ */
+static bool rewrite_vals(rewrite_context src,
+                         rewrite_context dest,
+                         rewrite_phase phase)
 {
   size_t i, j, src_offset, dest_offset;
+  uint16_t num_moves;
   const live_value* val_src, *val_dest;
+  const plan_move* moves;
   bool needs_local_fixup = false;
 
-  TIMER_FG_START(rewrite_frame);
-  ST_INFO("Rewriting frame (CFA: %p -> %p)\n", ACT(src).cfa, ACT(dest).cfa);
-
-  /* Copy live values */
   src_offset = ACT(src).site.live_offset;
   dest_offset = ACT(dest).site.live_offset;
+  if((moves = get_site_moves(src->handle, dest->handle->arch,
+                             ACT(src).site.id, &num_moves)))
+  {
+    for(i = 0; i < num_moves; i++)
+    {
+      ASSERT(moves[i].src < ACT(src).site.num_live &&
+             moves[i].dest < ACT(dest).site.num_live,
+             "invalid live value move\n");
+      val_src = &src->handle->live_vals[moves[i].src + src_offset];
+      val_dest = &dest->handle->live_vals[moves[i].dest + dest_offset];
+      needs_local_fixup |= rewrite_val(src, val_src, dest, val_dest, phase);
+    }
+    return needs_local_fixup;
+  }
+
   for(i = 0, j = 0; j < ACT(dest).site.num_live; i++, j++)
   {
     ASSERT(i < src->handle->live_vals_count,
@@ -630,7 +1012,7 @@ static void rewrite_frame(rewrite_context src, rewrite_context dest)
     ASSERT(!val_dest->is_duplicate, "invalid duplicate location record\n");
 
     /* Apply to first location record */
-    needs_local_fixup |= rewrite_val(src, val_src, dest, val_dest);
+    needs_local_fixup |= rewrite_val(src, val_src, dest, val_dest, phase);
 
     /* Apply to all duplicate location records */
     while((j + 1 + dest_offset) < dest->handle->live_vals_count &&
@@ -640,7 +1022,7 @@ static void rewrite_frame(rewrite_context src, rewrite_context dest)
       val_dest = &dest->handle->live_vals[j + dest_offset];
       ASSERT(!val_dest->is_alloca, "invalid duplicate location record\n");
       ST_INFO("Applying to duplicate location record\n");
-      needs_local_fixup |= rewrite_val(src, val_src, dest, val_dest);
+      needs_local_fixup |= rewrite_val(src, val_src, dest, val_dest, phase);
     }
 
     /* Advance source value past duplicates location records */
@@ -650,14 +1032,197 @@ static void rewrite_frame(rewrite_context src, rewrite_context dest)
   ASSERT(i == ACT(src).site.num_live && j == ACT(dest).site.num_live,
         "did not handle all live values\n");
 
+  return needs_local_fixup;
+}
+
+#ifdef _REWRITE_PLANS
+
+/*
+ * Rewrite the current frame's live values by running a precompiled plan.
+ */
+static bool run_plan(rewrite_context src,
+                     rewrite_context dest,
+                     const rewrite_plan* plan,
+                     rewrite_phase phase)
+{
+  size_t i;
+  const plan_op* op;
+  void* src_regs = ACT(src).regs, *dest_regs = ACT(dest).regs;
+  void* src_addr, *callee_addr;
+  bool needs_local_fixup = false;
+
+  for(i = 0; i < plan->num_ops; i++)
+  {
+    op = &plan->ops[i];
+    switch(op->type)
+    {
+    case PLAN_COPY:
+      if(phase == REWRITE_FIXUP) break;
+      memcpy(plan_loc_addr(&op->loc.dest, dest_regs),
+             plan_loc_addr(&op->loc.src, src_regs), op->size);
+      break;
+    case PLAN_COPY_CALLEE_SAVED:
+      if(phase == REWRITE_FIXUP) break;
+      src_addr = plan_loc_addr(&op->loc.src, src_regs);
+      memcpy(plan_loc_addr(&op->loc.dest, dest_regs), src_addr, op->size);
+      if((callee_addr = get_callee_saved_loc(dest, op->regnum, dest->act)))
+        memcpy(callee_addr, src_addr, op->size);
+      break;
+    case PLAN_POINTED_TO:
+      if(phase == REWRITE_COPY || !dest->stack_pointers.num_sorted) break;
+      resolve_pointed_to(dest, plan_loc_addr(&op->loc.src, src_regs),
+                         plan_loc_addr(&op->loc.dest, dest_regs), op->size);
+      break;
+    case PLAN_REWRITE_VAL:
+      needs_local_fixup |= rewrite_val(src, op->val.src, dest, op->val.dest,
+                                       phase);
+      break;
+    }
+  }
+
+  return needs_local_fixup;
+}
+
+#endif /* _REWRITE_PLANS */
+
+/*
+ * Transform an individual frame from the source to destination stack.
+ */
+static void rewrite_frame(rewrite_context src,
+                          rewrite_context dest,
+                          rewrite_phase phase)
+{
+  size_t i, dest_offset;
+  bool needs_local_fixup;
+#ifdef _REWRITE_PLANS
+  const rewrite_plan* plan;
+#endif
+
+  TIMER_FG_START(rewrite_frame);
+  ST_INFO("Rewriting frame (CFA: %p -> %p)\n", ACT(src).cfa, ACT(dest).cfa);
+
+  /* Copy live values */
+#ifdef _REWRITE_PLANS
+  if((plan = get_rewrite_plan(src, dest)))
+    needs_local_fixup = run_plan(src, dest, plan, phase);
+  else
+#endif
+  needs_local_fixup = rewrite_vals(src, dest, phase);
+
   /* Set architecture-specific live values */
-  dest_offset = ACT(dest).site.arch_live_offset;
-  for(i = 0; i < ACT(dest).site.num_arch_live; i++)
-    put_val_arch(dest, &dest->handle->arch_live_vals[i + dest_offset]);
+  if(phase != REWRITE_FIXUP)
+  {
+    dest_offset = ACT(dest).site.arch_live_offset;
+    for(i = 0; i < ACT(dest).site.num_arch_live; i++)
+      put_val_arch(dest, &dest->handle->arch_live_vals[i + dest_offset]);
+  }
 
-  /* Fix up pointers to local values */
-  if(needs_local_fixup) fixup_local_pointers(src, dest);
+  /* Fix up pointers to local values & track the rest for callers' frames */
+  if(phase != REWRITE_COPY)
+  {
+    fixups_sort_staged(&dest->stack_pointers);
+    if(needs_local_fixup) fixup_local_pointers(src, dest);
+    fixups_merge(&dest->stack_pointers);
+  }
 
   TIMER_FG_STOP(rewrite_frame);
 }
 
+/*
+ * Rewrite all frames, one frame at a time.
+ */
+static void rewrite_frames(rewrite_context src, rewrite_context dest)
+{
+  uint64_t* saved_fbp;
+
+  // Note: the following code is brittle -- it has to happen in this *exact*
+  // order because of the way the stack is unwound and information in the
+  // current & surrounding frames is accessed.  Modify with care!
+
+  /* Rewrite outer-most frame. */
+  ST_INFO("--> Rewriting outermost frame <--\n");
+
+  set_return_address_funcentry(dest, (void*)NEXT_ACT(dest).site.addr);
+  pop_frame_funcentry(dest);
+
+  /* Rewrite rest of frames. */
+  for(src->act = 1; src->act < src->num_acts - 1; src->act++)
+  {
+    ST_INFO("--> Rewriting frame %d <--\n", src->act);
+
+    set_return_address(dest, (void*)NEXT_ACT(dest).site.addr);
+    rewrite_frame(src, dest, REWRITE_ALL);
+    saved_fbp = get_savedfbp_loc(dest);
+    ASSERT(saved_fbp, "invalid saved frame pointer location\n");
+    pop_frame(dest, true);
+    *saved_fbp = (uint64_t)REGOPS(dest)->fbp(ACT(dest).regs);
+    ST_INFO("Old FP saved to %p\n", saved_fbp);
+  }
+
+  // Note: there may be a few things to fix up in the innermost function, e.g.,
+  // the TOC pointer on PowerPC
+  ST_INFO("--> Rewriting frame %d (starting function) <--\n", src->act);
+  rewrite_frame(src, dest, REWRITE_ALL);
+}
+
+#ifdef _PARALLEL_REWRITE
+
+/*
+ * Rewrite all frames in three phases.
+ */
+static void rewrite_frames_parallel(rewrite_context src, rewrite_context dest)
+{
+  uint64_t* saved_fbp;
+  rewrite_context ctxs[2] = { src, dest };
+
+  /*
+   * Lay out all destination frames.  Copying a frame's values only requires
+   * its bounds & the callee-saved bitmaps of the frames it calls, so once all
+   * frames are laid out they can be copied independently.
+   */
+  ST_INFO("--> Laying out %d destination frames <--\n", dest->num_acts);
+
+  set_return_address_funcentry(dest, (void*)NEXT_ACT(dest).site.addr);
+  pop_frame_funcentry(dest);
+  while(dest->act < dest->num_acts - 1)
+  {
+    set_return_address(dest, (void*)NEXT_ACT(dest).site.addr);
+    saved_fbp = get_savedfbp_loc(dest);
+    ASSERT(saved_fbp, "invalid saved frame pointer location\n");
+    pop_frame(dest, true);
+    *saved_fbp = (uint64_t)REGOPS(dest)->fbp(ACT(dest).regs);
+  }
+
+  /* Copy values in parallel */
+  ST_INFO("--> Copying frame values across %lu threads <--\n", num_workers());
+  parallel_for(copy_frames, ctxs, 1, src->num_acts, PARALLEL_CHUNK_FRAMES);
+
+  /*
+   * Resolve pointers to the stack.  Fixups are tracked across frames, so
+   * frames must be processed in order.
+   */
+  ST_INFO("--> Resolving pointers to the stack <--\n");
+  for(src->act = dest->act = 1; src->act < src->num_acts;
+      src->act++, dest->act++)
+    rewrite_frame(src, dest, REWRITE_FIXUP);
+  src->act = dest->act = dest->num_acts - 1;
+}
+
+/*
+ * Copy values for frames [BEGIN, END).
+ */
+static void copy_frames(void* arg, size_t begin, size_t end)
+{
+  rewrite_context* ctxs = (rewrite_context*)arg;
+  struct rewrite_context src = *ctxs[0], dest = *ctxs[1];
+
+  /* Each thread walks frames using its own view of the contexts */
+  for(src.act = begin; src.act < end; src.act++)
+  {
+    dest.act = src.act;
+    rewrite_frame(&src, &dest, REWRITE_COPY);
+  }
+}
+
+#endif /* _PARALLEL_REWRITE */
+
@@ -6,6 +6,7 @@
  */
 
 #include "unwind.h"
+#include "arena.h"
 
 ///////////////////////////////////////////////////////////////////////////////
 // File-local API
@@ -18,6 +19,7 @@
 static inline void setup_regset(rewrite_context ctx, int act)
 {
   ASSERT(act > 0, "Cannot set up outermost activation using this function\n");
+  reserve_frame(ctx, act);
   ctx->acts[act].regs = &ctx->regset_pool[act * REGOPS(ctx)->regset_size];
   REGOPS(ctx)->regset_clone(ctx->acts[act - 1].regs, ctx->acts[act].regs);
 }
@@ -61,7 +61,8 @@ static int userspace_rewrite_internal(void* sp,
                                       void* src_regs,
                                       void* dest_regs,
                                       st_handle src_handle,
-                                      st_handle dest_handle);
+                                      st_handle dest_handle,
+                                      st_rewrite_mode mode);
 
 ///////////////////////////////////////////////////////////////////////////////
 // User-space initialization, rewriting & teardown
@@ -213,25 +214,21 @@ stack_bounds get_stack_bounds()
 }
 
 /*
- * Rewrite from source to destination stack.
+ * Resolve handles for rewriting between a pair of architectures.
  */
-int st_userspace_rewrite(void* sp,
-                         enum arch src_arch,
-                         void* src_regs,
+int st_userspace_prepare(enum arch src_arch,
                          enum arch dest_arch,
-                         void* dest_regs)
+                         st_userspace_handles* handles)
 {
-  st_handle src_handle, dest_handle;
-
   switch(src_arch)
   {
-  case ARCH_AARCH64: src_handle = aarch64_handle; break;
-  case ARCH_POWERPC64: src_handle = powerpc64_handle; break;
-  case ARCH_X86_64: src_handle = x86_64_handle; break;
+  case ARCH_AARCH64: handles->src = aarch64_handle; break;
+  case ARCH_POWERPC64: handles->src = powerpc64_handle; break;
+  case ARCH_X86_64: handles->src = x86_64_handle; break;
   default: ST_WARN("Unsupported source architecture!\n"); return 1;
   }
 
-  if(!src_handle)
+  if(!handles->src)
   {
     ST_WARN("Could not load rewriting information for source!\n");
     return 1;
@@ -239,20 +236,49 @@ int st_userspace_rewrite(void* sp,
 
   switch(dest_arch)
   {
-  case ARCH_AARCH64: dest_handle = aarch64_handle; break;
-  case ARCH_POWERPC64: dest_handle = powerpc64_handle; break;
-  case ARCH_X86_64: dest_handle = x86_64_handle; break;
+  case ARCH_AARCH64: handles->dest = aarch64_handle; break;
+  case ARCH_POWERPC64: handles->dest = powerpc64_handle; break;
+  case ARCH_X86_64: handles->dest = x86_64_handle; break;
   default: ST_WARN("Unsupported destination architecture!\n"); return 1;
   }
 
-  if(!dest_handle)
+  if(!handles->dest)
   {
     ST_WARN("Could not rewriting information for destination!\n");
     return 1;
   }
 
+  return 0;
+}
+
+/*
+ * Rewrite from source to destination stack using previously-resolved handles.
+ */
+int st_userspace_rewrite_prepared(void* sp,
+                                  const st_userspace_handles* handles,
+                                  void* src_regs,
+                                  void* dest_regs,
+                                  st_rewrite_mode mode)
+{
   return userspace_rewrite_internal(sp, src_regs, dest_regs,
-                                    src_handle, dest_handle);
+                                    handles->src, handles->dest, mode);
+}
+
+/*
+ * Rewrite from source to destination stack.
+ */
+int st_userspace_rewrite(void* sp,
+                         enum arch src_arch,
+                         void* src_regs,
+                         enum arch dest_arch,
+                         void* dest_regs,
+                         st_rewrite_mode mode)
+{
+  st_userspace_handles handles;
+
+  if(st_userspace_prepare(src_arch, dest_arch, &handles)) return 1;
+  return userspace_rewrite_internal(sp, src_regs, dest_regs,
+                                    handles.src, handles.dest, mode);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -415,7 +441,8 @@ static int userspace_rewrite_internal(void* sp,
                                       void* src_regs,
                                       void* dest_regs,
                                       st_handle src_handle,
-                                      st_handle dest_handle)
+                                      st_handle dest_handle,
+                                      st_rewrite_mode mode)
 {
   int retval = 0;
   void* stack_a, *stack_b, *cur_stack, *new_stack;
@@ -462,8 +489,13 @@ static int userspace_rewrite_internal(void* sp,
   cur_stack = (sp >= stack_b) ? stack_a : stack_b;
   new_stack = (sp >= stack_b) ? stack_b : stack_a;
   ST_INFO("On stack %p, rewriting to %p\n", cur_stack, new_stack);
-  if(st_rewrite_stack(src_handle, src_regs, cur_stack,
-                      dest_handle, dest_regs, new_stack))
+  if(mode == ST_REWRITE_ONDEMAND)
+    retval = st_rewrite_ondemand(src_handle, src_regs, cur_stack,
+                                 dest_handle, dest_regs, new_stack);
+  else
+    retval = st_rewrite_stack(src_handle, src_regs, cur_stack,
+                              dest_handle, dest_regs, new_stack);
+  if(retval)
   {
     ST_WARN("stack transformation failed (%s -> %s)\n",
             arch_name(src_handle->arch), arch_name(dest_handle->arch));
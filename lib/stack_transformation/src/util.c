@@ -109,32 +109,174 @@ const void* get_section_data(Elf* e, const char* sec)
   return data->d_buf;
 }
 
+/*
+ * Search for and return the header of the section named SEC in a mapped
+ * binary.
+ */
+const Elf64_Shdr*
+get_mapped_section(const void* map, size_t size, const char* sec)
+{
+  const Elf64_Ehdr* ehdr = (const Elf64_Ehdr*)map;
+  const Elf64_Shdr* shdrs, *strtab;
+  const char* names;
+  size_t i, num, strndx;
+
+  ASSERT(map && sec, "invalid arguments to get_mapped_section()\n");
+
+  shdrs = (const Elf64_Shdr*)(map + ehdr->e_shoff);
+
+  /* Section 0 holds the real counts if they overflow the ELF header fields */
+  num = ehdr->e_shnum ? ehdr->e_shnum : shdrs[0].sh_size;
+  strndx = ehdr->e_shstrndx != SHN_XINDEX ? ehdr->e_shstrndx
+                                          : shdrs[0].sh_link;
+  if(ehdr->e_shoff + num * sizeof(Elf64_Shdr) > size || strndx >= num)
+    return NULL;
+
+  strtab = &shdrs[strndx];
+  if(strtab->sh_offset + strtab->sh_size > size) return NULL;
+  names = (const char*)(map + strtab->sh_offset);
+
+  for(i = 0; i < num; i++)
+  {
+    if(shdrs[i].sh_name >= strtab->sh_size) continue;
+    if(!strncmp(sec, names + shdrs[i].sh_name,
+                strtab->sh_size - shdrs[i].sh_name))
+      return &shdrs[i];
+  }
+  return NULL;
+}
+
+/*
+ * Get the number of entries in section SEC of a mapped binary.
+ */
+int64_t get_mapped_num_entries(const void* map, size_t size, const char* sec)
+{
+  const Elf64_Shdr* shdr;
+
+  if(!(shdr = get_mapped_section(map, size, sec))) return -1;
+  return shdr->sh_entsize ? (shdr->sh_size / shdr->sh_entsize) : -1;
+}
+
+/*
+ * Return the start of section SEC in a mapped binary.
+ */
+const void*
+get_mapped_section_data(const void* map, size_t size, const char* sec)
+{
+  const Elf64_Shdr* shdr;
+
+  if(!(shdr = get_mapped_section(map, size, sec))) return NULL;
+  if(shdr->sh_type == SHT_NOBITS) return NULL;
+  if(shdr->sh_offset + shdr->sh_size > size) return NULL;
+
+  /* Records are accessed in place, so they must be suitably aligned */
+  if(shdr->sh_addralign > 1 && (shdr->sh_offset % shdr->sh_addralign))
+    return NULL;
+  return map + shdr->sh_offset;
+}
+
+/* Number of keys per cache line, used to prefetch several levels ahead. */
+#define KEYS_PER_LINE (64 / sizeof(uint64_t))
+
+/*
+ * Fill the index in Eytzinger order using an in-order traversal of the
+ * implicit tree rooted at K.  Returns the next record to be placed.
+ */
+static uint64_t fill_search_index(search_index* index,
+                                  const char* records,
+                                  size_t size,
+                                  size_t offset,
+                                  uint64_t i,
+                                  uint64_t k)
+{
+  if(k <= index->count)
+  {
+    i = fill_search_index(index, records, size, offset, i, 2 * k);
+    memcpy(&index->keys[k], records + (i * size) + offset, sizeof(uint64_t));
+    index->pos[k] = i++;
+    i = fill_search_index(index, records, size, offset, i, 2 * k + 1);
+  }
+  return i;
+}
+
+/*
+ * Build a search index over sorted records.
+ */
+bool init_search_index(search_index* index,
+                       const void* records,
+                       uint64_t count,
+                       size_t size,
+                       size_t offset)
+{
+  ASSERT(index && records, "invalid arguments to init_search_index()\n");
+
+  index->count = 0;
+  index->keys = NULL;
+  index->pos = NULL;
+  if(count >= UINT32_MAX) return false;
+
+  index->keys = (uint64_t*)MALLOC(sizeof(uint64_t) * (count + 1));
+  index->pos = (uint32_t*)MALLOC(sizeof(uint32_t) * (count + 1));
+  if(!index->keys || !index->pos)
+  {
+    free_search_index(index);
+    return false;
+  }
+
+  index->count = count;
+  fill_search_index(index, records, size, offset, 0, 1);
+  return true;
+}
+
+/*
+ * Free a search index.
+ */
+void free_search_index(search_index* index)
+{
+  free(index->keys);
+  free(index->pos);
+  index->count = 0;
+  index->keys = NULL;
+  index->pos = NULL;
+}
+
+/*
+ * Return the position in INDEX of the first key greater than (if STRICT) or
+ * greater than or equal to KEY, or 0 if there is no such key.
+ */
+static inline uint64_t search_index_bound(const search_index* index,
+                                          uint64_t key,
+                                          bool strict)
+{
+  uint64_t k = 1;
+
+  while(k <= index->count)
+  {
+    __builtin_prefetch(index->keys + k * KEYS_PER_LINE);
+    k = 2 * k + (strict ? index->keys[k] <= key : index->keys[k] < key);
+  }
+
+  /* Undo the right turns taken after the last left turn. */
+  return k >> __builtin_ffsll(~k);
+}
+
 /*
  * Search through call site entries for the specified return address.
  */
 bool get_site_by_addr(st_handle handle, void* ret_addr, call_site* cs)
 {
   bool found = false;
-  long min = 0;
-  long max = (handle->sites_count - 1);
-  long mid;
-  uint64_t retaddr = (uint64_t)ret_addr;
+  uint64_t k, retaddr = (uint64_t)ret_addr;
+  const search_index* index = &handle->sites_addr_index;
 
   TIMER_FG_START(get_site_by_addr);
   ASSERT(cs, "invalid arguments to get_site_by_addr()\n");
 
-  while(max >= min)
+  k = search_index_bound(index, retaddr, false);
+  if(k && index->keys[k] == retaddr)
   {
-    mid = (max + min) / 2;
-    if(handle->sites_addr[mid].addr == retaddr) {
-      *cs = handle->sites_addr[mid];
-      found = true;
-      break;
-    }
-    else if(retaddr > handle->sites_addr[mid].addr)
-      min = mid + 1;
-    else
-      max = mid - 1;
+    *cs = handle->sites_addr[index->pos[k]];
+    found = true;
   }
 
   TIMER_FG_STOP(get_site_by_addr);
@@ -147,81 +289,98 @@ bool get_site_by_addr(st_handle handle, void* ret_addr, call_site* cs)
 bool get_site_by_id(st_handle handle, uint64_t csid, call_site* cs)
 {
   bool found = false;
-  long min = 0;
-  long max = (handle->sites_count - 1);
-  long mid;
+  uint64_t k;
+  const search_index* index = &handle->sites_id_index;
 
   TIMER_FG_START(get_site_by_id);
   ASSERT(cs, "invalid arguments to get_site_by_id()\n");
 
-  while(max >= min)
+  k = search_index_bound(index, csid, false);
+  if(k && index->keys[k] == csid)
   {
-    mid = (max + min) / 2;
-    if(handle->sites_id[mid].id == csid) {
-      *cs = handle->sites_id[mid];
-      found = true;
-      break;
-    }
-    else if(csid > handle->sites_id[mid].id)
-      min = mid + 1;
-    else
-      max = mid - 1;
+    *cs = handle->sites_id[index->pos[k]];
+    found = true;
   }
 
   TIMER_FG_STOP(get_site_by_id);
   return found;
 }
 
-/* Check if an address is within the range of a function unwinding record */
-#define IN_RANGE( idx, _addr ) \
-  (handle->unwind_addrs[idx].addr <= _addr && \
-   _addr < handle->unwind_addrs[idx + 1].addr)
+/*
+ * Search through plans for the specified destination architecture & call site
+ * ID.
+ */
+const plan_move* get_site_moves(st_handle handle,
+                                uint16_t arch,
+                                uint64_t csid,
+                                uint16_t* num_moves)
+{
+  const plan_move* moves = NULL;
+  const plan_site* plan;
+  uint64_t min = 0, max = handle->plan_sites_count, mid;
+
+  TIMER_FG_START(get_site_moves);
+  ASSERT(num_moves, "invalid arguments to get_site_moves()\n");
+
+  while(min < max)
+  {
+    mid = (min + max) / 2;
+    plan = &handle->plan_sites[mid];
+    if(plan->arch < arch || (plan->arch == arch && plan->id < csid))
+      min = mid + 1;
+    else max = mid;
+  }
+
+  if(min < handle->plan_sites_count)
+  {
+    plan = &handle->plan_sites[min];
+    if(plan->arch == arch && plan->id == csid)
+    {
+      ASSERT(plan->move_offset + plan->num_moves <= handle->plan_moves_count,
+             "out-of-bounds plan move access\n");
+      *num_moves = plan->num_moves;
+      moves = &handle->plan_moves[plan->move_offset];
+    }
+  }
+
+  TIMER_FG_STOP(get_site_moves);
+  return moves;
+}
 
 /*
  * Search through unwinding information addresses for the specified address.
+ * The enclosing function's record is the one preceding the first record with
+ * a greater address.
  */
 bool get_unwind_offset_by_addr(st_handle handle, void* addr, unwind_addr* meta)
 {
   bool found = false;
-  long min = 0;
-  long max = (handle->unwind_addr_count - 1);
-  long mid;
+  uint64_t k, pos = 0;
   uint64_t addr_int = (uint64_t)addr;
+  const search_index* index = &handle->unwind_addr_index;
 
   TIMER_FG_START(get_unwind_offset_by_addr);
   ASSERT(meta, "invalid arguments to get_unwind_offset_by_addr()\n");
 
-  while(max >= min)
+  k = search_index_bound(index, addr_int, true);
+  if(k && index->pos[k] > 0)
   {
-    mid = (max + min) / 2;
-
-    // Corner case: mid == last record, this is always a stopping condition
-    if(mid == handle->unwind_addr_count - 1)
-    {
-      if(handle->unwind_addrs[mid].addr <= addr_int)
-      {
-        ST_WARN("cannot check range of last record (0x%lx = record %ld?)\n",
-                addr_int, mid);
-        *meta = handle->unwind_addrs[mid];
-        found = true;
-      }
-      break;
-    }
-
-    if(IN_RANGE(mid, addr_int))
-    {
-      *meta = handle->unwind_addrs[mid];
-      found = true;
-      break;
-    }
-    else if(addr_int > handle->unwind_addrs[mid].addr)
-      min = mid + 1;
-    else
-      max = mid - 1;
+    pos = index->pos[k] - 1;
+    *meta = handle->unwind_addrs[pos];
+    found = true;
+  }
+  else if(!k && index->count)
+  {
+    // Corner case: address is past the last record, can't check its range
+    pos = index->count - 1;
+    ST_WARN("cannot check range of last record (0x%lx = record %lu?)\n",
+            addr_int, pos);
+    *meta = handle->unwind_addrs[pos];
+    found = true;
   }
 
   if(found)
-    ST_INFO("Address of enclosing function: 0x%lx (%d)\n", meta->addr, mid);
+    ST_INFO("Address of enclosing function: 0x%lx (%lu)\n", meta->addr, pos);
 
   TIMER_FG_STOP(get_unwind_offset_by_addr);
   return found;
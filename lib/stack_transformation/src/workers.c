@@ -0,0 +1,183 @@
+/*
+ * Implementation of a simple worker pool.  A single parallel_for() is
+ * serviced at a time; helper threads sleep on a condition variable between
+ * jobs & grab chunks of iterations from a shared counter.
+ */
+
+#include "workers.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// File-local API & definitions
+///////////////////////////////////////////////////////////////////////////////
+
+/* The job currently being serviced by the pool. */
+typedef struct job {
+  work_fn fn;
+  void* arg;
+  size_t next; /* next unclaimed iteration */
+  size_t end;
+  size_t chunk;
+} job;
+
+/* Worker pool state. */
+static struct {
+  size_t workers; /* threads sharing work, including the calling thread */
+  pthread_mutex_t busy; /* held by the thread whose job is being serviced */
+  pthread_mutex_t lock; /* protects the fields below */
+  pthread_cond_t start, done;
+  uint64_t generation; /* incremented for every job */
+  size_t finished; /* helpers which have finished the current job */
+  job cur;
+} pool = {
+  .workers = 1,
+  .busy = PTHREAD_MUTEX_INITIALIZER,
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .start = PTHREAD_COND_INITIALIZER,
+  .done = PTHREAD_COND_INITIALIZER,
+  .generation = 0,
+  .finished = 0,
+};
+
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Read the number of workers from the environment & spawn helper threads.
+ */
+static void init_pool(void);
+
+/*
+ * Helper thread main loop.
+ */
+static void* helper_main(void* arg);
+
+/*
+ * Claim & run chunks of the job until all iterations have been handed out.
+ */
+static void run_chunks(job* job);
+
+///////////////////////////////////////////////////////////////////////////////
+// Worker pool
+///////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Return the number of threads sharing work.
+ */
+size_t num_workers(void)
+{
+  pthread_once(&pool_once, init_pool);
+  return pool.workers;
+}
+
+/*
+ * Run FN over [BEGIN, END) across the pool.
+ */
+void parallel_for(work_fn fn, void* arg, size_t begin, size_t end,
+                  size_t chunk)
+{
+  ASSERT(fn && chunk, "invalid arguments to parallel_for()\n");
+
+  if(begin >= end) return;
+  if(num_workers() == 1 || end - begin <= chunk ||
+     pthread_mutex_trylock(&pool.busy))
+  {
+    fn(arg, begin, end);
+    return;
+  }
+
+  pthread_mutex_lock(&pool.lock);
+  pool.cur.fn = fn;
+  pool.cur.arg = arg;
+  pool.cur.next = begin;
+  pool.cur.end = end;
+  pool.cur.chunk = chunk;
+  pool.finished = 0;
+  pool.generation++;
+  pthread_cond_broadcast(&pool.start);
+  pthread_mutex_unlock(&pool.lock);
+
+  run_chunks(&pool.cur);
+
+  /* Every helper checks in for every job, so wait for all of them. */
+  pthread_mutex_lock(&pool.lock);
+  while(pool.finished < pool.workers - 1)
+    pthread_cond_wait(&pool.done, &pool.lock);
+  pthread_mutex_unlock(&pool.lock);
+
+  pthread_mutex_unlock(&pool.busy);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// File-local API (implementation)
+///////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Read the number of workers from the environment & spawn helper threads.
+ */
+static void init_pool(void)
+{
+  const char* env;
+  long workers = PARALLEL_WORKERS;
+  size_t i;
+  pthread_t helper;
+  pthread_attr_t attr;
+
+  if((env = getenv(ENV_REWRITE_WORKERS))) workers = strtol(env, NULL, 10);
+  if(workers < 1) workers = 1;
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  for(i = 1; i < (size_t)workers; i++)
+  {
+    if(pthread_create(&helper, &attr, helper_main, NULL))
+    {
+      ST_WARN("could not spawn rewriting helper thread\n");
+      break;
+    }
+    pool.workers++;
+  }
+  pthread_attr_destroy(&attr);
+
+  ST_INFO("Sharing parallel rewrites across %lu threads\n", pool.workers);
+}
+
+/*
+ * Helper thread main loop.
+ */
+static void* helper_main(void* arg)
+{
+  uint64_t seen = 0;
+
+  while(true)
+  {
+    pthread_mutex_lock(&pool.lock);
+    while(pool.generation == seen)
+      pthread_cond_wait(&pool.start, &pool.lock);
+    seen = pool.generation;
+    pthread_mutex_unlock(&pool.lock);
+
+    run_chunks(&pool.cur);
+
+    pthread_mutex_lock(&pool.lock);
+    pool.finished++;
+    pthread_cond_signal(&pool.done);
+    pthread_mutex_unlock(&pool.lock);
+  }
+
+  return NULL;
+}
+
+/*
+ * Claim & run chunks of the job.
+ */
+static void run_chunks(job* job)
+{
+  size_t begin, end;
+
+  while((begin = __atomic_fetch_add(&job->next, job->chunk, __ATOMIC_RELAXED))
+        < job->end)
+  {
+    end = begin + job->chunk;
+    if(end > job->end) end = job->end;
+    job->fn(job->arg, begin, end);
+  }
+}
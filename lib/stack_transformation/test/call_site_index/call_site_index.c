@@ -0,0 +1,237 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <time.h>
+#include <assert.h>
+
+#include "definitions.h"
+#include "util.h"
+
+#define NUM_SIZES 5
+static const uint64_t sizes[NUM_SIZES] = { 1000, 10000, 100000, 500000, 1000000 };
+static long lookups = 1000000;
+
+/* Number of lookups checked against the baseline for correctness */
+#define MAX_CHECKS 1000
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+/* Baseline: binary search over the section sorted by return address */
+static bool bsearch_site_by_addr(st_handle handle, uint64_t addr, call_site* cs)
+{
+  long min = 0, max = handle->sites_count - 1, mid;
+  while(max >= min)
+  {
+    mid = (max + min) / 2;
+    if(handle->sites_addr[mid].addr == addr) { *cs = handle->sites_addr[mid]; return true; }
+    else if(addr > handle->sites_addr[mid].addr) min = mid + 1;
+    else max = mid - 1;
+  }
+  return false;
+}
+
+/* Baseline: binary search over the section sorted by ID */
+static bool bsearch_site_by_id(st_handle handle, uint64_t id, call_site* cs)
+{
+  long min = 0, max = handle->sites_count - 1, mid;
+  while(max >= min)
+  {
+    mid = (max + min) / 2;
+    if(handle->sites_id[mid].id == id) { *cs = handle->sites_id[mid]; return true; }
+    else if(id > handle->sites_id[mid].id) min = mid + 1;
+    else max = mid - 1;
+  }
+  return false;
+}
+
+/* Baseline: binary search for the function enclosing an address */
+static bool bsearch_unwind(st_handle handle, uint64_t addr, unwind_addr* meta)
+{
+  long min = 0, max = handle->unwind_addr_count - 1, mid;
+  while(max >= min)
+  {
+    mid = (max + min) / 2;
+    if(mid == handle->unwind_addr_count - 1 ||
+       (handle->unwind_addrs[mid].addr <= addr &&
+        addr < handle->unwind_addrs[mid + 1].addr))
+    {
+      if(handle->unwind_addrs[mid].addr > addr) return false;
+      *meta = handle->unwind_addrs[mid];
+      return true;
+    }
+    else if(addr > handle->unwind_addrs[mid].addr) min = mid + 1;
+    else max = mid - 1;
+  }
+  return false;
+}
+
+static inline unsigned long elapsed(struct timespec* start, struct timespec* end)
+{
+  return (end->tv_sec * 1000000000 + end->tv_nsec) -
+         (start->tv_sec * 1000000000 + start->tv_nsec);
+}
+
+/* Generate a fake handle with COUNT call sites, 4 per function */
+static st_handle generate_handle(uint64_t count)
+{
+  uint64_t i, addr = 0x400000;
+  st_handle handle = calloc(1, sizeof(struct _st_handle));
+  call_site* by_id = malloc(sizeof(call_site) * count);
+  call_site* by_addr = malloc(sizeof(call_site) * count);
+  unwind_addr* funcs = malloc(sizeof(unwind_addr) * (count / 4 + 1));
+  assert(handle && by_id && by_addr && funcs);
+
+  for(i = 0; i < count; i++)
+  {
+    if(i % 4 == 0)
+    {
+      funcs[i / 4].addr = addr;
+      funcs[i / 4].num_unwind = 0;
+      funcs[i / 4].unwind_offset = i / 4;
+    }
+    addr += 8 + rand() % 64;
+    by_addr[i] = EMPTY_CALL_SITE;
+    by_addr[i].id = i * 3 + 1; // IDs are sparse
+    by_addr[i].addr = addr;
+    by_id[i] = by_addr[i]; // IDs increase with address for simplicity
+  }
+
+  handle->sites_count = count;
+  handle->sites_id = by_id;
+  handle->sites_addr = by_addr;
+  handle->unwind_addr_count = (count + 3) / 4;
+  handle->unwind_addrs = funcs;
+
+  if(!init_search_index(&handle->unwind_addr_index, funcs,
+                        handle->unwind_addr_count, sizeof(unwind_addr),
+                        offsetof(unwind_addr, addr)) ||
+     !init_search_index(&handle->sites_id_index, by_id, count,
+                        sizeof(call_site), offsetof(call_site, id)) ||
+     !init_search_index(&handle->sites_addr_index, by_addr, count,
+                        sizeof(call_site), offsetof(call_site, addr)))
+  {
+    fprintf(stderr, "Could not build search indexes\n");
+    exit(1);
+  }
+  return handle;
+}
+
+static void destroy_handle(st_handle handle)
+{
+  free_search_index(&handle->unwind_addr_index);
+  free_search_index(&handle->sites_id_index);
+  free_search_index(&handle->sites_addr_index);
+  free((void*)handle->sites_id);
+  free((void*)handle->sites_addr);
+  free((void*)handle->unwind_addrs);
+  free(handle);
+}
+
+int main(int argc, char** argv)
+{
+  int i;
+  long j;
+  uint64_t* queries, sum_bs = 0, sum_idx = 0;
+  struct timespec start, end;
+  st_handle handle;
+  call_site cs_bs, cs_idx;
+  unwind_addr ua_bs, ua_idx;
+  unsigned long t_bs, t_idx;
+
+  if(argc > 1) lookups = atol(argv[1]);
+  srand(0);
+  queries = malloc(sizeof(uint64_t) * lookups);
+  assert(queries);
+
+  printf("%10s %12s %12s %12s %12s %12s %12s\n", "sites",
+         "addr (bs)", "addr (idx)", "id (bs)", "id (idx)",
+         "func (bs)", "func (idx)");
+  for(i = 0; i < NUM_SIZES; i++)
+  {
+    handle = generate_handle(sizes[i]);
+    printf("%10lu", sizes[i]);
+
+    /* Lookups by return address */
+    for(j = 0; j < lookups; j++)
+      queries[j] = handle->sites_addr[rand() % sizes[i]].addr;
+    for(j = 0; j < MIN(MAX_CHECKS, lookups); j++)
+    {
+      if(!bsearch_site_by_addr(handle, queries[j], &cs_bs) ||
+         !get_site_by_addr(handle, (void*)queries[j], &cs_idx) ||
+         cs_bs.id != cs_idx.id)
+        fprintf(stderr, "Mismatched call site for 0x%lx\n", queries[j]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(j = 0; j < lookups; j++)
+    {
+      bsearch_site_by_addr(handle, queries[j], &cs_bs);
+      sum_bs += cs_bs.id;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    t_bs = elapsed(&start, &end);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(j = 0; j < lookups; j++)
+    {
+      get_site_by_addr(handle, (void*)queries[j], &cs_idx);
+      sum_idx += cs_idx.id;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    t_idx = elapsed(&start, &end);
+    printf(" %12.2f %12.2f", (double)t_bs / lookups, (double)t_idx / lookups);
+
+    /* Lookups by ID */
+    for(j = 0; j < lookups; j++)
+      queries[j] = handle->sites_id[rand() % sizes[i]].id;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(j = 0; j < lookups; j++)
+    {
+      bsearch_site_by_id(handle, queries[j], &cs_bs);
+      sum_bs += cs_bs.addr;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    t_bs = elapsed(&start, &end);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(j = 0; j < lookups; j++)
+    {
+      get_site_by_id(handle, queries[j], &cs_idx);
+      sum_idx += cs_idx.addr;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    t_idx = elapsed(&start, &end);
+    printf(" %12.2f %12.2f", (double)t_bs / lookups, (double)t_idx / lookups);
+
+    /* Lookups of enclosing function, i.e., addresses between call sites */
+    for(j = 0; j < lookups; j++)
+      queries[j] = handle->sites_addr[rand() % sizes[i]].addr - 4;
+    for(j = 0; j < MIN(MAX_CHECKS, lookups); j++)
+    {
+      if(!bsearch_unwind(handle, queries[j], &ua_bs) ||
+         !get_unwind_offset_by_addr(handle, (void*)queries[j], &ua_idx) ||
+         ua_bs.addr != ua_idx.addr)
+        fprintf(stderr, "Mismatched function for 0x%lx\n", queries[j]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(j = 0; j < lookups; j++)
+    {
+      bsearch_unwind(handle, queries[j], &ua_bs);
+      sum_bs += ua_bs.addr;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    t_bs = elapsed(&start, &end);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(j = 0; j < lookups; j++)
+    {
+      get_unwind_offset_by_addr(handle, (void*)queries[j], &ua_idx);
+      sum_idx += ua_idx.addr;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    t_idx = elapsed(&start, &end);
+    printf(" %12.2f %12.2f\n", (double)t_bs / lookups, (double)t_idx / lookups);
+
+    destroy_handle(handle);
+  }
+
+  /* Make sure lookups aren't optimized away */
+  if(sum_bs != sum_idx) fprintf(stderr, "Searches returned different records!\n");
+  free(queries);
+  return sum_bs != sum_idx;
+}
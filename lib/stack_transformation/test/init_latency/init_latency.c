@@ -0,0 +1,86 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <stack_transform.h>
+
+/* Mirrors ENV_DISABLE_MMAP in the runtime's config.h */
+#define DISABLE_MMAP "ST_DISABLE_MMAP"
+
+static int iterations = 100;
+
+/* Read the resident set size in kilobytes. */
+static long rss_kb()
+{
+  long size, resident = -1;
+  FILE* fp = fopen("/proc/self/statm", "r");
+  if(fp)
+  {
+    if(fscanf(fp, "%ld %ld", &size, &resident) != 2) resident = -1;
+    fclose(fp);
+  }
+  return resident < 0 ? -1 : resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static void measure(const char* bin, const char* mode)
+{
+  int i;
+  long before, after;
+  struct timespec start, end;
+  st_handle handle;
+
+  /* Resident memory for a single, cold handle */
+  before = rss_kb();
+  handle = st_init(bin);
+  after = rss_kb();
+  if(!handle)
+  {
+    fprintf(stderr, "%s: could not initialize handle for %s\n", mode, bin);
+    exit(1);
+  }
+  st_destroy(handle);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(i = 0; i < iterations; i++)
+  {
+    handle = st_init(bin);
+    st_destroy(handle);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  printf("%-6s: %8.2f us/st_init(), RSS +%ld kB\n", mode,
+         ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec))
+           / iterations / 1000.0,
+         after - before);
+}
+
+/* Run the measurement in a fresh process so the modes don't share state. */
+static int run(const char* bin, const char* mode, int disable_mmap)
+{
+  int status;
+  pid_t pid = fork();
+
+  if(pid == 0)
+  {
+    if(disable_mmap) setenv(DISABLE_MMAP, "1", 1);
+    else unsetenv(DISABLE_MMAP);
+    measure(bin, mode);
+    exit(0);
+  }
+  else if(pid < 0 || waitpid(pid, &status, 0) < 0) return 1;
+  return !WIFEXITED(status) || WEXITSTATUS(status);
+}
+
+int main(int argc, char** argv)
+{
+  int ret = 0;
+
+  if(argc > 1) iterations = atoi(argv[1]);
+  if(iterations < 1) iterations = 1;
+
+  ret |= run(argv[0], "mmap", 0);
+  ret |= run(argv[0], "libelf", 1);
+  return ret;
+}
@@ -0,0 +1,98 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <assert.h>
+
+#include "definitions.h"
+#include "plan.h"
+
+#define NUM_SITES 1000
+static long cycles = 64;
+
+static inline unsigned long elapsed(struct timespec* start, struct timespec* end)
+{
+  return (end->tv_sec * 1000000000 + end->tv_nsec) -
+         (start->tv_sec * 1000000000 + start->tv_nsec);
+}
+
+/* Generate a fake handle with COUNT call sites & no live values */
+static st_handle generate_handle(uint64_t count)
+{
+  st_handle handle = calloc(1, sizeof(struct _st_handle));
+  assert(handle);
+
+  handle->arch = EM_X86_64;
+  handle->sites_count = count;
+  if(!init_plan_cache(handle))
+  {
+    fprintf(stderr, "Could not initialize plan cache\n");
+    exit(1);
+  }
+  return handle;
+}
+
+static void destroy_handle(st_handle handle)
+{
+  free_plan_cache(handle);
+  free(handle);
+}
+
+/* Look up the plans for all call sites, returns the number not found */
+static long lookup_plans(rewrite_context src, rewrite_context dest)
+{
+  long i, missing = 0;
+
+  for(i = 0; i < NUM_SITES; i++)
+  {
+    ACT(src).site.id = i;
+    if(!get_rewrite_plan(src, dest)) missing++;
+  }
+  return missing;
+}
+
+int main(int argc, char** argv)
+{
+  long i, missing = 0;
+  struct timespec start, end;
+  struct rewrite_context src, dest;
+  activation src_act, dest_act;
+  unsigned long t_miss, t_hit;
+
+  if(argc > 1) cycles = atol(argv[1]);
+
+  src_act.site = EMPTY_CALL_SITE;
+  dest_act.site = EMPTY_CALL_SITE;
+  src.acts = &src_act;
+  dest.acts = &dest_act;
+  src.act = dest.act = 0;
+  src.handle = generate_handle(NUM_SITES);
+
+  printf("%10s %12s %12s\n", "cycle", "miss (ns)", "hit (ns)");
+  for(i = 0; i < cycles; i++)
+  {
+    dest.handle = generate_handle(NUM_SITES);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    missing += lookup_plans(&src, &dest);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    t_miss = elapsed(&start, &end);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    missing += lookup_plans(&src, &dest);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    t_hit = elapsed(&start, &end);
+
+    printf("%10ld %12.2f %12.2f\n", i,
+           (double)t_miss / NUM_SITES, (double)t_hit / NUM_SITES);
+    destroy_handle(dest.handle);
+  }
+
+  destroy_handle(src.handle);
+  if(missing)
+  {
+    printf("Plan cache full: %ld lookups failed\n", missing);
+    return 1;
+  }
+  printf("Plan cache OK\n");
+  return 0;
+}
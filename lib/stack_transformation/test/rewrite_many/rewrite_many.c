@@ -1,24 +1,39 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 
 #include <stack_transform.h>
 #include "stack_transform_timing.h"
 
 static int max_depth = 10;
+static int ondemand = 0;
 static int post_transform = 0;
 
 long outer_frame()
 {
   if(!post_transform)
   {
+    if(ondemand)
+    {
 #ifdef __aarch64__
-    TIME_AND_TEST_REWRITE("./rewrite_many_aarch64", outer_frame);
+      TIME_AND_TEST_ONDEMAND("./rewrite_many_aarch64", outer_frame);
 #elif defined(__powerpc64__)
-    TIME_AND_TEST_REWRITE("./rewrite_many_powerpc64", outer_frame);
+      TIME_AND_TEST_ONDEMAND("./rewrite_many_powerpc64", outer_frame);
 #elif defined(__x86_64__)
-    TIME_AND_TEST_REWRITE("./rewrite_many_x86-64", outer_frame);
+      TIME_AND_TEST_ONDEMAND("./rewrite_many_x86-64", outer_frame);
 #endif
+    }
+    else
+    {
+#ifdef __aarch64__
+      TIME_AND_TEST_REWRITE("./rewrite_many_aarch64", outer_frame);
+#elif defined(__powerpc64__)
+      TIME_AND_TEST_REWRITE("./rewrite_many_powerpc64", outer_frame);
+#elif defined(__x86_64__)
+      TIME_AND_TEST_REWRITE("./rewrite_many_x86-64", outer_frame);
+#endif
+    }
   }
   return rand();
 }
@@ -85,10 +100,16 @@ long recurse(int depth)
 
 int main(int argc, char** argv)
 {
+  long ret;
+
   if(argc > 1)
     max_depth = atoi(argv[1]);
+  if(argc > 2 && !strcmp(argv[2], "ondemand"))
+    ondemand = 1;
 
   srand(0);
-  return recurse(1);
+  ret = recurse(1);
+  PRINT_AMORTIZED_TIME();
+  return ret;
 }
 
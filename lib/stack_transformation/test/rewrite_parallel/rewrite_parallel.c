@@ -0,0 +1,61 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <stack_transform.h>
+#include "stack_transform_timing.h"
+
+#define LOCAL_SIZE 8
+
+static int max_depth = 400;
+static int post_transform = 0;
+
+void outer_frame()
+{
+  if(!post_transform)
+  {
+#ifdef __aarch64__
+    TIME_AND_TEST_REWRITE("./rewrite_parallel_aarch64", outer_frame);
+#elif defined(__powerpc64__)
+    TIME_AND_TEST_REWRITE("./rewrite_parallel_powerpc64", outer_frame);
+#elif defined(__x86_64__)
+    TIME_AND_TEST_REWRITE("./rewrite_parallel_x86-64", outer_frame);
+#endif
+  }
+}
+
+/* Prevent the compiler from promoting the local array out of memory. */
+void __attribute__((noinline)) fill(long* arr, long val)
+{
+  int i;
+  for(i = 0; i < LOCAL_SIZE; i++) arr[i] = val + i;
+}
+
+void recurse(int depth, int* sum)
+{
+  long local[LOCAL_SIZE];
+  long a = rand(), b = rand(), c = rand(), d = rand();
+  long check = a ^ b ^ c ^ d;
+  int i;
+
+  fill(local, check);
+  if(depth < max_depth) recurse(depth + 1, sum);
+  else outer_frame();
+
+  for(i = 0; i < LOCAL_SIZE; i++)
+    if(local[i] != check + i) break;
+  if((a ^ b ^ c ^ d) == check && i == LOCAL_SIZE) (*sum)++;
+  else fprintf(stderr, "Corrupted frame at depth %d\n", depth);
+}
+
+int main(int argc, char** argv)
+{
+  int sum = 0;
+
+  if(argc > 1)
+    max_depth = atoi(argv[1]);
+
+  srand(0);
+  recurse(1, &sum);
+  printf("sum = %d (expected %d)\n", sum, max_depth);
+  return (sum == max_depth ? 0 : 1);
+}
@@ -0,0 +1,68 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <stack_transform.h>
+#include "stack_transform_timing.h"
+
+#define NUM_VARS 8
+#define LOCAL_SIZE 16
+
+static int max_depth = 10;
+static int post_transform = 0;
+
+void outer_frame()
+{
+  if(!post_transform)
+  {
+#ifdef __aarch64__
+    TIME_AND_TEST_REWRITE("./stack_pointer_many_aarch64", outer_frame);
+#elif defined(__powerpc64__)
+    TIME_AND_TEST_REWRITE("./stack_pointer_many_powerpc64", outer_frame);
+#elif defined(__x86_64__)
+    TIME_AND_TEST_REWRITE("./stack_pointer_many_x86-64", outer_frame);
+#endif
+  }
+}
+
+/* Prevent the compiler from promoting the local array out of memory. */
+void __attribute__((noinline)) fill(int* arr, int depth)
+{
+  int i;
+  for(i = 0; i < LOCAL_SIZE; i++) arr[i] = depth;
+}
+
+void recurse(int depth, int* p0, int* p1, int* p2, int* p3,
+             int* p4, int* p5, int* p6, int* p7)
+{
+  int local[LOCAL_SIZE];
+  int* mid = &local[LOCAL_SIZE / 2], *last = &local[LOCAL_SIZE - 1];
+
+  fill(local, depth);
+  if(depth < max_depth) recurse(depth + 1, p0, p1, p2, p3, p4, p5, p6, p7);
+  else outer_frame();
+
+  /* Pointers into this frame must also have been reified. */
+  if(*mid != depth || *last != depth)
+    fprintf(stderr, "Corrupted local data at depth %d\n", depth);
+  else
+  {
+    (*p0)++; (*p1)++; (*p2)++; (*p3)++;
+    (*p4)++; (*p5)++; (*p6)++; (*p7)++;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  int vars[NUM_VARS] = { 0 };
+  int i, sum = 0;
+
+  if(argc > 1)
+    max_depth = atoi(argv[1]);
+
+  recurse(1, &vars[0], &vars[1], &vars[2], &vars[3],
+          &vars[4], &vars[5], &vars[6], &vars[7]);
+
+  for(i = 0; i < NUM_VARS; i++) sum += vars[i];
+  printf("sum = %d (expected %d)\n", sum, NUM_VARS * max_depth);
+  return (sum == NUM_VARS * max_depth ? 0 : 1);
+}
@@ -11,6 +11,34 @@
 static void* __attribute__((noinline))
 get_call_site() { return __builtin_return_address(0); }
 
+/* When the most recent rewrite started, used to calculate amortized time. */
+static struct timespec __st_rewrite_start __attribute__((unused)) =
+  { .tv_sec = 0, .tv_nsec = 0 };
+
+/* Handle kept open until all frames have been rewritten on-demand. */
+static st_handle __st_ondemand_handle __attribute__((unused)) = NULL;
+
+/*
+ * Print the time from starting the most recent rewrite until now, i.e., the
+ * total cost of the rewrite amortized over the execution of the transformed
+ * frames.  Call after returning to the starting function, at which point all
+ * frames have been transformed in either mode.
+ */
+#define PRINT_AMORTIZED_TIME( ) \
+  ({ \
+    struct timespec end = { .tv_sec = 0, .tv_nsec = 0 }; \
+    clock_gettime(CLOCK_MONOTONIC, &end); \
+    printf("[ST] Total amortized time: %lu\n", \
+          (end.tv_sec * 1000000000 + end.tv_nsec) - \
+          (__st_rewrite_start.tv_sec * 1000000000 + \
+           __st_rewrite_start.tv_nsec)); \
+    if(__st_ondemand_handle) \
+    { \
+      st_destroy(__st_ondemand_handle); \
+      __st_ondemand_handle = NULL; \
+    } \
+  })
+
 #ifdef __aarch64__
 
 /* Times rewriting the entire stack (aarch64) */
@@ -103,6 +131,55 @@ get_call_site() { return __builtin_return_address(0); }
         printf("[ST] Total elapsed time: %lu\n", \
               (end.tv_sec * 1000000000 + end.tv_nsec) - \
               (start.tv_sec * 1000000000 + start.tv_nsec)); \
+        __st_rewrite_start = start; \
+        post_transform = 1; \
+        SET_REGS_AARCH64(regset_dest); \
+        SET_FRAME_AARCH64(regset_dest.x[29], regset_dest.sp); \
+        SET_PC_IMM(func); \
+      } \
+    } \
+    else fprintf(stderr, "Couldn't open ELF information\n"); \
+  })
+
+/*
+ * Times rewriting the stack on-demand (aarch64).  Only reports the time the
+ * thread is paused for transformation -- remaining frames are transformed as
+ * the thread returns into them.  Use PRINT_AMORTIZED_TIME() after returning
+ * to the starting function to get the total time.
+ */
+#define TIME_AND_TEST_ONDEMAND( aarch64_bin, func ) \
+  ({ \
+    int ret; \
+    struct timespec start = { .tv_sec = 0, .tv_nsec = 0 }; \
+    struct timespec init = { .tv_sec = 0, .tv_nsec = 0 }; \
+    struct timespec rewrite = { .tv_sec = 0, .tv_nsec = 0 }; \
+    struct regset_aarch64 regset, regset_dest; \
+    stack_bounds bounds = get_stack_bounds(); \
+    READ_REGS_AARCH64(regset); \
+    regset.pc = get_call_site(); \
+    clock_gettime(CLOCK_MONOTONIC, &start); \
+    st_handle src = st_init(aarch64_bin); \
+    clock_gettime(CLOCK_MONOTONIC, &init); \
+    if(src) \
+    { \
+      ret = st_rewrite_ondemand(src, &regset, bounds.high, \
+                                src, &regset_dest, bounds.low); \
+      clock_gettime(CLOCK_MONOTONIC, &rewrite); \
+      if(ret) \
+      { \
+        fprintf(stderr, "Couldn't re-write the stack\n"); \
+        st_destroy(src); \
+      } \
+      else \
+      { \
+        printf("[ST] Setup time: %lu\n", \
+              (init.tv_sec * 1000000000 + init.tv_nsec) - \
+              (start.tv_sec * 1000000000 + start.tv_nsec)); \
+        printf("[ST] Pause time: %lu\n", \
+              (rewrite.tv_sec * 1000000000 + rewrite.tv_nsec) - \
+              (init.tv_sec * 1000000000 + init.tv_nsec)); \
+        __st_rewrite_start = start; \
+        __st_ondemand_handle = src; \
         post_transform = 1; \
         SET_REGS_AARCH64(regset_dest); \
         SET_FRAME_AARCH64(regset_dest.x[29], regset_dest.sp); \
@@ -137,6 +214,7 @@ get_call_site() { return __builtin_return_address(0); }
         printf("[ST] Transform time: %lu\n", \
               (end.tv_sec * 1000000000 + end.tv_nsec) - \
               (start.tv_sec * 1000000000 + start.tv_nsec)); \
+        __st_rewrite_start = start; \
         post_transform = 1; \
         SET_REGS_AARCH64(regset_dest); \
         SET_FRAME_AARCH64(regset_dest.x[29], regset_dest.sp); \
@@ -242,6 +320,7 @@ get_call_site() { return __builtin_return_address(0); }
         printf("[ST] Total elapsed time: %lu\n", \
               (end.tv_sec * 1000000000 + end.tv_nsec) - \
               (start.tv_sec * 1000000000 + start.tv_nsec)); \
+        __st_rewrite_start = start; \
         post_transform = 1; \
         SET_REGS_POWERPC64(regset_dest); \
         SET_FRAME_POWERPC64(regset_dest.r[31], regset_dest.r[1]); \
@@ -252,6 +331,54 @@ get_call_site() { return __builtin_return_address(0); }
       fprintf(stderr, "Couldn't open ELF information\n"); \
   })
 
+/*
+ * Times rewriting the stack on-demand (powerpc64).  Only reports the time the
+ * thread is paused for transformation -- remaining frames are transformed as
+ * the thread returns into them.  Use PRINT_AMORTIZED_TIME() after returning
+ * to the starting function to get the total time.
+ */
+#define TIME_AND_TEST_ONDEMAND( powerpc64_bin, func ) \
+  ({ \
+    int ret; \
+    struct timespec start = { .tv_sec = 0, .tv_nsec = 0 }; \
+    struct timespec init = { .tv_sec = 0, .tv_nsec = 0 }; \
+    struct timespec rewrite = { .tv_sec = 0, .tv_nsec = 0 }; \
+    struct regset_powerpc64 regset, regset_dest; \
+    stack_bounds bounds = get_stack_bounds(); \
+    READ_REGS_POWERPC64(regset); \
+    regset.pc = get_call_site(); \
+    clock_gettime(CLOCK_MONOTONIC, &start); \
+    st_handle src = st_init(powerpc64_bin); \
+    clock_gettime(CLOCK_MONOTONIC, &init); \
+    if(src) \
+    { \
+      ret = st_rewrite_ondemand(src, &regset, bounds.high, \
+                                src, &regset_dest, bounds.low); \
+      clock_gettime(CLOCK_MONOTONIC, &rewrite); \
+      if(ret) \
+      { \
+        fprintf(stderr, "Couldn't re-write the stack\n"); \
+        st_destroy(src); \
+      } \
+      else \
+      { \
+        printf("[ST] Setup time: %lu\n", \
+              (init.tv_sec * 1000000000 + init.tv_nsec) - \
+              (start.tv_sec * 1000000000 + start.tv_nsec)); \
+        printf("[ST] Pause time: %lu\n", \
+              (rewrite.tv_sec * 1000000000 + rewrite.tv_nsec) - \
+              (init.tv_sec * 1000000000 + init.tv_nsec)); \
+        __st_rewrite_start = start; \
+        __st_ondemand_handle = src; \
+        post_transform = 1; \
+        SET_REGS_POWERPC64(regset_dest); \
+        SET_FRAME_POWERPC64(regset_dest.r[31], regset_dest.r[1]); \
+        SET_PC_IMM(func); \
+      } \
+    } \
+    else fprintf(stderr, "Couldn't open ELF information\n"); \
+  })
+
 /*
  * Time & test the re-write with a previously initialized handle.  Good for
  * testing multi-threaded applications which all use the same handle.
@@ -277,6 +404,7 @@ get_call_site() { return __builtin_return_address(0); }
         printf("[ST] Transform time: %lu\n", \
               (end.tv_sec * 1000000000 + end.tv_nsec) - \
               (start.tv_sec * 1000000000 + start.tv_nsec)); \
+        __st_rewrite_start = start; \
         post_transform = 1; \
         SET_REGS_POWERPC64(regset_dest); \
         SET_FRAME_POWERPC64(regset_dest.r[31], regset_dest.r[1]); \
@@ -380,6 +508,55 @@ get_call_site() { return __builtin_return_address(0); }
         printf("[ST] Total elapsed time: %lu\n", \
               (end.tv_sec * 1000000000 + end.tv_nsec) - \
               (start.tv_sec * 1000000000 + start.tv_nsec)); \
+        __st_rewrite_start = start; \
+        post_transform = 1; \
+        SET_REGS_X86_64(regset_dest); \
+        SET_FRAME_X86_64(regset_dest.rbp, regset_dest.rsp); \
+        SET_RIP_IMM(func); \
+      } \
+    } \
+    else fprintf(stderr, "Couldn't open ELF information\n"); \
+  })
+
+/*
+ * Times rewriting the stack on-demand (x86-64).  Only reports the time the
+ * thread is paused for transformation -- remaining frames are transformed as
+ * the thread returns into them.  Use PRINT_AMORTIZED_TIME() after returning
+ * to the starting function to get the total time.
+ */
+#define TIME_AND_TEST_ONDEMAND( x86_64_bin, func ) \
+  ({ \
+    int ret; \
+    struct timespec start = { .tv_sec = 0, .tv_nsec = 0 }; \
+    struct timespec init = { .tv_sec = 0, .tv_nsec = 0 }; \
+    struct timespec rewrite = { .tv_sec = 0, .tv_nsec = 0 }; \
+    struct regset_x86_64 regset, regset_dest; \
+    stack_bounds bounds = get_stack_bounds(); \
+    READ_REGS_X86_64(regset); \
+    regset.rip = get_call_site(); \
+    clock_gettime(CLOCK_MONOTONIC, &start); \
+    st_handle src = st_init(x86_64_bin); \
+    clock_gettime(CLOCK_MONOTONIC, &init); \
+    if(src) \
+    { \
+      ret = st_rewrite_ondemand(src, &regset, bounds.high, \
+                                src, &regset_dest, bounds.low); \
+      clock_gettime(CLOCK_MONOTONIC, &rewrite); \
+      if(ret) \
+      { \
+        fprintf(stderr, "Couldn't re-write the stack\n"); \
+        st_destroy(src); \
+      } \
+      else \
+      { \
+        printf("[ST] Setup time: %lu\n", \
+              (init.tv_sec * 1000000000 + init.tv_nsec) - \
+              (start.tv_sec * 1000000000 + start.tv_nsec)); \
+        printf("[ST] Pause time: %lu\n", \
+              (rewrite.tv_sec * 1000000000 + rewrite.tv_nsec) - \
+              (init.tv_sec * 1000000000 + init.tv_nsec)); \
+        __st_rewrite_start = start; \
+        __st_ondemand_handle = src; \
         post_transform = 1; \
         SET_REGS_X86_64(regset_dest); \
         SET_FRAME_X86_64(regset_dest.rbp, regset_dest.rsp); \
@@ -414,6 +591,7 @@ get_call_site() { return __builtin_return_address(0); }
         printf("[ST] Transform time: %lu\n", \
               (end.tv_sec * 1000000000 + end.tv_nsec) - \
               (start.tv_sec * 1000000000 + start.tv_nsec)); \
+        __st_rewrite_start = start; \
         post_transform = 1; \
         SET_REGS_X86_64(regset_dest); \
         SET_FRAME_X86_64(regset_dest.rbp, regset_dest.rsp); \
@@ -8,6 +8,10 @@
  * URL: https://hal.inria.fr/inria-00558509v1/document
  * Accessed: 5/19/2016
  *
+ * By default, liveness sets are calculated as sparse bit-vectors over a dense
+ * per-function numbering of tracked values rather than as sets of values,
+ * which avoids allocating tree nodes for every set union in large functions.
+ *
  * Author: Rob Lyerly <rlyerly@vt.edu>
  * Date: 5/19/2016
  */
@@ -18,7 +22,10 @@
 #include <map>
 #include <set>
 #include <list>
+#include <vector>
 #include "llvm/Pass.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SparseBitVector.h"
 #include "llvm/Analysis/LoopNestingTree.h"
 #include "llvm/IR/Function.h"
 #include "llvm/Support/raw_ostream.h"
@@ -135,6 +142,33 @@ private:
   std::map<const Function *, LiveVals> FuncBBLiveIn;
   std::map<const Function *, LiveVals> FuncBBLiveOut;
 
+  /* Maps live values, as bits indexed by value number, to a basic block. */
+  typedef SparseBitVector<> LiveBits;
+  typedef DenseMap<const BasicBlock *, LiveBits> LiveBitVals;
+
+  /* Dense numbering of a function's tracked values. */
+  struct ValueNumbering {
+    DenseMap<const Value *, unsigned> IDs;
+    std::vector<const Value *> Values;
+
+    /* Number a value if it hasn't been already. */
+    void add(const Value *val) {
+      if(IDs.insert(std::make_pair(val, Values.size())).second)
+        Values.push_back(val);
+    }
+
+    /* Return a value's number, or -1 if it isn't tracked. */
+    int lookup(const Value *val) const {
+      DenseMap<const Value *, unsigned>::const_iterator it = IDs.find(val);
+      return it != IDs.end() ? it->second : -1;
+    }
+  };
+
+  /* Store bit-vector analysis for all functions. */
+  std::map<const Function *, ValueNumbering> FuncValueNums;
+  std::map<const Function *, LiveBitVals> FuncBBLiveInBits;
+  std::map<const Function *, LiveBitVals> FuncBBLiveOutBits;
+
   /**
    * Return whether or not a value is a variable that should be tracked.
    * @param val a value
@@ -201,6 +235,47 @@ private:
   void loopTreeDFS(LoopNestingForest &LNF,
                    LiveVals &liveIn,
                    LiveVals &liveOut);
+
+  /**
+   * Number the values tracked by the analysis in a function, i.e., arguments,
+   * instructions and their operands.
+   * @param F a function
+   * @param nums the numbering to populate
+   */
+  void numberValues(const Function &F, ValueNumbering &nums) const;
+
+  /**
+   * Convert a bit-vector of numbered values into a newly allocated set.
+   * @param bits a bit-vector of values
+   * @param nums the function's value numbering
+   * @return a set of values; this set must be freed by the user.
+   */
+  static std::set<const Value *> *toSet(const LiveBits &bits,
+                                        const ValueNumbering &nums);
+
+  /**
+   * Bit-vector versions of the above, used when calculating liveness with
+   * bit-vectors.
+   */
+  void phiUses(const BasicBlock *B,
+               const BasicBlock *S,
+               const ValueNumbering &nums,
+               LiveBits &uses);
+  void phiDefs(const BasicBlock *B,
+               const ValueNumbering &nums,
+               LiveBits &defs);
+  void dagDFS(Function &F,
+              const ValueNumbering &nums,
+              LiveBitVals &liveIn,
+              LiveBitVals &liveOut);
+  void propagateValues(const LoopNestingTree &loopNest,
+                       const ValueNumbering &nums,
+                       LiveBitVals &liveIn,
+                       LiveBitVals &liveOut);
+  void loopTreeDFS(LoopNestingForest &LNF,
+                   const ValueNumbering &nums,
+                   LiveBitVals &liveIn,
+                   LiveBitVals &liveOut);
 };
 
 } /* llvm namespace */
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include "llvm/Analysis/LiveValues.h"
 #include "llvm/IR/Metadata.h"
 #include "llvm/IR/Instructions.h"
@@ -6,12 +7,20 @@
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/ADT/PostOrderIterator.h"
 #include "llvm/ADT/SCCIterator.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 
 #define DEBUG_TYPE "live-values"
 
 using namespace llvm;
 
+/// Calculate liveness sets as sparse bit-vectors over numbered values rather
+/// than as sets of values.  The set-based engine is kept for comparison.
+const static cl::opt<bool>
+BitVectorLiveness("live-values-bitvector", cl::Hidden, cl::init(true),
+  cl::desc("Calculate live-value sets using bit-vectors"));
+
 char LiveValues::ID = 0;
 INITIALIZE_PASS_BEGIN(LiveValues, "live-values", 
                     "Live-value set calculation", true, true)
@@ -39,7 +48,7 @@ void LiveValues::getAnalysisUsage(AnalysisUsage &AU) const
 
 bool LiveValues::runOnFunction(Function &F)
 {
-  if(FuncBBLiveIn.count(&F))
+  if(FuncBBLiveIn.count(&F) || FuncBBLiveInBits.count(&F))
   {
     DEBUG(
       errs() << "\nFound previous analysis for " << F.getName() << "\n\n";
@@ -53,11 +62,22 @@ bool LiveValues::runOnFunction(Function &F)
                     "LiveValues: performing bottom-up dataflow analysis\n");
 
     LoopNestingForest LNF;
-    FuncBBLiveIn.emplace(&F, LiveVals());
-    FuncBBLiveOut.emplace(&F, LiveVals());
+    if(BitVectorLiveness)
+    {
+      numberValues(F, FuncValueNums[&F]);
+      FuncBBLiveInBits.emplace(&F, LiveBitVals());
+      FuncBBLiveOutBits.emplace(&F, LiveBitVals());
+    }
+    else
+    {
+      FuncBBLiveIn.emplace(&F, LiveVals());
+      FuncBBLiveOut.emplace(&F, LiveVals());
+    }
 
     /* 1. Compute partial liveness sets using a postorder traversal. */
-    dagDFS(F, FuncBBLiveIn[&F], FuncBBLiveOut[&F]);
+    if(BitVectorLiveness)
+      dagDFS(F, FuncValueNums[&F], FuncBBLiveInBits[&F], FuncBBLiveOutBits[&F]);
+    else dagDFS(F, FuncBBLiveIn[&F], FuncBBLiveOut[&F]);
 
     DEBUG(errs() << "LiveValues: constructing loop-nesting forest\n");
 
@@ -67,7 +87,10 @@ bool LiveValues::runOnFunction(Function &F)
     DEBUG(errs() << "LiveValues: propagating values within loop-nests\n");
 
     /* 3. Propagate live variables within loop bodies. */
-    loopTreeDFS(LNF, FuncBBLiveIn[&F], FuncBBLiveOut[&F]);
+    if(BitVectorLiveness)
+      loopTreeDFS(LNF, FuncValueNums[&F], FuncBBLiveInBits[&F],
+                  FuncBBLiveOutBits[&F]);
+    else loopTreeDFS(LNF, FuncBBLiveIn[&F], FuncBBLiveOut[&F]);
 
     DEBUG(
       print(errs(), &F);
@@ -87,7 +110,38 @@ LiveValues::print(raw_ostream &O, const Function *F) const
 
   O << "LiveValues: results of live-value analysis\n";
 
-  if(!FuncBBLiveIn.count(F) || !FuncBBLiveOut.count(F))
+  if(FuncBBLiveInBits.count(F))
+  {
+    const ValueNumbering &nums = FuncValueNums.at(F);
+    const LiveBitVals &liveIn = FuncBBLiveInBits.at(F),
+                      &liveOut = FuncBBLiveOutBits.at(F);
+    LiveBits::iterator bitIt;
+
+    for(Function::const_iterator bb = F->begin(); bb != F->end(); bb++)
+    {
+      if(!liveIn.count(&*bb)) continue;
+      const LiveBits &liveInBits = liveIn.find(&*bb)->second;
+      const LiveBits &liveOutBits = liveOut.find(&*bb)->second;
+
+      bb->printAsOperand(O, false, M);
+      O << "\n  Live-in:\n    ";
+      for(bitIt = liveInBits.begin(); bitIt != liveInBits.end(); ++bitIt)
+      {
+        nums.Values[*bitIt]->printAsOperand(O, false, M);
+        O << " ";
+      }
+
+      O << "\n  Live-out:\n    ";
+      for(bitIt = liveOutBits.begin(); bitIt != liveOutBits.end(); ++bitIt)
+      {
+        nums.Values[*bitIt]->printAsOperand(O, false, M);
+        O << " ";
+      }
+
+      O << "\n";
+    }
+  }
+  else if(!FuncBBLiveIn.count(F) || !FuncBBLiveOut.count(F))
   {
     if(F->hasName())
       O << "No liveness information for function " << F->getName() << "\n";
@@ -127,12 +181,24 @@ LiveValues::print(raw_ostream &O, const Function *F) const
 std::set<const Value *> *LiveValues::getLiveIn(const BasicBlock *BB) const
 {
   const Function *F = BB->getParent();
+  if(FuncBBLiveInBits.count(F))
+  {
+    const LiveBitVals &Blocks = FuncBBLiveInBits.at(F);
+    assert(Blocks.count(BB) && "No liveness information for basic block");
+    return toSet(Blocks.find(BB)->second, FuncValueNums.at(F));
+  }
   return new std::set<const Value *>(FuncBBLiveIn.at(F).at(BB));
 }
 
 std::set<const Value *> *LiveValues::getLiveOut(const BasicBlock *BB) const
 {
   const Function *F = BB->getParent();
+  if(FuncBBLiveOutBits.count(F))
+  {
+    const LiveBitVals &Blocks = FuncBBLiveOutBits.at(F);
+    assert(Blocks.count(BB) && "No liveness information for basic block");
+    return toSet(Blocks.find(BB)->second, FuncValueNums.at(F));
+  }
   return new std::set<const Value *>(FuncBBLiveOut.at(F).at(BB));
 }
 
@@ -147,6 +213,27 @@ std::set<const Value *>
   // Note: some functions have unreachable basic blocks (e.g., functions that
   // call exit and then return a value).  If we don't have analysis for the
   // block, return an empty set.
+  if(FuncBBLiveOutBits.count(F))
+  {
+    const ValueNumbering &nums = FuncValueNums.at(F);
+    const LiveBitVals &Blocks = FuncBBLiveOutBits.at(F);
+    LiveBitVals::const_iterator it = Blocks.find(BB);
+    int id;
+
+    if(it == Blocks.end()) return new std::set<const Value *>;
+    LiveBits liveBits(it->second);
+    for(ri = BB->rbegin(), rie = BB->rend(); ri != rie; ri++)
+    {
+      if((id = nums.lookup(&*ri)) >= 0) liveBits.reset(id);
+      for(User::const_op_iterator op = ri->op_begin();
+          op != ri->op_end();
+          op++)
+        if((id = nums.lookup(*op)) >= 0) liveBits.set(id);
+      if(&*ri == inst) break;
+    }
+    return toSet(liveBits, nums);
+  }
+
   const LiveVals &Blocks = FuncBBLiveOut.at(F);
   if(Blocks.count(BB)) live = new std::set<const Value *>(Blocks.at(BB));
   else return new std::set<const Value *>;
@@ -372,6 +459,7 @@ void LiveValues::propagateValues(const LoopNestingTree &loopNest,
     }
 
     liveLoop.clear();
+    phiDefined.clear();
   }
 }
 
@@ -384,3 +472,191 @@ void LiveValues::loopTreeDFS(LoopNestingForest &LNF,
     propagateValues(*it, liveIn, liveOut);
 }
 
+
+void LiveValues::numberValues(const Function &F, ValueNumbering &nums) const
+{
+  // Number definitions first so values defined near each other (and likely
+  // live together) share bit-vector elements, then values only used as
+  // operands (e.g., globals).
+  for(Function::const_arg_iterator arg = F.arg_begin();
+      arg != F.arg_end();
+      arg++)
+    if(includeVal(&*arg)) nums.add(&*arg);
+
+  for(const_inst_iterator inst = inst_begin(F), ie = inst_end(F);
+      inst != ie;
+      inst++)
+    if(!inst->getType()->isVoidTy() && includeVal(&*inst)) nums.add(&*inst);
+
+  for(const_inst_iterator inst = inst_begin(F), ie = inst_end(F);
+      inst != ie;
+      inst++)
+    for(User::const_op_iterator op = inst->op_begin();
+        op != inst->op_end();
+        op++)
+      if(includeVal(*op)) nums.add(*op);
+}
+
+std::set<const Value *> *LiveValues::toSet(const LiveBits &bits,
+                                           const ValueNumbering &nums)
+{
+  // Sets are ordered by pointer rather than value number, so sort first to
+  // build the set in linear time.
+  SmallVector<const Value *, 64> sorted;
+  for(LiveBits::iterator it = bits.begin(); it != bits.end(); ++it)
+    sorted.push_back(nums.Values[*it]);
+  std::sort(sorted.begin(), sorted.end());
+  return new std::set<const Value *>(sorted.begin(), sorted.end());
+}
+
+void LiveValues::phiUses(const BasicBlock *B,
+                         const BasicBlock *S,
+                         const ValueNumbering &nums,
+                         LiveBits &uses)
+{
+  const PHINode *phi;
+  int id;
+
+  for(BasicBlock::const_iterator it = S->begin(); it != S->end(); it++)
+  {
+    if((phi = dyn_cast<PHINode>(&*it))) {
+      for(unsigned i = 0; i < phi->getNumIncomingValues(); i++)
+        if(phi->getIncomingBlock(i) == B &&
+           (id = nums.lookup(phi->getIncomingValue(i))) >= 0)
+          uses.set(id);
+    }
+    else break; // phi-nodes are always at the start of the basic block
+  }
+}
+
+void LiveValues::phiDefs(const BasicBlock *B,
+                         const ValueNumbering &nums,
+                         LiveBits &defs)
+{
+  int id;
+
+  for(BasicBlock::const_iterator it = B->begin(); it != B->end(); it++)
+  {
+    if(isa<PHINode>(&*it)) {
+      if((id = nums.lookup(&*it)) >= 0) defs.set(id);
+    }
+    else break; // phi-nodes are always at the start of the basic block
+  }
+}
+
+void LiveValues::dagDFS(Function &F,
+                        const ValueNumbering &nums,
+                        LiveBitVals &liveIn,
+                        LiveBitVals &liveOut)
+{
+  LiveBits live, phiDefined, succLive;
+  std::set<Edge> loopEdges;
+  SmallVector<Edge, 16> loopEdgeVec;
+  int id;
+
+  /* Find loop edges & convert to set for existence checking. */
+  FindFunctionBackedges(F, loopEdgeVec);
+  for(SmallVectorImpl<Edge>::const_iterator eit = loopEdgeVec.begin();
+      eit != loopEdgeVec.end();
+      eit++)
+    loopEdges.insert(*eit);
+
+  /* Calculate partial liveness sets for CFG nodes. */
+  for(auto B = po_iterator<const BasicBlock *>::begin(&F.getEntryBlock());
+      B != po_iterator<const BasicBlock *>::end(&F.getEntryBlock());
+      B++)
+  {
+    /* Calculate live-out set (lines 4-7 of Algorithm 2). */
+    for(succ_const_iterator S = succ_begin(*B); S != succ_end(*B); S++)
+    {
+      // Note: skip self-loop-edges, see above.
+      if(*S == *B) continue;
+
+      phiUses(*B, *S, nums, live);
+      if(!loopEdges.count(Edge(*B, *S)))
+      {
+        phiDefs(*S, nums, phiDefined);
+        succLive.intersectWithComplement(liveIn[*S], phiDefined);
+        live |= succLive;
+        phiDefined.clear();
+      }
+    }
+    liveOut[*B] = live;
+
+    /* Calculate live-in set (lines 8-11 of Algorithm 2). */
+    for(BasicBlock::const_reverse_iterator inst = (*B)->rbegin();
+        inst != (*B)->rend();
+        inst++)
+    {
+      if(isa<PHINode>(&*inst)) break;
+
+      if((id = nums.lookup(&*inst)) >= 0) live.reset(id);
+      for(User::const_op_iterator op = inst->op_begin();
+          op != inst->op_end();
+          op++)
+        if((id = nums.lookup(*op)) >= 0) live.set(id);
+    }
+    phiDefs(*B, nums, live);
+    liveIn[*B] = live;
+
+    live.clear();
+
+    DEBUG(
+      errs() << "  ";
+      (*B)->printAsOperand(errs(), false);
+      errs() << ":\n";
+      errs() << "    Live-in:\n      ";
+      LiveBits::iterator it;
+      for(it = liveIn[*B].begin(); it != liveIn[*B].end(); ++it)
+      {
+        nums.Values[*it]->printAsOperand(errs(), false);
+        errs() << " ";
+      }
+      errs() << "\n    Live-out:\n      ";
+      for(it = liveOut[*B].begin(); it != liveOut[*B].end(); ++it)
+      {
+        nums.Values[*it]->printAsOperand(errs(), false);
+        errs() << " ";
+      }
+      errs() << "\n";
+    );
+  }
+}
+
+void LiveValues::propagateValues(const LoopNestingTree &loopNest,
+                                 const ValueNumbering &nums,
+                                 LiveBitVals &liveIn,
+                                 LiveBitVals &liveOut)
+{
+  LiveBits liveLoop, phiDefined;
+
+  /* Iterate over all loop nodes. */
+  for(LoopNestingTree::loop_iterator loop = loopNest.loop_begin();
+      loop != loopNest.loop_end();
+      loop++)
+  {
+    /* Calculate LiveLoop (lines 3 & 4 of Algorithm 3). */
+    phiDefs(*loop, nums, phiDefined);
+    liveLoop.intersectWithComplement(liveIn[*loop], phiDefined);
+
+    /* Propagate values to children (lines 5-8 of Algorithm 3). */
+    for(LoopNestingTree::child_iterator child = loopNest.children_begin(loop);
+        child != loopNest.children_end(loop);
+        child++) {
+      liveIn[*child] |= liveLoop;
+      liveOut[*child] |= liveLoop;
+    }
+
+    phiDefined.clear();
+  }
+}
+
+void LiveValues::loopTreeDFS(LoopNestingForest &LNF,
+                             const ValueNumbering &nums,
+                             LiveBitVals &liveIn,
+                             LiveBitVals &liveOut)
+{
+  LoopNestingForest::const_iterator it;
+  for(it = LNF.begin(); it != LNF.end(); it++)
+    propagateValues(*it, nums, liveIn, liveOut);
+}
@@ -20,6 +20,7 @@
 #include "llvm/ADT/Triple.h"
 #include "llvm/Analysis/PopcornUtil.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
@@ -29,6 +30,7 @@ using namespace llvm;
 
 #define DEBUG_TYPE "migration-points"
 #define MIGRATE_FLAG_NAME "__migrate_flag"
+#define MIGRATE_REQUEST_NAME "__migrate_request"
 
 /// Disable rollback-only transactions for PowerPC.
 const static cl::opt<bool>
@@ -43,6 +45,14 @@ AbortCount("abort-count", cl::Hidden, cl::init(""),
   cl::desc("Add counters for each abort handler in the specified function"),
   cl::value_desc("function"));
 
+/// Sample abort handler counters rather than counting every abort.  The
+/// runtime counts one in every N aborts per thread & scales counts when
+/// dumping them.
+const static cl::opt<unsigned>
+AbortCountSample("abort-count-sample", cl::Hidden, cl::init(1),
+  cl::desc("Count one in every N aborts per thread when using -abort-count"),
+  cl::value_desc("N"));
+
 STATISTIC(NumMigPoints, "Number of migration points added");
 STATISTIC(NumHTMBegins, "Number of HTM begin intrinsics added");
 STATISTIC(NumHTMEnds, "Number of HTM end intrinsics added");
@@ -76,12 +86,13 @@ public:
       MigrateAPI = M.getOrInsertFunction("migrate", FuncTy);
       MigrateFlag = cast<GlobalValue>(
         M.getOrInsertGlobal(MIGRATE_FLAG_NAME, Type::getInt32Ty(C)));
-      // TODO this needs to be thread-local storage
-      //MigrateFlag->setThreadLocal(true);
+      MigrateFlag->setThreadLocal(true);
     }
     else {
       MigrateAPI = M.getOrInsertFunction("check_migrate", FuncTy);
-      MigrateFlag = nullptr;
+      MigrateFlag = cast<GlobalValue>(
+        M.getOrInsertGlobal(MIGRATE_REQUEST_NAME, Type::getInt32Ty(C)));
+      MigrateFlag->setThreadLocal(true);
     }
   }
 
@@ -129,10 +140,15 @@ public:
       GlobalVariable *NumCtrs = cast<GlobalVariable>(
         M.getOrInsertGlobal("__num_abort_counters", Unsigned));
       NumCtrs->setInitializer(ConstantInt::get(Unsigned, 1024, false));
-      Type *ArrType = ArrayType::get(Type::getInt64Ty(C), 1024);
-      AbortCounters = cast<GlobalVariable>(
-        M.getOrInsertGlobal("__abort_counters", ArrType));
-      AbortCounters->setInitializer(ConstantAggregateZero::get(ArrType));
+      GlobalVariable *SamplePeriod = cast<GlobalVariable>(
+        M.getOrInsertGlobal("__abort_sample_period", Unsigned));
+      SamplePeriod->setInitializer(
+        ConstantInt::get(Unsigned, AbortCountSample ? AbortCountSample : 1,
+                         false));
+      std::vector<Type *> ArgTy = { Unsigned };
+      FunctionType *FuncTy =
+        FunctionType::get(Type::getVoidTy(C), ArgTy, false);
+      AbortCountAPI = M.getOrInsertFunction("__abort_count", FuncTy);
     }
 
     return true;
@@ -239,7 +255,7 @@ private:
   /// Should we instrument HTM abort handlers with counters for precise
   /// profiling of which code locations cause aborts & all associated state.
   bool DoAbortInstrument;
-  GlobalVariable *AbortCounters;
+  Constant *AbortCountAPI;
   unsigned AbortHandlerCount;
   std::ofstream MapFile;
 
@@ -281,15 +297,44 @@ private:
     }
   }
 
-  /// Add a migration point directly before an instruction.
+  /// Add a migration point directly before an instruction.  The migration
+  /// library is only called if the thread's migration request word is set, so
+  /// the common case is a load & a branch around a cold block containing the
+  /// call.
   void addMigrationPoint(Instruction *I) {
     LLVMContext &C = I->getContext();
-    IRBuilder<> Worker(I);
+    BasicBlock *CurBB = I->getParent(), *NewSuccBB, *MigPointBB;
+    BasicBlock::iterator SplitPt = I;
+
+    // Keep static allocas in the entry block, otherwise they'd be lowered as
+    // dynamic stack allocations.
+    if(CurBB == &CurBB->getParent()->getEntryBlock())
+      while(isa<AllocaInst>(&*SplitPt)) SplitPt++;
+
+    NewSuccBB = CurBB->splitBasicBlock(SplitPt,
+                  "migpointsucc" + std::to_string(NumMigPoints));
+    MigPointBB =
+      BasicBlock::Create(C, "migpoint" + std::to_string(NumMigPoints),
+                         CurBB->getParent(), NewSuccBB);
+
+    // Check the request word & branch to the migration point if it's set.
+    // The flag is volatile, as it may be set by a signal handler.
+    IRBuilder<> FlagCheckWorker(CurBB->getTerminator());
+    Value *Flag = FlagCheckWorker.CreateLoad(MigrateFlag, true);
+    Value *Zero = ConstantInt::get(Type::getInt32Ty(C), 0, false);
+    Value *Cmp = FlagCheckWorker.CreateICmpNE(Flag, Zero);
+    MDNode *Weights = MDBuilder(C).createBranchWeights(1, 1 << 20);
+    FlagCheckWorker.CreateCondBr(Cmp, MigPointBB, NewSuccBB, Weights);
+    CurBB->getTerminator()->eraseFromParent();
+
+    // Add call to migration library API.
+    IRBuilder<> MigPointWorker(MigPointBB);
     std::vector<Value *> Args = {
       ConstantPointerNull::get(CallbackType),
       ConstantPointerNull::get(Type::getInt8PtrTy(C, 0))
     };
-    Worker.CreateCall(MigrateAPI, Args);
+    MigPointWorker.CreateCall(MigrateAPI, Args);
+    MigPointWorker.CreateBr(NewSuccBB);
   }
 
   // Note: because we're only supporting 2 architectures for now, we're not
@@ -328,18 +373,13 @@ private:
       if(!AbortHandlerCount) MapFile << FlagCheckBB->getName().str();
       else MapFile << " " << FlagCheckBB->getName().str();
 
-      // Add instrumentation to increment the counter's value.
-      std::string CtrNum(std::to_string(AbortHandlerCount));
-      std::vector<Value *> Idx = {
-        ConstantInt::get(Type::getInt64Ty(C), 0),
-        ConstantInt::get(Type::getInt64Ty(C), AbortHandlerCount),
+      // Add instrumentation to increment the counter's value.  The runtime
+      // keeps per-thread counters (and does any sampling) so aborting threads
+      // don't contend on a shared counter array.
+      std::vector<Value *> CtrArgs = {
+        ConstantInt::get(Type::getInt32Ty(C), AbortHandlerCount, false)
       };
-      Value *One = ConstantInt::get(Type::getInt64Ty(C), 1, false);
-      Value *GEP = FlagCheckWorker.CreateInBoundsGEP(AbortCounters, Idx,
-                                                     "ctrptr" + CtrNum);
-      Value *CtrVal = FlagCheckWorker.CreateLoad(GEP, "ctr" + CtrNum);
-      Value *Inc = FlagCheckWorker.CreateAdd(CtrVal, One);
-      FlagCheckWorker.CreateStore(Inc, GEP);
+      FlagCheckWorker.CreateCall(AbortCountAPI, CtrArgs);
 
       AbortHandlerCount++;
     }
@@ -38,5 +38,22 @@ ret_t add_sections(bin *b,
                    uint64_t start_id,
                    const char *unwind_sec);
 
+/**
+ * Add rewriting plans to the object.  Pairs the object's call sites with the
+ * call sites of the same ID in each of the destination binaries, checks that
+ * their live value location records match up & records which location records
+ * are copied to which.  Stack transformation metadata must have already been
+ * added to all binaries.
+ * @param b a binary descriptor
+ * @param dests binary descriptors for other architectures
+ * @param num_dests number of binary descriptors pointed to by dests
+ * @param sec prefix of sections to be added
+ * @return 0 if the sections were added, an error code otherwise
+ */
+ret_t add_plan_sections(bin *b,
+                        bin **dests,
+                        size_t num_dests,
+                        const char *sec);
+
 #endif /* _WRITE_H */
 
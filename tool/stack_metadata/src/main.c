@@ -18,7 +18,10 @@
 // Configuration
 ///////////////////////////////////////////////////////////////////////////////
 
-static const char *args = "hf:s:i:v";
+/* Maximum number of binaries for which to add rewriting plans */
+#define MAX_PLAN_BINS 8
+
+static const char *args = "hf:s:i:p:v";
 static const char *help =
 "gen-stackinfo -- post-process object files (and their LLVM-generated stack \
 maps) to tag call-sites with globally-unique identifiers & generate stack \
@@ -30,14 +33,24 @@ Options:\n\
 \t-f name : object file or executable to post-process\n\
 \t-s name : section name prefix added to object file (default is '" SECTION_PREFIX "')\n\
 \t-i num  : number at which to begin generating call site IDs\n\
+\t-p name : add rewriting plans for migrating to the binary for another \
+architecture (can be specified multiple times)\n\
 \t-v      : be verbose\n\n\
 \
-Note: this tool *must* be run after symbol alignment!";
+Note: this tool *must* be run after symbol alignment!  Rewriting plans can \
+only be added after stack transformation metadata has been added to all \
+binaries, e.g.:\n\n\
+\tgen-stackinfo -f prog_aarch64\n\
+\tgen-stackinfo -f prog_x86-64\n\
+\tgen-stackinfo -f prog_aarch64 -p prog_x86-64\n\
+\tgen-stackinfo -f prog_x86-64 -p prog_aarch64";
 
 static const char *file = NULL;
 static char unwind_addr_name[512];
 static const char *section_name = SECTION_PREFIX;
 static uint64_t start_id = 0;
+static const char *plan_files[MAX_PLAN_BINS];
+static size_t num_plan_files = 0;
 bool verbose = false;
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -70,6 +83,11 @@ static void parse_args(int argc, char **argv)
     case 'i':
       start_id = atol(optarg);
       break;
+    case 'p':
+      if(num_plan_files == MAX_PLAN_BINS)
+        die("too many binaries for rewriting plans", INVALID_ARGUMENT);
+      plan_files[num_plan_files++] = optarg;
+      break;
     case 'v':
       verbose = true;
       break;
@@ -90,6 +108,26 @@ static void parse_args(int argc, char **argv)
 // Driver
 ///////////////////////////////////////////////////////////////////////////////
 
+/*
+ * Pair call sites with the binaries for other architectures & add rewriting
+ * plans.
+ */
+static void add_plans(bin *b)
+{
+  ret_t ret;
+  size_t i;
+  bin *dests[MAX_PLAN_BINS];
+
+  for(i = 0; i < num_plan_files; i++)
+    if((ret = init_elf_bin(plan_files[i], &dests[i])))
+      die("could not initialize ELF information", ret);
+
+  if((ret = add_plan_sections(b, dests, num_plan_files, section_name)))
+    die("could not add rewriting plan sections", ret);
+
+  for(i = 0; i < num_plan_files; i++) free_elf_bin(dests[i]);
+}
+
 int main(int argc, char **argv)
 {
   ret_t ret;
@@ -106,6 +144,14 @@ int main(int argc, char **argv)
   if((ret = init_elf_bin(file, &b)))
     die("could not initialize ELF information", ret);
 
+  /* Metadata has already been added, only add rewriting plans */
+  if(num_plan_files)
+  {
+    add_plans(b);
+    free_elf_bin(b);
+    return 0;
+  }
+
   /* Read stack map information */
   if((ret = init_stackmap(b, &sm, &num_sm)))
     die("could not read stack map section", ret);
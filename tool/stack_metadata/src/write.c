@@ -13,6 +13,29 @@
 // Private API
 ///////////////////////////////////////////////////////////////////////////////
 
+/* Size of a live value, or of the data for a stack allocation. */
+#define VAL_SIZE( val ) (val->is_alloca ? val->alloca_size : val->size)
+
+/**
+ * Return whether a pair of location records are for a va_list, which is
+ * implemented with different sizes for different architectures and is skipped
+ * by the runtime:
+ *   x86_64:    24
+ *   aarch64:   32
+ *   powerpc64:  8
+ * @param src source location record
+ * @param dest destination location record
+ * @return true if the records are for a va_list, false otherwise
+ */
+static inline bool is_va_list(const live_value *src, const live_value *dest)
+{
+  if(!src->is_alloca || !dest->is_alloca) return false;
+  return (VAL_SIZE(src) == 24 && VAL_SIZE(dest) == 32) ||
+         (VAL_SIZE(src) == 32 && VAL_SIZE(dest) == 24) ||
+         (VAL_SIZE(src) == 24 && VAL_SIZE(dest) == 8) ||
+         (VAL_SIZE(src) == 8 && VAL_SIZE(dest) == 24);
+}
+
 /**
  * Generate the call-site metadata section.
  * @param b a binary descriptor
@@ -38,6 +61,59 @@ create_call_site_metadata(bin *b, uint64_t start_id,
                           size_t *num_arch_live, arch_live_value **arch_live,
                           size_t num_addrs, const unwind_addr *addrs);
 
+/**
+ * Update the offsets of stack transformation sections & write the binary.
+ * Sections added by this tool, i.e., all trailing sections named with the
+ * prefix, are laid out after the last section preceding them.
+ * @param b a binary descriptor
+ * @param sec prefix of stack transformation sections
+ * @return 0 if the binary was written, an error code otherwise
+ */
+static ret_t write_sections(bin *b, const char *sec);
+
+/**
+ * Drop any rewriting plans from a binary by emptying the plan sections.
+ * Plans reference the binary's location records & must be regenerated
+ * whenever they are.
+ * @param b a binary descriptor
+ * @param sec prefix of stack transformation sections
+ * @return 0 if the plans were dropped, an error code otherwise
+ */
+static ret_t drop_plan_sections(bin *b, const char *sec);
+
+/**
+ * Get a binary's call site (sorted by ID) & live value location records.
+ * @param b a binary descriptor
+ * @param sec prefix of stack transformation sections
+ * @param num_sites number of call sites pointed to by sites
+ * @param sites call site metadata
+ * @param live live value location records
+ * @return 0 if the metadata was found, an error code otherwise
+ */
+static ret_t get_site_metadata(bin *b, const char *sec, size_t *num_sites,
+                               const call_site **sites,
+                               const live_value **live);
+
+/**
+ * Pair a call site's location records with those of the same call site in
+ * another binary, exactly like the runtime when rewriting the site's frame.
+ * Warns about records which don't match up.
+ * @param src_site source call site
+ * @param src_live source binary's live value location records
+ * @param dest_site destination call site
+ * @param dest_live destination binary's live value location records
+ * @param num_moves number of moves copied to moves
+ * @param moves live value moves
+ * @return true if the records were paired, false if the call sites' records
+ *         are inconsistent
+ */
+static bool pair_live_values(const call_site *src_site,
+                             const live_value *src_live,
+                             const call_site *dest_site,
+                             const live_value *dest_live,
+                             uint16_t *num_moves,
+                             plan_move *moves);
+
 /**
  * Comparison function to sort unwind address ranges by address.  Called by
  * qsort().
@@ -63,6 +139,15 @@ static int sort_id(const void *a, const void *b);
  */
 static int sort_addr(const void *a, const void *b);
 
+/**
+ * Comparison function to sort plans by destination architecture & ID.  Called
+ * by qsort().
+ * @param a first plan record
+ * @param b second plan record
+ * @return -1 if a < b, 0 if a == b or 1 if a > b
+ */
+static int sort_plan(const void *a, const void *b);
+
 ///////////////////////////////////////////////////////////////////////////////
 // Public API
 ///////////////////////////////////////////////////////////////////////////////
@@ -106,13 +191,11 @@ ret_t add_sections(bin *b,
                    uint64_t start_id,
                    const char *unwind_sec)
 {
-  size_t num_shdr, i, added = 0, cur_offset, num_sites,
-         num_live, num_arch_live, num_unwind;
+  size_t num_sites, num_live, num_arch_live, num_unwind;
   char sec_name[BUF_SIZE];
   call_site *id_sites, *addr_sites;
   live_value *live_vals;
   arch_live_value *archlive;
-  Elf64_Ehdr *ehdr;
   Elf64_Shdr *shdr;
   Elf_Scn *scn;
   const unwind_addr *unwind;
@@ -139,7 +222,6 @@ ret_t add_sections(bin *b,
   else
     ret = add_section(b->e, sec_name, num_sites, sizeof(call_site), id_sites);
   if(ret) return ret;
-  added++;
 
   /* Add call site section sorted by address */
   addr_sites = malloc(sizeof(call_site) * num_sites);
@@ -151,7 +233,6 @@ ret_t add_sections(bin *b,
   else
     ret = add_section(b->e, sec_name, num_sites, sizeof(call_site), addr_sites);
   if(ret) return ret;
-  added++;
 
   /* Add live-value location section. */
   snprintf(sec_name, BUF_SIZE, "%s.%s", sec, SECTION_LIVE);
@@ -160,7 +241,6 @@ ret_t add_sections(bin *b,
   else
     ret = add_section(b->e, sec_name, num_live, sizeof(live_value), live_vals);
   if(ret) return ret;
-  added++;
 
   /* Add architecture-specific location section. */
   snprintf(sec_name, BUF_SIZE, "%s.%s", sec, SECTION_ARCH);
@@ -169,10 +249,137 @@ ret_t add_sections(bin *b,
   else
     ret = add_section(b->e, sec_name, num_arch_live, sizeof(arch_live_value), archlive);
   if(ret) return ret;
-  added++;
 
-  /* Calculate offset of last non-stack-transform section */
+  if((ret = drop_plan_sections(b, sec))) return ret;
+
+  return write_sections(b, sec);
+}
+
+ret_t add_plan_sections(bin *b,
+                        bin **dests,
+                        size_t num_dests,
+                        const char *sec)
+{
+  size_t i, j, num_sites, num_dest_sites, num_plans = 0, num_moves = 0,
+         max_moves = 0;
+  uint16_t site_moves;
+  char sec_name[BUF_SIZE], msg[BUF_SIZE];
+  const call_site *sites, *dest_sites, *dest_site;
+  const live_value *live, *dest_live;
+  plan_site *plans;
+  plan_move *moves;
+  Elf_Scn *scn;
+  ret_t ret;
+
+  if(!b || !dests || !num_dests || !sec) return INVALID_ARGUMENT;
+  if((ret = get_site_metadata(b, sec, &num_sites, &sites, &live)))
+    return ret;
+
+  plans = malloc(sizeof(plan_site) * num_sites * num_dests);
+  if(!plans) return CREATE_METADATA_FAILED;
+  moves = NULL;
+
+  for(i = 0; i < num_dests; i++)
+  {
+    if(dests[i]->arch == b->arch)
+    {
+      snprintf(msg, BUF_SIZE, "'%s' & '%s' are for the same architecture",
+               b->name, dests[i]->name);
+      warn(msg);
+      return INVALID_ARGUMENT;
+    }
+    if((ret = get_site_metadata(dests[i], sec, &num_dest_sites, &dest_sites,
+                                &dest_live)))
+      return ret;
+
+    /* Each destination location record is moved to exactly once */
+    for(j = 0; j < num_dest_sites; j++) max_moves += dest_sites[j].num_live;
+    moves = realloc(moves, sizeof(plan_move) * (max_moves ? max_moves : 1));
+    if(!moves) return CREATE_METADATA_FAILED;
+
+    if(verbose) printf("Pairing %lu call sites with '%s'\n",
+                       num_sites, dests[i]->name);
+
+    for(j = 0; j < num_sites; j++)
+    {
+      dest_site = bsearch(&sites[j], dest_sites, num_dest_sites,
+                          sizeof(call_site), sort_id);
+      if(!dest_site)
+      {
+        snprintf(msg, BUF_SIZE, "call site %lu not found in '%s'",
+                 sites[j].id, dests[i]->name);
+        warn(msg);
+        return INVALID_METADATA;
+      }
+
+      if(!pair_live_values(&sites[j], live, dest_site, dest_live,
+                           &site_moves, &moves[num_moves]))
+      {
+        snprintf(msg, BUF_SIZE, "live values at call site %lu don't match up "
+                 "with '%s'", sites[j].id, dests[i]->name);
+        warn(msg);
+        return INVALID_METADATA;
+      }
+
+      plans[num_plans].id = sites[j].id;
+      plans[num_plans].arch = dests[i]->arch;
+      plans[num_plans].num_moves = site_moves;
+      plans[num_plans].move_offset = num_moves;
+      plans[num_plans].padding = 0;
+      num_moves += site_moves;
+      num_plans++;
+    }
+  }
+
+  if(verbose)
+    printf("Creating %lu rewriting plans with %lu live value moves\n",
+           num_plans, num_moves);
+
+  /* Add plan section sorted by destination architecture & ID */
+  qsort(plans, num_plans, sizeof(plan_site), sort_plan);
+  snprintf(sec_name, BUF_SIZE, "%s.%s", sec, SECTION_PLAN);
+  if((scn = get_section_by_name(b->e, sec_name)))
+    ret = update_section(b->e, scn, num_plans, sizeof(plan_site), plans);
+  else
+    ret = add_section(b->e, sec_name, num_plans, sizeof(plan_site), plans);
+  if(ret) return ret;
+
+  /* Add live value move section */
+  snprintf(sec_name, BUF_SIZE, "%s.%s", sec, SECTION_PLAN_MOVE);
+  if((scn = get_section_by_name(b->e, sec_name)))
+    ret = update_section(b->e, scn, num_moves, sizeof(plan_move), moves);
+  else
+    ret = add_section(b->e, sec_name, num_moves, sizeof(plan_move), moves);
+  if(ret) return ret;
+
+  return write_sections(b, sec);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Private API
+///////////////////////////////////////////////////////////////////////////////
+
+static ret_t write_sections(bin *b, const char *sec)
+{
+  size_t num_shdr, shdrstrndx, sec_len, added, i, cur_offset;
+  const char *name;
+  Elf64_Ehdr *ehdr;
+  Elf64_Shdr *shdr;
+  Elf_Scn *scn;
+
+  /* Count the stack transformation sections at the end of the binary */
   if(elf_getshdrnum(b->e, &num_shdr) == -1) return READ_ELF_FAILED;
+  if(elf_getshdrstrndx(b->e, &shdrstrndx)) return READ_ELF_FAILED;
+  sec_len = strlen(sec);
+  for(added = 0; added < num_shdr - 1; added++)
+  {
+    if(!(scn = elf_getscn(b->e, num_shdr - (added + 1)))) return READ_ELF_FAILED;
+    if(!(shdr = elf64_getshdr(scn))) return READ_ELF_FAILED;
+    name = elf_strptr(b->e, shdrstrndx, shdr->sh_name);
+    if(!name || strncmp(name, sec, sec_len) || name[sec_len] != '.') break;
+  }
+
+  /* Calculate offset of last non-stack-transform section */
   if(!(scn = elf_getscn(b->e, num_shdr - (added + 1)))) return READ_ELF_FAILED;
   if(!(shdr = elf64_getshdr(scn))) return READ_ELF_FAILED;
   cur_offset = shdr->sh_offset + shdr->sh_size;
@@ -197,9 +404,129 @@ ret_t add_sections(bin *b,
   return SUCCESS;
 }
 
-///////////////////////////////////////////////////////////////////////////////
-// Private API
-///////////////////////////////////////////////////////////////////////////////
+static ret_t drop_plan_sections(bin *b, const char *sec)
+{
+  static plan_site no_plans;
+  static plan_move no_moves;
+  char sec_name[BUF_SIZE], msg[BUF_SIZE];
+  Elf_Scn *scn;
+  Elf64_Shdr *shdr;
+  ret_t ret;
+
+  snprintf(sec_name, BUF_SIZE, "%s.%s", sec, SECTION_PLAN);
+  if(!(scn = get_section_by_name(b->e, sec_name))) return SUCCESS;
+  if(!(shdr = elf64_getshdr(scn))) return READ_ELF_FAILED;
+  if(shdr->sh_size)
+  {
+    snprintf(msg, BUF_SIZE, "dropping rewriting plans from '%s', re-run with "
+             "-p to regenerate them", b->name);
+    warn(msg);
+  }
+  if((ret = update_section(b->e, scn, 0, sizeof(plan_site), &no_plans)))
+    return ret;
+
+  snprintf(sec_name, BUF_SIZE, "%s.%s", sec, SECTION_PLAN_MOVE);
+  if(!(scn = get_section_by_name(b->e, sec_name))) return SUCCESS;
+  return update_section(b->e, scn, 0, sizeof(plan_move), &no_moves);
+}
+
+static ret_t get_site_metadata(bin *b, const char *sec, size_t *num_sites,
+                               const call_site **sites,
+                               const live_value **live)
+{
+  char sec_name[BUF_SIZE];
+  Elf_Scn *scn;
+  Elf64_Shdr *shdr;
+
+  snprintf(sec_name, BUF_SIZE, "%s.%s", sec, SECTION_ID);
+  if(!(scn = get_section_by_name(b->e, sec_name))) return FIND_SECTION_FAILED;
+  if(!(shdr = elf64_getshdr(scn))) return READ_ELF_FAILED;
+  if(!shdr->sh_size || shdr->sh_entsize != sizeof(call_site))
+    return INVALID_METADATA;
+  if(!(*sites = get_section_data(scn))) return READ_ELF_FAILED;
+  *num_sites = shdr->sh_size / shdr->sh_entsize;
+
+  // Note: binaries may not have any live values
+  snprintf(sec_name, BUF_SIZE, "%s.%s", sec, SECTION_LIVE);
+  if(!(scn = get_section_by_name(b->e, sec_name))) return FIND_SECTION_FAILED;
+  if(!(shdr = elf64_getshdr(scn))) return READ_ELF_FAILED;
+  if(shdr->sh_size && shdr->sh_entsize != sizeof(live_value))
+    return INVALID_METADATA;
+  *live = shdr->sh_size ? get_section_data(scn) : NULL;
+  if(shdr->sh_size && !*live) return READ_ELF_FAILED;
+
+  return SUCCESS;
+}
+
+/* Check a pair of location records, mirroring the runtime's checks. */
+static void check_live_values(const call_site *site,
+                              const live_value *src,
+                              const live_value *dest)
+{
+  char msg[BUF_SIZE];
+
+  if(dest->is_temporary || is_va_list(src, dest)) return;
+
+  if(VAL_SIZE(src) != VAL_SIZE(dest))
+  {
+    snprintf(msg, BUF_SIZE, "call site %lu: value has different size "
+             "(%u vs. %u)", site->id, VAL_SIZE(src), VAL_SIZE(dest));
+    warn(msg);
+  }
+  if(src->is_ptr != dest->is_ptr)
+  {
+    snprintf(msg, BUF_SIZE, "call site %lu: value is a pointer in only one "
+             "binary", site->id);
+    warn(msg);
+  }
+  if(src->is_alloca != dest->is_alloca && !src->is_temporary)
+  {
+    snprintf(msg, BUF_SIZE, "call site %lu: value is a stack allocation in "
+             "only one binary", site->id);
+    warn(msg);
+  }
+}
+
+static bool pair_live_values(const call_site *src_site,
+                             const live_value *src_live,
+                             const call_site *dest_site,
+                             const live_value *dest_live,
+                             uint16_t *num_moves,
+                             plan_move *moves)
+{
+  size_t i, j, num = 0;
+  const live_value *src, *dest;
+
+  src = &src_live[src_site->live_offset];
+  dest = &dest_live[dest_site->live_offset];
+  for(i = 0, j = 0; j < dest_site->num_live; i++, j++)
+  {
+    if(i >= src_site->num_live) return false;
+    if(src[i].is_duplicate || dest[j].is_duplicate) return false;
+
+    /* Apply to first location record */
+    check_live_values(src_site, &src[i], &dest[j]);
+    moves[num].src = i;
+    moves[num++].dest = j;
+
+    /* Apply to all duplicate location records */
+    while(j + 1 < dest_site->num_live && dest[j + 1].is_duplicate)
+    {
+      j++;
+      if(dest[j].is_alloca) return false;
+      check_live_values(src_site, &src[i], &dest[j]);
+      moves[num].src = i;
+      moves[num++].dest = j;
+    }
+
+    /* Advance source value past duplicate location records */
+    while(i + 1 < src_site->num_live && src[i + 1].is_duplicate) i++;
+  }
+  if(i != src_site->num_live) return false;
+
+  *num_moves = num;
+  return true;
+}
 
 static bool
 create_call_site_metadata(bin *b, uint64_t start_id,
@@ -320,3 +647,14 @@ static int sort_addr(const void *a, const void *b)
   else return 1;
 }
 
+static int sort_plan(const void *a, const void *b)
+{
+  const plan_site *ps_a = (const plan_site*)a;
+  const plan_site *ps_b = (const plan_site*)b;
+
+  if(ps_a->arch != ps_b->arch) return ps_a->arch < ps_b->arch ? -1 : 1;
+  else if(ps_a->id < ps_b->id) return -1;
+  else if(ps_a->id == ps_b->id) return 0;
+  else return 1;
+}
+
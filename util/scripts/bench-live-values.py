@@ -0,0 +1,239 @@
+#!/usr/bin/python3
+
+import os
+import sys
+import time
+import random
+import argparse
+import tempfile
+import subprocess
+
+###############################################################################
+# Config
+###############################################################################
+
+# Passes run to time live-value analysis, see lib/migration/Makefile
+Passes = [ "-insert-stackmaps" ]
+
+# Flag selecting the liveness engine, see lib/Analysis/LiveValues.cpp
+EngineFlag = "-live-values-bitvector"
+Engines = { "set" : "false", "bitvector" : "true" }
+
+###############################################################################
+# Helpers
+###############################################################################
+
+def parseArguments():
+    desc = "Compare the compile time of the set & bit-vector live-value " \
+           "analysis engines over a corpus of large functions.  Unless a " \
+           "corpus is given, one is generated with synthetic functions " \
+           "containing many basic blocks & long-lived values"
+
+    parser = argparse.ArgumentParser(description=desc,
+        formatter_class=argparse.ArgumentDefaultsHelpFormatter)
+
+    config = parser.add_argument_group("Configuration")
+    config.add_argument("-opt", type=str, default="/usr/local/popcorn/bin/opt",
+        help="Popcorn compiler's LLVM optimizer",
+        dest="opt")
+    config.add_argument("-corpus", type=str, nargs="+", default=None,
+        help="LLVM IR/bitcode files to analyze instead of generated ones",
+        dest="corpus")
+    config.add_argument("-iters", type=int, default=3,
+        help="Number of timed runs per file & engine, fastest is reported",
+        dest="iters")
+    config.add_argument("-verbose", action="store_true",
+        help="Verbose printing",
+        dest="verbose")
+
+    generate = parser.add_argument_group("Generated corpus")
+    generate.add_argument("-files", type=int, default=4,
+        help="Number of files to generate",
+        dest="files")
+    generate.add_argument("-functions", type=int, default=4,
+        help="Number of functions per file",
+        dest="functions")
+    generate.add_argument("-regions", type=int, default=500,
+        help="Number of control-flow regions (diamonds or loops) per function",
+        dest="regions")
+    generate.add_argument("-uses", type=int, default=8,
+        help="Number of earlier values used by each basic block",
+        dest="uses")
+    generate.add_argument("-seed", type=int, default=0,
+        help="Random seed",
+        dest="seed")
+    generate.add_argument("-keep", type=str, default=None,
+        help="Directory in which to keep the generated corpus",
+        dest="keep")
+
+    return parser.parse_args()
+
+class FunctionGenerator:
+    ''' Generate a function as a chain of diamonds & (possibly nested) loops.
+        Each basic block uses values from dominating blocks & passes them to
+        calls, so values stay live across many blocks & call sites.
+    '''
+    def __init__(self, name, regions, uses, rand):
+        self.name = name
+        self.regions = regions
+        self.uses = uses
+        self.rand = rand
+        self.lines = []
+        self.nextVal = 0
+        self.nextBlock = 0
+        self.dominating = [ "%arg" ]
+
+    def value(self):
+        self.nextVal += 1
+        return "%v{}".format(self.nextVal)
+
+    def block(self):
+        self.nextBlock += 1
+        return "b{}".format(self.nextBlock)
+
+    def label(self, block):
+        self.lines.append("{}:".format(block))
+
+    def body(self, pool):
+        ''' Combine & pass values from the pool to a call, returns the result.
+        '''
+        cur = self.rand.choice(pool)
+        for used in self.rand.sample(pool, min(self.uses, len(pool))):
+            val = self.value()
+            self.lines.append("  {} = add i64 {}, {}".format(val, cur, used))
+            cur = val
+        val = self.value()
+        self.lines.append("  {} = call i64 @sink(i64 {})".format(val, cur))
+        return val
+
+    def cond(self, val):
+        cmp = self.value()
+        self.lines.append("  {} = icmp slt i64 {}, {}".format(
+            cmp, val, self.rand.randint(-100, 100)))
+        return cmp
+
+    def diamond(self, cur):
+        left, right, join = self.block(), self.block(), self.block()
+        self.lines.append("  br i1 {}, label %{}, label %{}".format(
+            self.cond(self.dominating[-1]), left, right))
+        self.label(left)
+        leftVal = self.body(self.dominating)
+        self.lines.append("  br label %{}".format(join))
+        self.label(right)
+        rightVal = self.body(self.dominating)
+        self.lines.append("  br label %{}".format(join))
+        self.label(join)
+        phi = self.value()
+        self.lines.append("  {} = phi i64 [ {}, %{} ], [ {}, %{} ]".format(
+            phi, leftVal, left, rightVal, right))
+        self.dominating.append(phi)
+        self.dominating.append(self.body(self.dominating))
+        return join
+
+    def loop(self, cur, depth):
+        header, latch, exit = self.block(), self.block(), self.block()
+        self.lines.append("  br label %{}".format(header))
+        self.label(header)
+        iv, ivNext = self.value(), self.value()
+        self.lines.append("  {} = phi i64 [ 0, %{} ], [ {}, %{} ]".format(
+            iv, cur, ivNext, latch))
+        self.dominating.append(iv)
+        if depth > 0 and self.rand.random() < 0.5:
+            self.loop(header, depth - 1)
+        else:
+            self.body(self.dominating)
+        self.lines.append("  br label %{}".format(latch))
+        self.label(latch)
+        self.lines.append("  {} = add i64 {}, 1".format(ivNext, iv))
+        self.lines.append("  br i1 {}, label %{}, label %{}".format(
+            self.cond(ivNext), header, exit))
+        self.label(exit)
+        return exit
+
+    def generate(self):
+        cur = "entry"
+        self.lines.append("define i64 @{}(i64 %arg) {{".format(self.name))
+        self.label(cur)
+        self.dominating.append(self.body(self.dominating))
+        for i in range(self.regions):
+            if self.rand.random() < 0.7: cur = self.diamond(cur)
+            else: cur = self.loop(cur, 2)
+        self.lines.append("  ret i64 {}".format(self.dominating[-1]))
+        self.lines.append("}")
+        return "\n".join(self.lines)
+
+def generateCorpus(args, directory):
+    rand = random.Random(args.seed)
+    corpus = []
+    for i in range(args.files):
+        name = os.path.join(directory, "live-values-{}.ll".format(i))
+        with open(name, 'w') as fp:
+            fp.write("declare i64 @sink(i64)\n\n")
+            for j in range(args.functions):
+                gen = FunctionGenerator("func{}".format(j), args.regions,
+                                        args.uses, rand)
+                fp.write(gen.generate() + "\n\n")
+        corpus.append(name)
+    return corpus
+
+def runOpt(args, irFile, engine, output):
+    cmd = [ args.opt ] + Passes + \
+          [ "{}={}".format(EngineFlag, Engines[engine]), "-S", "-o", output,
+            irFile ]
+    if args.verbose: print(" ".join(cmd))
+    start = time.perf_counter()
+    subprocess.check_call(cmd)
+    return time.perf_counter() - start
+
+def timeEngines(args, irFile, directory):
+    ''' Time each engine on a file & check they insert identical stackmaps.
+    '''
+    times = {}
+    outputs = {}
+    for engine in Engines:
+        outputs[engine] = os.path.join(directory, "out-{}.ll".format(engine))
+        times[engine] = min([ runOpt(args, irFile, engine, outputs[engine])
+                              for i in range(args.iters) ])
+
+    contents = []
+    for engine in Engines:
+        with open(outputs[engine], 'r') as fp: contents.append(fp.read())
+        os.remove(outputs[engine])
+    return times, all(content == contents[0] for content in contents)
+
+###############################################################################
+# Driver
+###############################################################################
+
+if __name__ == "__main__":
+    args = parseArguments()
+    if args.iters < 1: args.iters = 1
+
+    with tempfile.TemporaryDirectory() as tmp:
+        if args.corpus: corpus = args.corpus
+        else:
+            directory = args.keep if args.keep else tmp
+            if not os.path.isdir(directory): os.makedirs(directory)
+            corpus = generateCorpus(args, directory)
+
+        totals = { engine : 0.0 for engine in Engines }
+        mismatched = 0
+        print("{:<32} {:>14} {:>14} {:>8}".format("File", "set (s)",
+              "bitvector (s)", "speedup"))
+        for irFile in corpus:
+            times, match = timeEngines(args, irFile, tmp)
+            for engine in Engines: totals[engine] += times[engine]
+            if not match: mismatched += 1
+            print("{:<32} {:>14.3f} {:>14.3f} {:>7.2f}x{}".format(
+                  os.path.basename(irFile), times["set"], times["bitvector"],
+                  times["set"] / times["bitvector"],
+                  "" if match else " (output differs!)"))
+
+        print("{:<32} {:>14.3f} {:>14.3f} {:>7.2f}x".format("Total",
+              totals["set"], totals["bitvector"],
+              totals["set"] / totals["bitvector"]))
+
+    if mismatched:
+        print("ERROR: engines inserted different stackmaps for {} file(s)" \
+              .format(mismatched))
+        sys.exit(1)
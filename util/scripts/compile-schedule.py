@@ -0,0 +1,107 @@
+#!/usr/bin/python3
+
+import sys
+import struct
+import argparse
+
+###############################################################################
+# Config
+###############################################################################
+
+# Compiled thread schedule format, see lib/migration/src/mapping.c
+Magic = b"PSCH"
+Version = 1
+MaxRegions = 1 << 20
+DefaultRegion = -1
+
+###############################################################################
+# Helpers
+###############################################################################
+
+def parseArguments():
+    desc = "Compile a text thread schedule (e.g., as written by " \
+           "metisgraph.py) into the binary format mmap'd by the migration " \
+           "library"
+
+    parser = argparse.ArgumentParser(description=desc,
+        formatter_class=argparse.ArgumentDefaultsHelpFormatter)
+
+    config = parser.add_argument_group("Configuration")
+    config.add_argument("-input", type=str, default="thread-schedule.txt",
+        help="Text thread schedule",
+        dest="input")
+    config.add_argument("-output", type=str, default="thread-schedule.bin",
+        help="Compiled thread schedule",
+        dest="output")
+    config.add_argument("-verbose", action="store_true",
+        help="Verbose printing",
+        dest="verbose")
+
+    return parser.parse_args()
+
+def parseSchedule(schedule):
+    ''' Parse a text schedule into a dictionary mapping regions to node lists.
+        Each line has the format:
+
+          <region #> <# entries> <PTID 0 node> ... <PTID N node>
+
+        Later lines override earlier lines for the same region.
+    '''
+    regions = {}
+    with open(schedule, 'r') as fp:
+        toks = fp.read().split()
+
+    pos = 0
+    line = 0
+    while pos < len(toks):
+        try:
+            region = int(toks[pos])
+            num = int(toks[pos + 1])
+            nodes = [ int(tok) for tok in toks[pos + 2:pos + 2 + num] ]
+        except (ValueError, IndexError):
+            print("ERROR: invalid thread mapping format, line {}".format(line))
+            sys.exit(1)
+        if len(nodes) != num:
+            print("ERROR: not enough node mappings, line {}".format(line))
+            sys.exit(1)
+        if region != DefaultRegion and (region < 0 or region >= MaxRegions):
+            print("ERROR: region number must be -1 or between 0 and {}, " \
+                  "line {}".format(MaxRegions - 1, line))
+            sys.exit(1)
+        regions[region] = nodes
+        pos += 2 + num
+        line += 1
+
+    return regions
+
+def writeSchedule(output, regions, verbose):
+    ''' Write a compiled schedule, with a dense region table indexed by region
+        number followed by the node table.
+    '''
+    dense = max([ r for r in regions if r != DefaultRegion ], default=-1) + 1
+    table = []
+    nodes = []
+    for region in list(range(dense)) + [ DefaultRegion ]:
+        mapping = regions.get(region, [])
+        table.append((len(nodes), len(mapping)))
+        nodes.extend(mapping)
+
+    with open(output, 'wb') as fp:
+        fp.write(Magic)
+        fp.write(struct.pack("<III", Version, dense, len(nodes)))
+        for entry in table:
+            fp.write(struct.pack("<II", entry[0], entry[1]))
+        fp.write(struct.pack("<{}i".format(len(nodes)), *nodes))
+
+    if verbose:
+        print("Wrote {} regions ({} table entries), {} node mappings to '{}'" \
+              .format(len(regions), dense + 1, len(nodes), output))
+
+###############################################################################
+# Driver
+###############################################################################
+
+if __name__ == "__main__":
+    args = parseArguments()
+    regions = parseSchedule(args.input)
+    writeSchedule(args.output, regions, args.verbose)
@@ -21,22 +21,84 @@ def printHelp():
 	print("Usage: ./stack-depth-info.py -d file [ OPTIONS ]")
 	print("Options:")
 	print("  -h / --help : print help & exit")
-	print("  -d file     : stack depth file dumped by library (usually stack_depth.dat)")
+	print("  -d file     : stack depth file dumped by library (usually stack_depth.dat), text or binary")
 	print("  -b file     : binary from which data was dumped, gives more detailed information")
 	print("  -f          : only print names of functions who called the stack depth library (requires -b)")
 	print("  -v          : verbose output, prints caller information")
 
+def readVarint(data, pos):
+	val = 0
+	shift = 0
+	while True:
+		byte = data[pos]
+		pos += 1
+		val |= (byte & 0x7f) << shift
+		if not (byte & 0x80):
+			return val, pos
+		shift += 7
+
+def parseBinary(data):
+	# Binary format, see lib/stack_depth/stack_depth_format.h
+	pos = 4
+	version, pos = readVarint(data, pos)
+	if version != 1:
+		print("Unsupported stack depth data version " + str(version))
+		sys.exit(1)
+	numAddrs, pos = readVarint(data, pos)
+	numFuncs, pos = readVarint(data, pos)
+
+	addrs = []
+	addr = 0
+	for i in range(numAddrs):
+		delta, pos = readVarint(data, pos)
+		addr += delta
+		addrs.append(addr)
+
+	for i in range(numFuncs):
+		func, pos = readVarint(data, pos)
+		calls, pos = readVarint(data, pos)
+		depth, pos = readVarint(data, pos)
+		maxCaller, pos = readVarint(data, pos)
+		maxDepth, pos = readVarint(data, pos)
+		incl, pos = readVarint(data, pos)
+		numCallers, pos = readVarint(data, pos)
+		callers = []
+		caller = 0
+		for j in range(numCallers):
+			delta, pos = readVarint(data, pos)
+			count, pos = readVarint(data, pos)
+			caller += delta
+			callers.append((addrs[caller], count))
+		yield (addrs[func], calls, float(depth) / float(calls), \
+			(addrs[maxCaller], maxDepth), callers, incl)
+
 def parseData(fileName):
 	numCalls = 0
 	avgDepth = 0.0
 	maxDepth = (0, 0, 0)
 	funcCalls = []
 
+	fp = open(fileName, 'rb')
+	data = fp.read()
+	fp.close()
+	if data[:4] == b"SDPF":
+		for tup in parseBinary(data):
+			numCalls += tup[1]
+			avgDepth += tup[1] * tup[2]
+			if tup[3][1] > maxDepth[2]:
+				maxDepth = (tup[0], tup[3][0], tup[3][1])
+			funcCalls.append(tup)
+		avgDepth /= float(numCalls)
+		return avgDepth, maxDepth, sorted(funcCalls, key=lambda func: func[1], reverse=True)
+
 	# Read in raw data, which is of the format:
-	# (<function>, <# of calls>, <average depth>, (max depth caller, max depth), [<callers>])
+	# (<function>, <# of calls>, <average depth>, (max depth caller, max depth), [<callers>], <inclusive ns>)
+	# Older data files don't contain inclusive time.
 	fp = open(fileName, 'r')
 	for line in fp:
 		tup = eval(line.strip())
+		if len(tup) < 6:
+			tup = tup + (0,)
 		numCalls += tup[1]
 		avgDepth += tup[1] * tup[2]
 		if tup[3][1] > maxDepth[2]:
@@ -54,9 +116,9 @@ def printRaw(dataFile, avgDepth, maxDepth, funcCalls):
 	print("Average depth: {:4.3f}".format(avgDepth))
 	print("Max depth: " + str(maxDepth[2]) + ", " + hex(maxDepth[0]) + " called by " + hex(maxDepth[1]))
 	print()
-	print("{0:<14s} {1:>12s} {2:>12s}".format("Function:", "Num Calls", "Avg. Depth"))
+	print("{0:<14s} {1:>12s} {2:>12s} {3:>16s}".format("Function:", "Num Calls", "Avg. Depth", "Incl. Time (ms)"))
 	for val in funcCalls:
-		print("0x{0:<12x} {1:>12d} {2:>12.3f}".format(val[0], val[1], val[2]))
+		print("0x{0:<12x} {1:>12d} {2:>12.3f} {3:>16.3f}".format(val[0], val[1], val[2], val[5] / 1e6))
 
 	if verbose:
 		for val in funcCalls:
@@ -111,10 +173,10 @@ def printDetailed(dataFile, binFile, symbols, avgDepth, maxDepth, funcCalls):
 			getSymbol(symbols, maxDepth[0]) + " (" + hex(maxDepth[0]) + ") called by " + \
 			getSymbol(symbols, maxDepth[1]) + " (" + hex(maxDepth[1]) + ")")
 		print()
-		print("{0:<55s} {1:>12s} {2:>12s}".format("Function:", "Num Calls", "Avg. Depth"))
+		print("{0:<55s} {1:>12s} {2:>12s} {3:>16s}".format("Function:", "Num Calls", "Avg. Depth", "Incl. Time (ms)"))
 		for val in funcCalls:
 			sym = getSymbol(symbols, val[0])
-			print("{0:<55s} {1:>12d} {2:>12.3f}".format(sym + " (" + hex(val[0]) + ")", val[1], val[2]))
+			print("{0:<55s} {1:>12d} {2:>12.3f} {3:>16.3f}".format(sym + " (" + hex(val[0]) + ")", val[1], val[2], val[5] / 1e6))
 
 		if verbose:
 			for val in funcCalls: